@@ -0,0 +1,122 @@
+/* Tests that friends find and connect to each other when the shared keys for
+ * new peers are computed on crypto worker threads.
+ */
+
+#ifndef _XOPEN_SOURCE
+#define _XOPEN_SOURCE 600
+#endif
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "check_compat.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../toxcore/ccompat.h"
+#include "../toxcore/tox.h"
+#include "../toxcore/util.h"
+
+#include "helpers.h"
+
+#define CRYPTO_WORKER_THREADS 2
+
+#define FR_MESSAGE "Gentoo"
+
+static void accept_friend_request(Tox *tox, const uint8_t *public_key, const uint8_t *data, size_t length,
+                                  void *userdata)
+{
+    ck_assert_msg(length == sizeof(FR_MESSAGE) && memcmp(FR_MESSAGE, data, sizeof(FR_MESSAGE)) == 0,
+                  "unexpected friend request message");
+    tox_friend_add_norequest(tox, public_key, nullptr);
+}
+
+static void handle_message(Tox *tox, uint32_t friend_number, TOX_MESSAGE_TYPE type, const uint8_t *message,
+                           size_t length, void *userdata)
+{
+    bool *message_received = (bool *)userdata;
+    *message_received = true;
+}
+
+static void test_crypto_workers(void)
+{
+    printf("initialising 2 toxes with %u crypto worker threads\n", CRYPTO_WORKER_THREADS);
+    uint32_t index[] = { 1, 2 };
+    const time_t cur_time = time(nullptr);
+
+    struct Tox_Options *options = tox_options_new(nullptr);
+    ck_assert(options != nullptr);
+    tox_options_set_crypto_worker_threads(options, CRYPTO_WORKER_THREADS);
+
+    Tox *const tox1 = tox_new_log(options, nullptr, &index[0]);
+    Tox *const tox2 = tox_new_log(options, nullptr, &index[1]);
+    tox_options_free(options);
+
+    ck_assert_msg(tox1 && tox2, "failed to create 2 tox instances");
+
+    printf("bootstrapping tox2 off tox1\n");
+    uint8_t dht_key[TOX_PUBLIC_KEY_SIZE];
+    tox_self_get_dht_id(tox1, dht_key);
+    const uint16_t dht_port = tox_self_get_udp_port(tox1, nullptr);
+
+    tox_bootstrap(tox2, "localhost", dht_port, dht_key, nullptr);
+
+    while (tox_self_get_connection_status(tox1) == TOX_CONNECTION_NONE ||
+            tox_self_get_connection_status(tox2) == TOX_CONNECTION_NONE) {
+        tox_iterate(tox1, nullptr);
+        tox_iterate(tox2, nullptr);
+
+        c_sleep(ITERATION_INTERVAL);
+    }
+
+    printf("toxes are online, took %ld seconds\n", time(nullptr) - cur_time);
+
+    printf("tox1 adds tox2 as friend, tox2 accepts\n");
+    tox_callback_friend_request(tox2, accept_friend_request);
+
+    uint8_t address[TOX_ADDRESS_SIZE];
+    tox_self_get_address(tox2, address);
+
+    const uint32_t test = tox_friend_add(tox1, address, (const uint8_t *)FR_MESSAGE, sizeof(FR_MESSAGE), nullptr);
+    ck_assert_msg(test == 0, "Failed to add friend error code: %i", test);
+
+    while (tox_friend_get_connection_status(tox1, 0, nullptr) != TOX_CONNECTION_UDP ||
+            tox_friend_get_connection_status(tox2, 0, nullptr) != TOX_CONNECTION_UDP) {
+        tox_iterate(tox1, nullptr);
+        tox_iterate(tox2, nullptr);
+
+        c_sleep(ITERATION_INTERVAL);
+    }
+
+    printf("tox1 sends tox2 a message\n");
+    tox_callback_friend_message(tox2, &handle_message);
+
+    const uint8_t message[] = "Hello";
+    ck_assert(tox_friend_send_message(tox1, 0, TOX_MESSAGE_TYPE_NORMAL, message, sizeof(message), nullptr) != 0);
+
+    bool message_received = false;
+
+    while (!message_received) {
+        tox_iterate(tox1, nullptr);
+        tox_iterate(tox2, &message_received);
+
+        c_sleep(ITERATION_INTERVAL);
+    }
+
+    printf("test_crypto_workers succeeded, took %ld seconds\n", time(nullptr) - cur_time);
+
+    tox_kill(tox1);
+    tox_kill(tox2);
+}
+
+int main(void)
+{
+    setvbuf(stdout, nullptr, _IONBF, 0);
+
+    test_crypto_workers();
+    return 0;
+}
@@ -680,6 +680,242 @@ loop_top:
 }
 END_TEST
 
+/* Number of random other nodes each node of the lookup test network knows. */
+#define LOOKUP_NETWORK_PEERS 8
+
+/* Milliseconds the lookup test network runs before friends are added. */
+#define LOOKUP_NETWORK_SETTLE_TIME 10000
+
+/* Longest a friend may take to be found in the lookup test network. */
+#define LOOKUP_NETWORK_TIMEOUT 120000
+
+/* Build a network of NUM_DHT nodes that each know LOOKUP_NETWORK_PEERS random
+ * others, let it settle, then have NUM_DHT_FRIENDS pairs of them look for each
+ * other. Returns
+ * the milliseconds it took until the last pair found its friend, and sets
+ * average_ms to the average over the pairs.
+ *
+ * Friends not found within LOOKUP_NETWORK_TIMEOUT count as found then, and
+ * fail the test if must_find is set.
+ */
+static uint64_t time_to_locate_friends(uint8_t parallelism, bool must_find, uint64_t *average_ms)
+{
+    DHT *dhts[NUM_DHT];
+    uint32_t index[NUM_DHT];
+
+    for (uint32_t i = 0; i < NUM_DHT; ++i) {
+        IP ip;
+        ip_init(&ip, 1);
+
+        Logger *log = logger_new();
+        index[i] = i + 1;
+        logger_callback_log(log, (logger_cb *)print_debug_log, nullptr, &index[i]);
+
+        dhts[i] = new_DHT(log, new_networking(log, ip, DHT_DEFAULT_PORT + i), true);
+        ck_assert_msg(dhts[i] != nullptr, "Failed to create dht instances %u", i);
+        ck_assert_msg(dht_set_lookup_parallelism(dhts[i], parallelism) == 0, "Failed to set lookup parallelism");
+    }
+
+    for (uint32_t i = 0; i < NUM_DHT; ++i) {
+        for (uint32_t j = 0; j < LOOKUP_NETWORK_PEERS; ++j) {
+            const uint32_t peer = (i + 1 + random_u32() % (NUM_DHT - 1)) % NUM_DHT;
+            IP_Port ip_port;
+            ip_port.ip = get_loopback();
+            ip_port.port = net_port(dhts[peer]->net);
+            addto_lists(dhts[i], ip_port, dhts[peer]->self_public_key);
+        }
+    }
+
+    /* Give the nodes time to find their neighbours, as they would have had
+     * in a network that has been up for a while. */
+    const uint64_t settle_start = current_time_monotonic();
+
+    while (current_time_monotonic() - settle_start < LOOKUP_NETWORK_SETTLE_TIME) {
+        for (uint32_t i = 0; i < NUM_DHT; ++i) {
+            networking_poll(dhts[i]->net, nullptr);
+            do_DHT(dhts[i]);
+        }
+
+        c_sleep(5);
+    }
+
+    struct {
+        uint16_t tox1;
+        uint16_t tox2;
+        uint64_t found_ms;
+    } pairs[NUM_DHT_FRIENDS];
+
+    const uint64_t start = current_time_monotonic();
+
+    for (uint32_t i = 0; i < NUM_DHT_FRIENDS; ++i) {
+        pairs[i].tox1 = random_u32() % NUM_DHT;
+        pairs[i].tox2 = (pairs[i].tox1 + (random_u32() % (NUM_DHT - 1)) + 1) % NUM_DHT;
+        pairs[i].found_ms = 0;
+        DHT_addfriend(dhts[pairs[i].tox2], dhts[pairs[i].tox1]->self_public_key, &ip_callback, nullptr, 0, nullptr);
+    }
+
+    uint32_t found = 0;
+
+    while (found < NUM_DHT_FRIENDS && current_time_monotonic() - start < LOOKUP_NETWORK_TIMEOUT) {
+        for (uint32_t i = 0; i < NUM_DHT; ++i) {
+            networking_poll(dhts[i]->net, nullptr);
+            do_DHT(dhts[i]);
+        }
+
+        for (uint32_t i = 0; i < NUM_DHT_FRIENDS; ++i) {
+            IP_Port ip_port;
+
+            if (pairs[i].found_ms == 0
+                    && DHT_getfriendip(dhts[pairs[i].tox2], dhts[pairs[i].tox1]->self_public_key, &ip_port) == 1) {
+                pairs[i].found_ms = MAX(current_time_monotonic() - start, 1);
+                ++found;
+            }
+        }
+
+        c_sleep(5);
+    }
+
+    ck_assert_msg(!must_find || found == NUM_DHT_FRIENDS, "Only %u of %u friends were found", found, NUM_DHT_FRIENDS);
+
+    uint64_t max_ms = 0;
+    uint64_t total_ms = 0;
+
+    for (uint32_t i = 0; i < NUM_DHT_FRIENDS; ++i) {
+        const uint64_t found_ms = pairs[i].found_ms != 0 ? pairs[i].found_ms : LOOKUP_NETWORK_TIMEOUT;
+        max_ms = MAX(max_ms, found_ms);
+        total_ms += found_ms;
+    }
+
+    for (uint32_t i = 0; i < NUM_DHT; ++i) {
+        Networking_Core *n = dhts[i]->net;
+        Logger *log = dhts[i]->log;
+        kill_DHT(dhts[i]);
+        kill_networking(n);
+        logger_kill(log);
+    }
+
+    *average_ms = total_ms / NUM_DHT_FRIENDS;
+    return max_ms;
+}
+
+START_TEST(test_lookup_latency)
+{
+    uint64_t periodic_average_ms;
+    const uint64_t periodic_max_ms = time_to_locate_friends(0, false, &periodic_average_ms);
+    printf("periodic get nodes requests: friends found in %lu ms on average, %lu ms at most\n",
+           (unsigned long)periodic_average_ms, (unsigned long)periodic_max_ms);
+
+    uint64_t lookup_average_ms;
+    const uint64_t lookup_max_ms = time_to_locate_friends(DHT_DEFAULT_LOOKUP_PARALLELISM, true, &lookup_average_ms);
+    printf("lookups with %u requests in flight: friends found in %lu ms on average, %lu ms at most\n",
+           DHT_DEFAULT_LOOKUP_PARALLELISM, (unsigned long)lookup_average_ms, (unsigned long)lookup_max_ms);
+}
+END_TEST
+
+#define NUM_WARM_START_DHT 20
+
+/* Milliseconds the network runs before its first node is restarted. */
+#define WARM_START_SETTLE_TIME 5000
+
+/* Longest a restarted node may take to be connected again. */
+#define WARM_START_TIMEOUT 3000
+
+START_TEST(test_warm_start)
+{
+    DHT *dhts[NUM_WARM_START_DHT];
+
+    for (uint32_t i = 0; i < NUM_WARM_START_DHT; ++i) {
+        IP ip;
+        ip_init(&ip, 1);
+
+        Logger *log = logger_new();
+        dhts[i] = new_DHT(log, new_networking(log, ip, DHT_DEFAULT_PORT + i), true);
+        ck_assert_msg(dhts[i] != nullptr, "Failed to create dht instances %u", i);
+    }
+
+    for (uint32_t i = 0; i < NUM_WARM_START_DHT; ++i) {
+        IP_Port ip_port;
+        ip_port.ip = get_loopback();
+        ip_port.port = net_port(dhts[i]->net);
+        DHT_bootstrap(dhts[(i + NUM_WARM_START_DHT - 1) % NUM_WARM_START_DHT], ip_port, dhts[i]->self_public_key);
+    }
+
+    const uint64_t settle_start = current_time_monotonic();
+
+    while (current_time_monotonic() - settle_start < WARM_START_SETTLE_TIME) {
+        for (uint32_t i = 0; i < NUM_WARM_START_DHT; ++i) {
+            networking_poll(dhts[i]->net, nullptr);
+            do_DHT(dhts[i]);
+        }
+
+        c_sleep(50);
+    }
+
+    ck_assert_msg(DHT_isconnected(dhts[0]), "Network didn't come up");
+
+    /* Restart the first node from its saved state. */
+    const uint32_t size = DHT_size(dhts[0]);
+    uint8_t *const data = (uint8_t *)malloc(size);
+    ck_assert(data != nullptr);
+    DHT_save(dhts[0], data);
+
+    Logger *log = dhts[0]->log;
+    Networking_Core *net = dhts[0]->net;
+    kill_DHT(dhts[0]);
+    kill_networking(net);
+
+    IP ip;
+    ip_init(&ip, 1);
+    dhts[0] = new_DHT(log, new_networking(log, ip, DHT_DEFAULT_PORT), true);
+    ck_assert_msg(dhts[0] != nullptr, "Failed to restart dht");
+    ck_assert_msg(DHT_load(dhts[0], data, size) == 0, "Failed to load saved dht");
+    free(data);
+
+    uint32_t restored = 0;
+
+    for (uint32_t i = 0; i < LCLIENT_LIST; ++i) {
+        const Client_data *const client = &dhts[0]->close_clientlist[i];
+        const IPPTsPng *const assocs[] = { &client->assoc4, &client->assoc6 };
+
+        for (uint32_t j = 0; j < 2; ++j) {
+            if (assocs[j]->timestamp != 0) {
+                ck_assert_msg(is_timeout(assocs[j]->timestamp, BAD_NODE_TIMEOUT),
+                              "Cached node is good before it answered");
+                ++restored;
+            }
+        }
+    }
+
+    ck_assert_msg(restored != 0, "No nodes were restored into the close list");
+    ck_assert_msg(!DHT_isconnected(dhts[0]), "Connected before anyone answered");
+
+    const uint64_t start = current_time_monotonic();
+
+    while (!DHT_isconnected(dhts[0])) {
+        ck_assert_msg(current_time_monotonic() - start < WARM_START_TIMEOUT, "Not connected again after %u ms",
+                      WARM_START_TIMEOUT);
+
+        for (uint32_t i = 0; i < NUM_WARM_START_DHT; ++i) {
+            networking_poll(dhts[i]->net, nullptr);
+            do_DHT(dhts[i]);
+        }
+
+        c_sleep(5);
+    }
+
+    printf("restarted node connected again after %lu ms, with %u nodes restored\n",
+           (unsigned long)(current_time_monotonic() - start), restored);
+
+    for (uint32_t i = 0; i < NUM_WARM_START_DHT; ++i) {
+        log = dhts[i]->log;
+        net = dhts[i]->net;
+        kill_DHT(dhts[i]);
+        kill_networking(net);
+        logger_kill(log);
+    }
+}
+END_TEST
+
 START_TEST(test_dht_create_packet)
 {
     uint8_t plain[100] = {0};
@@ -791,14 +1027,244 @@ START_TEST(test_dht_node_packing)
 }
 END_TEST
 
+/* A key sharing exactly `bits` leading bits with base_key. */
+static void key_with_prefix(uint8_t *public_key, const uint8_t *base_key, unsigned int bits)
+{
+    random_bytes(public_key, CRYPTO_PUBLIC_KEY_SIZE);
+
+    for (unsigned int i = 0; i < bits && i < CRYPTO_PUBLIC_KEY_SIZE * 8; ++i) {
+        const uint8_t mask = 1 << (7 - i % 8);
+        public_key[i / 8] = (public_key[i / 8] & ~mask) | (base_key[i / 8] & mask);
+    }
+
+    if (bits < CRYPTO_PUBLIC_KEY_SIZE * 8) {
+        public_key[bits / 8] ^= (public_key[bits / 8] ^ ~base_key[bits / 8]) & (1 << (7 - bits % 8));
+    }
+}
+
+static bool same_nodes(const Node_format *a, const Node_format *b, int num)
+{
+    for (int i = 0; i < num; ++i) {
+        if (index_of_node_pk(b, num, a[i].public_key) == UINT32_MAX) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+START_TEST(test_close_list_buckets)
+{
+    IP ip;
+    ip_init(&ip, 1);
+    Logger *log = logger_new();
+    DHT *dht = new_DHT(log, new_networking(log, ip, DHT_DEFAULT_PORT), true);
+    ck_assert_msg(dht != nullptr, "Failed to create DHT");
+
+    IP_Port ip_port;
+    ip_port.ip = get_loopback();
+
+    for (uint32_t i = 0; i < LCLIENT_LIST * 4; ++i) {
+        uint8_t public_key[CRYPTO_PUBLIC_KEY_SIZE];
+        key_with_prefix(public_key, dht->self_public_key, random_u32() % 24);
+        ip_port.port = net_htons(i + 1);
+        addto_lists(dht, ip_port, public_key);
+    }
+
+    uint32_t num_close = 0;
+
+    for (uint32_t i = 0; i < LCLIENT_LIST; ++i) {
+        const Client_data *const client = &dht->close_clientlist[i];
+
+        if (client->assoc4.timestamp == 0 && client->assoc6.timestamp == 0) {
+            continue;
+        }
+
+        ++num_close;
+        ck_assert_msg(close_bucket(dht, client->public_key) == i / LCLIENT_NODES, "node %u is in the wrong bucket", i);
+        ck_assert_msg(index_of_close_pk(dht, client->public_key) == i, "node %u not found by its key", i);
+        ck_assert_msg(index_of_close_ip_port(dht, &client->assoc6.ip_port) == i, "node %u not found by its address", i);
+    }
+
+    ck_assert_msg(num_close > MAX_SENT_NODES, "only %u nodes made it into the close list", num_close);
+
+    /* The closest nodes must be the same ones a scan of the whole lists finds. */
+    for (uint32_t i = 0; i < 1000; ++i) {
+        uint8_t target[CRYPTO_PUBLIC_KEY_SIZE];
+        key_with_prefix(target, dht->self_public_key, random_u32() % 32);
+
+        Node_format nodes[MAX_SENT_NODES];
+        const int num_nodes = get_close_nodes(dht, target, nodes, net_family_unspec, 1, 0);
+
+        Node_format expected[MAX_SENT_NODES];
+        uint32_t num_expected = 0;
+        memset(expected, 0, sizeof(expected));
+        get_close_nodes_inner(target, expected, net_family_unspec, dht->close_clientlist, LCLIENT_LIST, &num_expected,
+                              1, 0);
+
+        for (uint32_t j = 0; j < dht->num_friends; ++j) {
+            get_close_nodes_inner(target, expected, net_family_unspec, dht->friends_list[j].client_list,
+                                  MAX_FRIEND_CLIENTS, &num_expected, 1, 0);
+        }
+
+        ck_assert_msg(num_nodes == num_expected, "found %d close nodes, expected %u", num_nodes, num_expected);
+        ck_assert_msg(same_nodes(nodes, expected, num_nodes), "bucket walk found different close nodes");
+    }
+
+    Networking_Core *net = dht->net;
+    kill_DHT(dht);
+    kill_networking(net);
+    logger_kill(log);
+}
+END_TEST
+
+#define NUM_INDEXED_FRIENDS 500
+
+/* Whether the node could go in the friend's list, as addto_lists() decides it
+ * for every friend without the index. */
+static bool friend_could_take(const DHT_Friend *dht_friend, const uint8_t *public_key)
+{
+    return index_of_client_pk(dht_friend->client_list, MAX_FRIEND_CLIENTS, public_key) != UINT32_MAX
+           || store_node_ok(&dht_friend->client_list[1], public_key, dht_friend->public_key)
+           || store_node_ok(&dht_friend->client_list[0], public_key, dht_friend->public_key);
+}
+
+static bool is_candidate(const DHT *dht, uint32_t num_candidates, uint32_t friend_num)
+{
+    for (uint32_t i = 0; i < num_candidates; ++i) {
+        if (dht->friend_candidates[i] == friend_num) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+START_TEST(test_friend_index)
+{
+    IP ip;
+    ip_init(&ip, 1);
+    Logger *log = logger_new();
+    DHT *dht = new_DHT(log, new_networking(log, ip, DHT_DEFAULT_PORT), true);
+    ck_assert_msg(dht != nullptr, "Failed to create DHT");
+    ck_assert(dht_set_lookup_parallelism(dht, 0) == 0);
+
+    for (uint32_t i = 0; i < NUM_INDEXED_FRIENDS; ++i) {
+        uint8_t public_key[CRYPTO_PUBLIC_KEY_SIZE];
+        random_bytes(public_key, sizeof(public_key));
+        ck_assert(DHT_addfriend(dht, public_key, nullptr, nullptr, 0, nullptr) == 0);
+    }
+
+    IP_Port ip_port;
+    ip_port.ip = get_loopback();
+
+    /* Nodes close to the friends fill up their lists, and every node has to
+     * be offered to each friend that could take it. */
+    for (uint32_t i = 0; i < 20000; ++i) {
+        const DHT_Friend *const target = &dht->friends_list[random_u32() % dht->num_friends];
+        uint8_t public_key[CRYPTO_PUBLIC_KEY_SIZE];
+        key_with_prefix(public_key, target->public_key, random_u32() % 24);
+
+        const uint32_t num_candidates = friends_accepting(dht, public_key);
+
+        for (uint32_t j = 0; j < dht->num_friends; ++j) {
+            ck_assert_msg(!friend_could_take(&dht->friends_list[j], public_key) || is_candidate(dht, num_candidates, j),
+                          "friend %u could take node %u but isn't offered it", j, i);
+        }
+
+        ip_port.port = net_htons(i + 1);
+        addto_lists(dht, ip_port, public_key);
+    }
+
+    ck_assert_msg(dht->num_open_friends < dht->num_friends / 2, "%u of %u friends still take any node",
+                  dht->num_open_friends, dht->num_friends);
+
+    /* The lists are kept ordered as nodes are added, unused entries first. */
+    for (uint32_t i = 0; i < dht->num_friends; ++i) {
+        const DHT_Friend *const dht_friend = &dht->friends_list[i];
+
+        for (uint32_t j = 1; j < MAX_FRIEND_CLIENTS; ++j) {
+            ck_assert_msg(!client_goes_before(&dht_friend->client_list[j], &dht_friend->client_list[j - 1],
+                                              dht_friend->public_key), "friend %u list out of order at %u", i, j);
+        }
+    }
+
+    /* Deleting friends moves others to new friend numbers. */
+    while (dht->num_friends > DHT_FAKE_FRIEND_NUMBER + NUM_INDEXED_FRIENDS / 2) {
+        const uint32_t friend_num = DHT_FAKE_FRIEND_NUMBER + random_u32() % (dht->num_friends - DHT_FAKE_FRIEND_NUMBER);
+        ck_assert(DHT_delfriend(dht, dht->friends_list[friend_num].public_key, 0) == 0);
+    }
+
+    uint32_t num_open = 0;
+
+    for (uint32_t i = 0; i < dht->num_friends; ++i) {
+        const DHT_Friend *const dht_friend = &dht->friends_list[i];
+        ck_assert_msg(friend_number(dht, dht_friend->public_key) == i, "friend %u not found by its key", i);
+        ck_assert_msg(dht_friend->accept_bits == friend_accept_bits(dht_friend), "friend %u index is stale", i);
+
+        if (dht_friend->accept_bits == 0) {
+            ck_assert_msg(dht->open_friends[dht_friend->open_index] == i, "friend %u not in the open list", i);
+            ++num_open;
+        }
+    }
+
+    ck_assert_msg(num_open == dht->num_open_friends, "%u open friends listed, %u expected", dht->num_open_friends,
+                  num_open);
+
+    Networking_Core *net = dht->net;
+    kill_DHT(dht);
+    kill_networking(net);
+    logger_kill(log);
+}
+END_TEST
+
+START_TEST(test_key_distance)
+{
+    uint8_t pk[CRYPTO_PUBLIC_KEY_SIZE];
+    uint8_t pk1[CRYPTO_PUBLIC_KEY_SIZE];
+    uint8_t pk2[CRYPTO_PUBLIC_KEY_SIZE];
+
+    /* Every length of shared prefix, checked against a bit by bit comparison. */
+    for (unsigned int bits = 0; bits <= CRYPTO_PUBLIC_KEY_SIZE * 8; ++bits) {
+        for (uint32_t i = 0; i < 20; ++i) {
+            random_bytes(pk, sizeof(pk));
+            key_with_prefix(pk1, pk, random_u32() % (CRYPTO_PUBLIC_KEY_SIZE * 8));
+            key_with_prefix(pk2, pk1, bits);
+
+            unsigned int first_bit = 0;
+            int expected = 0;
+
+            while (first_bit < CRYPTO_PUBLIC_KEY_SIZE * 8 && pk_bit(pk1, first_bit) == pk_bit(pk2, first_bit)) {
+                ++first_bit;
+            }
+
+            if (first_bit < CRYPTO_PUBLIC_KEY_SIZE * 8) {
+                expected = pk_bit(pk1, first_bit) == pk_bit(pk, first_bit) ? 1 : 2;
+            }
+
+            ck_assert_msg(bit_by_bit_cmp(pk1, pk2) == first_bit, "wrong first different bit: %u instead of %u",
+                          bit_by_bit_cmp(pk1, pk2), first_bit);
+            ck_assert_msg(id_closest(pk, pk1, pk2) == expected, "wrong closest key with %u bits in common", bits);
+            ck_assert_msg(id_closest(pk, pk2, pk1) == (expected == 0 ? 0 : 3 - expected),
+                          "id_closest isn't symmetric with %u bits in common", bits);
+        }
+    }
+}
+END_TEST
+
 static Suite *dht_suite(void)
 {
     Suite *s = suite_create("DHT");
     DEFTESTCASE(dht_create_packet);
     DEFTESTCASE(dht_node_packing);
+    DEFTESTCASE(close_list_buckets);
+    DEFTESTCASE(friend_index);
+    DEFTESTCASE(key_distance);
 
     DEFTESTCASE_SLOW(list, 20);
     DEFTESTCASE_SLOW(DHT_test, 50);
+    DEFTESTCASE_SLOW(lookup_latency, 300);
+    DEFTESTCASE_SLOW(warm_start, 30);
 
     if (enable_broken_tests) {
         DEFTESTCASE(addto_lists_ipv4);
@@ -0,0 +1,156 @@
+/* Tests that Tox instances can be driven from an external event loop, using
+ * their file descriptors and iteration deadlines instead of a fixed interval.
+ */
+
+#ifndef _XOPEN_SOURCE
+#define _XOPEN_SOURCE 600
+#endif
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "check_compat.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#if defined(_WIN32) || defined(__WIN32__) || defined (WIN32)
+#include <winsock2.h>
+#else
+#include <sys/select.h>
+#endif
+
+#include "../toxcore/ccompat.h"
+#include "../toxcore/tox.h"
+#include "../toxcore/util.h"
+
+#include "helpers.h"
+
+#define NUM_TOXES 2
+
+/* Wait until one of the toxes has I/O or a deadline, then iterate those. */
+static void iterate_ready(Tox **toxes, uint32_t num_toxes)
+{
+    fd_set read_fds;
+    fd_set write_fds;
+    FD_ZERO(&read_fds);
+    FD_ZERO(&write_fds);
+
+    int32_t max_fd = -1;
+    uint64_t deadline = UINT64_MAX;
+
+    for (uint32_t i = 0; i < num_toxes; ++i) {
+        const size_t size = tox_get_fds_size(toxes[i]);
+        ck_assert_msg(size > 0, "tox %u has no file descriptors with UDP enabled", i);
+
+        int32_t *fds = (int32_t *)calloc(size, sizeof(int32_t));
+        uint8_t *events = (uint8_t *)calloc(size, sizeof(uint8_t));
+        ck_assert(fds != nullptr && events != nullptr);
+        TOX_ERR_GET_FDS err;
+        ck_assert(tox_get_fds(toxes[i], fds, events, &err));
+        ck_assert(err == TOX_ERR_GET_FDS_OK);
+
+        for (size_t j = 0; j < size; ++j) {
+            ck_assert_msg(events[j] != TOX_FD_EVENT_NONE, "descriptor %d waits for nothing", fds[j]);
+
+            if (events[j] & TOX_FD_EVENT_READ) {
+                FD_SET(fds[j], &read_fds);
+            }
+
+            if (events[j] & TOX_FD_EVENT_WRITE) {
+                FD_SET(fds[j], &write_fds);
+            }
+
+            if (fds[j] > max_fd) {
+                max_fd = fds[j];
+            }
+        }
+
+        free(events);
+        free(fds);
+
+        const uint64_t tox_deadline = tox_iteration_deadline(toxes[i]);
+        ck_assert_msg(tox_deadline <= tox_time_monotonic() + 1000, "deadline is more than a second away");
+
+        if (tox_deadline < deadline) {
+            deadline = tox_deadline;
+        }
+    }
+
+    const uint64_t now = tox_time_monotonic();
+    const uint64_t wait = deadline > now ? deadline - now : 0;
+    struct timeval timeout;
+    timeout.tv_sec = wait / 1000;
+    timeout.tv_usec = (wait % 1000) * 1000;
+
+    const int ready = select(max_fd + 1, &read_fds, &write_fds, nullptr, &timeout);
+    ck_assert_msg(ready >= 0, "select() failed");
+
+    /* Simply iterate everything that had I/O: we can't tell whose it was
+     * without going through the descriptors again. */
+    for (uint32_t i = 0; i < num_toxes; ++i) {
+        if (ready > 0 || tox_iteration_deadline(toxes[i]) <= tox_time_monotonic()) {
+            tox_iterate(toxes[i], nullptr);
+        }
+    }
+}
+
+static void test_event_loop(void)
+{
+    uint32_t index[] = { 1, 2 };
+    const time_t cur_time = time(nullptr);
+    Tox *toxes[NUM_TOXES];
+
+    for (uint32_t i = 0; i < NUM_TOXES; ++i) {
+        toxes[i] = tox_new_log(nullptr, nullptr, &index[i]);
+        ck_assert_msg(toxes[i] != nullptr, "failed to create tox instance %u", i);
+    }
+
+    uint8_t public_key[TOX_PUBLIC_KEY_SIZE];
+    tox_self_get_public_key(toxes[1], public_key);
+    tox_friend_add_norequest(toxes[0], public_key, nullptr);
+    tox_self_get_public_key(toxes[0], public_key);
+    tox_friend_add_norequest(toxes[1], public_key, nullptr);
+
+    uint8_t dht_key[TOX_PUBLIC_KEY_SIZE];
+    tox_self_get_dht_id(toxes[0], dht_key);
+    const uint16_t dht_port = tox_self_get_udp_port(toxes[0], nullptr);
+    tox_bootstrap(toxes[1], "localhost", dht_port, dht_key, nullptr);
+
+    uint32_t wakeups = 0;
+
+    while (tox_friend_get_connection_status(toxes[0], 0, nullptr) != TOX_CONNECTION_UDP ||
+            tox_friend_get_connection_status(toxes[1], 0, nullptr) != TOX_CONNECTION_UDP) {
+        iterate_ready(toxes, NUM_TOXES);
+        ++wakeups;
+    }
+
+    printf("friends connected after %u wakeups, took %ld seconds\n", wakeups, (long)(time(nullptr) - cur_time));
+
+    /* Once connected, nothing should need us as often as the fixed 50ms
+     * iteration interval. */
+    const uint64_t idle_start = tox_time_monotonic();
+    uint32_t idle_wakeups = 0;
+
+    while (tox_time_monotonic() - idle_start < 3000) {
+        iterate_ready(toxes, NUM_TOXES);
+        ++idle_wakeups;
+    }
+
+    printf("%u wakeups in 3 idle seconds\n", idle_wakeups);
+    ck_assert_msg(idle_wakeups < 3 * 20, "woke up %u times, no better than polling every 50ms", idle_wakeups);
+
+    for (uint32_t i = 0; i < NUM_TOXES; ++i) {
+        tox_kill(toxes[i]);
+    }
+}
+
+int main(void)
+{
+    setvbuf(stdout, nullptr, _IONBF, 0);
+
+    test_event_loop();
+    return 0;
+}
@@ -0,0 +1,224 @@
+/* Tests that messages aren't held up behind file data that gets lost, as the
+ * file data is sent on a lossless stream of its own, and that a peer that
+ * doesn't support streams gets everything on the stream peers always used.
+ */
+
+#ifndef _XOPEN_SOURCE
+#define _XOPEN_SOURCE 600
+#endif
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "check_compat.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../toxcore/Messenger.h"
+#include "../toxcore/ccompat.h"
+#include "../toxcore/tox.h"
+#include "../toxcore/util.h"
+
+#include "helpers.h"
+
+#define FILE_SIZE (256 * 1024)
+#define NUM_MESSAGES 16
+
+/* Iterations after which something that didn't happen has failed. */
+#define MAX_ITERATIONS 2000
+
+typedef struct Transfer {
+    uint64_t sent;
+    uint64_t received;
+    bool done;
+    uint32_t messages;
+    uint32_t stream_packets; /* Stream data packets that reached tox2, all dropped. */
+} Transfer;
+
+static void accept_file(Tox *tox, uint32_t friend_number, uint32_t file_number, uint32_t kind, uint64_t file_size,
+                        const uint8_t *filename, size_t filename_length, void *user_data)
+{
+    ck_assert(tox_file_control(tox, friend_number, file_number, TOX_FILE_CONTROL_RESUME, nullptr));
+}
+
+static void send_chunk(Tox *tox, uint32_t friend_number, uint32_t file_number, uint64_t position, size_t length,
+                       void *user_data)
+{
+    if (length == 0) {
+        return;
+    }
+
+    Transfer *transfer = (Transfer *)user_data;
+    VLA(uint8_t, data, length);
+    memset(data, (uint8_t)position, length);
+
+    ck_assert(tox_file_send_chunk(tox, friend_number, file_number, position, data, length, nullptr));
+    transfer->sent += length;
+}
+
+static void receive_chunk(Tox *tox, uint32_t friend_number, uint32_t file_number, uint64_t position,
+                          const uint8_t *data, size_t length, void *user_data)
+{
+    Transfer *transfer = (Transfer *)user_data;
+
+    ck_assert_msg(position == transfer->received, "file data out of order");
+    transfer->received += length;
+
+    if (length == 0) {
+        transfer->done = true;
+    }
+}
+
+static void receive_message(Tox *tox, uint32_t friend_number, TOX_MESSAGE_TYPE type, const uint8_t *message,
+                            size_t length, void *user_data)
+{
+    Transfer *transfer = (Transfer *)user_data;
+    ++transfer->messages;
+}
+
+static int drop_stream_packet(void *object, IP_Port source, const uint8_t *packet, uint16_t length, void *userdata)
+{
+    Transfer *transfer = (Transfer *)object;
+    ++transfer->stream_packets;
+    return 0;
+}
+
+static void iterate(Tox *tox1, Tox *tox2, Transfer *transfer)
+{
+    tox_iterate(tox1, transfer);
+    tox_iterate(tox2, transfer);
+    c_sleep(50);
+}
+
+static bool file_stream_available(Tox *tox)
+{
+    const Messenger *m = (const Messenger *)tox;
+    const int id = friend_connection_crypt_connection_id(m->fr_c, m->friendlist[0].friendcon_id);
+    return crypto_stream_available(m->net_crypto, id, FILE_DATA_STREAM);
+}
+
+/* Connect tox1 and tox2, the latter acting as a peer that doesn't know about
+ * streams unless streams, and drop the stream data packets that reach tox2.
+ */
+static void connect_toxes(Tox *tox1, Tox *tox2, Transfer *transfer, bool streams)
+{
+    Messenger *m2 = (Messenger *)tox2;
+    nc_set_streams(m2->net_crypto, streams);
+    networking_registerhandler(m2->net, NET_PACKET_CRYPTO_STREAM_DATA, &drop_stream_packet, transfer);
+
+    uint8_t public_key[TOX_PUBLIC_KEY_SIZE];
+    tox_self_get_public_key(tox2, public_key);
+    tox_friend_add_norequest(tox1, public_key, nullptr);
+    tox_self_get_public_key(tox1, public_key);
+    tox_friend_add_norequest(tox2, public_key, nullptr);
+
+    uint8_t dht_key[TOX_PUBLIC_KEY_SIZE];
+    tox_self_get_dht_id(tox1, dht_key);
+    const uint16_t dht_port = tox_self_get_udp_port(tox1, nullptr);
+    tox_bootstrap(tox2, "localhost", dht_port, dht_key, nullptr);
+
+    while (tox_friend_get_connection_status(tox1, 0, nullptr) != TOX_CONNECTION_UDP ||
+            tox_friend_get_connection_status(tox2, 0, nullptr) != TOX_CONNECTION_UDP) {
+        iterate(tox1, tox2, transfer);
+    }
+
+    tox_callback_file_recv(tox2, &accept_file);
+    tox_callback_file_chunk_request(tox1, &send_chunk);
+    tox_callback_file_recv_chunk(tox2, &receive_chunk);
+    tox_callback_friend_message(tox2, &receive_message);
+}
+
+static void send_messages(Tox *tox)
+{
+    for (uint32_t i = 0; i < NUM_MESSAGES; ++i) {
+        const uint8_t message[] = "Not behind the file";
+        ck_assert(tox_friend_send_message(tox, 0, TOX_MESSAGE_TYPE_NORMAL, message, sizeof(message), nullptr) != 0);
+    }
+}
+
+static void test_lost_file_data_doesnt_hold_up_messages(void)
+{
+    printf("test_lost_file_data_doesnt_hold_up_messages\n");
+    uint32_t index[] = { 1, 2 };
+    Tox *const tox1 = tox_new_log(nullptr, nullptr, &index[0]);
+    Tox *const tox2 = tox_new_log(nullptr, nullptr, &index[1]);
+    ck_assert_msg(tox1 && tox2, "failed to create 2 tox instances");
+
+    Transfer transfer = {0};
+    connect_toxes(tox1, tox2, &transfer, true);
+
+    uint32_t iterations = 0;
+
+    while (!file_stream_available(tox1)) {
+        ck_assert_msg(++iterations < MAX_ITERATIONS, "tox2 never announced its streams");
+        iterate(tox1, tox2, &transfer);
+    }
+
+    ck_assert(tox_file_send(tox1, 0, TOX_FILE_KIND_DATA, FILE_SIZE, nullptr, (const uint8_t *)"file", 4, nullptr)
+              != UINT32_MAX);
+
+    /* All the file data tox1 sends gets lost. */
+    iterations = 0;
+
+    while (transfer.stream_packets == 0) {
+        ck_assert_msg(++iterations < MAX_ITERATIONS, "file data never sent");
+        iterate(tox1, tox2, &transfer);
+    }
+
+    send_messages(tox1);
+    iterations = 0;
+
+    while (transfer.messages < NUM_MESSAGES) {
+        ck_assert_msg(++iterations < MAX_ITERATIONS, "messages held up behind lost file data");
+        iterate(tox1, tox2, &transfer);
+    }
+
+    printf("%u messages arrived with %llu bytes of file data sent and %u stream packets lost\n", transfer.messages,
+           (unsigned long long)transfer.sent, transfer.stream_packets);
+    ck_assert(transfer.received == 0);
+
+    tox_kill(tox1);
+    tox_kill(tox2);
+}
+
+static void test_peer_without_streams_gets_everything_on_default_stream(void)
+{
+    printf("test_peer_without_streams_gets_everything_on_default_stream\n");
+    uint32_t index[] = { 3, 4 };
+    Tox *const tox1 = tox_new_log(nullptr, nullptr, &index[0]);
+    Tox *const tox2 = tox_new_log(nullptr, nullptr, &index[1]);
+    ck_assert_msg(tox1 && tox2, "failed to create 2 tox instances");
+
+    Transfer transfer = {0};
+    connect_toxes(tox1, tox2, &transfer, false);
+
+    ck_assert(tox_file_send(tox1, 0, TOX_FILE_KIND_DATA, FILE_SIZE, nullptr, (const uint8_t *)"file", 4, nullptr)
+              != UINT32_MAX);
+    send_messages(tox1);
+    uint32_t iterations = 0;
+
+    while (!transfer.done || transfer.messages < NUM_MESSAGES) {
+        ck_assert_msg(++iterations < MAX_ITERATIONS, "file or messages never arrived");
+        iterate(tox1, tox2, &transfer);
+    }
+
+    ck_assert(transfer.received == FILE_SIZE);
+    ck_assert(transfer.stream_packets == 0);
+    ck_assert(!file_stream_available(tox1));
+
+    tox_kill(tox1);
+    tox_kill(tox2);
+}
+
+int main(void)
+{
+    setvbuf(stdout, nullptr, _IONBF, 0);
+
+    test_lost_file_data_doesnt_hold_up_messages();
+    test_peer_without_streams_gets_everything_on_default_stream();
+    return 0;
+}
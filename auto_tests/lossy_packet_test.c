@@ -23,24 +23,31 @@
 
 #define LOSSY_PACKET_FILLER 200
 
+/* Lossy packets sent at once, more than pacing holds back. */
+#define LOSSY_PACKET_BURST 64
+
 static void handle_lossy_packet(Tox *tox, uint32_t friend_number, const uint8_t *data, size_t length, void *user_data)
 {
     uint8_t cmp_packet[TOX_MAX_CUSTOM_PACKET_SIZE];
     memset(cmp_packet, LOSSY_PACKET_FILLER, sizeof(cmp_packet));
 
     if (length == TOX_MAX_CUSTOM_PACKET_SIZE && memcmp(data, cmp_packet, sizeof(cmp_packet)) == 0) {
-        bool *custom_packet_received = (bool *)user_data;
-        *custom_packet_received = true;
+        uint32_t *custom_packets_received = (uint32_t *)user_data;
+        ++*custom_packets_received;
     }
 }
 
-static void test_lossy_packet(void)
+static void test_lossy_packet(bool pacing)
 {
-    printf("initialising 2 toxes\n");
+    printf("initialising 2 toxes, pacing %s\n", pacing ? "enabled" : "disabled");
     uint32_t index[] = { 1, 2 };
     const time_t cur_time = time(nullptr);
-    Tox *const tox1 = tox_new_log(nullptr, nullptr, &index[0]);
-    Tox *const tox2 = tox_new_log(nullptr, nullptr, &index[1]);
+    struct Tox_Options *options = tox_options_new(nullptr);
+    ck_assert(options != nullptr);
+    tox_options_set_packet_pacing_enabled(options, pacing);
+    Tox *const tox1 = tox_new_log(options, nullptr, &index[0]);
+    Tox *const tox2 = tox_new_log(options, nullptr, &index[1]);
+    tox_options_free(options);
 
     ck_assert_msg(tox1 && tox2, "failed to create 2 tox instances");
 
@@ -86,14 +93,29 @@ static void test_lossy_packet(void)
     ret = tox_friend_send_lossy_packet(tox1, 0, packet, TOX_MAX_CUSTOM_PACKET_SIZE, nullptr);
     ck_assert_msg(ret == true, "tox_friend_send_lossy_packet fail %i", ret);
 
-    bool received_lossy_packet = false;
+    uint32_t received_lossy_packets = 0;
 
-    while (!received_lossy_packet) {
+    while (received_lossy_packets == 0) {
         tox_iterate(tox1, nullptr);
-        tox_iterate(tox2, &received_lossy_packet);
+        tox_iterate(tox2, &received_lossy_packets);
         c_sleep(200);
     }
 
+    /* All of a burst arrive, whether pacing holds some of it back or not. */
+    for (uint32_t i = 0; i < LOSSY_PACKET_BURST; ++i) {
+        ret = tox_friend_send_lossy_packet(tox1, 0, packet, TOX_MAX_CUSTOM_PACKET_SIZE, nullptr);
+        ck_assert_msg(ret == true, "tox_friend_send_lossy_packet fail %i", ret);
+    }
+
+    while (received_lossy_packets < 1 + LOSSY_PACKET_BURST) {
+        tox_iterate(tox1, nullptr);
+        tox_iterate(tox2, &received_lossy_packets);
+        c_sleep(tox_iteration_interval(tox1));
+    }
+
+    ck_assert_msg(received_lossy_packets == 1 + LOSSY_PACKET_BURST, "received %u lossy packets",
+                  (unsigned)received_lossy_packets);
+
     printf("test_lossy_packet succeeded, took %ld seconds\n", time(nullptr) - cur_time);
 
     tox_kill(tox1);
@@ -104,6 +126,7 @@ int main(void)
 {
     setvbuf(stdout, nullptr, _IONBF, 0);
 
-    test_lossy_packet();
+    test_lossy_packet(false);
+    test_lossy_packet(true);
     return 0;
 }
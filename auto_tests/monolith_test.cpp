@@ -55,6 +55,11 @@ namespace encryptsave_test
 int main(void);
 #include "encryptsave_test.c"
 }
+namespace event_loop_test
+{
+int main(void);
+#include "event_loop_test.c"
+}
 namespace file_saving_test
 {
 int main(void);
@@ -95,6 +100,11 @@ namespace onion_test
 int main(void);
 #include "onion_test.c"
 }
+namespace reconnect_test
+{
+int main(void);
+#include "reconnect_test.c"
+}
 namespace resource_leak_test
 {
 int main(void);
@@ -209,44 +219,44 @@ int main(int argc, char *argv[])
 {
 #if defined(__x86_64__) && defined(__LP64__)
     // toxcore/DHT
-    CHECK_SIZE(Client_data, 496);
+    CHECK_SIZE(Client_data, 512);
     CHECK_SIZE(Cryptopacket_Handles, 16);
-    CHECK_SIZE(DHT, 676528);
-    CHECK_SIZE(DHT_Friend, 5104);
+    CHECK_SIZE(DHT, 546032);
+    CHECK_SIZE(DHT_Friend, 6552);
     CHECK_SIZE(Hardening, 144);
     CHECK_SIZE(IPPTs, 40);
-    CHECK_SIZE(IPPTsPng, 232);
+    CHECK_SIZE(IPPTsPng, 240);
     CHECK_SIZE(NAT, 48);
     CHECK_SIZE(Node_format, 64);
-    CHECK_SIZE(Shared_Key, 80);
-    CHECK_SIZE(Shared_Keys, 81920);
+    CHECK_SIZE(Shared_Key_Cache_Stats, 32);
     // toxcore/friend_connection
     CHECK_SIZE(Friend_Conn, 1784);
     CHECK_SIZE(Friend_Connections, 72);
     // toxcore/friend_requests
     CHECK_SIZE(Friend_Requests, 1080);
     // toxcore/group
-    CHECK_SIZE(Group_c, 728);
+    CHECK_SIZE(Group_c, 736);
     CHECK_SIZE(Group_Chats, 2120);
     CHECK_SIZE(Group_Peer, 480);
-    // toxcore/list
-    CHECK_SIZE(BS_LIST, 32);
+    // toxcore/hash_table
+    CHECK_SIZE(Hash_Table, 40);
     // toxcore/logger
     CHECK_SIZE(Logger, 24);
     // toxcore/Messenger
     CHECK_SIZE(File_Transfers, 72);
     CHECK_SIZE(Friend, 39264);
-    CHECK_SIZE(Messenger, 2008);
-    CHECK_SIZE(Messenger_Options, 72);
+    CHECK_SIZE(Messenger, 2040);
+    CHECK_SIZE(Messenger_Options, 96);
     CHECK_SIZE(Receipts, 16);
     // toxcore/net_crypto
 #ifdef __linux__
-    CHECK_SIZE(Crypto_Connection, 525392);
-    CHECK_SIZE(Net_Crypto, 272);
+    CHECK_SIZE(Crypto_Connection, 1520);
+    CHECK_SIZE(Net_Crypto, 36832);
 #endif
-    CHECK_SIZE(New_Connection, 168);
+    CHECK_SIZE(Crypto_Conn_Stats, 48);
+    CHECK_SIZE(New_Connection, 192);
     CHECK_SIZE(Packet_Data, 1384);
-    CHECK_SIZE(Packets_Array, 262152);
+    CHECK_SIZE(Packets_Array, 32);
     // toxcore/network
     CHECK_SIZE(IP, 24);
     CHECK_SIZE(IP4, 4);
@@ -254,11 +264,12 @@ int main(int argc, char *argv[])
     CHECK_SIZE(IP6, 16);
 #endif
     CHECK_SIZE(IP_Port, 32);
-    CHECK_SIZE(Networking_Core, 4112);
+#ifdef __linux__
+    CHECK_SIZE(Networking_Core, 4200);
+#endif
     CHECK_SIZE(Packet_Handler, 16);
     // toxcore/onion_announce
-    CHECK_SIZE(Cmp_data, 296);
-    CHECK_SIZE(Onion_Announce, 128048);
+    CHECK_SIZE(Onion_Announce, 46128);
     CHECK_SIZE(Onion_Announce_Entry, 288);
     // toxcore/onion_client
     CHECK_SIZE(Last_Pinged, 40);
@@ -269,13 +280,13 @@ int main(int argc, char *argv[])
     CHECK_SIZE(Onion_Friend, 1936);
     CHECK_SIZE(Onion_Node, 168);
     // toxcore/onion
-    CHECK_SIZE(Onion, 245832);
+    CHECK_SIZE(Onion, 72);
     CHECK_SIZE(Onion_Path, 392);
     // toxcore/ping_array
-    CHECK_SIZE(Ping_Array, 24);
+    CHECK_SIZE(Ping_Array, 40);
     CHECK_SIZE(Ping_Array_Entry, 32);
     // toxcore/ping
-    CHECK_SIZE(Ping, 2072);
+    CHECK_SIZE(Ping, 2080);
     // toxcore/TCP_client
     CHECK_SIZE(TCP_Client_Connection, 12064);
     CHECK_SIZE(TCP_Proxy_Info, 40);
@@ -289,10 +300,10 @@ int main(int argc, char *argv[])
 #ifdef TCP_SERVER_USE_EPOLL
     CHECK_SIZE(TCP_Server, 6049968);  // 6MB!
 #else
-    CHECK_SIZE(TCP_Server, 6049952);  // 6MB!
+    CHECK_SIZE(TCP_Server, 6049960);  // 6MB!
 #endif
     // toxcore/tox
-    CHECK_SIZE(Tox_Options, 64);
+    CHECK_SIZE(Tox_Options, 88);
 #endif
     return 0;
 }
@@ -1,3 +1,7 @@
+#ifndef _XOPEN_SOURCE
+#define _XOPEN_SOURCE 600
+#endif
+
 #ifdef HAVE_CONFIG_H
 #include "config.h"
 #endif
@@ -165,6 +169,136 @@ START_TEST(test_ip_equal)
 }
 END_TEST
 
+#define RECV_TEST_PACKETS 100
+
+static int handle_recv_test_packet(void *object, IP_Port ip_port, const uint8_t *data, uint16_t len, void *userdata)
+{
+    uint32_t *received = (uint32_t *)object;
+    ++*received;
+    return 0;
+}
+
+START_TEST(test_recv_stats)
+{
+    IP ip;
+    ip_init(&ip, 0);
+    ip.ip.v4 = get_ip4_loopback();
+
+    Networking_Core *net = new_networking(nullptr, ip, TOX_PORT_DEFAULT);
+    ck_assert_msg(net != nullptr, "Failed to create networking");
+
+    uint32_t received = 0;
+    networking_registerhandler(net, NET_PACKET_PING_REQUEST, &handle_recv_test_packet, &received);
+
+    IP_Port self;
+    self.ip = ip;
+    self.port = net_port(net);
+    const uint8_t packet[16] = {NET_PACKET_PING_REQUEST};
+
+    for (uint32_t i = 0; i < RECV_TEST_PACKETS; ++i) {
+        ck_assert_msg(sendpacket(net, self, packet, sizeof(packet)) == sizeof(packet), "Failed to send packet %u", i);
+    }
+
+    for (uint32_t i = 0; i < 20 && received < RECV_TEST_PACKETS; ++i) {
+        c_sleep(50);
+        networking_poll(net, nullptr);
+    }
+
+    const Net_Recv_Stats *stats = net_recv_stats(net);
+    ck_assert_msg(received == RECV_TEST_PACKETS, "Expected %u packets, received %u", RECV_TEST_PACKETS, received);
+    ck_assert_msg(stats->packets == RECV_TEST_PACKETS, "Stats counted %u packets", (unsigned)stats->packets);
+    ck_assert_msg(stats->syscalls >= stats->polls, "Expected at least one syscall per poll");
+    ck_assert_msg(stats->max_batch_size >= 1 && stats->max_batch_size <= NET_RECV_BATCH_SIZE,
+                  "Invalid maximum batch size %u", stats->max_batch_size);
+
+    kill_networking(net);
+}
+END_TEST
+
+START_TEST(test_send_queue)
+{
+    IP ip;
+    ip_init(&ip, 0);
+    ip.ip.v4 = get_ip4_loopback();
+
+    Networking_Core *net = new_networking(nullptr, ip, TOX_PORT_DEFAULT);
+    ck_assert_msg(net != nullptr, "Failed to create networking");
+    ck_assert_msg(networking_enable_send_queue(net) == 0, "Failed to enable send queue");
+
+    uint32_t received = 0;
+    networking_registerhandler(net, NET_PACKET_PING_REQUEST, &handle_recv_test_packet, &received);
+
+    IP_Port self;
+    self.ip = ip;
+    self.port = net_port(net);
+    const uint8_t packet[16] = {NET_PACKET_PING_REQUEST};
+
+    /* Fewer packets than the queue holds, so none are sent before the flush. */
+    for (uint32_t i = 0; i < NET_SEND_QUEUE_SIZE / 2; ++i) {
+        ck_assert_msg(sendpacket(net, self, packet, sizeof(packet)) == sizeof(packet), "Failed to queue packet %u", i);
+    }
+
+    /* networking_poll() reads the socket before it flushes the queue. */
+    c_sleep(50);
+    networking_poll(net, nullptr);
+    ck_assert_msg(received == 0, "Queued packets were sent before the queue was flushed");
+
+    for (uint32_t i = 0; i < 20 && received < NET_SEND_QUEUE_SIZE / 2; ++i) {
+        c_sleep(50);
+        networking_poll(net, nullptr);
+    }
+
+    ck_assert_msg(received == NET_SEND_QUEUE_SIZE / 2, "Expected %u packets, received %u", NET_SEND_QUEUE_SIZE / 2,
+                  received);
+
+    kill_networking(net);
+}
+END_TEST
+
+START_TEST(test_io_uring)
+{
+    IP ip;
+    ip_init(&ip, 0);
+    ip.ip.v4 = get_ip4_loopback();
+
+    /* Falls back to plain sockets where io_uring isn't available, in which
+     * case this checks that the fallback works. */
+    Networking_Core *net = new_networking_ex(nullptr, ip, TOX_PORTRANGE_FROM, TOX_PORTRANGE_TO, NET_BACKEND_IO_URING,
+                          nullptr);
+    ck_assert_msg(net != nullptr, "Failed to create networking");
+#ifndef __linux__
+    ck_assert_msg(net_backend(net) == NET_BACKEND_SOCKETS, "io_uring selected where it doesn't exist");
+#endif
+
+    uint32_t received = 0;
+    networking_registerhandler(net, NET_PACKET_PING_REQUEST, &handle_recv_test_packet, &received);
+
+    IP_Port self;
+    self.ip = ip;
+    self.port = net_port(net);
+    const uint8_t packet[16] = {NET_PACKET_PING_REQUEST};
+
+    for (uint32_t i = 0; i < RECV_TEST_PACKETS; ++i) {
+        ck_assert_msg(sendpacket(net, self, packet, sizeof(packet)) == sizeof(packet), "Failed to send packet %u", i);
+    }
+
+    /* With io_uring, the sends wait for networking_poll() to submit them. */
+    ck_assert_msg(networking_send_queue_pending(net) == (net_backend(net) == NET_BACKEND_IO_URING),
+                  "Sends pending doesn't match the backend in use");
+
+    for (uint32_t i = 0; i < 20 && received < RECV_TEST_PACKETS; ++i) {
+        c_sleep(50);
+        networking_poll(net, nullptr);
+    }
+
+    const Net_Recv_Stats *stats = net_recv_stats(net);
+    ck_assert_msg(received == RECV_TEST_PACKETS, "Expected %u packets, received %u", RECV_TEST_PACKETS, received);
+    ck_assert_msg(stats->packets == RECV_TEST_PACKETS, "Stats counted %u packets", (unsigned)stats->packets);
+
+    kill_networking(net);
+}
+END_TEST
+
 static Suite *network_suite(void)
 {
     Suite *s = suite_create("Network");
@@ -173,6 +307,9 @@ static Suite *network_suite(void)
 
     DEFTESTCASE(addr_resolv_localhost);
     DEFTESTCASE(ip_equal);
+    DEFTESTCASE(recv_stats);
+    DEFTESTCASE(send_queue);
+    DEFTESTCASE(io_uring);
 
     return s;
 }
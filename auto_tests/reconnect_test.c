@@ -0,0 +1,315 @@
+/* Tests that data reaches a peer that comes back after the last connection
+ * ended at least a round trip sooner when the session is resumed, and that a
+ * resumption packet can't be used twice.
+ */
+
+#ifndef _XOPEN_SOURCE
+#define _XOPEN_SOURCE 600
+#endif
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "check_compat.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../toxcore/net_crypto.h"
+#include "../toxcore/util.h"
+
+#include "helpers.h"
+
+/* net_crypto only sends to an IPv6 address that it has heard from, so the
+ * peers use IPv4 to reach the relay.
+ */
+static IP get_loopback(void)
+{
+    IP ip;
+    ip_init(&ip, false);
+    ip.ip.v4 = get_ip4_loopback();
+    return ip;
+}
+
+/* Time a round of the test takes, standing in for half a round trip. */
+#define ROUND_INTERVAL 5
+
+/* Rounds a packet and its answer take through the relay. */
+#define ROUNDS_PER_ROUND_TRIP 2
+
+/* Rounds after which a connection that isn't made has failed. */
+#define MAX_ROUNDS 1000
+
+typedef struct Peer {
+    Logger *log;
+    Networking_Core *net;
+    DHT *dht;
+    Net_Crypto *c;
+    int id; /* The connection to the other peer, -1 if there is none. */
+    uint32_t accepted; /* Connections the other peer made to us. */
+    uint32_t received; /* Data packets received on the connection. */
+} Peer;
+
+/* Sits between the peers, so that the test can see their packets. */
+typedef struct Relay {
+    Logger *log;
+    Networking_Core *net;
+    IP_Port peers[2];
+    uint8_t resumption_packet[MAX_CRYPTO_PACKET_SIZE];
+    uint16_t resumption_packet_length;
+} Relay;
+
+static int handle_status(void *object, int id, uint8_t status, void *userdata)
+{
+    Peer *p = (Peer *)object;
+
+    if (status == 0) {
+        p->id = -1;
+    }
+
+    return 0;
+}
+
+static int handle_data(void *object, int id, const uint8_t *data, uint16_t length, void *userdata)
+{
+    Peer *p = (Peer *)object;
+    ++p->received;
+    return 0;
+}
+
+static void set_handlers(Peer *p)
+{
+    connection_status_handler(p->c, p->id, &handle_status, p, 0);
+    connection_data_handler(p->c, p->id, &handle_data, p, 0);
+}
+
+static int handle_new_connection(void *object, New_Connection *n_c)
+{
+    Peer *p = (Peer *)object;
+
+    if (p->id != -1) {
+        return -1;
+    }
+
+    const int id = accept_crypto_connection(p->c, n_c);
+
+    if (id == -1) {
+        return -1;
+    }
+
+    p->id = id;
+    set_handlers(p);
+    ++p->accepted;
+    return 0;
+}
+
+static int relay_packet(void *object, IP_Port source, const uint8_t *packet, uint16_t length, void *userdata)
+{
+    Relay *relay = (Relay *)object;
+
+    if (packet[0] == NET_PACKET_CRYPTO_RESUME) {
+        memcpy(relay->resumption_packet, packet, length);
+        relay->resumption_packet_length = length;
+    }
+
+    const IP_Port dest = source.port == relay->peers[0].port ? relay->peers[1] : relay->peers[0];
+    sendpacket(relay->net, dest, packet, length);
+    return 0;
+}
+
+static void new_peer(Peer *p, uint32_t *index, bool resumption)
+{
+    p->log = logger_new();
+    logger_callback_log(p->log, (logger_cb *)print_debug_log, nullptr, index);
+    p->net = new_networking(p->log, get_loopback(), TOX_PORTRANGE_FROM);
+    ck_assert(p->net != nullptr);
+    p->dht = new_DHT(p->log, p->net, true);
+    ck_assert(p->dht != nullptr);
+    TCP_Proxy_Info proxy_info = {{{{0}}}};
+    p->c = new_net_crypto(p->log, p->dht, &proxy_info);
+    ck_assert(p->c != nullptr);
+    nc_set_session_resumption(p->c, resumption);
+    new_connection_handler(p->c, &handle_new_connection, p);
+    p->id = -1;
+    p->accepted = 0;
+}
+
+static void kill_peer(Peer *p)
+{
+    kill_net_crypto(p->c);
+    kill_DHT(p->dht);
+    kill_networking(p->net);
+    logger_kill(p->log);
+}
+
+static void new_relay(Relay *relay, uint32_t *index, const Peer *p1, const Peer *p2)
+{
+    relay->log = logger_new();
+    logger_callback_log(relay->log, (logger_cb *)print_debug_log, nullptr, index);
+    relay->net = new_networking(relay->log, get_loopback(), TOX_PORTRANGE_FROM);
+    ck_assert(relay->net != nullptr);
+    relay->peers[0].ip = get_loopback();
+    relay->peers[0].port = net_port(p1->net);
+    relay->peers[1].ip = get_loopback();
+    relay->peers[1].port = net_port(p2->net);
+    relay->resumption_packet_length = 0;
+
+    const uint8_t packet_ids[] = {NET_PACKET_COOKIE_REQUEST, NET_PACKET_COOKIE_RESPONSE, NET_PACKET_CRYPTO_HS,
+                                  NET_PACKET_CRYPTO_DATA, NET_PACKET_CRYPTO_STREAM_DATA, NET_PACKET_CRYPTO_RESUME
+                                 };
+
+    for (size_t i = 0; i < sizeof(packet_ids); ++i) {
+        networking_registerhandler(relay->net, packet_ids[i], &relay_packet, relay);
+    }
+}
+
+static void kill_relay(Relay *relay)
+{
+    kill_networking(relay->net);
+    logger_kill(relay->log);
+}
+
+static void do_round(Peer *p1, Peer *p2, Relay *relay)
+{
+    networking_poll(p1->net, nullptr);
+    do_net_crypto(p1->c, nullptr);
+    networking_poll(p2->net, nullptr);
+    do_net_crypto(p2->c, nullptr);
+    networking_poll(relay->net, nullptr);
+    c_sleep(ROUND_INTERVAL);
+}
+
+static bool established(const Peer *p)
+{
+    return p->id != -1 && crypto_connection_status(p->c, p->id, nullptr, nullptr) == CRYPTO_CONN_ESTABLISHED;
+}
+
+/* Have p1, and p2 too if both_connect, connect to the other through the relay.
+ * p1 sends p2 a data packet as soon as the connection takes it.
+ *
+ * return the number of rounds it took until p2 had the data packet.
+ */
+static uint32_t connect_peers(Peer *p1, Peer *p2, Relay *relay, bool both_connect)
+{
+    IP_Port relay_ip_port;
+    relay_ip_port.ip = get_loopback();
+    relay_ip_port.port = net_port(relay->net);
+
+    p1->id = new_crypto_connection(p1->c, nc_get_self_public_key(p2->c), dht_get_self_public_key(p2->dht));
+    ck_assert(p1->id != -1);
+    set_handlers(p1);
+    set_direct_ip_port(p1->c, p1->id, relay_ip_port, 0);
+    p2->received = 0;
+
+    if (both_connect) {
+        p2->id = new_crypto_connection(p2->c, nc_get_self_public_key(p1->c), dht_get_self_public_key(p1->dht));
+        ck_assert(p2->id != -1);
+        set_handlers(p2);
+        set_direct_ip_port(p2->c, p2->id, relay_ip_port, 0);
+    }
+
+    const uint8_t packet[] = {CRYPTO_RESERVED_PACKETS, 'h', 'i'};
+    bool sent = false;
+    uint32_t data_rounds = 0;
+
+    for (uint32_t rounds = 0; !established(p1) || !established(p2) || data_rounds == 0; ++rounds) {
+        ck_assert_msg(rounds < MAX_ROUNDS, "peers failed to connect");
+
+        if (!sent) {
+            sent = write_cryptpacket(p1->c, p1->id, packet, sizeof(packet), 0) != -1;
+        }
+
+        do_round(p1, p2, relay);
+
+        if (data_rounds == 0 && p2->received != 0) {
+            data_rounds = rounds + 1;
+        }
+    }
+
+    return data_rounds;
+}
+
+/* Let the connection run long enough for the peers to tell each other what
+ * they support, then have p1 end it.
+ */
+static void disconnect_peers(Peer *p1, Peer *p2, Relay *relay)
+{
+    const uint64_t start = current_time_monotonic();
+
+    while (current_time_monotonic() < start + 2 * CRYPTO_SEND_PACKET_INTERVAL) {
+        do_round(p1, p2, relay);
+        ck_assert(established(p1) && established(p2));
+    }
+
+    crypto_kill(p1->c, p1->id);
+    p1->id = -1;
+
+    for (uint32_t rounds = 0; p2->id != -1; ++rounds) {
+        ck_assert_msg(rounds < MAX_ROUNDS, "peer 2 didn't see the connection end");
+        do_round(p1, p2, relay);
+    }
+}
+
+/* return the number of rounds it took the peers to connect again. */
+static uint32_t test_reconnect(bool resumption, bool both_connect)
+{
+    uint32_t index[] = { 1, 2, 3 };
+    Peer p1;
+    Peer p2;
+    Relay relay;
+    new_peer(&p1, &index[0], resumption);
+    new_peer(&p2, &index[1], resumption);
+    new_relay(&relay, &index[2], &p1, &p2);
+
+    const uint32_t first_rounds = connect_peers(&p1, &p2, &relay, false);
+    disconnect_peers(&p1, &p2, &relay);
+    ck_assert(p2.accepted == 1);
+
+    const uint32_t rounds = connect_peers(&p1, &p2, &relay, both_connect);
+    printf("session resumption %s, %s: data arrived after %u rounds on the first connection, %u on the next\n",
+           resumption ? "enabled" : "disabled", both_connect ? "both connect" : "one connects", first_rounds, rounds);
+
+    if (!resumption) {
+        ck_assert(relay.resumption_packet_length == 0);
+    } else if (!both_connect) {
+        ck_assert(relay.resumption_packet_length != 0);
+        ck_assert(p2.accepted == 2);
+
+        /* The peers have a new session to resume once this connection ends,
+         * but the old resumption packet resumes nothing. */
+        disconnect_peers(&p1, &p2, &relay);
+        sendpacket(relay.net, relay.peers[1], relay.resumption_packet, relay.resumption_packet_length);
+
+        for (uint32_t i = 0; i < 20; ++i) {
+            do_round(&p1, &p2, &relay);
+        }
+
+        ck_assert_msg(p2.id == -1 && p2.accepted == 2, "replayed resumption packet was accepted");
+    }
+
+    kill_relay(&relay);
+    kill_peer(&p2);
+    kill_peer(&p1);
+    return rounds;
+}
+
+int main(void)
+{
+    setvbuf(stdout, nullptr, _IONBF, 0);
+
+    const uint32_t handshake_rounds = test_reconnect(false, false);
+    const uint32_t resumption_rounds = test_reconnect(true, false);
+    ck_assert_msg(resumption_rounds + ROUNDS_PER_ROUND_TRIP <= handshake_rounds,
+                  "resuming the session took %u rounds, a handshake %u", resumption_rounds, handshake_rounds);
+
+    const uint32_t both_handshake_rounds = test_reconnect(false, true);
+    const uint32_t both_resumption_rounds = test_reconnect(true, true);
+    ck_assert_msg(both_resumption_rounds + ROUNDS_PER_ROUND_TRIP <= both_handshake_rounds,
+                  "resuming the session from both sides took %u rounds, a handshake %u",
+                  both_resumption_rounds, both_handshake_rounds);
+
+    return 0;
+}
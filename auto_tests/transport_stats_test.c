@@ -0,0 +1,163 @@
+/* Tests that the transport statistics of the connection to a friend follow
+ * what happens on it: packets lost on the way are counted as resent, and the
+ * resends slow the connection down.
+ */
+
+#ifndef _XOPEN_SOURCE
+#define _XOPEN_SOURCE 600
+#endif
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "check_compat.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../toxcore/Messenger.h"
+#include "../toxcore/ccompat.h"
+#include "../toxcore/tox.h"
+#include "../toxcore/util.h"
+
+#include "helpers.h"
+
+#define LOSSLESS_PACKET_ID 160
+#define NUM_PACKETS 64
+
+/* One in this many data packets reaching tox2 is dropped while dropping. */
+#define DROP_EVERY 4
+
+typedef struct Lossy_Path {
+    packet_handler_callback handler;
+    void *object;
+    bool dropping;
+    uint32_t packets;
+    uint32_t dropped;
+} Lossy_Path;
+
+static int drop_some(void *object, IP_Port source, const uint8_t *packet, uint16_t length, void *userdata)
+{
+    Lossy_Path *path = (Lossy_Path *)object;
+
+    if (path->dropping && ++path->packets % DROP_EVERY == 0) {
+        ++path->dropped;
+        return 0;
+    }
+
+    return path->handler(path->object, source, packet, length, userdata);
+}
+
+static void handle_lossless_packet(Tox *tox, uint32_t friend_number, const uint8_t *data, size_t length,
+                                   void *user_data)
+{
+    uint32_t *received = (uint32_t *)user_data;
+    ++*received;
+}
+
+static void iterate(Tox *tox1, Tox *tox2, uint32_t *received)
+{
+    tox_iterate(tox1, nullptr);
+    tox_iterate(tox2, received);
+    c_sleep(50);
+}
+
+/* Send count lossless packets from tox1 to tox2, and wait until tox1 knows
+ * they all arrived.
+ */
+static void send_packets(Tox *tox1, Tox *tox2, uint32_t count, Tox_Friend_Transport_Stats *stats)
+{
+    tox_callback_friend_lossless_packet(tox2, &handle_lossless_packet);
+
+    uint8_t packet[TOX_MAX_CUSTOM_PACKET_SIZE];
+    memset(packet, LOSSLESS_PACKET_ID, sizeof(packet));
+
+    uint32_t sent = 0;
+    uint32_t received = 0;
+
+    do {
+        /* As many as the connection takes at once, the rest later. */
+        while (sent < count && tox_friend_send_lossless_packet(tox1, 0, packet, sizeof(packet), nullptr)) {
+            ++sent;
+        }
+
+        iterate(tox1, tox2, &received);
+        ck_assert(tox_friend_get_transport_stats(tox1, 0, stats, nullptr));
+    } while (sent < count || received < count || stats->send_queue > 0);
+
+    ck_assert(received == count);
+}
+
+static void test_transport_stats(void)
+{
+    printf("initialising 2 toxes\n");
+    uint32_t index[] = { 1, 2 };
+    Tox *const tox1 = tox_new_log(nullptr, nullptr, &index[0]);
+    Tox *const tox2 = tox_new_log(nullptr, nullptr, &index[1]);
+
+    ck_assert_msg(tox1 && tox2, "failed to create 2 tox instances");
+
+    uint8_t public_key[TOX_PUBLIC_KEY_SIZE];
+    tox_self_get_public_key(tox2, public_key);
+    tox_friend_add_norequest(tox1, public_key, nullptr);
+    tox_self_get_public_key(tox1, public_key);
+    tox_friend_add_norequest(tox2, public_key, nullptr);
+
+    uint8_t dht_key[TOX_PUBLIC_KEY_SIZE];
+    tox_self_get_dht_id(tox1, dht_key);
+    const uint16_t dht_port = tox_self_get_udp_port(tox1, nullptr);
+    tox_bootstrap(tox2, "localhost", dht_port, dht_key, nullptr);
+
+    while (tox_friend_get_connection_status(tox1, 0, nullptr) != TOX_CONNECTION_UDP ||
+            tox_friend_get_connection_status(tox2, 0, nullptr) != TOX_CONNECTION_UDP) {
+        iterate(tox1, tox2, nullptr);
+    }
+
+    Tox_Friend_Transport_Stats stats;
+    TOX_ERR_FRIEND_QUERY query_err;
+    ck_assert(!tox_friend_get_transport_stats(tox1, 0, nullptr, &query_err));
+    ck_assert(query_err == TOX_ERR_FRIEND_QUERY_NULL);
+    ck_assert(!tox_friend_get_transport_stats(tox1, 1, &stats, &query_err));
+    ck_assert(query_err == TOX_ERR_FRIEND_QUERY_FRIEND_NOT_FOUND);
+
+    printf("sending over a clean path\n");
+    send_packets(tox1, tox2, 1, &stats);
+
+    /* Once tox2 confirmed the packet, tox1 knows the round trip time. */
+    ck_assert(stats.connection == TOX_CONNECTION_UDP);
+    ck_assert(stats.rtt < 1000);
+    ck_assert(stats.send_rate > 0);
+    ck_assert(stats.send_queue == 0);
+    ck_assert_msg(stats.packets_resent == 0, "%lu packets resent without loss", (unsigned long)stats.packets_resent);
+    ck_assert_msg(stats.congestion_events == 0, "%lu congestion events without loss",
+                  (unsigned long)stats.congestion_events);
+
+    printf("sending with one in %d packets lost\n", DROP_EVERY);
+    Messenger *m2 = (Messenger *)tox2;
+    Lossy_Path path = {nullptr};
+    path.handler = networking_get_handler(m2->net, NET_PACKET_CRYPTO_DATA, &path.object);
+    ck_assert(path.handler != nullptr);
+    networking_registerhandler(m2->net, NET_PACKET_CRYPTO_DATA, &drop_some, &path);
+    path.dropping = true;
+
+    send_packets(tox1, tox2, NUM_PACKETS, &stats);
+
+    ck_assert(path.dropped > 0);
+    ck_assert_msg(stats.packets_resent > 0, "%u packets lost, none resent", path.dropped);
+    ck_assert_msg(stats.congestion_events > 0, "%lu packets resent, no congestion event",
+                  (unsigned long)stats.packets_resent);
+
+    tox_kill(tox1);
+    tox_kill(tox2);
+}
+
+int main(void)
+{
+    setvbuf(stdout, nullptr, _IONBF, 0);
+
+    test_transport_stats();
+    return 0;
+}
@@ -22,7 +22,6 @@ put toxcore/crypto_core_mem.c
 put toxcore/friend_connection.c
 put toxcore/friend_requests.c
 put toxcore/group.c
-put toxcore/list.c
 put toxcore/logger.c
 put toxcore/network.c
 put toxcore/net_crypto.c
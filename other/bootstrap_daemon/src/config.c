@@ -27,6 +27,7 @@
 #include "config_defaults.h"
 #include "log.h"
 
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -34,6 +35,45 @@
 
 #include "../../bootstrap_node_packets.h"
 
+// The requests whose rate can be limited, under `rate_limits` in the config file.
+static const Rate_Limit_Config rate_limited_requests[RATE_LIMITED_REQUEST_COUNT] = {
+    {"ping",           NET_PACKET_PING_REQUEST,       DEFAULT_RATE_LIMIT_RATE, DEFAULT_RATE_LIMIT_BURST},
+    {"get_nodes",      NET_PACKET_GET_NODES,          DEFAULT_RATE_LIMIT_RATE, DEFAULT_RATE_LIMIT_BURST},
+    {"onion_announce", NET_PACKET_ANNOUNCE_REQUEST,   DEFAULT_RATE_LIMIT_RATE, DEFAULT_RATE_LIMIT_BURST},
+    {"onion_data",     NET_PACKET_ONION_DATA_REQUEST, DEFAULT_RATE_LIMIT_RATE, DEFAULT_RATE_LIMIT_BURST},
+    {"onion_route",    NET_PACKET_ONION_SEND_INITIAL, DEFAULT_RATE_LIMIT_RATE, DEFAULT_RATE_LIMIT_BURST},
+};
+
+/**
+ * Parses the rate limits from `cfg` into `rate_limits`, using the defaults for
+ * the ones it doesn't set.
+ *
+ * Supposed to be called from get_general_config only.
+ */
+static void parse_rate_limits_config(config_t *cfg, Rate_Limit_Config *rate_limits)
+{
+    const char *NAME_RATE_LIMITS = "rate_limits";
+
+    for (int i = 0; i < RATE_LIMITED_REQUEST_COUNT; ++i) {
+        rate_limits[i] = rate_limited_requests[i];
+
+        char path[64];
+        snprintf(path, sizeof(path), "%s.%s.rate", NAME_RATE_LIMITS, rate_limits[i].name);
+
+        if (config_lookup_int(cfg, path, &rate_limits[i].rate) == CONFIG_FALSE) {
+            continue;
+        }
+
+        snprintf(path, sizeof(path), "%s.%s.burst", NAME_RATE_LIMITS, rate_limits[i].name);
+
+        if (config_lookup_int(cfg, path, &rate_limits[i].burst) == CONFIG_FALSE) {
+            log_write(LOG_LEVEL_WARNING, "No '%s' setting in configuration file.\n", path);
+            log_write(LOG_LEVEL_WARNING, "Using the rate as '%s': %d\n", path, rate_limits[i].rate);
+            rate_limits[i].burst = rate_limits[i].rate;
+        }
+    }
+}
+
 /**
  * Parses tcp relay ports from `cfg` and puts them into `tcp_relay_ports` array.
  *
@@ -142,12 +182,17 @@ static void parse_tcp_relay_ports_config(config_t *cfg, uint16_t **tcp_relay_por
 }
 
 int get_general_config(const char *cfg_file_path, char **pid_file_path, char **keys_file_path, int *port,
+                       int *udp_worker_threads, int *shared_key_cache_size, int *crypto_worker_threads,
                        int *enable_ipv6, int *enable_ipv4_fallback, int *enable_lan_discovery, int *enable_tcp_relay,
-                       uint16_t **tcp_relay_ports, int *tcp_relay_port_count, int *enable_motd, char **motd)
+                       uint16_t **tcp_relay_ports, int *tcp_relay_port_count, int *enable_motd, char **motd,
+                       Rate_Limit_Config *rate_limits)
 {
     config_t cfg;
 
     const char *NAME_PORT                 = "port";
+    const char *NAME_UDP_WORKER_THREADS   = "udp_worker_threads";
+    const char *NAME_SHARED_KEY_CACHE_SIZE = "shared_key_cache_size";
+    const char *NAME_CRYPTO_WORKER_THREADS = "crypto_worker_threads";
     const char *NAME_PID_FILE_PATH        = "pid_file_path";
     const char *NAME_KEYS_FILE_PATH       = "keys_file_path";
     const char *NAME_ENABLE_IPV6          = "enable_ipv6";
@@ -173,6 +218,29 @@ int get_general_config(const char *cfg_file_path, char **pid_file_path, char **k
         *port = DEFAULT_PORT;
     }
 
+    // Get number of UDP worker threads
+    if (config_lookup_int(&cfg, NAME_UDP_WORKER_THREADS, udp_worker_threads) == CONFIG_FALSE) {
+        log_write(LOG_LEVEL_WARNING, "No '%s' setting in configuration file.\n", NAME_UDP_WORKER_THREADS);
+        log_write(LOG_LEVEL_WARNING, "Using default '%s': %d\n", NAME_UDP_WORKER_THREADS, DEFAULT_UDP_WORKER_THREADS);
+        *udp_worker_threads = DEFAULT_UDP_WORKER_THREADS;
+    }
+
+    // Get shared key cache size
+    if (config_lookup_int(&cfg, NAME_SHARED_KEY_CACHE_SIZE, shared_key_cache_size) == CONFIG_FALSE) {
+        log_write(LOG_LEVEL_WARNING, "No '%s' setting in configuration file.\n", NAME_SHARED_KEY_CACHE_SIZE);
+        log_write(LOG_LEVEL_WARNING, "Using default '%s': %d\n", NAME_SHARED_KEY_CACHE_SIZE,
+                  DEFAULT_SHARED_KEY_CACHE_SIZE);
+        *shared_key_cache_size = DEFAULT_SHARED_KEY_CACHE_SIZE;
+    }
+
+    // Get number of crypto worker threads
+    if (config_lookup_int(&cfg, NAME_CRYPTO_WORKER_THREADS, crypto_worker_threads) == CONFIG_FALSE) {
+        log_write(LOG_LEVEL_WARNING, "No '%s' setting in configuration file.\n", NAME_CRYPTO_WORKER_THREADS);
+        log_write(LOG_LEVEL_WARNING, "Using default '%s': %d\n", NAME_CRYPTO_WORKER_THREADS,
+                  DEFAULT_CRYPTO_WORKER_THREADS);
+        *crypto_worker_threads = DEFAULT_CRYPTO_WORKER_THREADS;
+    }
+
     // Get PID file location
     const char *tmp_pid_file;
 
@@ -259,12 +327,17 @@ int get_general_config(const char *cfg_file_path, char **pid_file_path, char **k
         (*motd)[motd_length - 1] = '\0';
     }
 
+    parse_rate_limits_config(&cfg, rate_limits);
+
     config_destroy(&cfg);
 
     log_write(LOG_LEVEL_INFO, "Successfully read:\n");
     log_write(LOG_LEVEL_INFO, "'%s': %s\n", NAME_PID_FILE_PATH,        *pid_file_path);
     log_write(LOG_LEVEL_INFO, "'%s': %s\n", NAME_KEYS_FILE_PATH,       *keys_file_path);
     log_write(LOG_LEVEL_INFO, "'%s': %d\n", NAME_PORT,                 *port);
+    log_write(LOG_LEVEL_INFO, "'%s': %d\n", NAME_UDP_WORKER_THREADS,   *udp_worker_threads);
+    log_write(LOG_LEVEL_INFO, "'%s': %d\n", NAME_SHARED_KEY_CACHE_SIZE, *shared_key_cache_size);
+    log_write(LOG_LEVEL_INFO, "'%s': %d\n", NAME_CRYPTO_WORKER_THREADS, *crypto_worker_threads);
     log_write(LOG_LEVEL_INFO, "'%s': %s\n", NAME_ENABLE_IPV6,          *enable_ipv6          ? "true" : "false");
     log_write(LOG_LEVEL_INFO, "'%s': %s\n", NAME_ENABLE_IPV4_FALLBACK, *enable_ipv4_fallback ? "true" : "false");
     log_write(LOG_LEVEL_INFO, "'%s': %s\n", NAME_ENABLE_LAN_DISCOVERY, *enable_lan_discovery ? "true" : "false");
@@ -291,6 +364,11 @@ int get_general_config(const char *cfg_file_path, char **pid_file_path, char **k
         log_write(LOG_LEVEL_INFO, "'%s': %s\n", NAME_MOTD, *motd);
     }
 
+    for (int i = 0; i < RATE_LIMITED_REQUEST_COUNT; ++i) {
+        log_write(LOG_LEVEL_INFO, "Rate limit of '%s' requests: %d per second, bursts of %d\n", rate_limits[i].name,
+                  rate_limits[i].rate, rate_limits[i].burst);
+    }
+
     return 1;
 }
 
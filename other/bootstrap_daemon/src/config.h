@@ -27,6 +27,18 @@
 
 #include "../../../toxcore/DHT.h"
 
+// Number of kinds of requests whose rate can be limited in the config file.
+#define RATE_LIMITED_REQUEST_COUNT 5
+
+// How many requests of one kind a single source may send, see
+// networking_set_rate_limit(). A rate of 0 means no limit.
+typedef struct Rate_Limit_Config {
+    const char *name;
+    uint8_t packet_id;
+    int rate;
+    int burst;
+} Rate_Limit_Config;
+
 /**
  * Gets general config options from the config file.
  *
@@ -34,12 +46,16 @@
  *            also, iff `tcp_relay_ports_count` > 0, then you are responsible for freeing `tcp_relay_ports`
  *            and also `motd` iff `enable_motd` is set.
  *
+ * `rate_limits` must have room for RATE_LIMITED_REQUEST_COUNT limits.
+ *
  * @return 1 on success,
  *         0 on failure, doesn't modify any data pointed by arguments.
  */
 int get_general_config(const char *cfg_file_path, char **pid_file_path, char **keys_file_path, int *port,
+                       int *udp_worker_threads, int *shared_key_cache_size, int *crypto_worker_threads,
                        int *enable_ipv6, int *enable_ipv4_fallback, int *enable_lan_discovery, int *enable_tcp_relay,
-                       uint16_t **tcp_relay_ports, int *tcp_relay_port_count, int *enable_motd, char **motd);
+                       uint16_t **tcp_relay_ports, int *tcp_relay_port_count, int *enable_motd, char **motd,
+                       Rate_Limit_Config *rate_limits);
 
 /**
  * Bootstraps off nodes listed in the config file.
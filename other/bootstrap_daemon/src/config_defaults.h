@@ -30,6 +30,9 @@
 #define DEFAULT_PID_FILE_PATH         "tox-bootstrapd.pid"
 #define DEFAULT_KEYS_FILE_PATH        "tox-bootstrapd.keys"
 #define DEFAULT_PORT                  33445
+#define DEFAULT_UDP_WORKER_THREADS    0 // 0 - handle all UDP traffic in the main thread
+#define DEFAULT_SHARED_KEY_CACHE_SIZE 65536
+#define DEFAULT_CRYPTO_WORKER_THREADS 0 // 0 - compute shared keys in the main thread
 #define DEFAULT_ENABLE_IPV6           1 // 1 - true, 0 - false
 #define DEFAULT_ENABLE_IPV4_FALLBACK  1 // 1 - true, 0 - false
 #define DEFAULT_ENABLE_LAN_DISCOVERY  1 // 1 - true, 0 - false
@@ -38,5 +41,7 @@
 #define DEFAULT_TCP_RELAY_PORTS_COUNT 3
 #define DEFAULT_ENABLE_MOTD           1 // 1 - true, 0 - false
 #define DEFAULT_MOTD                  DAEMON_NAME
+#define DEFAULT_RATE_LIMIT_RATE       0 // 0 - no limit
+#define DEFAULT_RATE_LIMIT_BURST      0
 
 #endif // CONFIG_DEFAULTS_H
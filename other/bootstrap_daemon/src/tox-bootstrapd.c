@@ -37,6 +37,7 @@
 #include "../../../toxcore/tox.h"
 #include "../../../toxcore/LAN_discovery.h"
 #include "../../../toxcore/TCP_server.h"
+#include "../../../toxcore/crypto_pool.h"
 #include "../../../toxcore/logger.h"
 #include "../../../toxcore/onion_announce.h"
 #include "../../../toxcore/util.h"
@@ -48,10 +49,50 @@
 #include "config.h"
 #include "global.h"
 #include "log.h"
+#include "workers.h"
 
 
 #define SLEEP_MILLISECONDS(MS) usleep(1000*MS)
 
+// Seconds between two logs of the shared key cache statistics.
+#define SHARED_KEY_STATS_INTERVAL 3600
+
+// With UDP workers the main socket has to share the port with theirs, so it
+// can't move to another port of the range if the configured one is taken.
+static Networking_Core *new_daemon_networking(Logger *logger, IP ip, int port, int udp_worker_threads)
+{
+    if (udp_worker_threads > 0) {
+        return new_networking_reuseport(logger, ip, port, nullptr);
+    }
+
+    return new_networking(logger, ip, port);
+}
+
+// Logs how many requests were dropped for going over their rate limit.
+static void log_rate_limited(const Networking_Core *net, const Rate_Limit_Config *rate_limits)
+{
+    for (int i = 0; i < RATE_LIMITED_REQUEST_COUNT; ++i) {
+        if (rate_limits[i].rate != 0) {
+            log_write(LOG_LEVEL_INFO, "Rate limit of '%s' requests: %llu dropped.\n", rate_limits[i].name,
+                      (unsigned long long)networking_rate_limited(net, rate_limits[i].packet_id));
+        }
+    }
+}
+
+// Logs how well the shared key cache is doing, so that its size can be tuned.
+static void log_shared_key_cache_stats(const DHT *dht)
+{
+    Shared_Key_Cache_Stats stats;
+    dht_get_shared_key_cache_stats(dht, &stats);
+
+    const uint64_t lookups = stats.hits + stats.misses;
+    const unsigned int hit_rate = lookups == 0 ? 0 : (unsigned int)(stats.hits * 100 / lookups);
+
+    log_write(LOG_LEVEL_INFO, "Shared key cache: %u/%u keys, %llu hits, %llu misses, %llu evictions, %u%% hit rate.\n",
+              stats.size, stats.capacity, (unsigned long long)stats.hits, (unsigned long long)stats.misses,
+              (unsigned long long)stats.evictions, hit_rate);
+}
+
 // Uses the already existing key or creates one if it didn't exist
 //
 // returns 1 on success
@@ -195,6 +236,9 @@ int main(int argc, char *argv[])
 
     char *pid_file_path, *keys_file_path;
     int port;
+    int udp_worker_threads;
+    int shared_key_cache_size;
+    int crypto_worker_threads;
     int enable_ipv6;
     int enable_ipv4_fallback;
     int enable_lan_discovery;
@@ -203,9 +247,12 @@ int main(int argc, char *argv[])
     int tcp_relay_port_count;
     int enable_motd;
     char *motd;
+    Rate_Limit_Config rate_limits[RATE_LIMITED_REQUEST_COUNT];
 
-    if (get_general_config(cfg_file_path, &pid_file_path, &keys_file_path, &port, &enable_ipv6, &enable_ipv4_fallback,
-                           &enable_lan_discovery, &enable_tcp_relay, &tcp_relay_ports, &tcp_relay_port_count, &enable_motd, &motd)) {
+    if (get_general_config(cfg_file_path, &pid_file_path, &keys_file_path, &port, &udp_worker_threads,
+                           &shared_key_cache_size, &crypto_worker_threads, &enable_ipv6, &enable_ipv4_fallback,
+                           &enable_lan_discovery, &enable_tcp_relay, &tcp_relay_ports, &tcp_relay_port_count,
+                           &enable_motd, &motd, rate_limits)) {
         log_write(LOG_LEVEL_INFO, "General config read successfully\n");
     } else {
         log_write(LOG_LEVEL_ERROR, "Couldn't read config file: %s. Exiting.\n", cfg_file_path);
@@ -218,6 +265,33 @@ int main(int argc, char *argv[])
         return 1;
     }
 
+    if (udp_worker_threads < 0 || udp_worker_threads > MAX_UDP_WORKER_THREADS) {
+        log_write(LOG_LEVEL_ERROR, "Invalid number of UDP worker threads: %d, should be in [0, %d]. Exiting.\n",
+                  udp_worker_threads, MAX_UDP_WORKER_THREADS);
+        return 1;
+    }
+
+    if (shared_key_cache_size <= 0) {
+        log_write(LOG_LEVEL_ERROR, "Invalid shared key cache size: %d, should be positive. Exiting.\n",
+                  shared_key_cache_size);
+        return 1;
+    }
+
+    if (crypto_worker_threads < 0 || crypto_worker_threads > CRYPTO_POOL_MAX_THREADS) {
+        log_write(LOG_LEVEL_ERROR, "Invalid number of crypto worker threads: %d, should be in [0, %d]. Exiting.\n",
+                  crypto_worker_threads, CRYPTO_POOL_MAX_THREADS);
+        return 1;
+    }
+
+    for (int i = 0; i < RATE_LIMITED_REQUEST_COUNT; ++i) {
+        if (rate_limits[i].rate < 0 || (rate_limits[i].rate > 0 && rate_limits[i].burst <= 0)) {
+            log_write(LOG_LEVEL_ERROR, "Invalid rate limit of '%s' requests: %d per second, bursts of %d, "
+                      "should be 0 or positive with a positive burst. Exiting.\n", rate_limits[i].name,
+                      rate_limits[i].rate, rate_limits[i].burst);
+            return 1;
+        }
+    }
+
     if (!run_in_foreground) {
         daemonize(log_backend, pid_file_path);
     }
@@ -229,14 +303,14 @@ int main(int argc, char *argv[])
 
     Logger *logger = logger_new();
 
-    Networking_Core *net = new_networking(logger, ip, port);
+    Networking_Core *net = new_daemon_networking(logger, ip, port, udp_worker_threads);
 
     if (net == nullptr) {
         if (enable_ipv6 && enable_ipv4_fallback) {
             log_write(LOG_LEVEL_WARNING, "Couldn't initialize IPv6 networking. Falling back to using IPv4.\n");
             enable_ipv6 = 0;
             ip_init(&ip, enable_ipv6);
-            net = new_networking(logger, ip, port);
+            net = new_daemon_networking(logger, ip, port, udp_worker_threads);
 
             if (net == nullptr) {
                 log_write(LOG_LEVEL_ERROR, "Couldn't fallback to IPv4. Exiting.\n");
@@ -250,6 +324,20 @@ int main(int argc, char *argv[])
         }
     }
 
+    if (crypto_worker_threads > 0 && networking_enable_crypto_pool(net, crypto_worker_threads) != 0) {
+        log_write(LOG_LEVEL_ERROR, "Couldn't start %d crypto worker threads. Exiting.\n", crypto_worker_threads);
+        logger_kill(logger);
+        return 1;
+    }
+
+    for (int i = 0; i < RATE_LIMITED_REQUEST_COUNT; ++i) {
+        if (networking_set_rate_limit(net, rate_limits[i].packet_id, rate_limits[i].rate, rate_limits[i].burst) != 0) {
+            log_write(LOG_LEVEL_ERROR, "Couldn't set the rate limit of '%s' requests. Exiting.\n", rate_limits[i].name);
+            logger_kill(logger);
+            return 1;
+        }
+    }
+
     DHT *dht = new_DHT(logger, net, true);
 
     if (dht == nullptr) {
@@ -258,6 +346,12 @@ int main(int argc, char *argv[])
         return 1;
     }
 
+    if (dht_set_shared_key_cache_size(dht, shared_key_cache_size) != 0) {
+        log_write(LOG_LEVEL_ERROR, "Couldn't allocate a shared key cache of %d keys. Exiting.\n", shared_key_cache_size);
+        logger_kill(logger);
+        return 1;
+    }
+
     Onion *onion = new_onion(dht);
     Onion_Announce *onion_a = new_onion_announce(dht);
 
@@ -275,8 +369,6 @@ int main(int argc, char *argv[])
             logger_kill(logger);
             return 1;
         }
-
-        free(motd);
     }
 
     if (manage_keys(dht, keys_file_path)) {
@@ -289,6 +381,24 @@ int main(int argc, char *argv[])
 
     free(keys_file_path);
 
+    Workers *workers = nullptr;
+
+    if (udp_worker_threads > 0) {
+        workers = workers_start(udp_worker_threads, dht, onion, ip, port, enable_motd ? motd : nullptr);
+
+        if (workers != nullptr) {
+            log_write(LOG_LEVEL_INFO, "Started %d UDP worker threads successfully.\n", udp_worker_threads);
+        } else {
+            log_write(LOG_LEVEL_ERROR, "Couldn't start UDP worker threads. Exiting.\n");
+            logger_kill(logger);
+            return 1;
+        }
+    }
+
+    if (enable_motd) {
+        free(motd);
+    }
+
     TCP_Server *tcp_server = nullptr;
 
     if (enable_tcp_relay) {
@@ -323,6 +433,7 @@ int main(int argc, char *argv[])
     print_public_key(dht_get_self_public_key(dht));
 
     uint64_t last_LANdiscovery = 0;
+    uint64_t last_shared_key_stats = unix_time();
     const uint16_t net_htons_port = net_htons(port);
 
     int waiting_for_dht_connection = 1;
@@ -346,11 +457,21 @@ int main(int argc, char *argv[])
 
         networking_poll(dht_get_net(dht), nullptr);
 
+        if (workers != nullptr) {
+            workers_do(workers);
+        }
+
         if (waiting_for_dht_connection && DHT_isconnected(dht)) {
             log_write(LOG_LEVEL_INFO, "Connected to another bootstrap node successfully.\n");
             waiting_for_dht_connection = 0;
         }
 
+        if (is_timeout(last_shared_key_stats, SHARED_KEY_STATS_INTERVAL)) {
+            log_shared_key_cache_stats(dht);
+            log_rate_limited(dht_get_net(dht), rate_limits);
+            last_shared_key_stats = unix_time();
+        }
+
         SLEEP_MILLISECONDS(30);
     }
 }
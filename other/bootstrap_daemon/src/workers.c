@@ -0,0 +1,430 @@
+/*
+ * Tox DHT bootstrap daemon.
+ * UDP worker threads sharing the DHT port through SO_REUSEPORT.
+ */
+
+/*
+ * Copyright © 2016-2017 The TokTok team.
+ * Copyright © 2014-2016 Tox project.
+ *
+ * This file is part of Tox, the free peer to peer instant messenger.
+ *
+ * Tox is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Tox is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Tox.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#define _XOPEN_SOURCE 600
+
+#include "workers.h"
+
+#include "global.h"
+#include "log.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../../../toxcore/logger.h"
+#include "../../../toxcore/ping.h"
+#include "../../../toxcore/util.h"
+#include "../../bootstrap_node_packets.h"
+
+// Packets a worker can queue for the main thread between two workers_do() calls,
+// anything beyond that is dropped.
+#define FORWARD_QUEUE_SIZE 256
+
+// How often the workers get a fresh copy of the main DHT's close list, in seconds.
+#define CLOSE_LIST_SYNC_INTERVAL 5
+
+// How long a worker sleeps after a poll that didn't receive anything.
+#define WORKER_IDLE_SLEEP_MILLISECONDS 5
+
+typedef struct Forwarded_Packet {
+    IP_Port ip_port;
+    // The worker already answered the packet, the main thread only learns about
+    // its sender from it.
+    bool answered;
+    uint16_t length;
+    uint8_t data[MAX_UDP_PACKET_SIZE];
+} Forwarded_Packet;
+
+// Requests the worker answers itself, but whose senders the main DHT should
+// still learn about (and ping), as it does for the requests it receives.
+static const uint8_t answered_request_types[] = {
+    NET_PACKET_PING_REQUEST,
+    NET_PACKET_GET_NODES,
+};
+
+typedef struct Worker {
+    Workers *workers;
+    pthread_t thread;
+    bool running;
+
+    // Only touched by the worker thread once it runs.
+    Logger *logger;
+    Networking_Core *net;
+    DHT *dht;
+    Onion *onion;
+    uint32_t close_list_version;
+
+    // The DHT's own handlers of the requests that wrap_answered_request() wraps.
+    packet_handler_callback request_handlers[sizeof(answered_request_types)];
+    void *request_handler_objects[sizeof(answered_request_types)];
+
+    // Packets for the main thread, guarded by queue_mutex.
+    pthread_mutex_t queue_mutex;
+    Forwarded_Packet *queue;
+    uint32_t queue_length;
+} Worker;
+
+struct Workers {
+    // Guards the fields up to close_list_version.
+    pthread_mutex_t mutex;
+    bool stop;
+    uint8_t onion_key[CRYPTO_SYMMETRIC_KEY_SIZE];
+    uint64_t onion_key_timestamp;
+    Client_data *close_list;
+    uint32_t close_list_version;
+
+    // Only touched by the main thread.
+    DHT *dht;
+    Onion *onion;
+    uint64_t last_close_list_sync;
+    Forwarded_Packet *spare_queue;
+
+    Worker *workers;
+    uint32_t count;
+};
+
+// Packets whose handlers need state that only exists in the main thread: the
+// responses to its own requests, its friends (NAT ping), LAN discovery, the
+// onion announce store and the TCP relay's clients (onion recv 1).
+static const uint8_t forwarded_packet_types[] = {
+    NET_PACKET_PING_RESPONSE,
+    NET_PACKET_SEND_NODES_IPV6,
+    NET_PACKET_CRYPTO,
+    NET_PACKET_LAN_DISCOVERY,
+    NET_PACKET_ANNOUNCE_REQUEST,
+    NET_PACKET_ONION_DATA_REQUEST,
+    NET_PACKET_ONION_RECV_1,
+};
+
+static int queue_for_main_thread(Worker *worker, IP_Port source, const uint8_t *packet, uint16_t length,
+                                 bool answered)
+{
+    if (length > MAX_UDP_PACKET_SIZE) {
+        return 1;
+    }
+
+    pthread_mutex_lock(&worker->queue_mutex);
+
+    if (worker->queue_length == FORWARD_QUEUE_SIZE) {
+        pthread_mutex_unlock(&worker->queue_mutex);
+        return 1;
+    }
+
+    Forwarded_Packet *forwarded = &worker->queue[worker->queue_length];
+    forwarded->ip_port = source;
+    forwarded->answered = answered;
+    forwarded->length = length;
+    memcpy(forwarded->data, packet, length);
+    ++worker->queue_length;
+
+    pthread_mutex_unlock(&worker->queue_mutex);
+    return 0;
+}
+
+static int forward_to_main_thread(void *object, IP_Port source, const uint8_t *packet, uint16_t length,
+                                  void *userdata)
+{
+    return queue_for_main_thread((Worker *)object, source, packet, length, false);
+}
+
+static int handle_answered_request(void *object, IP_Port source, const uint8_t *packet, uint16_t length,
+                                   void *userdata)
+{
+    Worker *worker = (Worker *)object;
+
+    for (size_t i = 0; i < sizeof(answered_request_types); ++i) {
+        if (answered_request_types[i] != packet[0]) {
+            continue;
+        }
+
+        const int ret = worker->request_handlers[i](worker->request_handler_objects[i], source, packet, length, userdata);
+
+        // Only tell the main thread about senders of valid requests.
+        if (ret == 0) {
+            queue_for_main_thread(worker, source, packet, length, true);
+        }
+
+        return ret;
+    }
+
+    return 1;
+}
+
+// Makes `onion` and the shared state agree on the newest onion key. Whichever
+// thread rotated the key last wins, so a rotation done by any handler reaches
+// all threads within a loop iteration.
+//
+// Must be called with workers->mutex held.
+static void sync_onion_key(Workers *workers, Onion *onion)
+{
+    if (onion->timestamp > workers->onion_key_timestamp) {
+        memcpy(workers->onion_key, onion->secret_symmetric_key, CRYPTO_SYMMETRIC_KEY_SIZE);
+        workers->onion_key_timestamp = onion->timestamp;
+    } else {
+        memcpy(onion->secret_symmetric_key, workers->onion_key, CRYPTO_SYMMETRIC_KEY_SIZE);
+        onion->timestamp = workers->onion_key_timestamp;
+    }
+}
+
+static void *worker_thread(void *arg)
+{
+    Worker *worker = (Worker *)arg;
+    Workers *workers = worker->workers;
+
+    while (1) {
+        pthread_mutex_lock(&workers->mutex);
+
+        if (workers->stop) {
+            pthread_mutex_unlock(&workers->mutex);
+            break;
+        }
+
+        sync_onion_key(workers, worker->onion);
+
+        if (worker->close_list_version != workers->close_list_version) {
+            dht_set_close_clientlist(worker->dht, workers->close_list);
+            worker->close_list_version = workers->close_list_version;
+        }
+
+        pthread_mutex_unlock(&workers->mutex);
+
+        networking_poll(worker->net, nullptr);
+
+        if (net_recv_stats(worker->net)->last_poll_packets == 0) {
+            usleep(1000 * WORKER_IDLE_SLEEP_MILLISECONDS);
+        }
+    }
+
+    return nullptr;
+}
+
+static void worker_kill(Worker *worker)
+{
+    kill_onion(worker->onion);
+
+    if (worker->dht != nullptr) {
+        kill_DHT(worker->dht);
+    }
+
+    kill_networking(worker->net);
+    logger_kill(worker->logger);
+    free(worker->queue);
+    pthread_mutex_destroy(&worker->queue_mutex);
+}
+
+// @return 1 on success,
+//         0 on failure, in which case nothing needs to be freed.
+static int worker_init(Worker *worker, Workers *workers, IP ip, uint16_t port, const char *motd)
+{
+    worker->workers = workers;
+    worker->queue = (Forwarded_Packet *)calloc(FORWARD_QUEUE_SIZE, sizeof(Forwarded_Packet));
+
+    if (worker->queue == nullptr || pthread_mutex_init(&worker->queue_mutex, nullptr) != 0) {
+        free(worker->queue);
+        return 0;
+    }
+
+    worker->logger = logger_new();
+    worker->net = new_networking_reuseport(worker->logger, ip, port, nullptr);
+    worker->dht = worker->net ? new_DHT(worker->logger, worker->net, true) : nullptr;
+    worker->onion = worker->dht ? new_onion(worker->dht) : nullptr;
+
+    if (worker->onion == nullptr) {
+        worker_kill(worker);
+        return 0;
+    }
+
+    // The main thread keeps the time, the workers only read it.
+    networking_set_update_time(worker->net, false);
+
+    dht_set_self_public_key(worker->dht, dht_get_self_public_key(workers->dht));
+    dht_set_self_secret_key(worker->dht, dht_get_self_secret_key(workers->dht));
+
+    Shared_Key_Cache_Stats shared_keys;
+    dht_get_shared_key_cache_stats(workers->dht, &shared_keys);
+
+    if (dht_set_shared_key_cache_size(worker->dht, shared_keys.capacity) != 0) {
+        worker_kill(worker);
+        return 0;
+    }
+
+    // The kernel hashes a source to the same worker, so each one can keep its
+    // own buckets.
+    for (uint32_t i = 0; i < 256; ++i) {
+        uint32_t rate;
+        uint32_t burst;
+        networking_get_rate_limit(dht_get_net(workers->dht), i, &rate, &burst);
+
+        if (rate != 0 && networking_set_rate_limit(worker->net, i, rate, burst) != 0) {
+            worker_kill(worker);
+            return 0;
+        }
+    }
+
+    if (motd != nullptr
+            && bootstrap_set_callbacks(worker->net, DAEMON_VERSION_NUMBER, (const uint8_t *)motd, strlen(motd) + 1) != 0) {
+        worker_kill(worker);
+        return 0;
+    }
+
+    for (size_t i = 0; i < sizeof(answered_request_types); ++i) {
+        worker->request_handlers[i] = networking_get_handler(worker->net, answered_request_types[i],
+                                      &worker->request_handler_objects[i]);
+        networking_registerhandler(worker->net, answered_request_types[i], &handle_answered_request, worker);
+    }
+
+    for (size_t i = 0; i < sizeof(forwarded_packet_types); ++i) {
+        networking_registerhandler(worker->net, forwarded_packet_types[i], &forward_to_main_thread, worker);
+    }
+
+    // Everything else, e.g. cookie requests, goes to the main thread too, which
+    // handles or drops it as it does without workers.
+    for (uint32_t i = 0; i < 256; ++i) {
+        void *object;
+
+        if (networking_get_handler(worker->net, i, &object) == nullptr) {
+            networking_registerhandler(worker->net, i, &forward_to_main_thread, worker);
+        }
+    }
+
+    return 1;
+}
+
+Workers *workers_start(uint32_t count, DHT *dht, Onion *onion, IP ip, uint16_t port, const char *motd)
+{
+    Workers *workers = (Workers *)calloc(1, sizeof(Workers));
+
+    if (workers == nullptr) {
+        return nullptr;
+    }
+
+    workers->dht = dht;
+    workers->onion = onion;
+    workers->workers = (Worker *)calloc(count, sizeof(Worker));
+    workers->close_list = (Client_data *)calloc(LCLIENT_LIST, sizeof(Client_data));
+    workers->spare_queue = (Forwarded_Packet *)calloc(FORWARD_QUEUE_SIZE, sizeof(Forwarded_Packet));
+
+    if (workers->workers == nullptr || workers->close_list == nullptr || workers->spare_queue == nullptr
+            || pthread_mutex_init(&workers->mutex, nullptr) != 0) {
+        free(workers->spare_queue);
+        free(workers->close_list);
+        free(workers->workers);
+        free(workers);
+        return nullptr;
+    }
+
+    memcpy(workers->onion_key, onion->secret_symmetric_key, CRYPTO_SYMMETRIC_KEY_SIZE);
+    workers->onion_key_timestamp = onion->timestamp;
+
+    // Set up every worker before starting any thread: bootstrap_set_callbacks()
+    // writes globals that the threads read.
+    while (workers->count < count) {
+        if (!worker_init(&workers->workers[workers->count], workers, ip, port, motd)) {
+            log_write(LOG_LEVEL_ERROR, "Couldn't initialize UDP worker #%u.\n", workers->count);
+            workers_stop(workers);
+            return nullptr;
+        }
+
+        ++workers->count;
+    }
+
+    for (uint32_t i = 0; i < workers->count; ++i) {
+        Worker *worker = &workers->workers[i];
+
+        if (pthread_create(&worker->thread, nullptr, &worker_thread, worker) != 0) {
+            log_write(LOG_LEVEL_ERROR, "Couldn't start UDP worker thread #%u.\n", i);
+            workers_stop(workers);
+            return nullptr;
+        }
+
+        worker->running = true;
+    }
+
+    return workers;
+}
+
+void workers_do(Workers *workers)
+{
+    pthread_mutex_lock(&workers->mutex);
+
+    sync_onion_key(workers, workers->onion);
+
+    if (is_timeout(workers->last_close_list_sync, CLOSE_LIST_SYNC_INTERVAL)) {
+        memcpy(workers->close_list, dht_get_close_clientlist(workers->dht), LCLIENT_LIST * sizeof(Client_data));
+        ++workers->close_list_version;
+        workers->last_close_list_sync = unix_time();
+    }
+
+    pthread_mutex_unlock(&workers->mutex);
+
+    Networking_Core *net = dht_get_net(workers->dht);
+
+    for (uint32_t i = 0; i < workers->count; ++i) {
+        Worker *worker = &workers->workers[i];
+
+        // Swap queues so the worker isn't blocked while we handle its packets.
+        pthread_mutex_lock(&worker->queue_mutex);
+        Forwarded_Packet *queue = worker->queue;
+        const uint32_t queue_length = worker->queue_length;
+        worker->queue = workers->spare_queue;
+        worker->queue_length = 0;
+        pthread_mutex_unlock(&worker->queue_mutex);
+
+        for (uint32_t j = 0; j < queue_length; ++j) {
+            if (queue[j].answered) {
+                // Both requests start with the sender's DHT public key.
+                ping_add(dht_get_ping(workers->dht), queue[j].data + 1, queue[j].ip_port);
+            } else {
+                networking_dispatch(net, queue[j].ip_port, queue[j].data, queue[j].length, nullptr);
+            }
+        }
+
+        workers->spare_queue = queue;
+    }
+}
+
+void workers_stop(Workers *workers)
+{
+    pthread_mutex_lock(&workers->mutex);
+    workers->stop = true;
+    pthread_mutex_unlock(&workers->mutex);
+
+    for (uint32_t i = 0; i < workers->count; ++i) {
+        Worker *worker = &workers->workers[i];
+
+        if (worker->running) {
+            pthread_join(worker->thread, nullptr);
+        }
+
+        worker_kill(worker);
+    }
+
+    pthread_mutex_destroy(&workers->mutex);
+    free(workers->spare_queue);
+    free(workers->close_list);
+    free(workers->workers);
+    free(workers);
+}
@@ -0,0 +1,62 @@
+/*
+ * Tox DHT bootstrap daemon.
+ * UDP worker threads sharing the DHT port through SO_REUSEPORT.
+ */
+
+/*
+ * Copyright © 2016-2017 The TokTok team.
+ * Copyright © 2014-2016 Tox project.
+ *
+ * This file is part of Tox, the free peer to peer instant messenger.
+ *
+ * Tox is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Tox is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Tox.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef WORKERS_H
+#define WORKERS_H
+
+#include "../../../toxcore/onion.h"
+
+typedef struct Workers Workers;
+
+/**
+ * Starts `count` UDP worker threads. Each one binds its own SO_REUSEPORT socket
+ * to `port` (in host byte order), which `dht`'s socket must also be bound to
+ * with SO_REUSEPORT, so that the kernel spreads incoming packets over all of
+ * them by source address.
+ *
+ * A worker answers the requests that don't need any state of the main thread:
+ * pings, get nodes (from a copy of `dht`'s close list), onion routing and
+ * bootstrap info (if `motd` is not NULL). All other packets are queued for the
+ * main thread, see workers_do(). The workers' sockets get the rate limits of
+ * `dht`'s socket.
+ *
+ * @return Workers on success,
+ *         NULL on failure.
+ */
+Workers *workers_start(uint32_t count, DHT *dht, Onion *onion, IP ip, uint16_t port, const char *motd);
+
+/**
+ * Hands the packets queued by the workers to the handlers of `dht`'s socket and
+ * keeps the workers' close lists and onion keys in sync with `dht` and `onion`.
+ *
+ * Must be called from the main loop, i.e. the thread that runs `dht`.
+ */
+void workers_do(Workers *workers);
+
+/**
+ * Stops and joins the worker threads and frees `workers`.
+ */
+void workers_stop(Workers *workers);
+
+#endif // WORKERS_H
@@ -6,20 +6,27 @@
 #include "../toxcore/TCP_client.c"
 #include "../toxcore/TCP_connection.c"
 #include "../toxcore/TCP_server.c"
+#include "../toxcore/congestion.c"
 #include "../toxcore/crypto_core.c"
 #include "../toxcore/crypto_core_mem.c"
+#include "../toxcore/crypto_pool.c"
 #include "../toxcore/friend_connection.c"
 #include "../toxcore/friend_requests.c"
 #include "../toxcore/group.c"
-#include "../toxcore/list.c"
+#include "../toxcore/hash_table.c"
 #include "../toxcore/logger.c"
 #include "../toxcore/network.c"
+#include "../toxcore/network_uring.c"
 #include "../toxcore/net_crypto.c"
 #include "../toxcore/onion.c"
 #include "../toxcore/onion_announce.c"
 #include "../toxcore/onion_client.c"
 #include "../toxcore/ping.c"
 #include "../toxcore/ping_array.c"
+#include "../toxcore/rate_limiter.c"
+#include "../toxcore/resolver.c"
+#include "../toxcore/shared_key_cache.c"
+#include "../toxcore/timer_wheel.c"
 #include "../toxcore/tox_api.c"
 #include "../toxcore/util.c"
 
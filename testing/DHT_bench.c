@@ -0,0 +1,496 @@
+/* DHT benchmark
+ * Measures the per-packet cost of the close list lookups done for incoming
+ * DHT packets: finding the nodes closest to a key for a send nodes response,
+ * finding a node by its key, and adding a node from a received packet.
+ *
+ * Each is compared to a scan over the whole close list, which is what finding
+ * them took before the list was searched bucket by bucket. The close list
+ * layout and the work done per node are the same for both.
+ *
+ * It also measures the key distance comparisons all of these are built on,
+ * against the byte at a time versions, and adding a node to an ordered friend
+ * list, against sorting the whole list for it.
+ *
+ * Then it adds NUM_FRIENDS friends, and measures offering nodes to them in
+ * addto_lists() through the friend index, against offering each node to
+ * every friend.
+ *
+ * Usage: ./DHT_bench [iterations]
+ */
+
+/*
+ * Copyright © 2016-2018 The TokTok team.
+ *
+ * This file is part of Tox, the free peer to peer instant messenger.
+ *
+ * Tox is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Tox is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Tox.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+/* Included for the static functions, to compare them with the list scans
+ * they replaced. */
+#include "../toxcore/DHT.c"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define BENCH_PORT 33545
+#define NUM_KEYS 1024
+#define SORT_NODES 128
+#define NUM_FRIENDS 10000
+
+static uint8_t keys[NUM_KEYS][CRYPTO_PUBLIC_KEY_SIZE];
+static uint8_t close_keys[NUM_KEYS][CRYPTO_PUBLIC_KEY_SIZE];
+static IP_Port addrs[NUM_KEYS];
+
+/* A key sharing exactly `bits` leading bits with base_key. */
+static void key_with_prefix(uint8_t *public_key, const uint8_t *base_key, unsigned int bits)
+{
+    random_bytes(public_key, CRYPTO_PUBLIC_KEY_SIZE);
+
+    for (unsigned int i = 0; i < bits; ++i) {
+        const uint8_t mask = 1 << (7 - i % 8);
+        public_key[i / 8] = (public_key[i / 8] & ~mask) | (base_key[i / 8] & mask);
+    }
+
+    public_key[bits / 8] ^= (public_key[bits / 8] ^ ~base_key[bits / 8]) & (1 << (7 - bits % 8));
+}
+
+/* The byte at a time key comparisons. */
+static int bytewise_id_closest(const uint8_t *pk, const uint8_t *pk1, const uint8_t *pk2)
+{
+    for (size_t i = 0; i < CRYPTO_PUBLIC_KEY_SIZE; ++i) {
+        const uint8_t distance1 = pk[i] ^ pk1[i];
+        const uint8_t distance2 = pk[i] ^ pk2[i];
+
+        if (distance1 < distance2) {
+            return 1;
+        }
+
+        if (distance1 > distance2) {
+            return 2;
+        }
+    }
+
+    return 0;
+}
+
+static unsigned int bytewise_bit_by_bit_cmp(const uint8_t *pk1, const uint8_t *pk2)
+{
+    unsigned int i;
+    unsigned int j = 0;
+
+    for (i = 0; i < CRYPTO_PUBLIC_KEY_SIZE; ++i) {
+        if (pk1[i] == pk2[i]) {
+            continue;
+        }
+
+        for (j = 0; j < 8; ++j) {
+            const uint8_t mask = 1 << (7 - j);
+
+            if ((pk1[i] & mask) != (pk2[i] & mask)) {
+                break;
+            }
+        }
+
+        break;
+    }
+
+    return i * 8 + j;
+}
+
+typedef struct {
+    const uint8_t *base_public_key;
+    Client_data entry;
+} Sorting_Cmp_data;
+
+#define SORTING_BAD(assoc) is_timeout((assoc).timestamp, BAD_NODE_TIMEOUT)
+#define SORTING_INCORRECT_HARDENING(assoc) hardening_correct(&(assoc).hardening) != HARDENING_ALL_OK
+
+/* cmp_dht_entry() as it was before the lists were kept ordered. */
+static int sorting_cmp_dht_entry(const void *a, const void *b)
+{
+    const Client_data *const entry1 = &((const Sorting_Cmp_data *)a)->entry;
+    const Client_data *const entry2 = &((const Sorting_Cmp_data *)b)->entry;
+    const uint8_t *cmp_public_key = ((const Sorting_Cmp_data *)a)->base_public_key;
+
+    bool t1 = SORTING_BAD(entry1->assoc4) && SORTING_BAD(entry1->assoc6);
+    bool t2 = SORTING_BAD(entry2->assoc4) && SORTING_BAD(entry2->assoc6);
+
+    if (t1 || t2) {
+        return t1 == t2 ? 0 : (t1 ? -1 : 1);
+    }
+
+    t1 = SORTING_INCORRECT_HARDENING(entry1->assoc4) && SORTING_INCORRECT_HARDENING(entry1->assoc6);
+    t2 = SORTING_INCORRECT_HARDENING(entry2->assoc4) && SORTING_INCORRECT_HARDENING(entry2->assoc6);
+
+    if (t1 != t2) {
+        return t1 ? -1 : 1;
+    }
+
+    const int close = id_closest(cmp_public_key, entry1->public_key, entry2->public_key);
+    return close == 1 ? 1 : (close == 2 ? -1 : 0);
+}
+
+/* replace_all() as it was: sorting a copy of the whole list for every node. */
+static bool sorting_replace_all(Client_data *list, uint16_t length, const uint8_t *public_key, IP_Port ip_port,
+                                const uint8_t *comp_public_key)
+{
+    if (!store_node_ok(&list[1], public_key, comp_public_key) &&
+            !store_node_ok(&list[0], public_key, comp_public_key)) {
+        return false;
+    }
+
+    VLA(Sorting_Cmp_data, cmp_list, length);
+
+    for (uint32_t i = 0; i < length; i++) {
+        cmp_list[i].base_public_key = comp_public_key;
+        cmp_list[i].entry = list[i];
+    }
+
+    qsort(cmp_list, length, sizeof(Sorting_Cmp_data), sorting_cmp_dht_entry);
+
+    for (uint32_t i = 0; i < length; i++) {
+        list[i] = cmp_list[i].entry;
+    }
+
+    id_copy(list[0].public_key, public_key);
+    update_client_with_reset(&list[0], &ip_port);
+    return true;
+}
+
+/* The friend part of addto_lists() before the friend index. */
+static uint32_t scan_addto_friends(DHT *dht, IP_Port ip_port, const uint8_t *public_key)
+{
+    uint32_t used = 0;
+
+    for (uint32_t i = 0; i < dht->num_friends; ++i) {
+        const bool in_list = client_or_ip_port_in_list(dht->log, dht->friends_list[i].client_list,
+                             MAX_FRIEND_CLIENTS, public_key, ip_port, dht->friends_list[i].public_key);
+
+        if (in_list || replace_all(dht->friends_list[i].client_list, MAX_FRIEND_CLIENTS, public_key,
+                                   ip_port, dht->friends_list[i].public_key)) {
+            /* Keeps the index right for the other measurements. */
+            friend_reindex(dht, i);
+            used++;
+        }
+    }
+
+    return used;
+}
+
+static uint32_t scan_friend_number(const DHT *dht, const uint8_t *public_key)
+{
+    for (uint32_t i = 0; i < dht->num_friends; ++i) {
+        if (id_equal(dht->friends_list[i].public_key, public_key)) {
+            return i;
+        }
+    }
+
+    return UINT32_MAX;
+}
+
+static double ns_per_op(clock_t start, uint32_t iterations)
+{
+    return (double)(clock() - start) * 1000000000.0 / CLOCKS_PER_SEC / iterations;
+}
+
+static void print_result(const char *name, double buckets, double scan)
+{
+    printf("%-24s %10.1f ns %10.1f ns %8.2fx\n", name, buckets, scan, buckets > 0 ? scan / buckets : 0.0);
+}
+
+/* ns per node added to a full list of length nodes close to comp_public_key,
+ * by replace_all() or the sorting version. The first node is made bad before
+ * each, so that both take it: it is the one both replace.
+ */
+static double replace_ns(bool sorting, uint32_t length, const uint8_t *comp_public_key, uint32_t iterations)
+{
+    Client_data list[SORT_NODES];
+    memset(list, 0, sizeof(list));
+
+    for (uint32_t i = 0; i < length; ++i) {
+        replace_all(list, length, close_keys[i], addrs[i], comp_public_key);
+    }
+
+    const clock_t start = clock();
+
+    for (uint32_t i = 0; i < iterations; ++i) {
+        const uint32_t k = (i * 7919) % NUM_KEYS;
+        list[0].assoc4.timestamp = 0;
+        list[0].assoc6.timestamp = 0;
+
+        if (sorting) {
+            sorting_replace_all(list, length, close_keys[k], addrs[k], comp_public_key);
+        } else {
+            replace_all(list, length, close_keys[k], addrs[k], comp_public_key);
+        }
+    }
+
+    return ns_per_op(start, iterations);
+}
+
+int main(int argc, char *argv[])
+{
+    const uint32_t iterations = argc > 1 ? (uint32_t)atoi(argv[1]) : 1000000;
+
+    if (iterations == 0) {
+        printf("usage: %s [iterations]\n", argv[0]);
+        return 1;
+    }
+
+    IP ip;
+    ip_init(&ip, 0);
+    Logger *log = logger_new();
+    Networking_Core *net = new_networking(log, ip, BENCH_PORT);
+    DHT *dht = new_DHT(log, net, true);
+
+    if (dht == nullptr) {
+        printf("failed to create DHT\n");
+        return 1;
+    }
+
+    /* Fill the close list, with the nodes spread over the buckets the way
+     * they are on the network: half of them in bucket 0, a quarter in bucket
+     * 1, and so on. */
+    for (uint32_t i = 0; i < NUM_KEYS; ++i) {
+        unsigned int bits = 0;
+
+        while (bits < 32 && (random_u32() & 1)) {
+            ++bits;
+        }
+
+        key_with_prefix(keys[i], dht_get_self_public_key(dht), bits);
+        addrs[i].ip.family = net_family_ipv4;
+        addrs[i].ip.ip.v4.uint32 = random_u32();
+        addrs[i].port = net_htons(BENCH_PORT + 1 + i % 1000);
+        addto_lists(dht, addrs[i], keys[i]);
+    }
+
+    uint32_t num_close = 0;
+
+    for (uint32_t i = 0; i < LCLIENT_LIST; ++i) {
+        num_close += dht->close_clientlist[i].assoc4.timestamp != 0;
+    }
+
+    printf("%u nodes in the close list, %u iterations\n", num_close, iterations);
+    printf("%-24s %13s %13s %9s\n", "", "buckets", "list scan", "speedup");
+
+    Node_format nodes[MAX_SENT_NODES];
+    uint32_t found = 0;
+    clock_t start;
+
+    /* The closest nodes, for send nodes responses. */
+    start = clock();
+
+    for (uint32_t i = 0; i < iterations; ++i) {
+        uint32_t num_nodes = 0;
+        get_close_nodes_close_list(dht, keys[i % NUM_KEYS], nodes, net_family_ipv4, &num_nodes, 1, 0);
+        found += num_nodes;
+    }
+
+    const double close_buckets = ns_per_op(start, iterations);
+    start = clock();
+
+    for (uint32_t i = 0; i < iterations; ++i) {
+        uint32_t num_nodes = 0;
+        get_close_nodes_inner(keys[i % NUM_KEYS], nodes, net_family_ipv4, dht->close_clientlist, LCLIENT_LIST,
+                              &num_nodes, 1, 0);
+        found += num_nodes;
+    }
+
+    print_result("closest nodes", close_buckets, ns_per_op(start, iterations));
+
+    /* Finding the sender of a packet in the list, for every packet that
+     * reaches addto_lists(). */
+    start = clock();
+
+    for (uint32_t i = 0; i < iterations; ++i) {
+        found += close_client_or_ip_port_in_list(dht, keys[i % NUM_KEYS], addrs[i % NUM_KEYS]);
+    }
+
+    const double in_list_buckets = ns_per_op(start, iterations);
+    start = clock();
+
+    for (uint32_t i = 0; i < iterations; ++i) {
+        found += index_of_client_pk(dht->close_clientlist, LCLIENT_LIST, keys[i % NUM_KEYS]) != UINT32_MAX
+                 || index_of_client_ip_port(dht->close_clientlist, LCLIENT_LIST, &addrs[i % NUM_KEYS]) != UINT32_MAX;
+    }
+
+    const double in_list_scan = ns_per_op(start, iterations);
+    print_result("sender lookup", in_list_buckets, in_list_scan);
+
+    /* Finding a node by its key, for routed packets and pings. */
+    start = clock();
+
+    for (uint32_t i = 0; i < iterations; ++i) {
+        found += index_of_close_pk(dht, keys[i % NUM_KEYS]) != UINT32_MAX;
+    }
+
+    const double pk_buckets = ns_per_op(start, iterations);
+    start = clock();
+
+    for (uint32_t i = 0; i < iterations; ++i) {
+        found += index_of_client_pk(dht->close_clientlist, LCLIENT_LIST, keys[i % NUM_KEYS]) != UINT32_MAX;
+    }
+
+    print_result("key lookup", pk_buckets, ns_per_op(start, iterations));
+
+    /* A whole received packet: addto_lists() for a node already known. The
+     * sender lookup is the only part of it that used to scan the close list,
+     * so the old cost is what the lookup took on top of the rest. */
+    start = clock();
+
+    for (uint32_t i = 0; i < iterations; ++i) {
+        found += addto_lists(dht, addrs[i % NUM_KEYS], keys[i % NUM_KEYS]);
+    }
+
+    const double addto_buckets = ns_per_op(start, iterations);
+    print_result("addto_lists", addto_buckets, addto_buckets - in_list_buckets + in_list_scan);
+
+    printf("\n%-24s %13s %13s %9s\n", "", "word/simd", "bytewise", "speedup");
+
+    /* Keys sharing a prefix of 0 to 31 bytes with each other and with the
+     * key they are compared to, as for the nodes in a list sorted by distance
+     * to a key once it has filled up with the closest ones. */
+    for (uint32_t i = 0; i < NUM_KEYS; ++i) {
+        key_with_prefix(close_keys[i], dht->self_public_key, (i % CRYPTO_PUBLIC_KEY_SIZE) * 8 + random_u32() % 8);
+    }
+
+    const struct {
+        const char *name;
+        uint8_t (*keys)[CRYPTO_PUBLIC_KEY_SIZE];
+    } key_sets[] = {
+        {"unrelated keys", keys},
+        {"keys with prefixes", close_keys},
+    };
+
+    for (size_t k = 0; k < sizeof(key_sets) / sizeof(key_sets[0]); ++k) {
+        uint8_t (*const set)[CRYPTO_PUBLIC_KEY_SIZE] = key_sets[k].keys;
+        printf("%s:\n", key_sets[k].name);
+        start = clock();
+
+        for (uint32_t i = 0; i < iterations; ++i) {
+            found += id_closest(dht->self_public_key, set[i % NUM_KEYS], set[(i + 1) % NUM_KEYS]);
+        }
+
+        const double closest_words = ns_per_op(start, iterations);
+        start = clock();
+
+        for (uint32_t i = 0; i < iterations; ++i) {
+            found += bytewise_id_closest(dht->self_public_key, set[i % NUM_KEYS], set[(i + 1) % NUM_KEYS]);
+        }
+
+        print_result("  id_closest", closest_words, ns_per_op(start, iterations));
+        start = clock();
+
+        for (uint32_t i = 0; i < iterations; ++i) {
+            found += bit_by_bit_cmp(dht->self_public_key, set[i % NUM_KEYS]);
+        }
+
+        const double bits_words = ns_per_op(start, iterations);
+        start = clock();
+
+        for (uint32_t i = 0; i < iterations; ++i) {
+            found += bytewise_bit_by_bit_cmp(dht->self_public_key, set[i % NUM_KEYS]);
+        }
+
+        print_result("  bit_by_bit_cmp", bits_words, ns_per_op(start, iterations));
+    }
+
+    /* Adding a node to a friend's list, and to a list as long as the onion
+     * announce entries. */
+    printf("\n%-24s %13s %13s %9s\n", "", "ordered", "qsort", "speedup");
+    const uint32_t sorts = iterations / 100 > 0 ? iterations / 100 : 1;
+    const uint32_t lengths[] = { MAX_FRIEND_CLIENTS, SORT_NODES };
+
+    for (size_t i = 0; i < sizeof(lengths) / sizeof(lengths[0]); ++i) {
+        char name[32];
+        snprintf(name, sizeof(name), "add to %u nodes", lengths[i]);
+        print_result(name, replace_ns(false, lengths[i], dht->self_public_key, sorts),
+                     replace_ns(true, lengths[i], dht->self_public_key, sorts));
+    }
+
+    /* Friends whose lists are full of nodes close to them, as they are once
+     * they were found. No lookups, they would send packets. */
+    dht_set_lookup_parallelism(dht, 0);
+
+    for (uint32_t i = 0; i < NUM_FRIENDS; ++i) {
+        uint8_t friend_key[CRYPTO_PUBLIC_KEY_SIZE];
+        random_bytes(friend_key, sizeof(friend_key));
+
+        if (DHT_addfriend(dht, friend_key, nullptr, nullptr, 0, nullptr) != 0) {
+            printf("failed to add friend %u\n", i);
+            return 1;
+        }
+
+        for (uint32_t j = 0; j < MAX_FRIEND_CLIENTS * 2; ++j) {
+            uint8_t node_key[CRYPTO_PUBLIC_KEY_SIZE];
+            key_with_prefix(node_key, friend_key, 16 + random_u32() % 8);
+            IP_Port ip_port = addrs[j];
+            ip_port.ip.ip.v4.uint32 = random_u32();
+            addto_lists(dht, ip_port, node_key);
+        }
+    }
+
+    printf("\n%u friends, %u taking any node\n", dht->num_friends, dht->num_open_friends);
+    printf("%-24s %13s %13s %9s\n", "", "index", "friend scan", "speedup");
+
+    /* Friends from all over the list, 7919 being a prime. */
+    start = clock();
+
+    for (uint32_t i = 0; i < iterations; ++i) {
+        found += friend_number(dht, dht->friends_list[(i * 7919) % dht->num_friends].public_key);
+    }
+
+    const double number_index = ns_per_op(start, iterations);
+    const uint32_t scans = iterations / 1000 > 0 ? iterations / 1000 : 1;
+    start = clock();
+
+    for (uint32_t i = 0; i < scans; ++i) {
+        found += scan_friend_number(dht, dht->friends_list[(i * 7919) % dht->num_friends].public_key);
+    }
+
+    print_result("friend key lookup", number_index, ns_per_op(start, scans));
+
+    /* The nodes from before, unrelated to the friends: most nodes a packet
+     * comes from can't go in any friend's list. The close list part is the
+     * sender lookup measured above. */
+    start = clock();
+
+    for (uint32_t i = 0; i < iterations; ++i) {
+        found += addto_lists(dht, addrs[i % NUM_KEYS], keys[i % NUM_KEYS]);
+    }
+
+    const double addto_index = ns_per_op(start, iterations);
+    start = clock();
+
+    for (uint32_t i = 0; i < scans; ++i) {
+        found += close_client_or_ip_port_in_list(dht, keys[i % NUM_KEYS], addrs[i % NUM_KEYS]);
+        found += scan_addto_friends(dht, addrs[i % NUM_KEYS], keys[i % NUM_KEYS]);
+    }
+
+    print_result("addto_lists", addto_index, ns_per_op(start, scans));
+
+    /* Keep the compiler from dropping the loops. */
+    printf("(%u)\n", found);
+
+    kill_DHT(dht);
+    kill_networking(net);
+    logger_kill(log);
+    return 0;
+}
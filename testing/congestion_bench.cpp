@@ -0,0 +1,126 @@
+/* Congestion control benchmark
+ * Simulates connections sending over paths with a bottleneck, with the queue
+ * based controller and with LEDBAT, and reports how much of the bandwidth each
+ * gets through, how long its packets wait in the queue of the bottleneck, and
+ * how large its bursts are and how many of them a short queue drops, with and
+ * without pacing.
+ *
+ * Usage: ./congestion_bench [seconds]
+ */
+
+/*
+ * Copyright © 2016-2018 The TokTok team.
+ *
+ * This file is part of Tox, the free peer to peer instant messenger.
+ *
+ * Tox is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Tox is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Tox.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "congestion_sim.h"
+
+#include <cstdio>
+#include <cstdlib>
+
+namespace {
+
+// Throughput and queueing delay of each controller on each link.
+void report_throughput_and_delay(uint32_t seconds, uint32_t warmup)
+{
+    const Link links[] = {broadband, long_fat, lossy, slow};
+    const struct {
+        const char *name;
+        Congestion_Control_Type type;
+    } controllers[] = {
+        {"queue", CONGESTION_CONTROL_QUEUE},
+        {"ledbat", CONGESTION_CONTROL_LEDBAT},
+    };
+
+    std::printf("%-10s %-8s %12s %12s %12s\n", "link", "control", "utilisation", "mean delay", "max delay");
+
+    for (const Link &link : links) {
+        for (const auto &controller : controllers) {
+            const Result result = simulate(controller.type, link, seconds, warmup);
+            std::printf("%-10s %-8s %11.1f%% %9.1f ms %9.1f ms\n", link.name, controller.name,
+                        result.utilisation * 100.0, result.mean_delay, result.max_delay);
+        }
+    }
+}
+
+// Bursts and the loss they cause with and without pacing, for bulk and chunked
+// data, and for lossy frames.
+void report_bursts_and_loss(uint32_t seconds, uint32_t warmup)
+{
+    const Link links[] = {broadband, shallow};
+    const uint32_t intervals[] = {1, 5, 20};
+    // Always more to send, or 50 packets every 100 ms, e.g. a file read in
+    // chunks.
+    const struct {
+        const char *name;
+        uint32_t packets;
+        uint32_t interval;
+    } apps[] = {
+        {"bulk", 0, 0},
+        {"chunks", 50, 100},
+    };
+
+    std::printf("%-10s %-8s %-8s %8s %-6s %12s %10s %8s\n", "link", "control", "app", "interval", "paced",
+                "utilisation", "max burst", "loss");
+
+    for (const Link &link : links) {
+        for (const Congestion_Control_Type type : {CONGESTION_CONTROL_QUEUE, CONGESTION_CONTROL_LEDBAT}) {
+            for (const auto &app : apps) {
+                for (const uint32_t interval : intervals) {
+                    for (const bool pacing : {false, true}) {
+                        const Schedule schedule = {interval, pacing, app.packets, app.interval};
+                        const Result result = simulate(type, link, seconds, warmup, schedule);
+                        std::printf("%-10s %-8s %-8s %5u ms %-6s %11.1f%% %10u %7.2f%%\n", link.name,
+                                    type == CONGESTION_CONTROL_QUEUE ? "queue" : "ledbat", app.name, interval,
+                                    pacing ? "yes" : "no", result.utilisation * 100.0, result.max_burst,
+                                    result.loss * 100.0);
+                    }
+                }
+            }
+        }
+    }
+
+    // 30 frames a second of 25 lossy packets, e.g. video.
+    std::printf("%-10s %-8s %-8s %8s %-6s %12s %10s %8s\n", "link", "traffic", "app", "", "paced", "utilisation",
+                "max burst", "loss");
+
+    for (const bool pacing : {false, true}) {
+        const Result result = simulate_lossy(shallow, 25, 33, seconds, pacing);
+        std::printf("%-10s %-8s %-8s %8s %-6s %11.1f%% %10u %7.2f%%\n", shallow.name, "lossy", "video", "",
+                    pacing ? "yes" : "no", result.utilisation * 100.0, result.max_burst, result.loss * 100.0);
+    }
+}
+
+}  // namespace
+
+int main(int argc, char *argv[])
+{
+    const uint32_t seconds = argc > 1 ? uint32_t(std::atoi(argv[1])) : 60;
+
+    if (seconds <= 1) {
+        std::printf("usage: %s [seconds]\n", argv[0]);
+        return 1;
+    }
+
+    // The first third of the run is not measured, the controllers are still
+    // finding the rate of the link then.
+    const uint32_t warmup = seconds / 3;
+
+    report_throughput_and_delay(seconds, warmup);
+    std::printf("\n");
+    report_bursts_and_loss(seconds, warmup);
+    return 0;
+}
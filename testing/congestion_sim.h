@@ -0,0 +1,325 @@
+// A simulated path with a bottleneck for the congestion controllers to send
+// over, shared by the congestion tests and the congestion benchmark.
+#ifndef C_TOXCORE_TESTING_CONGESTION_SIM_H
+#define C_TOXCORE_TESTING_CONGESTION_SIM_H
+
+#include "../toxcore/congestion.h"
+
+#include <algorithm>
+#include <cmath>
+#include <deque>
+#include <random>
+#include <utility>
+#include <vector>
+
+
+// A path with a bottleneck: packets queue up in front of a link sending
+// bandwidth packets a second, up to buffer of them; the others are dropped,
+// as are a share loss of all of them. It takes rtt ms to get to the peer and
+// back without any queue.
+struct Link {
+    const char *name;
+    double bandwidth;
+    uint32_t rtt;
+    double loss;
+    uint32_t buffer;
+};
+
+// How the sender is run: send_crypto_packets() every interval ms, with or
+// without pacing. The application gives it app_packets new packets every
+// app_interval ms, or always has more if app_interval is 0.
+struct Schedule {
+    uint32_t interval;
+    bool pacing;
+    uint32_t app_packets;
+    uint32_t app_interval;
+};
+
+struct Result {
+    // Share of the bandwidth that reached the peer, packets sent again or not.
+    double utilisation;
+    // Mean and largest time packets spent in the queue, in ms.
+    double mean_delay;
+    double max_delay;
+    // Most packets sent in one ms, and the share of them the full queue
+    // dropped.
+    uint32_t max_burst;
+    double loss;
+};
+
+// The peer confirms what it received this often, as net_crypto does with its
+// request packets.
+constexpr uint32_t ack_interval = 50;
+
+struct Ack {
+    uint64_t time;
+    uint32_t received_until;
+    uint32_t highest;
+};
+
+// Send as much as the controller lets a connection send over link for seconds,
+// the way send_crypto_packets() does, and measure what it got through after the
+// first warmup seconds.
+inline Result simulate(Congestion_Control_Type type, const Link &link, uint32_t seconds, uint32_t warmup,
+                       const Schedule &run = {1, false, 0, 0})
+{
+    std::mt19937 random(1234);
+    std::uniform_real_distribution<double> coin(0.0, 1.0);
+
+    Congestion_Control cc;
+    congestion_init(&cc, type);
+
+    // Sender.
+    std::vector<uint64_t> sent_time;
+    std::vector<bool> dropped;
+    std::deque<uint32_t> resend;
+    uint32_t acked_until = 0;
+    uint64_t min_rtt = 1000;
+    uint64_t last_congestion_event = 0;
+    double tokens = CONGESTION_MIN_QUEUE_LENGTH;
+    double requested_tokens = CONGESTION_MIN_QUEUE_LENGTH;
+    Congestion_Sample sample = {};
+
+    // Path: the bottleneck queue, the packets past it on their way to the
+    // peer, and the acks on their way back.
+    std::deque<std::pair<uint64_t, uint32_t>> queue;
+    std::deque<std::pair<uint64_t, uint32_t>> in_flight;
+    std::deque<Ack> acks;
+    double service = 0.0;
+    uint64_t now = 0;
+
+    const uint64_t end = uint64_t(seconds) * 1000;
+    const uint64_t start = uint64_t(warmup) * 1000;
+
+    uint32_t backlog = 0;
+    uint32_t max_burst = 0;
+    uint64_t sent = 0;
+    uint64_t overflowed = 0;
+
+    const auto send = [&](uint32_t seq) {
+        const bool overflow = queue.size() >= link.buffer;
+
+        if (now >= start) {
+            ++sent;
+            overflowed += overflow;
+        }
+
+        if (coin(random) < link.loss || overflow) {
+            dropped[seq] = true;
+        } else {
+            queue.emplace_back(now, seq);
+        }
+    };
+
+    // Peer.
+    std::vector<bool> received;
+    uint32_t received_until = 0;
+    uint32_t highest = 0;
+
+    uint64_t delivered = 0;
+    double delay_sum = 0.0;
+    double max_delay = 0.0;
+    uint64_t delay_count = 0;
+
+    for (now = 1; now <= end; ++now) {
+        // Acks reaching the sender.
+        while (!acks.empty() && acks.front().time <= now) {
+            const Ack ack = acks.front();
+            acks.pop_front();
+
+            if (ack.received_until > acked_until) {
+                const uint64_t rtt = now - sent_time[acked_until];
+                min_rtt = std::min(min_rtt, rtt);
+                congestion_rtt(&cc, rtt, now);
+                sample.packets_acked += ack.received_until - acked_until;
+                acked_until = ack.received_until;
+            }
+
+            // Packets the peer has the later ones of were lost.
+            for (uint32_t seq = acked_until; seq < ack.highest; ++seq) {
+                if (dropped[seq] && now >= sent_time[seq] + link.rtt) {
+                    dropped[seq] = false;
+                    resend.push_back(seq);
+                }
+            }
+        }
+
+        if (now % CONGESTION_SAMPLE_INTERVAL == 0) {
+            sample.time = now;
+            sample.send_queue = uint32_t(sent_time.size()) - acked_until;
+            sample.min_rtt = min_rtt;
+            sample.last_congestion_event = last_congestion_event;
+            congestion_update(&cc, &sample);
+            sample = {};
+        }
+
+        // Send what the rates allow: the packets the peer asked for out of
+        // what the request rate allows, the new ones out of what is left.
+        uint32_t resent = 0;
+        uint32_t burst = 0;
+
+        if (now % run.interval == 0) {
+            const double packets = cc.send_rate * run.interval / 1000.0;
+            tokens = std::min(tokens + packets, congestion_burst_limit(&cc, packets, run.pacing));
+            requested_tokens = std::max(requested_tokens - std::floor(requested_tokens)
+                                        + cc.request_rate * run.interval / 1000.0, tokens);
+        }
+
+        while (now % run.interval == 0 && requested_tokens >= 1.0 && !resend.empty()) {
+            requested_tokens -= 1.0;
+            const uint32_t seq = resend.front();
+            resend.pop_front();
+            sent_time[seq] = now;
+            send(seq);
+            ++resent;
+        }
+
+        sample.packets_resent += resent;
+
+        if (resent < tokens) {
+            tokens -= resent;
+        } else if (resent > 0) {
+            last_congestion_event = now;
+            tokens = 0.0;
+        }
+
+        burst += resent;
+
+        if (run.app_interval != 0 && now % run.app_interval == 0) {
+            backlog += run.app_packets;
+        }
+
+        while (now % run.interval == 0 && tokens >= 1.0 && (run.app_interval == 0 || backlog > 0)) {
+            tokens -= 1.0;
+            backlog -= run.app_interval != 0;
+            const uint32_t seq = uint32_t(sent_time.size());
+            sent_time.push_back(now);
+            dropped.push_back(false);
+            received.push_back(false);
+            send(seq);
+            ++sample.packets_sent;
+            ++burst;
+        }
+
+        if (now >= start) {
+            max_burst = std::max(max_burst, burst);
+        }
+
+        // The bottleneck.
+        service = std::min(service + link.bandwidth / 1000.0, queue.empty() ? 1.0 : link.bandwidth / 1000.0 + 1.0);
+
+        while (service >= 1.0 && !queue.empty()) {
+            service -= 1.0;
+
+            if (now >= start) {
+                const double delay = double(now - queue.front().first);
+                delay_sum += delay;
+                max_delay = std::max(max_delay, delay);
+                ++delay_count;
+                ++delivered;
+            }
+
+            in_flight.emplace_back(now + link.rtt / 2, queue.front().second);
+            queue.pop_front();
+        }
+
+        // The peer.
+        while (!in_flight.empty() && in_flight.front().first <= now) {
+            const uint32_t seq = in_flight.front().second;
+            in_flight.pop_front();
+            received[seq] = true;
+            highest = std::max(highest, seq + 1);
+
+            while (received_until < received.size() && received[received_until]) {
+                ++received_until;
+            }
+        }
+
+        if (now % ack_interval == 0) {
+            acks.push_back({now + link.rtt / 2, received_until, highest});
+        }
+    }
+
+    Result result;
+    result.utilisation = double(delivered) / (link.bandwidth * (seconds - warmup));
+    result.mean_delay = delay_count > 0 ? delay_sum / delay_count : 0.0;
+    result.max_delay = max_delay;
+    result.max_burst = max_burst;
+    result.loss = sent > 0 ? double(overflowed) / sent : 0.0;
+    return result;
+}
+
+// Send frames of frame_packets lossy packets every frame_interval ms over link
+// for seconds, at once or paced as send_lossy_cryptpacket() does, and measure
+// how many of them got through.
+inline Result simulate_lossy(const Link &link, uint32_t frame_packets, uint32_t frame_interval, uint32_t seconds,
+                             bool pacing)
+{
+    // net_crypto's CRYPTO_LOSSY_PACING_GAIN, and the rate that empties its
+    // queue of CRYPTO_LOSSY_QUEUE_SIZE packets in a sample interval.
+    constexpr double gain = 2.0;
+    constexpr double min_rate = 32 * 1000.0 / CONGESTION_SAMPLE_INTERVAL;
+
+    Congestion_Pacer pacer = {};
+    uint32_t held_back = 0;
+    uint32_t given = 0;
+    double given_rate = 0.0;
+
+    uint32_t queue = 0;
+    double service = 0.0;
+
+    Result result = {};
+    uint64_t sent = 0;
+    uint64_t overflowed = 0;
+    uint64_t delivered = 0;
+
+    for (uint64_t now = 1; now <= uint64_t(seconds) * 1000; ++now) {
+        if (now % CONGESTION_SAMPLE_INTERVAL == 0) {
+            given_rate = given * 1000.0 / CONGESTION_SAMPLE_INTERVAL;
+            given = 0;
+        }
+
+        if (now % frame_interval == 0) {
+            held_back += frame_packets;
+            given += frame_packets;
+        }
+
+        const uint32_t burst = pacing ? congestion_pace(&pacer, std::max(given_rate * gain, min_rate), now, held_back)
+                               : held_back;
+        held_back -= burst;
+        result.max_burst = std::max(result.max_burst, burst);
+
+        for (uint32_t i = 0; i < burst; ++i) {
+            ++sent;
+
+            if (queue >= link.buffer) {
+                ++overflowed;
+            } else {
+                ++queue;
+            }
+        }
+
+        service = std::min(service + link.bandwidth / 1000.0, queue == 0 ? 1.0 : link.bandwidth / 1000.0 + 1.0);
+
+        while (service >= 1.0 && queue > 0) {
+            service -= 1.0;
+            --queue;
+            ++delivered;
+        }
+    }
+
+    result.utilisation = double(delivered) / (link.bandwidth * seconds);
+    result.loss = sent > 0 ? double(overflowed) / sent : 0.0;
+    return result;
+}
+
+const Link broadband = {"broadband", 1000, 50, 0.0, 1000};
+const Link long_fat = {"long fat", 10000, 200, 0.0, 4000};
+// LEDBAT halves its window on loss as TCP does, random loss costs it more than
+// it costs the queue controller.
+const Link lossy = {"lossy", 1000, 50, 0.01, 1000};
+const Link slow = {"slow", 100, 100, 0.0, 200};
+// A home router with little buffer in front of its uplink.
+const Link shallow = {"shallow", 1000, 50, 0.0, 16};
+
+#endif  // C_TOXCORE_TESTING_CONGESTION_SIM_H
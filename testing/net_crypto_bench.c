@@ -0,0 +1,539 @@
+/* net_crypto benchmark
+ * Measures what the lossless packet buffers cost per packet of a file
+ * transfer: queueing each chunk in the sender's send array, putting it in the
+ * receiver's recv array and reading it back out, and clearing it from the send
+ * array once it was acknowledged.
+ *
+ * The buffers take their Packet_Data from the packet pool; this is compared to
+ * the same arrays doing a malloc and a free for every packet, which is what
+ * they did before the pool.
+ *
+ * It then measures generating and handling the request packets for a window of
+ * packets with some of them lost, with the holes found in the occupancy bitmap
+ * of the arrays compared to the slot by slot walk they replaced.
+ *
+ * Usage: ./net_crypto_bench [packets]
+ */
+
+/*
+ * Copyright © 2016-2018 The TokTok team.
+ *
+ * This file is part of Tox, the free peer to peer instant messenger.
+ *
+ * Tox is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Tox is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Tox.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+/* Included for the static functions, to compare them with the malloc and free
+ * they replaced. */
+#include "../toxcore/net_crypto.c"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+/* The sender is acknowledged this many packets at a time, as it is by the
+ * data packets coming back from the receiver. */
+#define ACK_EVERY 32
+
+/* One in this many packets arrives after the next one. */
+#define REORDER_EVERY 100
+
+/* One in this many packets is lost when generating request packets. */
+#define LOSS_EVERY 50
+
+static Packets_Array send_array;
+static Packets_Array recv_array;
+
+/* The buffer functions as they were before the pool. */
+static int malloc_add_data_to_buffer(Packets_Array *array, uint32_t number, const Packet_Data *data)
+{
+    if (number - array->buffer_start > CRYPTO_PACKET_BUFFER_SIZE) {
+        return -1;
+    }
+
+    const uint32_t num = number % CRYPTO_PACKET_BUFFER_SIZE;
+
+    if (array->buffer[num]) {
+        return -1;
+    }
+
+    Packet_Data *new_d = (Packet_Data *)malloc(sizeof(Packet_Data));
+
+    if (new_d == nullptr) {
+        return -1;
+    }
+
+    memcpy(new_d, data, sizeof(Packet_Data));
+    array->buffer[num] = new_d;
+
+    if ((number - array->buffer_start) >= (array->buffer_end - array->buffer_start)) {
+        array->buffer_end = number + 1;
+    }
+
+    return 0;
+}
+
+static int64_t malloc_add_data_end_of_buffer(Packets_Array *array, const Packet_Data *data)
+{
+    if (num_packets_array(array) >= CRYPTO_PACKET_BUFFER_SIZE) {
+        return -1;
+    }
+
+    Packet_Data *new_d = (Packet_Data *)malloc(sizeof(Packet_Data));
+
+    if (new_d == nullptr) {
+        return -1;
+    }
+
+    memcpy(new_d, data, sizeof(Packet_Data));
+    const uint32_t id = array->buffer_end;
+    array->buffer[id % CRYPTO_PACKET_BUFFER_SIZE] = new_d;
+    ++array->buffer_end;
+    return id;
+}
+
+static int64_t malloc_read_data_beg_buffer(Packets_Array *array, Packet_Data *data)
+{
+    if (array->buffer_end == array->buffer_start) {
+        return -1;
+    }
+
+    const uint32_t num = array->buffer_start % CRYPTO_PACKET_BUFFER_SIZE;
+
+    if (!array->buffer[num]) {
+        return -1;
+    }
+
+    memcpy(data, array->buffer[num], sizeof(Packet_Data));
+    const uint32_t id = array->buffer_start;
+    ++array->buffer_start;
+    free(array->buffer[num]);
+    array->buffer[num] = nullptr;
+    return id;
+}
+
+static int malloc_clear_buffer_until(Packets_Array *array, uint32_t number)
+{
+    const uint32_t num_spots = array->buffer_end - array->buffer_start;
+
+    if (array->buffer_end - number >= num_spots || number - array->buffer_start > num_spots) {
+        return -1;
+    }
+
+    uint32_t i;
+
+    for (i = array->buffer_start; i != number; ++i) {
+        const uint32_t num = i % CRYPTO_PACKET_BUFFER_SIZE;
+
+        if (array->buffer[num]) {
+            free(array->buffer[num]);
+            array->buffer[num] = nullptr;
+        }
+    }
+
+    array->buffer_start = i;
+    return 0;
+}
+
+/* Hand packet number num to the receiver and read out what is in order. */
+static uint32_t receive(Packet_Pool *pool, uint32_t num, const Packet_Data *packet, Packet_Data *read)
+{
+    uint32_t received = 0;
+
+    if (pool != nullptr) {
+        add_data_to_buffer(pool, &recv_array, num, packet);
+
+        while (read_data_beg_buffer(pool, &recv_array, read) != -1) {
+            received += read->length;
+        }
+    } else {
+        malloc_add_data_to_buffer(&recv_array, num, packet);
+
+        while (malloc_read_data_beg_buffer(&recv_array, read) != -1) {
+            received += read->length;
+        }
+    }
+
+    return received;
+}
+
+/* ns per packet to send packets packets of a file, with window packets in
+ * flight. The pool is NULL for the malloc and free version.
+ */
+static double transfer_ns(Packet_Pool *pool, uint32_t packets, uint32_t window, uint64_t *received)
+{
+    Packet_Data packet;
+    Packet_Data read;
+    packet.sent_time = 1;
+    packet.length = MAX_CRYPTO_DATA_SIZE;
+    memset(packet.data, CRYPTO_RESERVED_PACKETS, sizeof(packet.data));
+
+    /* The packet held back to arrive after the next one. */
+    int64_t held_back = -1;
+
+    const clock_t start = clock();
+
+    for (uint32_t i = 0; i < packets; ++i) {
+        int64_t num;
+
+        if (pool != nullptr) {
+            num = add_data_end_of_buffer(pool, &send_array, &packet);
+        } else {
+            num = malloc_add_data_end_of_buffer(&send_array, &packet);
+        }
+
+        if (num == -1) {
+            printf("send array full\n");
+            exit(1);
+        }
+
+        if (held_back == -1 && num % REORDER_EVERY == 0) {
+            held_back = num;
+        } else {
+            *received += receive(pool, (uint32_t)num, &packet, &read);
+
+            if (held_back != -1) {
+                *received += receive(pool, (uint32_t)held_back, &packet, &read);
+                held_back = -1;
+            }
+        }
+
+        /* Acknowledge what the receiver had when it was a window ago. */
+        if (num % ACK_EVERY == 0 && num_packets_array(&send_array) >= window) {
+            const uint32_t acked = send_array.buffer_end - window;
+
+            if (pool != nullptr) {
+                clear_buffer_until(pool, &send_array, acked);
+            } else {
+                malloc_clear_buffer_until(&send_array, acked);
+            }
+        }
+    }
+
+    if (held_back != -1) {
+        *received += receive(pool, (uint32_t)held_back, &packet, &read);
+    }
+
+    const double ns = (double)(clock() - start) * 1000000000.0 / CLOCKS_PER_SEC / packets;
+
+    if (pool != nullptr) {
+        clear_buffer(pool, &send_array);
+    } else {
+        malloc_clear_buffer_until(&send_array, send_array.buffer_end);
+    }
+
+    return ns;
+}
+
+/* The request packet functions as they were before the occupancy bitmap. */
+static int slot_generate_request_packet(uint8_t *data, uint16_t length, const Packets_Array *array)
+{
+    data[0] = PACKET_ID_REQUEST;
+
+    uint16_t cur_len = 1;
+
+    if (array->buffer_start == array->buffer_end || length <= cur_len) {
+        return cur_len;
+    }
+
+    uint32_t n = 1;
+
+    for (uint32_t i = array->buffer_start; i != array->buffer_end; ++i) {
+        const uint32_t num = i % CRYPTO_PACKET_BUFFER_SIZE;
+
+        if (!array->buffer[num]) {
+            data[cur_len] = n;
+            n = 0;
+            ++cur_len;
+
+            if (length <= cur_len) {
+                return cur_len;
+            }
+        } else if (n == 255) {
+            data[cur_len] = 0;
+            n = 0;
+            ++cur_len;
+
+            if (length <= cur_len) {
+                return cur_len;
+            }
+        }
+
+        ++n;
+    }
+
+    return cur_len;
+}
+
+static int slot_handle_request_packet(Packet_Pool *pool, Packets_Array *array, const uint8_t *data, uint16_t length,
+                                      uint64_t *latest_send_time, uint64_t rtt_time)
+{
+    if (length <= 1) {
+        return 0;
+    }
+
+    ++data;
+    --length;
+
+    uint32_t n = 1;
+    uint32_t requested = 0;
+
+    const uint64_t temp_time = current_time_monotonic();
+    uint64_t l_sent_time = ~0;
+
+    for (uint32_t i = array->buffer_start; i != array->buffer_end; ++i) {
+        if (length == 0) {
+            break;
+        }
+
+        const uint32_t num = i % CRYPTO_PACKET_BUFFER_SIZE;
+
+        if (n == data[0]) {
+            if (array->buffer[num] && array->buffer[num]->sent_time + rtt_time < temp_time) {
+                array->buffer[num]->sent_time = 0;
+            }
+
+            ++data;
+            --length;
+            n = 0;
+            ++requested;
+        } else if (array->buffer[num]) {
+            if (l_sent_time < array->buffer[num]->sent_time) {
+                l_sent_time = array->buffer[num]->sent_time;
+            }
+
+            packet_pool_put(pool, array->buffer[num]);
+            packets_array_unset(array, num);
+        }
+
+        if (n == 255) {
+            n = 1;
+
+            if (data[0] != 0) {
+                return -1;
+            }
+
+            ++data;
+            --length;
+        } else {
+            ++n;
+        }
+    }
+
+    if (*latest_send_time < l_sent_time) {
+        *latest_send_time = l_sent_time;
+    }
+
+    return requested;
+}
+
+/* Put window packets in array after the ones it had, leaving out one in
+ * LOSS_EVERY of them if lossy is true. */
+static void fill_array(Packet_Pool *pool, Packets_Array *array, const Packet_Data *packet, uint32_t window, bool lossy)
+{
+    clear_buffer(pool, array);
+    const uint32_t start = array->buffer_end;
+
+    for (uint32_t i = 0; i < window; ++i) {
+        if (!lossy || i % LOSS_EVERY != LOSS_EVERY - 1) {
+            add_data_to_buffer(pool, array, start + i, packet);
+        }
+    }
+
+    set_buffer_end(array, start + window);
+}
+
+/* Put in occupied whether each of window packets from start is in array.
+ * Exits if the bitmap doesn't say the same. */
+static void packets_occupied(const Packets_Array *array, uint32_t start, uint32_t window, bool *occupied)
+{
+    for (uint32_t i = 0; i < window; ++i) {
+        const uint32_t num = (start + i) % CRYPTO_PACKET_BUFFER_SIZE;
+        occupied[i] = array->buffer[num] != nullptr;
+
+        if (occupied[i] != ((array->used[num / PACKETS_ARRAY_WORD_BITS] >> (num % PACKETS_ARRAY_WORD_BITS)) & 1)) {
+            printf("occupancy bitmap out of date at packet %u\n", start + i);
+            exit(1);
+        }
+    }
+}
+
+/* Print the ns per request packet generated and handled for window packets in
+ * flight, for the bitmap and the slot walk. Exits if they disagree.
+ */
+static void compare_requests(Packet_Pool *pool, uint32_t window, uint32_t rounds)
+{
+    Packet_Data packet;
+    packet.sent_time = 1;
+    packet.length = 1;
+    packet.data[0] = CRYPTO_RESERVED_PACKETS;
+
+    uint8_t request[MAX_CRYPTO_DATA_SIZE];
+    uint8_t slot_request[MAX_CRYPTO_DATA_SIZE];
+    int length = 0;
+    int slot_length = 0;
+
+    fill_array(pool, &recv_array, &packet, window, true);
+
+    clock_t start = clock();
+
+    for (uint32_t i = 0; i < rounds; ++i) {
+        length = generate_request_packet(request, sizeof(request), &recv_array);
+    }
+
+    const double generate_ns = (double)(clock() - start) * 1000000000.0 / CLOCKS_PER_SEC / rounds;
+    start = clock();
+
+    for (uint32_t i = 0; i < rounds; ++i) {
+        slot_length = slot_generate_request_packet(slot_request, sizeof(slot_request), &recv_array);
+    }
+
+    const double slot_generate_ns = (double)(clock() - start) * 1000000000.0 / CLOCKS_PER_SEC / rounds;
+
+    if (length != slot_length || memcmp(request, slot_request, length) != 0) {
+        printf("request packets differ for %u packets in flight\n", window);
+        exit(1);
+    }
+
+    bool *const occupied = (bool *)malloc(window * sizeof(bool));
+    bool *const slot_occupied = (bool *)malloc(window * sizeof(bool));
+
+    if (occupied == nullptr || slot_occupied == nullptr) {
+        printf("out of memory\n");
+        exit(1);
+    }
+
+    clock_t handle_clocks = 0;
+    clock_t slot_handle_clocks = 0;
+    clock_t repeat_clocks = 0;
+    clock_t slot_repeat_clocks = 0;
+    int requested = 0;
+    int slot_requested = 0;
+
+    for (uint32_t i = 0; i < rounds; ++i) {
+        uint64_t latest_send_time = 0;
+        fill_array(pool, &send_array, &packet, window, false);
+        start = clock();
+        requested = handle_request_packet(pool, &send_array, request, length, &latest_send_time, 0);
+        handle_clocks += clock() - start;
+
+        /* The next request packets ask for the same packets until they arrive,
+         * the others are gone by then. */
+        start = clock();
+        handle_request_packet(pool, &send_array, request, length, &latest_send_time, 0);
+        repeat_clocks += clock() - start;
+        packets_occupied(&send_array, send_array.buffer_end - window, window, occupied);
+
+        fill_array(pool, &send_array, &packet, window, false);
+        start = clock();
+        slot_requested = slot_handle_request_packet(pool, &send_array, request, length, &latest_send_time, 0);
+        slot_handle_clocks += clock() - start;
+
+        start = clock();
+        slot_handle_request_packet(pool, &send_array, request, length, &latest_send_time, 0);
+        slot_repeat_clocks += clock() - start;
+
+        packets_occupied(&send_array, send_array.buffer_end - window, window, slot_occupied);
+
+        if (requested != slot_requested || memcmp(occupied, slot_occupied, window * sizeof(bool)) != 0) {
+            printf("handled request packets differ for %u packets in flight\n", window);
+            exit(1);
+        }
+    }
+
+    free(slot_occupied);
+    free(occupied);
+
+    const double handle_ns = (double)handle_clocks * 1000000000.0 / CLOCKS_PER_SEC / rounds;
+    const double slot_handle_ns = (double)slot_handle_clocks * 1000000000.0 / CLOCKS_PER_SEC / rounds;
+    const double repeat_ns = (double)repeat_clocks * 1000000000.0 / CLOCKS_PER_SEC / rounds;
+    const double slot_repeat_ns = (double)slot_repeat_clocks * 1000000000.0 / CLOCKS_PER_SEC / rounds;
+
+    char name[32];
+    snprintf(name, sizeof(name), "generate, %u in flight", window);
+    printf("%-24s %10.1f ns %10.1f ns %8.2fx\n", name, generate_ns, slot_generate_ns,
+           generate_ns > 0 ? slot_generate_ns / generate_ns : 0.0);
+    snprintf(name, sizeof(name), "handle, %u in flight", window);
+    printf("%-24s %10.1f ns %10.1f ns %8.2fx\n", name, handle_ns, slot_handle_ns,
+           handle_ns > 0 ? slot_handle_ns / handle_ns : 0.0);
+    snprintf(name, sizeof(name), "repeat, %u in flight", window);
+    printf("%-24s %10.1f ns %10.1f ns %8.2fx\n", name, repeat_ns, slot_repeat_ns,
+           repeat_ns > 0 ? slot_repeat_ns / repeat_ns : 0.0);
+
+    clear_buffer(pool, &recv_array);
+    clear_buffer(pool, &send_array);
+}
+
+int main(int argc, char *argv[])
+{
+    const uint32_t packets = argc > 1 ? (uint32_t)atoi(argv[1]) : 1000000;
+
+    if (packets == 0) {
+        printf("usage: %s [packets]\n", argv[0]);
+        return 1;
+    }
+
+    Packet_Pool *pool = (Packet_Pool *)calloc(1, sizeof(Packet_Pool));
+
+    if (pool == nullptr || pthread_mutex_init(&pool->mutex, nullptr) != 0) {
+        printf("failed to create packet pool\n");
+        return 1;
+    }
+
+    if (init_packets_array(&send_array, CRYPTO_PACKET_BUFFER_SIZE) != 0
+            || init_packets_array(&recv_array, CRYPTO_PACKET_BUFFER_SIZE) != 0) {
+        printf("failed to create packet arrays\n");
+        return 1;
+    }
+
+    printf("%u packets of %u bytes\n", packets, (unsigned int)MAX_CRYPTO_DATA_SIZE);
+    printf("%-24s %13s %13s %9s %9s\n", "", "pool", "malloc", "speedup", "MB/s");
+
+    const uint32_t windows[] = { 64, 1024, 8192 };
+    uint64_t received = 0;
+
+    for (size_t i = 0; i < sizeof(windows) / sizeof(windows[0]); ++i) {
+        /* The first transfer fills the pool, as the first packets of a
+         * connection do. */
+        transfer_ns(pool, windows[i] * 2, windows[i], &received);
+
+        const double pool_ns = transfer_ns(pool, packets, windows[i], &received);
+        const double malloc_ns = transfer_ns(nullptr, packets, windows[i], &received);
+
+        char name[32];
+        snprintf(name, sizeof(name), "%u packets in flight", windows[i]);
+        printf("%-24s %10.1f ns %10.1f ns %8.2fx %9.0f\n", name, pool_ns, malloc_ns,
+               pool_ns > 0 ? malloc_ns / pool_ns : 0.0, pool_ns > 0 ? MAX_CRYPTO_DATA_SIZE * 1000.0 / pool_ns : 0.0);
+    }
+
+    printf("\nrequest packets, one in %u packets lost\n", LOSS_EVERY);
+    printf("%-24s %13s %13s %9s\n", "", "bitmap", "slots", "speedup");
+
+    for (size_t i = 0; i < sizeof(windows) / sizeof(windows[0]); ++i) {
+        compare_requests(pool, windows[i], packets / windows[i] + 1);
+    }
+
+    /* Keep the compiler from dropping the loops. */
+    printf("(%llu)\n", (unsigned long long)received);
+
+    free_packets_array(&send_array);
+    free_packets_array(&recv_array);
+    packet_pool_clear(pool);
+    pthread_mutex_destroy(&pool->mutex);
+    free(pool);
+    return 0;
+}
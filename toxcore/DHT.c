@@ -28,6 +28,7 @@
 #include "DHT.h"
 
 #include "LAN_discovery.h"
+#include "crypto_pool.h"
 #include "logger.h"
 #include "network.h"
 #include "ping.h"
@@ -37,12 +38,26 @@
 #include <stdlib.h>
 #include <string.h>
 
+#if defined(__GNUC__) && (defined(__AVX2__) || defined(__SSE2__)) && CRYPTO_PUBLIC_KEY_SIZE == 32
+#include <immintrin.h>
+#define DHT_KEY_SIMD 1
+#else
+#define DHT_KEY_SIMD 0
+#endif
+
 /* The timeout after which a node is discarded completely. */
 #define KILL_NODE_TIMEOUT (BAD_NODE_TIMEOUT + PING_INTERVAL)
 
 /* Ping interval in seconds for each random sending of a get nodes request. */
 #define GET_NODE_INTERVAL 20
 
+/* A friend list's timer waits up to this many seconds past the first ping that
+ * is due for the nodes due soon after it, so that they are pinged together
+ * rather than the list being looked at every time one of its nodes is due. No
+ * node is pinged before PING_INTERVAL has passed.
+ */
+#define PING_COALESCE_INTERVAL (PING_INTERVAL / 6)
+
 #define MAX_PUNCHING_PORTS 48
 
 /* Interval in seconds between punching attempts*/
@@ -59,8 +74,53 @@
 /* Number of get node requests to send to quickly find close nodes. */
 #define MAX_BOOTSTRAP_TIMES 5
 
+/* Size of the hash index of close list addresses: one chain per address the
+ * list can hold.
+ */
+#define CLOSE_IP_HASH_SIZE (LCLIENT_LIST * 2)
+
 #define ARRAY_SIZE(ARR) (sizeof (ARR) / sizeof (ARR)[0])
 
+/* Number of nodes a friend's lookup keeps track of, closest to the friend
+ * first. */
+#define LOOKUP_CANDIDATES (MAX_FRIEND_CLIENTS * 2)
+
+/* Seconds to wait for a node to answer a lookup's get nodes request before
+ * asking the next one instead. */
+#define LOOKUP_QUERY_TIMEOUT 2
+
+/* Seconds between lookups for a friend that still wasn't found. */
+#define LOOKUP_INTERVAL PING_INTERVAL
+
+typedef enum Lookup_State {
+    LOOKUP_NOT_ASKED,
+    LOOKUP_ASKED,
+    LOOKUP_ANSWERED,
+    LOOKUP_FAILED,
+} Lookup_State;
+
+typedef struct Lookup_Node {
+    Node_format node;
+    /* unix_time() at which the get nodes request was sent. */
+    uint64_t    asked;
+    Lookup_State state;
+} Lookup_Node;
+
+/* An iterative lookup for the nodes closest to a friend's key: the
+ * LOOKUP_CANDIDATES closest nodes heard of so far, of which the
+ * MAX_FRIEND_CLIENTS closest that didn't fail are asked for nodes, up to
+ * DHT::lookup_parallelism at a time.
+ */
+typedef struct DHT_Lookup {
+    Lookup_Node nodes[LOOKUP_CANDIDATES];
+    uint32_t    num_nodes;
+    uint32_t    in_flight;
+    bool        running;
+    /* unix_time() at which the lookup started, 0 to start it again as soon as
+     * there are nodes to ask. */
+    uint64_t    started;
+} DHT_Lookup;
+
 struct DHT_Friend {
     uint8_t     public_key[CRYPTO_PUBLIC_KEY_SIZE];
     Client_data client_list[MAX_FRIEND_CLIENTS];
@@ -82,6 +142,19 @@ struct DHT_Friend {
 
     Node_format to_bootstrap[MAX_SENT_NODES];
     unsigned int num_to_bootstrap;
+
+    /* Next time anything needs doing for client_list or to_bootstrap. */
+    Timer_Id timer;
+
+    DHT_Lookup lookup;
+
+    /* Nodes sharing fewer leading bits with public_key than this can't go in
+     * client_list, as it is full of closer good nodes. 0 if any node can: a
+     * slot is free or bad, or the lookup is running.
+     */
+    uint16_t accept_bits;
+    /* Index in DHT::open_friends while accept_bits is 0. */
+    uint16_t open_index;
 };
 
 struct DHT {
@@ -94,6 +167,13 @@ struct DHT {
     uint64_t       close_lastgetnodes;
     uint32_t       close_bootstrap_times;
 
+    /* Hash chains of the addresses in close_clientlist. Entry i * 2 stands
+     * for close_clientlist[i].assoc4 and i * 2 + 1 for its assoc6; links hold
+     * entry + 1 so that 0 ends a chain.
+     */
+    uint16_t       close_ip_heads[CLOSE_IP_HASH_SIZE];
+    uint16_t       close_ip_next[LCLIENT_LIST * 2];
+
     /* DHT keypair */
     uint8_t self_public_key[CRYPTO_PUBLIC_KEY_SIZE];
     uint8_t self_secret_key[CRYPTO_SECRET_KEY_SIZE];
@@ -101,12 +181,22 @@ struct DHT {
     DHT_Friend    *friends_list;
     uint16_t       num_friends;
 
+    /* Index over the friends, so that a node is only offered to the friends
+     * whose lists could take it: friend numbers sorted by key, the friends
+     * with accept_bits 0, and how many of the others have each accept_bits.
+     * friend_candidates holds the result of friends_accepting().
+     */
+    uint16_t      *friends_by_key;
+    uint16_t      *open_friends;
+    uint16_t       num_open_friends;
+    uint16_t       accept_bits_count[CRYPTO_PUBLIC_KEY_SIZE * 8 + 1];
+    uint16_t      *friend_candidates;
+
     Node_format   *loaded_nodes_list;
     uint32_t       loaded_num_nodes;
     unsigned int   loaded_nodes_index;
 
-    Shared_Keys shared_keys_recv;
-    Shared_Keys shared_keys_sent;
+    Shared_Key_Cache *shared_keys;
 
     struct Ping   *ping;
     Ping_Array    *dht_ping_array;
@@ -117,8 +207,22 @@ struct DHT {
 
     Node_format to_bootstrap[MAX_CLOSE_TO_BOOTSTRAP_NODES];
     unsigned int num_to_bootstrap;
+
+    Timer_Wheel *timers;
+    /* Next time to_bootstrap needs flushing or a get nodes request is due. */
+    Timer_Id close_timer;
+    /* Next time each close_clientlist node needs pinging or times out. Only
+     * nodes not in kill-timeout have one; close_live counts them.
+     */
+    Timer_Id close_node_timers[LCLIENT_LIST];
+    uint32_t close_live;
+
+    uint8_t lookup_parallelism;
 };
 
+static void close_rebucket(DHT *dht);
+static void close_reindex(DHT *dht);
+
 const uint8_t *dht_friend_public_key(const DHT_Friend *dht_friend)
 {
     return dht_friend->public_key;
@@ -141,10 +245,19 @@ const uint8_t *dht_get_self_secret_key(const DHT *dht)
 void dht_set_self_public_key(DHT *dht, const uint8_t *key)
 {
     memcpy(dht->self_public_key, key, CRYPTO_PUBLIC_KEY_SIZE);
+    close_rebucket(dht);
 }
 void dht_set_self_secret_key(DHT *dht, const uint8_t *key)
 {
     memcpy(dht->self_secret_key, key, CRYPTO_SECRET_KEY_SIZE);
+    shared_key_cache_clear(dht->shared_keys);
+
+    Crypto_Pool *const pool = networking_crypto_pool(dht->net);
+
+    /* Keys still being computed are for the old secret key. */
+    if (pool != nullptr) {
+        crypto_pool_cancel(pool, dht);
+    }
 }
 
 Networking_Core *dht_get_net(const DHT *dht)
@@ -155,6 +268,10 @@ struct Ping *dht_get_ping(const DHT *dht)
 {
     return dht->ping;
 }
+Timer_Wheel *dht_get_timer_wheel(const DHT *dht)
+{
+    return dht->timers;
+}
 const Client_data *dht_get_close_clientlist(const DHT *dht)
 {
     return dht->close_clientlist;
@@ -164,6 +281,12 @@ const Client_data *dht_get_close_client(const DHT *dht, uint32_t client_num)
     assert(client_num < sizeof(dht->close_clientlist) / sizeof(dht->close_clientlist[0]));
     return &dht->close_clientlist[client_num];
 }
+void dht_set_close_clientlist(DHT *dht, const Client_data *list)
+{
+    memcpy(dht->close_clientlist, list, sizeof(dht->close_clientlist));
+    close_reindex(dht);
+}
+
 uint16_t dht_get_num_friends(const DHT *dht)
 {
     return dht->num_friends;
@@ -180,6 +303,61 @@ const uint8_t *dht_get_friend_public_key(const DHT *dht, uint32_t friend_num)
     return dht->friends_list[friend_num].public_key;
 }
 
+/* Keys are compared a SIMD register or machine word at a time rather than
+ * a byte at a time: everything below only needs to know the first byte in
+ * which two keys differ. That pays off for keys sharing a prefix, like the
+ * ones in the close list and in the lists sorted by distance to a key. The
+ * SIMD versions are used when the compiler targets SSE2 (all x86-64) or AVX2
+ * (e.g. -march=haswell).
+ */
+/* return the index of the first byte in which pk1 and pk2 differ, or
+ *   CRYPTO_PUBLIC_KEY_SIZE if they are equal.
+ */
+static unsigned int first_different_byte(const uint8_t *pk1, const uint8_t *pk2)
+{
+    /* Unrelated keys nearly always differ right away. */
+    if (pk1[0] != pk2[0]) {
+        return 0;
+    }
+
+#if DHT_KEY_SIMD && defined(__AVX2__)
+    const __m256i a = _mm256_loadu_si256((const __m256i *)pk1);
+    const __m256i b = _mm256_loadu_si256((const __m256i *)pk2);
+    const uint32_t different = ~(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(a, b));
+
+    return different == 0 ? CRYPTO_PUBLIC_KEY_SIZE : (unsigned int)__builtin_ctz(different);
+#elif DHT_KEY_SIMD
+    const __m128i a_lo = _mm_loadu_si128((const __m128i *)pk1);
+    const __m128i b_lo = _mm_loadu_si128((const __m128i *)pk2);
+    const __m128i a_hi = _mm_loadu_si128((const __m128i *)(pk1 + 16));
+    const __m128i b_hi = _mm_loadu_si128((const __m128i *)(pk2 + 16));
+    const uint32_t equal = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(a_lo, b_lo))
+                           | ((uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(a_hi, b_hi)) << 16);
+    const uint32_t different = ~equal;
+
+    return different == 0 ? CRYPTO_PUBLIC_KEY_SIZE : (unsigned int)__builtin_ctz(different);
+#else
+    unsigned int i = 0;
+
+    for (; i + sizeof(uint64_t) <= CRYPTO_PUBLIC_KEY_SIZE; i += sizeof(uint64_t)) {
+        uint64_t word1;
+        uint64_t word2;
+        memcpy(&word1, pk1 + i, sizeof(uint64_t));
+        memcpy(&word2, pk2 + i, sizeof(uint64_t));
+
+        if (word1 != word2) {
+            break;
+        }
+    }
+
+    while (i < CRYPTO_PUBLIC_KEY_SIZE && pk1[i] == pk2[i]) {
+        ++i;
+    }
+
+    return i;
+#endif
+}
+
 /* Compares pk1 and pk2 with pk.
  *
  *  return 0 if both are same distance.
@@ -188,112 +366,103 @@ const uint8_t *dht_get_friend_public_key(const DHT *dht, uint32_t friend_num)
  */
 int id_closest(const uint8_t *pk, const uint8_t *pk1, const uint8_t *pk2)
 {
-    for (size_t i = 0; i < CRYPTO_PUBLIC_KEY_SIZE; ++i) {
-        const uint8_t distance1 = pk[i] ^ pk1[i];
-        const uint8_t distance2 = pk[i] ^ pk2[i];
-
-        if (distance1 < distance2) {
-            return 1;
-        }
+    /* The distances are equal up to the first byte where pk1 and pk2 differ,
+     * and that byte decides. */
+    const unsigned int i = first_different_byte(pk1, pk2);
 
-        if (distance1 > distance2) {
-            return 2;
-        }
+    if (i == CRYPTO_PUBLIC_KEY_SIZE) {
+        return 0;
     }
 
-    return 0;
+    const uint8_t distance1 = pk[i] ^ pk1[i];
+    const uint8_t distance2 = pk[i] ^ pk2[i];
+
+    return distance1 < distance2 ? 1 : 2;
 }
 
 /* Return index of first unequal bit number.
  */
 static unsigned int bit_by_bit_cmp(const uint8_t *pk1, const uint8_t *pk2)
 {
-    unsigned int i;
-    unsigned int j = 0;
-
-    for (i = 0; i < CRYPTO_PUBLIC_KEY_SIZE; ++i) {
-        if (pk1[i] == pk2[i]) {
-            continue;
-        }
+    const unsigned int i = first_different_byte(pk1, pk2);
 
-        for (j = 0; j < 8; ++j) {
-            const uint8_t mask = 1 << (7 - j);
+    if (i == CRYPTO_PUBLIC_KEY_SIZE) {
+        return i * 8;
+    }
 
-            if ((pk1[i] & mask) != (pk2[i] & mask)) {
-                break;
-            }
-        }
+    const uint8_t different = pk1[i] ^ pk2[i];
+#ifdef __GNUC__
+    const unsigned int j = (unsigned int)__builtin_clz(different) - (sizeof(unsigned int) - 1) * 8;
+#else
+    unsigned int j = 0;
 
-        break;
+    while ((different & (0x80 >> j)) == 0) {
+        ++j;
     }
 
+#endif
+
     return i * 8 + j;
 }
 
-/* Shared key generations are costly, it is therefor smart to store commonly used
- * ones so that they can re used later without being computed again.
- *
- * If shared key is already in shared_keys, copy it to shared_key.
- * else generate it into shared_key and copy it to shared_keys
+/* Copy shared_key to encrypt/decrypt DHT packet from public_key into shared_key
+ * for packets that we receive.
  */
-void get_shared_key(Shared_Keys *shared_keys, uint8_t *shared_key, const uint8_t *secret_key, const uint8_t *public_key)
+void DHT_get_shared_key_recv(DHT *dht, uint8_t *shared_key, const uint8_t *public_key)
 {
-    uint32_t num = ~0;
-    uint32_t curr = 0;
+    shared_key_cache_get(dht->shared_keys, shared_key, dht->self_secret_key, public_key);
+}
 
-    for (uint32_t i = 0; i < MAX_KEYS_PER_SLOT; ++i) {
-        const int index = public_key[30] * MAX_KEYS_PER_SLOT + i;
-        Shared_Key *const key = &shared_keys->keys[index];
+/* Copy shared_key to encrypt/decrypt DHT packet from public_key into shared_key
+ * for packets that we send.
+ */
+void DHT_get_shared_key_sent(DHT *dht, uint8_t *shared_key, const uint8_t *public_key)
+{
+    shared_key_cache_get(dht->shared_keys, shared_key, dht->self_secret_key, public_key);
+}
 
-        if (key->stored) {
-            if (id_equal(public_key, key->public_key)) {
-                memcpy(shared_key, key->shared_key, CRYPTO_SHARED_KEY_SIZE);
-                ++key->times_requested;
-                key->time_last_requested = unix_time();
-                return;
-            }
+static void dht_shared_key_computed(void *object, const uint8_t *public_key, const uint8_t *shared_key,
+                                    IP_Port source, const uint8_t *packet, uint16_t length, void *userdata)
+{
+    DHT *const dht = (DHT *)object;
+    shared_key_cache_put(dht->shared_keys, public_key, shared_key);
+    networking_dispatch(dht->net, source, packet, length, userdata);
+}
 
-            if (num != 0) {
-                if (is_timeout(key->time_last_requested, KEYS_TIMEOUT)) {
-                    num = 0;
-                    curr = index;
-                } else if (num > key->times_requested) {
-                    num = key->times_requested;
-                    curr = index;
-                }
-            }
-        } else if (num != 0) {
-            num = 0;
-            curr = index;
-        }
-    }
+bool dht_defer_for_shared_key(DHT *dht, const uint8_t *public_key, IP_Port source, const uint8_t *packet,
+                              uint16_t length)
+{
+    Crypto_Pool *const pool = networking_crypto_pool(dht->net);
 
-    encrypt_precompute(public_key, secret_key, shared_key);
+    if (pool == nullptr || shared_key_cache_contains(dht->shared_keys, public_key)) {
+        return false;
+    }
 
-    if (num != UINT32_MAX) {
-        Shared_Key *const key = &shared_keys->keys[curr];
-        key->stored = 1;
-        key->times_requested = 1;
-        memcpy(key->public_key, public_key, CRYPTO_PUBLIC_KEY_SIZE);
-        memcpy(key->shared_key, shared_key, CRYPTO_SHARED_KEY_SIZE);
-        key->time_last_requested = unix_time();
+    if (crypto_pool_precompute(pool, public_key, dht->self_secret_key, source, packet, length,
+                               &dht_shared_key_computed, dht) != 0) {
+        /* Rather drop the packet than stall everyone else computing its key. */
+        LOGGER_TRACE(dht->log, "crypto pool full, dropping packet %u", packet[0]);
     }
+
+    return true;
 }
 
-/* Copy shared_key to encrypt/decrypt DHT packet from public_key into shared_key
- * for packets that we receive.
- */
-void DHT_get_shared_key_recv(DHT *dht, uint8_t *shared_key, const uint8_t *public_key)
+int dht_set_shared_key_cache_size(DHT *dht, uint32_t size)
 {
-    get_shared_key(&dht->shared_keys_recv, shared_key, dht->self_secret_key, public_key);
+    Shared_Key_Cache *const cache = shared_key_cache_new(size);
+
+    if (cache == nullptr) {
+        return -1;
+    }
+
+    shared_key_cache_kill(dht->shared_keys);
+    dht->shared_keys = cache;
+    return 0;
 }
 
-/* Copy shared_key to encrypt/decrypt DHT packet from public_key into shared_key
- * for packets that we send.
- */
-void DHT_get_shared_key_sent(DHT *dht, uint8_t *shared_key, const uint8_t *public_key)
+void dht_get_shared_key_cache_stats(const DHT *dht, Shared_Key_Cache_Stats *stats)
 {
-    get_shared_key(&dht->shared_keys_sent, shared_key, dht->self_secret_key, public_key);
+    shared_key_cache_get_stats(dht->shared_keys, stats);
 }
 
 #define CRYPTO_SIZE 1 + CRYPTO_PUBLIC_KEY_SIZE * 2 + CRYPTO_NONCE_SIZE
@@ -340,6 +509,38 @@ int create_request(const uint8_t *send_public_key, const uint8_t *send_secret_ke
     return len + CRYPTO_SIZE;
 }
 
+/* Decrypt a request packet for us with the key shared with its sender.
+ *
+ *  return -1 if not valid request.
+ */
+static int open_request(const uint8_t *shared_key, uint8_t *data, uint8_t *request_id, const uint8_t *packet,
+                        uint16_t length)
+{
+    const uint8_t *const nonce = packet + 1 + CRYPTO_PUBLIC_KEY_SIZE * 2;
+    uint8_t temp[MAX_CRYPTO_REQUEST_SIZE];
+    int len1 = decrypt_data_symmetric(shared_key, nonce, packet + CRYPTO_SIZE, length - CRYPTO_SIZE, temp);
+
+    if (len1 == -1 || len1 == 0) {
+        crypto_memzero(temp, MAX_CRYPTO_REQUEST_SIZE);
+        return -1;
+    }
+
+    request_id[0] = temp[0];
+    --len1;
+    memcpy(data, temp + 1, len1);
+    crypto_memzero(temp, MAX_CRYPTO_REQUEST_SIZE);
+    return len1;
+}
+
+static bool valid_request(const uint8_t *self_public_key, const uint8_t *packet, uint16_t length)
+{
+    if (length <= CRYPTO_SIZE + CRYPTO_MAC_SIZE || length > MAX_CRYPTO_REQUEST_SIZE) {
+        return false;
+    }
+
+    return id_equal(packet + 1, self_public_key);
+}
+
 /* Puts the senders public key in the request in public_key, the data from the request
  * in data if a friend or ping request was sent to us and returns the length of the data.
  * packet is the request packet and length is its length.
@@ -353,30 +554,30 @@ int handle_request(const uint8_t *self_public_key, const uint8_t *self_secret_ke
         return -1;
     }
 
-    if (length <= CRYPTO_SIZE + CRYPTO_MAC_SIZE || length > MAX_CRYPTO_REQUEST_SIZE) {
-        return -1;
-    }
-
-    if (!id_equal(packet + 1, self_public_key)) {
+    if (!valid_request(self_public_key, packet, length)) {
         return -1;
     }
 
     memcpy(public_key, packet + 1 + CRYPTO_PUBLIC_KEY_SIZE, CRYPTO_PUBLIC_KEY_SIZE);
-    const uint8_t *const nonce = packet + 1 + CRYPTO_PUBLIC_KEY_SIZE * 2;
-    uint8_t temp[MAX_CRYPTO_REQUEST_SIZE];
-    int len1 = decrypt_data(public_key, self_secret_key, nonce,
-                            packet + CRYPTO_SIZE, length - CRYPTO_SIZE, temp);
+    uint8_t shared_key[CRYPTO_SHARED_KEY_SIZE];
+    encrypt_precompute(public_key, self_secret_key, shared_key);
+    const int len = open_request(shared_key, data, request_id, packet, length);
+    crypto_memzero(shared_key, sizeof(shared_key));
+    return len;
+}
 
-    if (len1 == -1 || len1 == 0) {
-        crypto_memzero(temp, MAX_CRYPTO_REQUEST_SIZE);
+/* Like handle_request(), but with the DHT's cached shared keys. */
+static int dht_handle_request(DHT *dht, uint8_t *public_key, uint8_t *data, uint8_t *request_id,
+                              const uint8_t *packet, uint16_t length)
+{
+    if (!valid_request(dht->self_public_key, packet, length)) {
         return -1;
     }
 
-    request_id[0] = temp[0];
-    --len1;
-    memcpy(data, temp + 1, len1);
-    crypto_memzero(temp, MAX_CRYPTO_REQUEST_SIZE);
-    return len1;
+    memcpy(public_key, packet + 1 + CRYPTO_PUBLIC_KEY_SIZE, CRYPTO_PUBLIC_KEY_SIZE);
+    uint8_t shared_key[CRYPTO_SHARED_KEY_SIZE];
+    DHT_get_shared_key_recv(dht, shared_key, public_key);
+    return open_request(shared_key, data, request_id, packet, length);
 }
 
 #define PACKED_NODE_SIZE_IP4 (1 + SIZE_IP4 + sizeof(uint16_t) + CRYPTO_PUBLIC_KEY_SIZE)
@@ -630,11 +831,6 @@ static uint32_t index_of_client_pk(const Client_data *array, uint32_t size, cons
     INDEX_OF_PK
 }
 
-static uint32_t index_of_friend_pk(const DHT_Friend *array, uint32_t size, const uint8_t *pk)
-{
-    INDEX_OF_PK
-}
-
 static uint32_t index_of_node_pk(const Node_format *array, uint32_t size, const uint8_t *pk)
 {
     INDEX_OF_PK
@@ -656,6 +852,216 @@ static uint32_t index_of_client_ip_port(const Client_data *array, uint32_t size,
     return UINT32_MAX;
 }
 
+/* The close list is a table of LCLIENT_LENGTH buckets of LCLIENT_NODES nodes
+ * each: a node goes in the bucket numbered after how many leading bits its
+ * public key shares with ours. Looking a key up only needs its bucket, and
+ * addresses are found through a hash index kept next to the list.
+ */
+static unsigned int close_bucket(const DHT *dht, const uint8_t *public_key)
+{
+    const unsigned int bucket = bit_by_bit_cmp(public_key, dht->self_public_key);
+    return bucket < LCLIENT_LENGTH ? bucket : LCLIENT_LENGTH - 1;
+}
+
+/* return index of public_key in the close list or UINT32_MAX if not found. */
+static uint32_t index_of_close_pk(const DHT *dht, const uint8_t *public_key)
+{
+    const uint32_t first = close_bucket(dht, public_key) * LCLIENT_NODES;
+    const uint32_t index = index_of_client_pk(&dht->close_clientlist[first], LCLIENT_NODES, public_key);
+    return index == UINT32_MAX ? UINT32_MAX : first + index;
+}
+
+static uint32_t ip_port_hash(const IP_Port *ip_port)
+{
+    uint32_t hash = ip_port->port;
+
+    if (net_family_is_ipv4(ip_port->ip.family)) {
+        hash ^= ip_port->ip.ip.v4.uint32;
+    } else {
+        for (size_t i = 0; i < 4; ++i) {
+            hash = hash * 31 + ip_port->ip.ip.v6.uint32[i];
+        }
+    }
+
+    hash *= 2654435761u;
+    return (hash ^ (hash >> 16)) % CLOSE_IP_HASH_SIZE;
+}
+
+static const IP_Port *close_ip_entry(const DHT *dht, uint32_t entry)
+{
+    const Client_data *const client = &dht->close_clientlist[entry / 2];
+    return entry % 2 == 0 ? &client->assoc4.ip_port : &client->assoc6.ip_port;
+}
+
+static bool close_ip_entry_set(const DHT *dht, uint32_t entry)
+{
+    const Family family = close_ip_entry(dht, entry)->ip.family;
+    return entry % 2 == 0 ? net_family_is_ipv4(family) : net_family_is_ipv6(family);
+}
+
+/* Add the addresses of close_clientlist[index] to the index. */
+static void close_ip_index(DHT *dht, uint32_t index)
+{
+    for (uint32_t entry = index * 2; entry < index * 2 + 2; ++entry) {
+        if (!close_ip_entry_set(dht, entry)) {
+            continue;
+        }
+
+        const uint32_t hash = ip_port_hash(close_ip_entry(dht, entry));
+        dht->close_ip_next[entry] = dht->close_ip_heads[hash];
+        dht->close_ip_heads[hash] = entry + 1;
+    }
+}
+
+/* Remove the addresses of close_clientlist[index] from the index. Must be
+ * called before changing them.
+ */
+static void close_ip_unindex(DHT *dht, uint32_t index)
+{
+    for (uint32_t entry = index * 2; entry < index * 2 + 2; ++entry) {
+        if (!close_ip_entry_set(dht, entry)) {
+            continue;
+        }
+
+        uint16_t *link = &dht->close_ip_heads[ip_port_hash(close_ip_entry(dht, entry))];
+
+        while (*link != 0 && *link != entry + 1) {
+            link = &dht->close_ip_next[*link - 1];
+        }
+
+        if (*link != 0) {
+            *link = dht->close_ip_next[entry];
+        }
+    }
+}
+
+static void close_timer(void *object, uint32_t number);
+static void close_node_timer(void *object, uint32_t number);
+
+/* Have close_timer() run in the next run, after adding nodes to to_bootstrap. */
+static void wake_close(DHT *dht)
+{
+    timer_wheel_set(dht->timers, &dht->close_timer, unix_time(), &close_timer, dht, 0);
+}
+
+/* Set the timer of close_clientlist[index] to the first time one of its
+ * addresses needs pinging or times out. Must be called after changing them.
+ */
+static void schedule_close_node(DHT *dht, uint32_t index)
+{
+    const Client_data *const client = &dht->close_clientlist[index];
+    const IPPTsPng *const assocs[] = { &client->assoc6, &client->assoc4 };
+    uint64_t deadline = UINT64_MAX;
+    bool good = false;
+
+    for (size_t i = 0; i < ARRAY_SIZE(assocs); ++i) {
+        if (is_timeout(assocs[i]->timestamp, KILL_NODE_TIMEOUT)) {
+            continue;
+        }
+
+        deadline = min_u64(deadline, min_u64(assocs[i]->last_pinged + PING_INTERVAL,
+                                             assocs[i]->timestamp + KILL_NODE_TIMEOUT));
+
+        if (!is_timeout(assocs[i]->timestamp, BAD_NODE_TIMEOUT)) {
+            good = true;
+        }
+    }
+
+    Timer_Id *const timer = &dht->close_node_timers[index];
+
+    if (deadline == UINT64_MAX) {
+        if (*timer != 0) {
+            timer_wheel_cancel(dht->timers, *timer);
+            *timer = 0;
+            --dht->close_live;
+        }
+
+        return;
+    }
+
+    if (*timer == 0) {
+        ++dht->close_live;
+    }
+
+    timer_wheel_set(dht->timers, timer, deadline, &close_node_timer, dht, index);
+
+    if (*timer == 0) {
+        --dht->close_live;
+    }
+
+    /* A good node makes the get nodes requests possible again. */
+    if (good && !timer_wheel_pending(dht->timers, dht->close_timer)) {
+        wake_close(dht);
+    }
+}
+
+/* Rebuild the address index and the node timers after rewriting the close
+ * list.
+ */
+static void close_reindex(DHT *dht)
+{
+    memset(dht->close_ip_heads, 0, sizeof(dht->close_ip_heads));
+
+    for (uint32_t i = 0; i < LCLIENT_LIST; ++i) {
+        close_ip_index(dht, i);
+        schedule_close_node(dht, i);
+    }
+}
+
+/* Move the close list nodes to the buckets they belong in after our public
+ * key changed. Nodes that don't fit any more are dropped.
+ */
+static void close_rebucket(DHT *dht)
+{
+    Client_data *const old_list = (Client_data *)malloc(sizeof(dht->close_clientlist));
+
+    if (old_list != nullptr) {
+        memcpy(old_list, dht->close_clientlist, sizeof(dht->close_clientlist));
+    }
+
+    memset(dht->close_clientlist, 0, sizeof(dht->close_clientlist));
+
+    for (uint32_t i = 0; old_list != nullptr && i < LCLIENT_LIST; ++i) {
+        if (old_list[i].assoc4.timestamp == 0 && old_list[i].assoc6.timestamp == 0) {
+            continue;
+        }
+
+        Client_data *const bucket = &dht->close_clientlist[close_bucket(dht, old_list[i].public_key) * LCLIENT_NODES];
+
+        for (uint32_t j = 0; j < LCLIENT_NODES; ++j) {
+            if (bucket[j].assoc4.timestamp == 0 && bucket[j].assoc6.timestamp == 0) {
+                bucket[j] = old_list[i];
+                break;
+            }
+        }
+    }
+
+    free(old_list);
+    close_reindex(dht);
+}
+
+/* return index of the close list node with address ip_port or UINT32_MAX if
+ *   not found.
+ */
+static uint32_t index_of_close_ip_port(const DHT *dht, const IP_Port *ip_port)
+{
+    if (!net_family_is_ipv4(ip_port->ip.family) && !net_family_is_ipv6(ip_port->ip.family)) {
+        return UINT32_MAX;
+    }
+
+    const uint32_t family_entry = net_family_is_ipv4(ip_port->ip.family) ? 0 : 1;
+
+    for (uint16_t link = dht->close_ip_heads[ip_port_hash(ip_port)]; link != 0; link = dht->close_ip_next[link - 1]) {
+        const uint32_t entry = link - 1;
+
+        if (entry % 2 == family_entry && ipport_equal(close_ip_entry(dht, entry), ip_port)) {
+            return entry / 2;
+        }
+    }
+
+    return UINT32_MAX;
+}
+
 /* Update ip_port of client if it's needed.
  */
 static void update_client(Logger *log, int index, Client_data *client, IP_Port ip_port)
@@ -687,19 +1093,91 @@ static void update_client(Logger *log, int index, Client_data *client, IP_Port i
         return;
     }
 
+    if (!ipport_equal(&assoc->ip_port, &ip_port)) {
+        assoc->rtt = 0;
+    }
+
     assoc->ip_port = ip_port;
     assoc->timestamp = unix_time();
 }
 
-/* Check if client with public_key is already in list of length length.
+/* The client lists of friends are kept ordered: the entries never used first,
+ * then the others furthest from the friend's key first. The first entry is
+ * the one a closer node replaces, unless there are bad ones.
+ */
+static bool client_unused(const Client_data *client)
+{
+    return client->assoc4.timestamp == 0 && client->assoc6.timestamp == 0;
+}
+
+/* return true if client1 goes before client2 in a list ordered for
+ *   comp_public_key.
+ */
+static bool client_goes_before(const Client_data *client1, const Client_data *client2,
+                               const uint8_t *comp_public_key)
+{
+    if (client_unused(client1) || client_unused(client2)) {
+        return !client_unused(client2);
+    }
+
+    return id_closest(comp_public_key, client1->public_key, client2->public_key) == 2;
+}
+
+/* Move list[index] to where it belongs in the ordered list, after its key or
+ * use changed. Only the entries between its old and new place are shifted.
+ *
+ * return its new index.
+ */
+static uint32_t client_list_reorder(Client_data *list, uint32_t length, uint32_t index, const uint8_t *comp_public_key)
+{
+    const Client_data client = list[index];
+    uint32_t low;
+    uint32_t high;
+
+    if (index > 0 && client_goes_before(&client, &list[index - 1], comp_public_key)) {
+        low = 0;
+        high = index - 1;
+    } else if (index + 1 < length && client_goes_before(&list[index + 1], &client, comp_public_key)) {
+        low = index + 1;
+        high = length - 1;
+    } else {
+        return index;
+    }
+
+    /* The first entry in [low, high] the client goes before, or high + 1. */
+    ++high;
+
+    while (low < high) {
+        const uint32_t mid = low + (high - low) / 2;
+
+        if (client_goes_before(&client, &list[mid], comp_public_key)) {
+            high = mid;
+        } else {
+            low = mid + 1;
+        }
+    }
+
+    if (low < index) {
+        memmove(&list[low + 1], &list[low], (index - low) * sizeof(Client_data));
+    } else {
+        --low;
+        memmove(&list[index], &list[index + 1], (low - index) * sizeof(Client_data));
+    }
+
+    list[low] = client;
+    return low;
+}
+
+/* Check if client with public_key is already in list of length length.
  * If it is then set its corresponding timestamp to current time.
  * If the id is already in the list with a different ip_port, update it.
+ * The list is kept ordered for comp_public_key.
  * TODO(irungentoo): Maybe optimize this.
  *
  *  return True(1) or False(0)
  */
 static int client_or_ip_port_in_list(Logger *log, Client_data *list, uint16_t length, const uint8_t *public_key,
-                                     IP_Port ip_port)
+                                     IP_Port ip_port, const uint8_t *comp_public_key)
 {
     const uint64_t temp_time = unix_time();
     uint32_t index = index_of_client_pk(list, length, public_key);
@@ -707,6 +1185,7 @@ static int client_or_ip_port_in_list(Logger *log, Client_data *list, uint16_t le
     /* if public_key is in list, find it and maybe overwrite ip_port */
     if (index != UINT32_MAX) {
         update_client(log, index, &list[index], ip_port);
+        client_list_reorder(list, length, index, comp_public_key);
         return 1;
     }
 
@@ -740,9 +1219,45 @@ static int client_or_ip_port_in_list(Logger *log, Client_data *list, uint16_t le
 
     /* kill the other address, if it was set */
     memset(assoc, 0, sizeof(IPPTsPng));
+    client_list_reorder(list, length, index, comp_public_key);
     return 1;
 }
 
+/* client_or_ip_port_in_list() for the close list, without walking it.
+ *
+ * A node found by its address under a new public key doesn't get the key
+ * written into its entry, as the key likely belongs in another bucket: the
+ * address is dropped from the entry instead and false returned, so the caller
+ * adds the new key where it belongs.
+ */
+static bool close_client_or_ip_port_in_list(DHT *dht, const uint8_t *public_key, IP_Port ip_port)
+{
+    uint32_t index = index_of_close_pk(dht, public_key);
+
+    if (index != UINT32_MAX) {
+        close_ip_unindex(dht, index);
+        update_client(dht->log, index, &dht->close_clientlist[index], ip_port);
+        close_ip_index(dht, index);
+        schedule_close_node(dht, index);
+        return true;
+    }
+
+    index = index_of_close_ip_port(dht, &ip_port);
+
+    if (index == UINT32_MAX) {
+        return false;
+    }
+
+    Client_data *const client = &dht->close_clientlist[index];
+    close_ip_unindex(dht, index);
+    memset(net_family_is_ipv4(ip_port.ip.family) ? &client->assoc4 : &client->assoc6, 0, sizeof(IPPTsPng));
+    close_ip_index(dht, index);
+    schedule_close_node(dht, index);
+
+    LOGGER_DEBUG(dht->log, "coipil[%u]: address taken over by another public_key", index);
+    return false;
+}
+
 /* Add node to the node list making sure only the nodes closest to cmp_pk are in the list.
  */
 bool add_to_list(Node_format *nodes_list, unsigned int length, const uint8_t *pk, IP_Port ip_port,
@@ -841,6 +1356,67 @@ static void get_close_nodes_inner(const uint8_t *public_key, Node_format *nodes_
     *num_nodes_ptr = num_nodes;
 }
 
+static bool pk_bit(const uint8_t *pk, unsigned int bit)
+{
+    return (pk[bit / 8] >> (7 - bit % 8)) & 1;
+}
+
+/* Put the close list buckets in order of the distance of their nodes to
+ * public_key: every node in a bucket is closer to public_key than all nodes in
+ * the buckets after it.
+ *
+ * Nodes in public_key's own bucket share more leading bits with it than any
+ * other. Those in the buckets above share exactly as many, and among them the
+ * first bit where a bucket's nodes differ from the others decides. Those in
+ * the buckets below share fewer bits the lower the bucket.
+ */
+static void close_buckets_by_distance(const DHT *dht, const uint8_t *public_key, uint8_t *order)
+{
+    const unsigned int own = close_bucket(dht, public_key);
+    uint8_t farther[LCLIENT_LENGTH];
+    unsigned int num_farther = 0;
+    unsigned int num = 0;
+
+    order[num++] = own;
+
+    for (unsigned int bucket = own + 1; bucket < LCLIENT_LENGTH - 1; ++bucket) {
+        /* Nodes in this bucket have the opposite bit to ours here, all nodes
+         * in the buckets above have our bit. */
+        if (pk_bit(public_key, bucket) != pk_bit(dht->self_public_key, bucket)) {
+            order[num++] = bucket;
+        } else {
+            farther[num_farther++] = bucket;
+        }
+    }
+
+    if (own != LCLIENT_LENGTH - 1) {
+        order[num++] = LCLIENT_LENGTH - 1;
+    }
+
+    while (num_farther > 0) {
+        order[num++] = farther[--num_farther];
+    }
+
+    for (unsigned int bucket = own; bucket > 0; --bucket) {
+        order[num++] = bucket - 1;
+    }
+}
+
+/* get_close_nodes_inner() for the close list, only going through as many
+ * buckets as it takes to find MAX_SENT_NODES nodes.
+ */
+static void get_close_nodes_close_list(const DHT *dht, const uint8_t *public_key, Node_format *nodes_list,
+                                       Family sa_family, uint32_t *num_nodes_ptr, uint8_t is_LAN, uint8_t want_good)
+{
+    uint8_t order[LCLIENT_LENGTH];
+    close_buckets_by_distance(dht, public_key, order);
+
+    for (uint32_t i = 0; i < LCLIENT_LENGTH && *num_nodes_ptr < MAX_SENT_NODES; ++i) {
+        get_close_nodes_inner(public_key, nodes_list, sa_family, &dht->close_clientlist[order[i] * LCLIENT_NODES],
+                              LCLIENT_NODES, num_nodes_ptr, is_LAN, want_good);
+    }
+}
+
 /* Find MAX_SENT_NODES nodes closest to the public_key for the send nodes request:
  * put them in the nodes_list and return how many were found.
  *
@@ -853,8 +1429,7 @@ static int get_somewhat_close_nodes(const DHT *dht, const uint8_t *public_key, N
                                     Family sa_family, uint8_t is_LAN, uint8_t want_good)
 {
     uint32_t num_nodes = 0;
-    get_close_nodes_inner(public_key, nodes_list, sa_family,
-                          dht->close_clientlist, LCLIENT_LIST, &num_nodes, is_LAN, 0);
+    get_close_nodes_close_list(dht, public_key, nodes_list, sa_family, &num_nodes, is_LAN, 0);
 
     /* TODO(irungentoo): uncomment this when hardening is added to close friend clients */
 #if 0
@@ -883,63 +1458,6 @@ int get_close_nodes(const DHT *dht, const uint8_t *public_key, Node_format *node
     return get_somewhat_close_nodes(dht, public_key, nodes_list, sa_family, is_LAN, want_good);
 }
 
-typedef struct {
-    const uint8_t *base_public_key;
-    Client_data entry;
-} DHT_Cmp_data;
-
-static int cmp_dht_entry(const void *a, const void *b)
-{
-    DHT_Cmp_data cmp1, cmp2;
-    memcpy(&cmp1, a, sizeof(DHT_Cmp_data));
-    memcpy(&cmp2, b, sizeof(DHT_Cmp_data));
-    const Client_data entry1 = cmp1.entry;
-    const Client_data entry2 = cmp2.entry;
-    const uint8_t *cmp_public_key = cmp1.base_public_key;
-
-#define ASSOC_TIMEOUT(assoc) is_timeout((assoc).timestamp, BAD_NODE_TIMEOUT)
-
-    bool t1 = ASSOC_TIMEOUT(entry1.assoc4) && ASSOC_TIMEOUT(entry1.assoc6);
-    bool t2 = ASSOC_TIMEOUT(entry2.assoc4) && ASSOC_TIMEOUT(entry2.assoc6);
-
-    if (t1 && t2) {
-        return 0;
-    }
-
-    if (t1) {
-        return -1;
-    }
-
-    if (t2) {
-        return 1;
-    }
-
-#define INCORRECT_HARDENING(assoc) hardening_correct(&(assoc).hardening) != HARDENING_ALL_OK
-
-    t1 = INCORRECT_HARDENING(entry1.assoc4) && INCORRECT_HARDENING(entry1.assoc6);
-    t2 = INCORRECT_HARDENING(entry2.assoc4) && INCORRECT_HARDENING(entry2.assoc6);
-
-    if (t1 && !t2) {
-        return -1;
-    }
-
-    if (!t1 && t2) {
-        return 1;
-    }
-
-    const int close = id_closest(cmp_public_key, entry1.public_key, entry2.public_key);
-
-    if (close == 1) {
-        return 1;
-    }
-
-    if (close == 2) {
-        return -1;
-    }
-
-    return 0;
-}
-
 /* Is it ok to store node with public_key in client.
  *
  * return 0 if node can't be stored.
@@ -952,24 +1470,6 @@ static unsigned int store_node_ok(const Client_data *client, const uint8_t *publ
            || id_closest(comp_public_key, client->public_key, public_key) == 2;
 }
 
-static void sort_client_list(Client_data *list, unsigned int length, const uint8_t *comp_public_key)
-{
-    // Pass comp_public_key to qsort with each Client_data entry, so the
-    // comparison function can use it as the base of comparison.
-    VLA(DHT_Cmp_data, cmp_list, length);
-
-    for (uint32_t i = 0; i < length; i++) {
-        cmp_list[i].base_public_key = comp_public_key;
-        cmp_list[i].entry = list[i];
-    }
-
-    qsort(cmp_list, length, sizeof(DHT_Cmp_data), cmp_dht_entry);
-
-    for (uint32_t i = 0; i < length; i++) {
-        list[i] = cmp_list[i].entry;
-    }
-}
-
 static void update_client_with_reset(Client_data *client, const IP_Port *ip_port)
 {
     IPPTsPng *ipptp_write = nullptr;
@@ -985,6 +1485,7 @@ static void update_client_with_reset(Client_data *client, const IP_Port *ip_port
 
     ipptp_write->ip_port = *ip_port;
     ipptp_write->timestamp = unix_time();
+    ipptp_write->rtt = 0;
 
     ip_reset(&ipptp_write->ret_ip_port.ip);
     ipptp_write->ret_ip_port.port = 0;
@@ -994,17 +1495,9 @@ static void update_client_with_reset(Client_data *client, const IP_Port *ip_port
     memset(ipptp_clear, 0, sizeof(*ipptp_clear));
 }
 
-/* Replace a first bad (or empty) node with this one
- *  or replace a possibly bad node (tests failed or not done yet)
- *  that is further than any other in the list
- *  from the comp_public_key
- *  or replace a good node that is further
- *  than any other in the list from the comp_public_key
- *  and further than public_key.
- *
- * Do not replace any node if the list has no bad or possibly bad nodes
- *  and all nodes in the list are closer to comp_public_key
- *  than public_key.
+/* Replace a bad (or unused) node in the ordered list with this one,
+ *  or else the node furthest from comp_public_key if it is further than
+ *  public_key.
  *
  *  returns true when the item was stored, false otherwise */
 static bool replace_all(Client_data    *list,
@@ -1017,17 +1510,26 @@ static bool replace_all(Client_data    *list,
         return false;
     }
 
-    if (!store_node_ok(&list[1], public_key, comp_public_key) &&
-            !store_node_ok(&list[0], public_key, comp_public_key)) {
-        return false;
+    uint32_t index = 0;
+
+    while (index < length && !(is_timeout(list[index].assoc4.timestamp, BAD_NODE_TIMEOUT)
+                               && is_timeout(list[index].assoc6.timestamp, BAD_NODE_TIMEOUT))) {
+        ++index;
     }
 
-    sort_client_list(list, length, comp_public_key);
+    if (index == length) {
+        if (!store_node_ok(&list[0], public_key, comp_public_key)) {
+            return false;
+        }
+
+        index = 0;
+    }
 
-    Client_data *const client = &list[0];
+    Client_data *const client = &list[index];
     id_copy(client->public_key, public_key);
 
     update_client_with_reset(client, &ip_port);
+    client_list_reorder(list, length, index, comp_public_key);
     return true;
 }
 
@@ -1040,15 +1542,9 @@ static bool replace_all(Client_data    *list,
  */
 static int add_to_close(DHT *dht, const uint8_t *public_key, IP_Port ip_port, bool simulate)
 {
-    unsigned int index = bit_by_bit_cmp(public_key, dht->self_public_key);
-
-    if (index >= LCLIENT_LENGTH) {
-        index = LCLIENT_LENGTH - 1;
-    }
+    const unsigned int index = close_bucket(dht, public_key);
 
     for (uint32_t i = 0; i < LCLIENT_NODES; ++i) {
-        /* TODO(iphydf): write bounds checking test to catch the case that
-         * index is left as >= LCLIENT_LENGTH */
         Client_data *const client = &dht->close_clientlist[(index * LCLIENT_NODES) + i];
 
         if (!is_timeout(client->assoc4.timestamp, BAD_NODE_TIMEOUT) ||
@@ -1060,8 +1556,11 @@ static int add_to_close(DHT *dht, const uint8_t *public_key, IP_Port ip_port, bo
             return 0;
         }
 
+        close_ip_unindex(dht, (index * LCLIENT_NODES) + i);
         id_copy(client->public_key, public_key);
         update_client_with_reset(client, &ip_port);
+        close_ip_index(dht, (index * LCLIENT_NODES) + i);
+        schedule_close_node(dht, (index * LCLIENT_NODES) + i);
         return 0;
     }
 
@@ -1075,6 +1574,21 @@ bool node_addable_to_close_list(DHT *dht, const uint8_t *public_key, IP_Port ip_
     return add_to_close(dht, public_key, ip_port, 1) == 0;
 }
 
+bool node_in_close_list(const DHT *dht, const uint8_t *public_key, IP_Port ip_port)
+{
+    const uint32_t index = index_of_close_pk(dht, public_key);
+
+    if (index == UINT32_MAX) {
+        return 0;
+    }
+
+    const IPPTsPng *const assoc = net_family_is_ipv4(ip_port.ip.family)
+                                  ? &dht->close_clientlist[index].assoc4
+                                  : &dht->close_clientlist[index].assoc6;
+
+    return !is_timeout(assoc->timestamp, BAD_NODE_TIMEOUT) && ipport_equal(&assoc->ip_port, &ip_port);
+}
+
 static bool is_pk_in_client_list(const Client_data *list, unsigned int client_list_length, const uint8_t *public_key,
                                  IP_Port ip_port)
 {
@@ -1093,13 +1607,282 @@ static bool is_pk_in_client_list(const Client_data *list, unsigned int client_li
 
 static bool is_pk_in_close_list(DHT *dht, const uint8_t *public_key, IP_Port ip_port)
 {
-    unsigned int index = bit_by_bit_cmp(public_key, dht->self_public_key);
+    const unsigned int index = close_bucket(dht, public_key);
+    return is_pk_in_client_list(dht->close_clientlist + index * LCLIENT_NODES, LCLIENT_NODES, public_key, ip_port);
+}
+
+static void friend_timer(void *object, uint32_t number);
+
+static void wake_friend(DHT *dht, uint32_t friend_num)
+{
+    timer_wheel_set(dht->timers, &dht->friends_list[friend_num].timer, unix_time(), &friend_timer, dht, friend_num);
+}
+
+/* return the index in DHT::friends_by_key of the first friend whose key is not
+ *   less than public_key.
+ */
+static uint32_t friend_key_index(const DHT *dht, const uint8_t *public_key)
+{
+    uint32_t low = 0;
+    uint32_t high = dht->num_friends;
+
+    while (low < high) {
+        const uint32_t mid = low + (high - low) / 2;
+        const uint8_t *const mid_key = dht->friends_list[dht->friends_by_key[mid]].public_key;
+
+        if (memcmp(mid_key, public_key, CRYPTO_PUBLIC_KEY_SIZE) < 0) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+
+    return low;
+}
+
+/* return the number of the friend with public_key.
+ * return UINT32_MAX if there is none.
+ */
+static uint32_t friend_number(const DHT *dht, const uint8_t *public_key)
+{
+    const uint32_t index = friend_key_index(dht, public_key);
 
-    if (index >= LCLIENT_LENGTH) {
-        index = LCLIENT_LENGTH - 1;
+    if (index == dht->num_friends || !id_equal(dht->friends_list[dht->friends_by_key[index]].public_key, public_key)) {
+        return UINT32_MAX;
     }
 
-    return is_pk_in_client_list(dht->close_clientlist + index * LCLIENT_NODES, LCLIENT_NODES, public_key, ip_port);
+    return dht->friends_by_key[index];
+}
+
+/* return the DHT_Friend::accept_bits the friend's list currently calls for. */
+static uint16_t friend_accept_bits(const DHT_Friend *dht_friend)
+{
+    if (dht_friend->lookup.running) {
+        return 0;
+    }
+
+    unsigned int bits = CRYPTO_PUBLIC_KEY_SIZE * 8;
+
+    for (uint32_t i = 0; i < MAX_FRIEND_CLIENTS; ++i) {
+        const Client_data *const client = &dht_friend->client_list[i];
+
+        if (is_timeout(client->assoc4.timestamp, BAD_NODE_TIMEOUT)
+                && is_timeout(client->assoc6.timestamp, BAD_NODE_TIMEOUT)) {
+            return 0;
+        }
+
+        const unsigned int client_bits = bit_by_bit_cmp(dht_friend->public_key, client->public_key);
+
+        if (client_bits < bits) {
+            bits = client_bits;
+        }
+    }
+
+    return bits;
+}
+
+/* return the unix_time() at which the first good node in the friend's list
+ *   goes bad, so that its accept_bits drop to 0.
+ * return UINT64_MAX if they are 0 already.
+ */
+static uint64_t friend_accept_deadline(const DHT_Friend *dht_friend)
+{
+    if (dht_friend->accept_bits == 0) {
+        return UINT64_MAX;
+    }
+
+    uint64_t deadline = UINT64_MAX;
+
+    for (uint32_t i = 0; i < MAX_FRIEND_CLIENTS; ++i) {
+        const Client_data *const client = &dht_friend->client_list[i];
+        const uint64_t last_heard = client->assoc4.timestamp > client->assoc6.timestamp
+                                    ? client->assoc4.timestamp : client->assoc6.timestamp;
+        deadline = min_u64(deadline, last_heard + BAD_NODE_TIMEOUT);
+    }
+
+    return deadline;
+}
+
+static void friend_index_accept(DHT *dht, uint32_t friend_num)
+{
+    DHT_Friend *const dht_friend = &dht->friends_list[friend_num];
+
+    if (dht_friend->accept_bits == 0) {
+        dht_friend->open_index = dht->num_open_friends;
+        dht->open_friends[dht->num_open_friends] = friend_num;
+        ++dht->num_open_friends;
+    } else {
+        ++dht->accept_bits_count[dht_friend->accept_bits];
+    }
+}
+
+static void friend_unindex_accept(DHT *dht, uint32_t friend_num)
+{
+    const DHT_Friend *const dht_friend = &dht->friends_list[friend_num];
+
+    if (dht_friend->accept_bits == 0) {
+        --dht->num_open_friends;
+        const uint16_t moved = dht->open_friends[dht->num_open_friends];
+        dht->open_friends[dht_friend->open_index] = moved;
+        dht->friends_list[moved].open_index = dht_friend->open_index;
+    } else {
+        --dht->accept_bits_count[dht_friend->accept_bits];
+    }
+}
+
+/* Bring the friend's accept_bits up to date, after its list or lookup
+ * changed. */
+static void friend_reindex(DHT *dht, uint32_t friend_num)
+{
+    DHT_Friend *const dht_friend = &dht->friends_list[friend_num];
+    const uint16_t bits = friend_accept_bits(dht_friend);
+
+    if (bits == dht_friend->accept_bits) {
+        return;
+    }
+
+    friend_unindex_accept(dht, friend_num);
+    dht_friend->accept_bits = bits;
+    friend_index_accept(dht, friend_num);
+}
+
+/* Make room in the friend index for num friends.
+ *
+ * return -1 on failure.
+ * return 0 on success.
+ */
+static int resize_friend_index(DHT *dht, uint32_t num)
+{
+    uint16_t **const arrays[] = { &dht->friends_by_key, &dht->open_friends, &dht->friend_candidates };
+
+    for (size_t i = 0; i < ARRAY_SIZE(arrays); ++i) {
+        if (num == 0) {
+            free(*arrays[i]);
+            *arrays[i] = nullptr;
+            continue;
+        }
+
+        uint16_t *const temp = (uint16_t *)realloc(*arrays[i], num * sizeof(uint16_t));
+
+        if (temp == nullptr) {
+            return -1;
+        }
+
+        *arrays[i] = temp;
+    }
+
+    return 0;
+}
+
+/* Put the numbers of the friends whose lists could take the node with
+ * public_key in DHT::friend_candidates: the friends with accept_bits 0, and
+ * the others sharing at least their accept_bits leading bits with the node.
+ * The latter share at least the smallest accept_bits of them all with it, so
+ * they are next to each other around public_key in DHT::friends_by_key.
+ *
+ * return the number of candidates.
+ */
+static uint32_t friends_accepting(DHT *dht, const uint8_t *public_key)
+{
+    uint32_t num = dht->num_open_friends;
+    memcpy(dht->friend_candidates, dht->open_friends, num * sizeof(uint16_t));
+
+    if (num == dht->num_friends) {
+        return num;
+    }
+
+    unsigned int min_bits = 1;
+
+    while (min_bits < CRYPTO_PUBLIC_KEY_SIZE * 8 && dht->accept_bits_count[min_bits] == 0) {
+        ++min_bits;
+    }
+
+    const uint32_t index = friend_key_index(dht, public_key);
+
+    for (uint32_t i = index; i < dht->num_friends; ++i) {
+        const uint16_t friend_num = dht->friends_by_key[i];
+        const DHT_Friend *const dht_friend = &dht->friends_list[friend_num];
+        const unsigned int bits = bit_by_bit_cmp(dht_friend->public_key, public_key);
+
+        if (bits < min_bits) {
+            break;
+        }
+
+        if (dht_friend->accept_bits != 0 && bits >= dht_friend->accept_bits) {
+            dht->friend_candidates[num] = friend_num;
+            ++num;
+        }
+    }
+
+    for (uint32_t i = index; i > 0; --i) {
+        const uint16_t friend_num = dht->friends_by_key[i - 1];
+        const DHT_Friend *const dht_friend = &dht->friends_list[friend_num];
+        const unsigned int bits = bit_by_bit_cmp(dht_friend->public_key, public_key);
+
+        if (bits < min_bits) {
+            break;
+        }
+
+        if (dht_friend->accept_bits != 0 && bits >= dht_friend->accept_bits) {
+            dht->friend_candidates[num] = friend_num;
+            ++num;
+        }
+    }
+
+    return num;
+}
+
+static uint32_t index_of_lookup_node(const DHT_Lookup *lookup, const uint8_t *public_key)
+{
+    for (uint32_t i = 0; i < lookup->num_nodes; ++i) {
+        if (id_equal(lookup->nodes[i].node.public_key, public_key)) {
+            return i;
+        }
+    }
+
+    return UINT32_MAX;
+}
+
+/* Add a node to the candidates of a lookup for target, if it is closer to
+ * target than the furthest of them.
+ *
+ * return true if the node was added.
+ */
+static bool lookup_add(DHT_Lookup *lookup, const uint8_t *target, const uint8_t *self_public_key,
+                       const uint8_t *public_key, IP_Port ip_port)
+{
+    if (id_equal(public_key, self_public_key) || index_of_lookup_node(lookup, public_key) != UINT32_MAX) {
+        return false;
+    }
+
+    uint32_t index = lookup->num_nodes;
+
+    while (index > 0 && id_closest(target, public_key, lookup->nodes[index - 1].node.public_key) == 1) {
+        --index;
+    }
+
+    if (index == LOOKUP_CANDIDATES) {
+        return false;
+    }
+
+    if (lookup->num_nodes == LOOKUP_CANDIDATES) {
+        /* The furthest candidate is dropped, an answer from it is ignored. */
+        if (lookup->nodes[LOOKUP_CANDIDATES - 1].state == LOOKUP_ASKED) {
+            --lookup->in_flight;
+        }
+
+        --lookup->num_nodes;
+    }
+
+    memmove(&lookup->nodes[index + 1], &lookup->nodes[index], (lookup->num_nodes - index) * sizeof(Lookup_Node));
+    ++lookup->num_nodes;
+
+    Lookup_Node *const candidate = &lookup->nodes[index];
+    memcpy(candidate->node.public_key, public_key, CRYPTO_PUBLIC_KEY_SIZE);
+    candidate->node.ip_port = ip_port;
+    candidate->asked = 0;
+    candidate->state = LOOKUP_NOT_ASKED;
+    return true;
 }
 
 /* Check if the node obtained with a get_nodes with public_key should be pinged.
@@ -1130,11 +1913,25 @@ static bool ping_node_from_getnodes_ok(DHT *dht, const uint8_t *public_key, IP_P
                 // TODO(irungentoo): ipv6 vs v4
                 add_to_list(dht->to_bootstrap, MAX_CLOSE_TO_BOOTSTRAP_NODES, public_key, ip_port, dht->self_public_key);
             }
+
+            wake_close(dht);
         }
     }
 
-    for (uint32_t i = 0; i < dht->num_friends; ++i) {
-        DHT_Friend *dht_friend = &dht->friends_list[i];
+    const uint32_t num_candidates = friends_accepting(dht, public_key);
+
+    for (uint32_t i = 0; i < num_candidates; ++i) {
+        const uint16_t candidate = dht->friend_candidates[i];
+        DHT_Friend *dht_friend = &dht->friends_list[candidate];
+
+        if (dht_friend->lookup.running) {
+            /* The lookup asks the node if it is among the closest ones. */
+            if (lookup_add(&dht_friend->lookup, dht_friend->public_key, dht->self_public_key, public_key, ip_port)) {
+                ret = true;
+            }
+
+            continue;
+        }
 
         bool store_ok = false;
 
@@ -1160,6 +1957,7 @@ static bool ping_node_from_getnodes_ok(DHT *dht, const uint8_t *public_key, IP_P
                 add_to_list(dht_friend->to_bootstrap, MAX_SENT_NODES, public_key, ip_port, dht_friend->public_key);
             }
 
+            wake_friend(dht, candidate);
             ret = true;
         }
     }
@@ -1185,8 +1983,7 @@ uint32_t addto_lists(DHT *dht, IP_Port ip_port, const uint8_t *public_key)
     /* NOTE: Current behavior if there are two clients with the same id is
      * to replace the first ip by the second.
      */
-    const bool in_close_list = client_or_ip_port_in_list(dht->log, dht->close_clientlist,
-                               LCLIENT_LIST, public_key, ip_port);
+    const bool in_close_list = close_client_or_ip_port_in_list(dht, public_key, ip_port);
 
     /* add_to_close should be called only if !in_list (don't extract to variable) */
     if (in_close_list || add_to_close(dht, public_key, ip_port, 0)) {
@@ -1195,14 +1992,25 @@ uint32_t addto_lists(DHT *dht, IP_Port ip_port, const uint8_t *public_key)
 
     DHT_Friend *friend_foundip = nullptr;
 
-    for (uint32_t i = 0; i < dht->num_friends; ++i) {
-        const bool in_list = client_or_ip_port_in_list(dht->log, dht->friends_list[i].client_list,
-                             MAX_FRIEND_CLIENTS, public_key, ip_port);
+    /* NOTE: a node that changed its key is only replaced by the new one in
+     * the lists that could take the new key.
+     */
+    const uint32_t num_candidates = friends_accepting(dht, public_key);
+
+    for (uint32_t i = 0; i < num_candidates; ++i) {
+        const uint16_t friend_num = dht->friend_candidates[i];
+        DHT_Friend *dht_friend = &dht->friends_list[friend_num];
+        const bool in_list = client_or_ip_port_in_list(dht->log, dht_friend->client_list,
+                             MAX_FRIEND_CLIENTS, public_key, ip_port, dht_friend->public_key);
 
         /* replace_all should be called only if !in_list (don't extract to variable) */
-        if (in_list || replace_all(dht->friends_list[i].client_list, MAX_FRIEND_CLIENTS, public_key,
-                                   ip_port, dht->friends_list[i].public_key)) {
-            DHT_Friend *dht_friend = &dht->friends_list[i];
+        if (in_list || replace_all(dht_friend->client_list, MAX_FRIEND_CLIENTS, public_key,
+                                   ip_port, dht_friend->public_key)) {
+            if (!in_list) {
+                wake_friend(dht, friend_num);
+            }
+
+            friend_reindex(dht, friend_num);
 
             if (id_equal(public_key, dht_friend->public_key)) {
                 friend_foundip = dht_friend;
@@ -1263,18 +2071,15 @@ static void returnedip_ports(DHT *dht, IP_Port ip_port, const uint8_t *public_ke
     }
 
     if (id_equal(public_key, dht->self_public_key)) {
-        update_client_data(dht->close_clientlist, LCLIENT_LIST, ip_port, nodepublic_key);
+        update_client_data(&dht->close_clientlist[close_bucket(dht, nodepublic_key) * LCLIENT_NODES], LCLIENT_NODES,
+                           ip_port, nodepublic_key);
         return;
     }
 
-    for (uint32_t i = 0; i < dht->num_friends; ++i) {
-        if (id_equal(public_key, dht->friends_list[i].public_key)) {
-            Client_data *const client_list = dht->friends_list[i].client_list;
+    const uint32_t friend_num = friend_number(dht, public_key);
 
-            if (update_client_data(client_list, MAX_FRIEND_CLIENTS, ip_port, nodepublic_key)) {
-                return;
-            }
-        }
+    if (friend_num != UINT32_MAX) {
+        update_client_data(dht->friends_list[friend_num].client_list, MAX_FRIEND_CLIENTS, ip_port, nodepublic_key);
     }
 }
 
@@ -1301,7 +2106,13 @@ static int getnodes(DHT *dht, IP_Port ip_port, const uint8_t *public_key, const
         memcpy(plain_message + sizeof(receiver), sendback_node, sizeof(Node_format));
         ping_id = ping_array_add(dht->dht_harden_ping_array, plain_message, sizeof(plain_message));
     } else {
-        ping_id = ping_array_add(dht->dht_ping_array, plain_message, sizeof(receiver));
+        /* Remember what we asked for, for the lookup looking for it, and when,
+         * to know how long the node takes to answer. */
+        const uint64_t sent_time = current_time_monotonic();
+        memcpy(plain_message + sizeof(receiver), client_id, CRYPTO_PUBLIC_KEY_SIZE);
+        memcpy(plain_message + sizeof(receiver) + CRYPTO_PUBLIC_KEY_SIZE, &sent_time, sizeof(sent_time));
+        ping_id = ping_array_add(dht->dht_ping_array, plain_message,
+                                 sizeof(receiver) + CRYPTO_PUBLIC_KEY_SIZE + sizeof(sent_time));
     }
 
     if (ping_id == 0) {
@@ -1389,6 +2200,10 @@ static int handle_getnodes(void *object, IP_Port source, const uint8_t *packet,
         return true;
     }
 
+    if (dht_defer_for_shared_key(dht, packet + 1, source, packet, length)) {
+        return 0;
+    }
+
     uint8_t plain[CRYPTO_NODE_SIZE];
     uint8_t shared_key[CRYPTO_SHARED_KEY_SIZE];
 
@@ -1411,17 +2226,28 @@ static int handle_getnodes(void *object, IP_Port source, const uint8_t *packet,
     return false;
 }
 
-/* return false if no
-   return true if yes */
+/* Check that we sent the get nodes request with ping_id to the node. target is
+ * set to the key the request asked for and sent_time to current_time_monotonic()
+ * when it was sent, if it wasn't a hardening request.
+ *
+ * return false if no
+ * return true if yes */
 static bool sent_getnode_to_node(DHT *dht, const uint8_t *public_key, IP_Port node_ip_port, uint64_t ping_id,
-                                 Node_format *sendback_node)
+                                 Node_format *sendback_node, uint8_t *target, bool *have_target, uint64_t *sent_time)
 {
     uint8_t data[sizeof(Node_format) * 2];
 
-    if (ping_array_check(dht->dht_ping_array, data, sizeof(data), ping_id) == sizeof(Node_format)) {
+    const uint32_t request_size = sizeof(Node_format) + CRYPTO_PUBLIC_KEY_SIZE + sizeof(uint64_t);
+
+    if (ping_array_check(dht->dht_ping_array, data, sizeof(data), ping_id) == request_size) {
         memset(sendback_node, 0, sizeof(Node_format));
+        memcpy(target, data + sizeof(Node_format), CRYPTO_PUBLIC_KEY_SIZE);
+        memcpy(sent_time, data + sizeof(Node_format) + CRYPTO_PUBLIC_KEY_SIZE, sizeof(uint64_t));
+        *have_target = true;
     } else if (ping_array_check(dht->dht_harden_ping_array, data, sizeof(data), ping_id) == sizeof(data)) {
         memcpy(sendback_node, data + sizeof(Node_format), sizeof(Node_format));
+        *have_target = false;
+        *sent_time = 0;
     } else {
         return false;
     }
@@ -1436,12 +2262,193 @@ static bool sent_getnode_to_node(DHT *dht, const uint8_t *public_key, IP_Port no
     return true;
 }
 
+static void set_client_rtt(Client_data *list, uint32_t length, const uint8_t *public_key, IP_Port ip_port,
+                           uint16_t rtt)
+{
+    const uint32_t index = index_of_client_pk(list, length, public_key);
+
+    if (index == UINT32_MAX) {
+        return;
+    }
+
+    IPPTsPng *const assoc = net_family_is_ipv4(ip_port.ip.family) ? &list[index].assoc4 : &list[index].assoc6;
+
+    if (ipport_equal(&assoc->ip_port, &ip_port)) {
+        assoc->rtt = rtt;
+    }
+}
+
+/* Record that the node with public_key at ip_port took rtt milliseconds to
+ * answer a get nodes request, in every list it is in.
+ */
+static void set_rtt(DHT *dht, const uint8_t *public_key, IP_Port ip_port, uint64_t rtt)
+{
+    /* convert IPv4-in-IPv6 to IPv4, as addto_lists() stored it */
+    if (net_family_is_ipv6(ip_port.ip.family) && IPV6_IPV4_IN_V6(ip_port.ip.ip.v6)) {
+        ip_port.ip.family = net_family_ipv4;
+        ip_port.ip.ip.v4.uint32 = ip_port.ip.ip.v6.uint32[3];
+    }
+
+    /* 0 stands for no answer yet. */
+    const uint16_t rtt16 = rtt == 0 ? 1 : (uint16_t)min_u64(rtt, UINT16_MAX);
+    const uint32_t first = close_bucket(dht, public_key) * LCLIENT_NODES;
+    set_client_rtt(&dht->close_clientlist[first], LCLIENT_NODES, public_key, ip_port, rtt16);
+
+    /* The lists it is in are among the ones that could take it. */
+    const uint32_t num_candidates = friends_accepting(dht, public_key);
+
+    for (uint32_t i = 0; i < num_candidates; ++i) {
+        set_client_rtt(dht->friends_list[dht->friend_candidates[i]].client_list, MAX_FRIEND_CLIENTS, public_key,
+                       ip_port, rtt16);
+    }
+}
+
+/* Ask the closest candidates that weren't asked yet, keeping up to
+ * DHT::lookup_parallelism requests in flight. The lookup ends once the
+ * MAX_FRIEND_CLIENTS closest candidates that didn't fail all answered.
+ */
+static void lookup_step(DHT *dht, DHT_Friend *dht_friend)
+{
+    DHT_Lookup *const lookup = &dht_friend->lookup;
+    uint32_t closest = 0;
+    bool any_answered = false;
+
+    for (uint32_t i = 0; i < lookup->num_nodes && closest < MAX_FRIEND_CLIENTS; ++i) {
+        Lookup_Node *const candidate = &lookup->nodes[i];
+
+        if (candidate->state == LOOKUP_FAILED) {
+            continue;
+        }
+
+        if (candidate->state == LOOKUP_NOT_ASKED && lookup->in_flight < dht->lookup_parallelism) {
+            const Node_format *const node = &candidate->node;
+
+            if (getnodes(dht, node->ip_port, node->public_key, dht_friend->public_key, nullptr) == -1) {
+                candidate->state = LOOKUP_FAILED;
+                continue;
+            }
+
+            candidate->state = LOOKUP_ASKED;
+            candidate->asked = unix_time();
+            ++lookup->in_flight;
+        }
+
+        if (candidate->state == LOOKUP_ANSWERED) {
+            any_answered = true;
+        }
+
+        ++closest;
+    }
+
+    if (lookup->in_flight != 0) {
+        return;
+    }
+
+    lookup->running = false;
+    friend_reindex(dht, dht_friend - dht->friends_list);
+
+    if (!any_answered) {
+        /* Nobody could be asked, try again once there are nodes to ask. */
+        lookup->started = 0;
+    }
+}
+
+static void lookup_start(DHT *dht, DHT_Friend *dht_friend)
+{
+    DHT_Lookup *const lookup = &dht_friend->lookup;
+    memset(lookup, 0, sizeof(DHT_Lookup));
+
+    if (dht->lookup_parallelism == 0) {
+        return;
+    }
+
+    lookup->running = true;
+    lookup->started = unix_time();
+    friend_reindex(dht, dht_friend - dht->friends_list);
+
+    Node_format nodes[MAX_SENT_NODES];
+    const int num_nodes = get_close_nodes(dht, dht_friend->public_key, nodes, net_family_unspec, 1, 0);
+
+    for (int i = 0; i < num_nodes; ++i) {
+        lookup_add(lookup, dht_friend->public_key, dht->self_public_key, nodes[i].public_key, nodes[i].ip_port);
+    }
+
+    for (uint32_t i = 0; i < MAX_FRIEND_CLIENTS; ++i) {
+        const Client_data *const client = &dht_friend->client_list[i];
+        const IPPTsPng *const assocs[] = { &client->assoc6, &client->assoc4 };
+
+        for (size_t j = 0; j < ARRAY_SIZE(assocs); ++j) {
+            const IPPTsPng *const assoc = assocs[j];
+
+            if (!is_timeout(assoc->timestamp, BAD_NODE_TIMEOUT)) {
+                lookup_add(lookup, dht_friend->public_key, dht->self_public_key, client->public_key, assoc->ip_port);
+            }
+        }
+    }
+
+    lookup_step(dht, dht_friend);
+}
+
+/* Called when the node with public_key answered a get nodes request for
+ * target, whether the lookup asked it or not. The nodes of the answer that
+ * came closer are asked right away instead of on the next do_DHT().
+ */
+static void lookup_answered(DHT *dht, const uint8_t *target, const uint8_t *public_key)
+{
+    const uint32_t friend_num = friend_number(dht, target);
+
+    if (friend_num == UINT32_MAX || !dht->friends_list[friend_num].lookup.running) {
+        return;
+    }
+
+    DHT_Friend *const dht_friend = &dht->friends_list[friend_num];
+    DHT_Lookup *const lookup = &dht_friend->lookup;
+    const uint32_t index = index_of_lookup_node(lookup, public_key);
+
+    if (index != UINT32_MAX) {
+        if (lookup->nodes[index].state == LOOKUP_ASKED) {
+            --lookup->in_flight;
+        }
+
+        lookup->nodes[index].state = LOOKUP_ANSWERED;
+    }
+
+    lookup_step(dht, dht_friend);
+}
+
+/* Give up on the nodes that didn't answer in time, and ask the next ones. */
+static void do_lookups(DHT *dht)
+{
+    /* Friends with a running lookup are open. Backwards, as a lookup that
+     * ends takes its friend off the list. */
+    for (uint32_t i = dht->num_open_friends; i > 0; --i) {
+        DHT_Friend *const dht_friend = &dht->friends_list[dht->open_friends[i - 1]];
+        DHT_Lookup *const lookup = &dht_friend->lookup;
+
+        if (!lookup->running) {
+            continue;
+        }
+
+        for (uint32_t j = 0; j < lookup->num_nodes; ++j) {
+            Lookup_Node *const candidate = &lookup->nodes[j];
+
+            if (candidate->state == LOOKUP_ASKED && is_timeout(candidate->asked, LOOKUP_QUERY_TIMEOUT)) {
+                candidate->state = LOOKUP_FAILED;
+                --lookup->in_flight;
+            }
+        }
+
+        lookup_step(dht, dht_friend);
+    }
+}
+
 /* Function is needed in following functions. */
 static int send_hardening_getnode_res(const DHT *dht, const Node_format *sendto, const uint8_t *queried_client_id,
                                       const uint8_t *nodes_data, uint16_t nodes_data_length);
 
 static int handle_sendnodes_core(void *object, IP_Port source, const uint8_t *packet, uint16_t length,
-                                 Node_format *plain_nodes, uint16_t size_plain_nodes, uint32_t *num_nodes_out)
+                                 Node_format *plain_nodes, uint16_t size_plain_nodes, uint32_t *num_nodes_out,
+                                 uint8_t *target, bool *have_target)
 {
     DHT *const dht = (DHT *)object;
     const uint32_t cid_size = 1 + CRYPTO_PUBLIC_KEY_SIZE + CRYPTO_NONCE_SIZE + 1 + sizeof(uint64_t) + CRYPTO_MAC_SIZE;
@@ -1479,11 +2486,12 @@ static int handle_sendnodes_core(void *object, IP_Port source, const uint8_t *pa
     }
 
     Node_format sendback_node;
+    uint64_t sent_time;
 
     uint64_t ping_id;
     memcpy(&ping_id, plain + 1 + data_size, sizeof(ping_id));
 
-    if (!sent_getnode_to_node(dht, packet + 1, source, ping_id, &sendback_node)) {
+    if (!sent_getnode_to_node(dht, packet + 1, source, ping_id, &sendback_node, target, have_target, &sent_time)) {
         return 1;
     }
 
@@ -1505,6 +2513,10 @@ static int handle_sendnodes_core(void *object, IP_Port source, const uint8_t *pa
     /* store the address the *request* was sent to */
     addto_lists(dht, source, packet + 1);
 
+    if (sent_time != 0) {
+        set_rtt(dht, packet + 1, source, current_time_monotonic() - sent_time);
+    }
+
     *num_nodes_out = num_nodes;
 
     send_hardening_getnode_res(dht, &sendback_node, packet + 1, plain + 1, data_size);
@@ -1516,13 +2528,12 @@ static int handle_sendnodes_ipv6(void *object, IP_Port source, const uint8_t *pa
     DHT *const dht = (DHT *)object;
     Node_format plain_nodes[MAX_SENT_NODES];
     uint32_t num_nodes;
-
-    if (handle_sendnodes_core(object, source, packet, length, plain_nodes, MAX_SENT_NODES, &num_nodes)) {
-        return 1;
-    }
-
-    if (num_nodes == 0) {
-        return 0;
+    uint8_t target[CRYPTO_PUBLIC_KEY_SIZE];
+    bool have_target;
+
+    if (handle_sendnodes_core(object, source, packet, length, plain_nodes, MAX_SENT_NODES, &num_nodes, target,
+                              &have_target)) {
+        return 1;
     }
 
     for (uint32_t i = 0; i < num_nodes; i++) {
@@ -1532,6 +2543,10 @@ static int handle_sendnodes_ipv6(void *object, IP_Port source, const uint8_t *pa
         }
     }
 
+    if (have_target) {
+        lookup_answered(dht, target, packet + 1);
+    }
+
     return 0;
 }
 
@@ -1541,7 +2556,7 @@ static int handle_sendnodes_ipv6(void *object, IP_Port source, const uint8_t *pa
 int DHT_addfriend(DHT *dht, const uint8_t *public_key, void (*ip_callback)(void *data, int32_t number, IP_Port),
                   void *data, int32_t number, uint16_t *lock_count)
 {
-    const uint32_t friend_num = index_of_friend_pk(dht->friends_list, dht->num_friends, public_key);
+    const uint32_t friend_num = friend_number(dht, public_key);
 
     uint16_t lock_num;
 
@@ -1565,6 +2580,10 @@ int DHT_addfriend(DHT *dht, const uint8_t *public_key, void (*ip_callback)(void
         return 0;
     }
 
+    if (resize_friend_index(dht, dht->num_friends + 1) == -1) {
+        return -1;
+    }
+
     DHT_Friend *const temp = (DHT_Friend *)realloc(dht->friends_list, sizeof(DHT_Friend) * (dht->num_friends + 1));
 
     if (temp == nullptr) {
@@ -1577,6 +2596,13 @@ int DHT_addfriend(DHT *dht, const uint8_t *public_key, void (*ip_callback)(void
     memcpy(dht_friend->public_key, public_key, CRYPTO_PUBLIC_KEY_SIZE);
 
     dht_friend->nat.NATping_id = random_u64();
+
+    /* Its list is empty, so it takes any node. */
+    const uint32_t index = friend_key_index(dht, public_key);
+    memmove(&dht->friends_by_key[index + 1], &dht->friends_by_key[index],
+            (dht->num_friends - index) * sizeof(uint16_t));
+    dht->friends_by_key[index] = dht->num_friends;
+    friend_index_accept(dht, dht->num_friends);
     ++dht->num_friends;
 
     lock_num = dht_friend->lock_count;
@@ -1589,15 +2615,21 @@ int DHT_addfriend(DHT *dht, const uint8_t *public_key, void (*ip_callback)(void
         *lock_count = lock_num + 1;
     }
 
-    dht_friend->num_to_bootstrap = get_close_nodes(dht, dht_friend->public_key, dht_friend->to_bootstrap, net_family_unspec,
-                                   1, 0);
+    if (dht->lookup_parallelism != 0) {
+        lookup_start(dht, dht_friend);
+    } else {
+        dht_friend->num_to_bootstrap = get_close_nodes(dht, dht_friend->public_key, dht_friend->to_bootstrap,
+                                       net_family_unspec, 1, 0);
+    }
+
+    wake_friend(dht, dht->num_friends - 1);
 
     return 0;
 }
 
 int DHT_delfriend(DHT *dht, const uint8_t *public_key, uint16_t lock_count)
 {
-    const uint32_t friend_num = index_of_friend_pk(dht->friends_list, dht->num_friends, public_key);
+    const uint32_t friend_num = friend_number(dht, public_key);
 
     if (friend_num == UINT32_MAX) {
         return -1;
@@ -1614,14 +2646,29 @@ int DHT_delfriend(DHT *dht, const uint8_t *public_key, uint16_t lock_count)
         return 0;
     }
 
+    timer_wheel_cancel(dht->timers, dht_friend->timer);
+    friend_unindex_accept(dht, friend_num);
+    const uint32_t index = friend_key_index(dht, public_key);
+    memmove(&dht->friends_by_key[index], &dht->friends_by_key[index + 1],
+            (dht->num_friends - index - 1) * sizeof(uint16_t));
     --dht->num_friends;
 
     if (dht->num_friends != friend_num) {
         memcpy(&dht->friends_list[friend_num],
                &dht->friends_list[dht->num_friends],
                sizeof(DHT_Friend));
+        /* Its timer and index entries still point at the old friend number. */
+        wake_friend(dht, friend_num);
+        dht->friends_by_key[friend_key_index(dht, dht->friends_list[friend_num].public_key)] = friend_num;
+
+        if (dht->friends_list[friend_num].accept_bits == 0) {
+            dht->open_friends[dht->friends_list[friend_num].open_index] = friend_num;
+        }
     }
 
+    /* Shrinking can't fail in a way that matters: the arrays stay larger. */
+    resize_friend_index(dht, dht->num_friends);
+
     if (dht->num_friends == 0) {
         free(dht->friends_list);
         dht->friends_list = nullptr;
@@ -1644,7 +2691,7 @@ int DHT_getfriendip(const DHT *dht, const uint8_t *public_key, IP_Port *ip_port)
     ip_reset(&ip_port->ip);
     ip_port->port = 0;
 
-    const uint32_t friend_index = index_of_friend_pk(dht->friends_list, dht->num_friends, public_key);
+    const uint32_t friend_index = friend_number(dht, public_key);
 
     if (friend_index == UINT32_MAX) {
         return -1;
@@ -1672,123 +2719,231 @@ int DHT_getfriendip(const DHT *dht, const uint8_t *public_key, IP_Port *ip_port)
     return -1;
 }
 
-/* returns number of nodes not in kill-timeout */
-static uint8_t do_ping_and_sendnode_requests(DHT *dht, uint64_t *lastgetnode, const uint8_t *public_key,
-        Client_data *list, uint32_t list_count, uint32_t *bootstrap_times, bool sortable)
+/* Ping the addresses of client not in kill-timeout every PING_INTERVAL seconds. */
+static void ping_client(DHT *dht, Client_data *client, const uint8_t *public_key)
 {
-    uint8_t not_kill = 0;
-    const uint64_t temp_time = unix_time();
+    IPPTsPng *assocs[] = { &client->assoc6, &client->assoc4 };
+
+    for (size_t j = 0; j < ARRAY_SIZE(assocs); j++) {
+        IPPTsPng *assoc = assocs[j];
 
+        if (!is_timeout(assoc->timestamp, KILL_NODE_TIMEOUT) && is_timeout(assoc->last_pinged, PING_INTERVAL)) {
+            getnodes(dht, assoc->ip_port, client->public_key, public_key, nullptr);
+            assoc->last_pinged = unix_time();
+        }
+    }
+}
+
+/* Send a get nodes request to a random good node in list.
+ *
+ * return false if there is no good node in list.
+ */
+static bool getnodes_random(DHT *dht, uint64_t *lastgetnode, const uint8_t *public_key, Client_data *list,
+                            uint32_t list_count, uint32_t *bootstrap_times)
+{
     uint32_t num_nodes = 0;
     VLA(Client_data *, client_list, list_count * 2);
     VLA(IPPTsPng *, assoc_list, list_count * 2);
-    unsigned int sort = 0;
-    bool sort_ok = false;
 
     for (uint32_t i = 0; i < list_count; i++) {
-        /* If node is not dead. */
         Client_data *client = &list[i];
 
         IPPTsPng *assocs[] = { &client->assoc6, &client->assoc4 };
 
         for (size_t j = 0; j < ARRAY_SIZE(assocs); j++) {
-            IPPTsPng *assoc = assocs[j];
+            /* If node is good. */
+            if (!is_timeout(assocs[j]->timestamp, BAD_NODE_TIMEOUT)) {
+                client_list[num_nodes] = client;
+                assoc_list[num_nodes] = assocs[j];
+                ++num_nodes;
+            }
+        }
+    }
 
-            if (!is_timeout(assoc->timestamp, KILL_NODE_TIMEOUT)) {
-                sort = 0;
-                not_kill++;
+    if (num_nodes == 0) {
+        return false;
+    }
 
-                if (is_timeout(assoc->last_pinged, PING_INTERVAL)) {
-                    getnodes(dht, assoc->ip_port, client->public_key, public_key, nullptr);
-                    assoc->last_pinged = temp_time;
-                }
+    uint32_t rand_node = rand() % num_nodes;
 
-                /* If node is good. */
-                if (!is_timeout(assoc->timestamp, BAD_NODE_TIMEOUT)) {
-                    client_list[num_nodes] = client;
-                    assoc_list[num_nodes] = assoc;
-                    ++num_nodes;
-                }
-            } else {
-                ++sort;
+    if ((num_nodes - 1) != rand_node) {
+        rand_node += rand() % (num_nodes - (rand_node + 1));
+    }
 
-                /* Timed out should be at beginning, if they are not, sort the list. */
-                if (sort > 1 && sort < (((j + 1) * 2) - 1)) {
-                    sort_ok = true;
-                }
+    getnodes(dht, assoc_list[rand_node]->ip_port, client_list[rand_node]->public_key, public_key, nullptr);
+
+    *lastgetnode = unix_time();
+    ++*bootstrap_times;
+    return true;
+}
+
+static void do_ping_and_sendnode_requests(DHT *dht, uint64_t *lastgetnode, const uint8_t *public_key,
+        Client_data *list, uint32_t list_count, uint32_t *bootstrap_times)
+{
+    for (uint32_t i = 0; i < list_count; i++) {
+        ping_client(dht, &list[i], public_key);
+    }
+
+    if (is_timeout(*lastgetnode, GET_NODE_INTERVAL) || *bootstrap_times < MAX_BOOTSTRAP_TIMES) {
+        getnodes_random(dht, lastgetnode, public_key, list, list_count, bootstrap_times);
+    }
+}
+
+/* return the unix_time() at which do_ping_and_sendnode_requests() next has
+ *   something to do in list: a node to ping or to time out, or a get nodes
+ *   request to send.
+ * return UINT64_MAX if nothing happens until nodes are added to the list.
+ */
+static uint64_t ping_and_sendnode_deadline(const Client_data *list, uint32_t list_count, uint64_t lastgetnode,
+        uint32_t bootstrap_times)
+{
+    uint64_t deadline = UINT64_MAX;
+    uint64_t first_ping = UINT64_MAX;
+    bool any_good = false;
+
+    for (uint32_t i = 0; i < list_count; ++i) {
+        const IPPTsPng *const assocs[] = { &list[i].assoc6, &list[i].assoc4 };
+
+        for (size_t j = 0; j < ARRAY_SIZE(assocs); ++j) {
+            const IPPTsPng *const assoc = assocs[j];
+
+            if (is_timeout(assoc->timestamp, KILL_NODE_TIMEOUT)) {
+                continue;
+            }
+
+            first_ping = min_u64(first_ping, assoc->last_pinged + PING_INTERVAL);
+            deadline = min_u64(deadline, assoc->timestamp + KILL_NODE_TIMEOUT);
+
+            if (!is_timeout(assoc->timestamp, BAD_NODE_TIMEOUT)) {
+                any_good = true;
             }
         }
     }
 
-    if (sortable && sort_ok) {
-        sort_client_list(list, list_count, public_key);
+    /* Wait for the last ping due within PING_COALESCE_INTERVAL of the first. */
+    uint64_t ping = first_ping;
+
+    for (uint32_t i = 0; i < list_count && first_ping != UINT64_MAX; ++i) {
+        const IPPTsPng *const assocs[] = { &list[i].assoc6, &list[i].assoc4 };
+
+        for (size_t j = 0; j < ARRAY_SIZE(assocs); ++j) {
+            const uint64_t due = assocs[j]->last_pinged + PING_INTERVAL;
+
+            if (!is_timeout(assocs[j]->timestamp, KILL_NODE_TIMEOUT) && due > ping
+                    && due <= first_ping + PING_COALESCE_INTERVAL) {
+                ping = due;
+            }
+        }
     }
 
-    if ((num_nodes != 0) && (is_timeout(*lastgetnode, GET_NODE_INTERVAL) || *bootstrap_times < MAX_BOOTSTRAP_TIMES)) {
-        uint32_t rand_node = rand() % num_nodes;
+    deadline = min_u64(deadline, ping);
 
-        if ((num_nodes - 1) != rand_node) {
-            rand_node += rand() % (num_nodes - (rand_node + 1));
+    if (any_good) {
+        if (bootstrap_times < MAX_BOOTSTRAP_TIMES) {
+            return unix_time();
         }
 
-        getnodes(dht, assoc_list[rand_node]->ip_port, client_list[rand_node]->public_key, public_key, nullptr);
+        deadline = min_u64(deadline, lastgetnode + GET_NODE_INTERVAL);
+    }
+
+    return deadline;
+}
+
+/* Run the list's timer when do_ping_and_sendnode_requests() next has
+ * something to do, or at other_deadline if that is earlier. */
+static void schedule_list_timer(Timer_Wheel *wheel, Timer_Id *timer, const Client_data *list, uint32_t list_count,
+                                uint64_t lastgetnode, uint32_t bootstrap_times, uint64_t other_deadline,
+                                timer_cb *cb, void *object, uint32_t number)
+{
+    const uint64_t deadline = min_u64(ping_and_sendnode_deadline(list, list_count, lastgetnode, bootstrap_times),
+                                      other_deadline);
 
-        *lastgetnode = temp_time;
-        ++*bootstrap_times;
+    if (deadline == UINT64_MAX) {
+        timer_wheel_cancel(wheel, *timer);
+        *timer = 0;
+        return;
     }
 
-    return not_kill;
+    timer_wheel_set(wheel, timer, deadline, cb, object, number);
 }
 
 /* Ping each client in the "friends" list every PING_INTERVAL seconds. Send a get nodes request
  * every GET_NODE_INTERVAL seconds to a random good node for each "friend" in our "friends" list.
+ * Runs from the friend's timer whenever one of these is due.
  */
-static void do_DHT_friends(DHT *dht)
+static void friend_timer(void *object, uint32_t number)
 {
-    for (size_t i = 0; i < dht->num_friends; ++i) {
-        DHT_Friend *const dht_friend = &dht->friends_list[i];
+    DHT *const dht = (DHT *)object;
+    DHT_Friend *const dht_friend = &dht->friends_list[number];
 
-        for (size_t j = 0; j < dht_friend->num_to_bootstrap; ++j) {
-            getnodes(dht, dht_friend->to_bootstrap[j].ip_port, dht_friend->to_bootstrap[j].public_key, dht_friend->public_key,
-                     nullptr);
-        }
+    if (dht->lookup_parallelism != 0 && !dht_friend->lookup.running
+            && (dht_friend->lookup.started == 0 || is_timeout(dht_friend->lookup.started, LOOKUP_INTERVAL))) {
+        IP_Port ip_port;
 
-        dht_friend->num_to_bootstrap = 0;
+        if (DHT_getfriendip(dht, dht_friend->public_key, &ip_port) != 1) {
+            lookup_start(dht, dht_friend);
+        }
+    }
 
-        do_ping_and_sendnode_requests(dht, &dht_friend->lastgetnode, dht_friend->public_key, dht_friend->client_list,
-                                      MAX_FRIEND_CLIENTS,
-                                      &dht_friend->bootstrap_times, 1);
+    for (size_t j = 0; j < dht_friend->num_to_bootstrap; ++j) {
+        getnodes(dht, dht_friend->to_bootstrap[j].ip_port, dht_friend->to_bootstrap[j].public_key, dht_friend->public_key,
+                 nullptr);
     }
+
+    dht_friend->num_to_bootstrap = 0;
+
+    do_ping_and_sendnode_requests(dht, &dht_friend->lastgetnode, dht_friend->public_key, dht_friend->client_list,
+                                  MAX_FRIEND_CLIENTS,
+                                  &dht_friend->bootstrap_times);
+
+    /* Also run when a good node goes bad, to open the list up to any node. */
+    friend_reindex(dht, number);
+    schedule_list_timer(dht->timers, &dht_friend->timer, dht_friend->client_list, MAX_FRIEND_CLIENTS,
+                        dht_friend->lastgetnode, dht_friend->bootstrap_times, friend_accept_deadline(dht_friend),
+                        &friend_timer, dht, number);
 }
 
-/* Ping each client in the close nodes list every PING_INTERVAL seconds.
- * Send a get nodes request every GET_NODE_INTERVAL seconds to a random good node in the list.
+/* Send a get nodes request every GET_NODE_INTERVAL seconds to a random good
+ * node in the close nodes list, and ask the nodes to bootstrap from for nodes.
+ * Runs only while the list has good nodes or there are nodes to bootstrap
+ * from, as it has to look at the whole list.
  */
-static void do_Close(DHT *dht)
+static void close_timer(void *object, uint32_t number)
 {
+    DHT *const dht = (DHT *)object;
+
     for (size_t i = 0; i < dht->num_to_bootstrap; ++i) {
         getnodes(dht, dht->to_bootstrap[i].ip_port, dht->to_bootstrap[i].public_key, dht->self_public_key, nullptr);
     }
 
     dht->num_to_bootstrap = 0;
 
-    uint8_t not_killed = do_ping_and_sendnode_requests(
-                             dht, &dht->close_lastgetnodes, dht->self_public_key, dht->close_clientlist, LCLIENT_LIST, &dht->close_bootstrap_times,
-                             0);
-
-    if (not_killed != 0) {
-        return;
+    if (is_timeout(dht->close_lastgetnodes, GET_NODE_INTERVAL) || dht->close_bootstrap_times < MAX_BOOTSTRAP_TIMES) {
+        if (!getnodes_random(dht, &dht->close_lastgetnodes, dht->self_public_key, dht->close_clientlist, LCLIENT_LIST,
+                             &dht->close_bootstrap_times)) {
+            /* Woken by schedule_close_node() once a node is good again. */
+            dht->close_timer = 0;
+            return;
+        }
     }
 
-    /* all existing nodes are at least KILL_NODE_TIMEOUT,
-     * which means we are mute, as we only send packets to
-     * nodes NOT in KILL_NODE_TIMEOUT
-     *
-     * so: reset all nodes to be BAD_NODE_TIMEOUT, but not
-     * KILL_NODE_TIMEOUT, so we at least keep trying pings */
+    const uint64_t deadline = dht->close_bootstrap_times < MAX_BOOTSTRAP_TIMES
+                              ? unix_time()
+                              : dht->close_lastgetnodes + GET_NODE_INTERVAL;
+    timer_wheel_set(dht->timers, &dht->close_timer, deadline, &close_timer, dht, 0);
+}
+
+/* All nodes in the close list are in kill-timeout, which means we are mute,
+ * as we only send packets to nodes not in kill-timeout.
+ *
+ * So reset all nodes to be in bad-timeout, but not kill-timeout, so we at
+ * least keep trying pings.
+ */
+static void close_revive(DHT *dht)
+{
     const uint64_t badonly = unix_time() - BAD_NODE_TIMEOUT;
 
-    for (size_t i = 0; i < LCLIENT_LIST; i++) {
+    for (uint32_t i = 0; i < LCLIENT_LIST; i++) {
         Client_data *const client = &dht->close_clientlist[i];
 
         IPPTsPng *const assocs[] = { &client->assoc6, &client->assoc4 };
@@ -1800,7 +2955,46 @@ static void do_Close(DHT *dht)
                 assoc->timestamp = badonly;
             }
         }
+
+        schedule_close_node(dht, i);
+    }
+}
+
+/* Ping a node in the close nodes list every PING_INTERVAL seconds. Runs when
+ * the node needs pinging or one of its addresses times out.
+ */
+static void close_node_timer(void *object, uint32_t number)
+{
+    DHT *const dht = (DHT *)object;
+    ping_client(dht, &dht->close_clientlist[number], dht->self_public_key);
+    schedule_close_node(dht, number);
+
+    if (dht->close_live == 0) {
+        close_revive(dht);
+    }
+}
+
+int dht_set_lookup_parallelism(DHT *dht, uint8_t parallelism)
+{
+    if (parallelism > DHT_MAX_LOOKUP_PARALLELISM) {
+        return -1;
+    }
+
+    dht->lookup_parallelism = parallelism;
+
+    if (parallelism == 0) {
+        for (uint32_t i = 0; i < dht->num_friends; ++i) {
+            dht->friends_list[i].lookup.running = false;
+            friend_reindex(dht, i);
+        }
     }
+
+    return 0;
+}
+
+uint8_t dht_get_lookup_parallelism(const DHT *dht)
+{
+    return dht->lookup_parallelism;
 }
 
 void DHT_getnodes(DHT *dht, const IP_Port *from_ipp, const uint8_t *from_id, const uint8_t *which_id)
@@ -1848,20 +3042,20 @@ int DHT_bootstrap_from_address(DHT *dht, const char *address, uint8_t ipv6enable
  */
 int route_packet(const DHT *dht, const uint8_t *public_key, const uint8_t *packet, uint16_t length)
 {
-    for (uint32_t i = 0; i < LCLIENT_LIST; ++i) {
-        if (id_equal(public_key, dht->close_clientlist[i].public_key)) {
-            const Client_data *const client = &dht->close_clientlist[i];
-            const IPPTsPng *const assocs[] = { &client->assoc6, &client->assoc4 };
+    const uint32_t index = index_of_close_pk(dht, public_key);
 
-            for (size_t j = 0; j < ARRAY_SIZE(assocs); j++) {
-                const IPPTsPng *const assoc = assocs[j];
+    if (index == UINT32_MAX) {
+        return -1;
+    }
 
-                if (ip_isset(&assoc->ip_port.ip)) {
-                    return sendpacket(dht->net, assoc->ip_port, packet, length);
-                }
-            }
+    const Client_data *const client = &dht->close_clientlist[index];
+    const IPPTsPng *const assocs[] = { &client->assoc6, &client->assoc4 };
 
-            break;
+    for (size_t j = 0; j < ARRAY_SIZE(assocs); j++) {
+        const IPPTsPng *const assoc = assocs[j];
+
+        if (ip_isset(&assoc->ip_port.ip)) {
+            return sendpacket(dht->net, assoc->ip_port, packet, length);
         }
     }
 
@@ -1949,7 +3143,7 @@ static int friend_iplist(const DHT *dht, IP_Port *ip_portlist, uint16_t friend_n
  */
 int route_tofriend(const DHT *dht, const uint8_t *friend_id, const uint8_t *packet, uint16_t length)
 {
-    const uint32_t num = index_of_friend_pk(dht->friends_list, dht->num_friends, friend_id);
+    const uint32_t num = friend_number(dht, friend_id);
 
     if (num == UINT32_MAX) {
         return 0;
@@ -2002,7 +3196,7 @@ int route_tofriend(const DHT *dht, const uint8_t *friend_id, const uint8_t *pack
  */
 static int routeone_tofriend(DHT *dht, const uint8_t *friend_id, const uint8_t *packet, uint16_t length)
 {
-    const uint32_t num = index_of_friend_pk(dht->friends_list, dht->num_friends, friend_id);
+    const uint32_t num = friend_number(dht, friend_id);
 
     if (num == UINT32_MAX) {
         return 0;
@@ -2090,7 +3284,7 @@ static int handle_NATping(void *object, IP_Port source, const uint8_t *source_pu
     uint64_t ping_id;
     memcpy(&ping_id, packet + 1, sizeof(uint64_t));
 
-    uint32_t friendnumber = index_of_friend_pk(dht->friends_list, dht->num_friends, source_pubkey);
+    uint32_t friendnumber = friend_number(dht, source_pubkey);
 
     if (friendnumber == UINT32_MAX) {
         return 1;
@@ -2344,18 +3538,18 @@ static int send_hardening_getnode_res(const DHT *dht, const Node_format *sendto,
 /* TODO(irungentoo): improve */
 static IPPTsPng *get_closelist_IPPTsPng(DHT *dht, const uint8_t *public_key, Family sa_family)
 {
-    for (uint32_t i = 0; i < LCLIENT_LIST; ++i) {
-        if (!id_equal(dht->close_clientlist[i].public_key, public_key)) {
-            continue;
-        }
+    const uint32_t index = index_of_close_pk(dht, public_key);
 
-        if (net_family_is_ipv4(sa_family)) {
-            return &dht->close_clientlist[i].assoc4;
-        }
+    if (index == UINT32_MAX) {
+        return nullptr;
+    }
 
-        if (net_family_is_ipv6(sa_family)) {
-            return &dht->close_clientlist[i].assoc6;
-        }
+    if (net_family_is_ipv4(sa_family)) {
+        return &dht->close_clientlist[index].assoc4;
+    }
+
+    if (net_family_is_ipv6(sa_family)) {
+        return &dht->close_clientlist[index].assoc6;
     }
 
     return nullptr;
@@ -2642,11 +3836,14 @@ static int cryptopacket_handle(void *object, IP_Port source, const uint8_t *pack
 
     // Check if request is for us.
     if (id_equal(packet + 1, dht->self_public_key)) {
+        if (dht_defer_for_shared_key(dht, packet + 1 + CRYPTO_PUBLIC_KEY_SIZE, source, packet, length)) {
+            return 0;
+        }
+
         uint8_t public_key[CRYPTO_PUBLIC_KEY_SIZE];
         uint8_t data[MAX_CRYPTO_REQUEST_SIZE];
         uint8_t number;
-        const int len = handle_request(dht->self_public_key, dht->self_secret_key, public_key,
-                                       data, &number, packet, length);
+        const int len = dht_handle_request(dht, public_key, data, &number, packet, length);
 
         if (len == -1 || len == 0) {
             return 1;
@@ -2693,6 +3890,16 @@ DHT *new_DHT(Logger *log, Networking_Core *net, bool holepunching_enabled)
 
     dht->hole_punching_enabled = holepunching_enabled;
 
+    dht->timers = timer_wheel_new(unix_time());
+    dht->shared_keys = shared_key_cache_new(SHARED_KEY_CACHE_DEFAULT_CAPACITY);
+
+    if (dht->timers == nullptr || dht->shared_keys == nullptr) {
+        shared_key_cache_kill(dht->shared_keys);
+        timer_wheel_kill(dht->timers);
+        free(dht);
+        return nullptr;
+    }
+
     dht->ping = ping_new(dht);
 
     if (dht->ping == nullptr) {
@@ -2708,8 +3915,9 @@ DHT *new_DHT(Logger *log, Networking_Core *net, bool holepunching_enabled)
 
     crypto_new_keypair(dht->self_public_key, dht->self_secret_key);
 
-    dht->dht_ping_array = ping_array_new(DHT_PING_ARRAY_SIZE, PING_TIMEOUT);
-    dht->dht_harden_ping_array = ping_array_new(DHT_PING_ARRAY_SIZE, PING_TIMEOUT);
+    dht->dht_ping_array = ping_array_new_slab(DHT_PING_ARRAY_SIZE, PING_TIMEOUT, sizeof(Node_format) * 2);
+    dht->dht_harden_ping_array = ping_array_new_slab(DHT_PING_ARRAY_SIZE, PING_TIMEOUT, sizeof(Node_format) * 2);
+    dht->lookup_parallelism = DHT_DEFAULT_LOOKUP_PARALLELISM;
 
     for (uint32_t i = 0; i < DHT_FAKE_FRIEND_NUMBER; ++i) {
         uint8_t random_key_bytes[CRYPTO_PUBLIC_KEY_SIZE];
@@ -2737,13 +3945,13 @@ void do_DHT(DHT *dht)
         DHT_connect_after_load(dht);
     }
 
-    do_Close(dht);
-    do_DHT_friends(dht);
+    timer_wheel_run(dht->timers, unix_time());
+    do_lookups(dht);
     do_NAT(dht);
-    ping_iterate(dht->ping);
 #if DHT_HARDENING
     do_hardening(dht);
 #endif
+    networking_flush_send_queue(dht->net);
     dht->last_run = unix_time();
 }
 
@@ -2756,7 +3964,17 @@ void kill_DHT(DHT *dht)
     ping_array_kill(dht->dht_ping_array);
     ping_array_kill(dht->dht_harden_ping_array);
     ping_kill(dht->ping);
+    timer_wheel_kill(dht->timers);
+
+    Crypto_Pool *const pool = networking_crypto_pool(dht->net);
+
+    if (pool != nullptr) {
+        crypto_pool_cancel(pool, dht);
+    }
+
+    shared_key_cache_kill(dht->shared_keys);
     free(dht->friends_list);
+    resize_friend_index(dht, 0);
     free(dht->loaded_nodes_list);
     free(dht);
 }
@@ -2767,9 +3985,121 @@ void kill_DHT(DHT *dht)
 
 #define DHT_STATE_COOKIE_TYPE      0x11ce
 #define DHT_STATE_TYPE_NODES       4
+#define DHT_STATE_TYPE_NODE_CACHE  5
 
 #define MAX_SAVED_DHT_NODES (((DHT_FAKE_FRIEND_NUMBER * MAX_FRIEND_CLIENTS) + LCLIENT_LIST) * 2)
 
+/* The node cache section is a version byte followed by up to
+ * DHT_NODE_CACHE_SIZE packed nodes, each followed by the unix time it was
+ * last heard from (64 bit) and its round trip time in milliseconds (16 bit),
+ * best node first.
+ */
+#define DHT_NODE_CACHE_VERSION 1
+#define DHT_NODE_CACHE_SIZE 64
+#define NODE_CACHE_ENTRY_EXTRA (sizeof(uint64_t) + sizeof(uint16_t))
+
+/* Nodes not heard from for this many seconds aren't restored from the cache. */
+#define DHT_NODE_CACHE_MAX_AGE (7 * 24 * 60 * 60)
+
+typedef struct Node_Cache_Entry {
+    Node_format node;
+    uint64_t    last_seen;
+    uint16_t    rtt;
+} Node_Cache_Entry;
+
+/* return true if a is worth pinging before b on startup: it was heard from in
+ *   a later PING_INTERVAL, or in the same one and answers faster.
+ *
+ * This only looks at the entries, so that DHT_size() and DHT_save() pick the
+ * same nodes.
+ */
+static bool node_cache_better(const Node_Cache_Entry *a, const Node_Cache_Entry *b)
+{
+    if (a->last_seen / PING_INTERVAL != b->last_seen / PING_INTERVAL) {
+        return a->last_seen > b->last_seen;
+    }
+
+    const uint32_t rtt_a = a->rtt != 0 ? a->rtt : UINT16_MAX + 1;
+    const uint32_t rtt_b = b->rtt != 0 ? b->rtt : UINT16_MAX + 1;
+    return rtt_a < rtt_b;
+}
+
+static void node_cache_offer(Node_Cache_Entry *entries, uint32_t *num, const uint8_t *public_key,
+                             const IPPTsPng *assoc)
+{
+    if (assoc->timestamp == 0
+            || (!net_family_is_ipv4(assoc->ip_port.ip.family) && !net_family_is_ipv6(assoc->ip_port.ip.family))) {
+        return;
+    }
+
+    Node_Cache_Entry entry;
+    memcpy(entry.node.public_key, public_key, CRYPTO_PUBLIC_KEY_SIZE);
+    entry.node.ip_port = assoc->ip_port;
+    entry.last_seen = assoc->timestamp;
+    entry.rtt = assoc->rtt;
+
+    for (uint32_t i = 0; i < *num; ++i) {
+        if (id_equal(entries[i].node.public_key, public_key)
+                && ipport_equal(&entries[i].node.ip_port, &entry.node.ip_port)) {
+            return;
+        }
+    }
+
+    uint32_t index = *num;
+
+    while (index > 0 && node_cache_better(&entry, &entries[index - 1])) {
+        --index;
+    }
+
+    if (index == DHT_NODE_CACHE_SIZE) {
+        return;
+    }
+
+    if (*num < DHT_NODE_CACHE_SIZE) {
+        ++*num;
+    }
+
+    memmove(&entries[index + 1], &entries[index], (*num - 1 - index) * sizeof(Node_Cache_Entry));
+    entries[index] = entry;
+}
+
+/* Fill entries, DHT_NODE_CACHE_SIZE big, with the nodes most worth pinging
+ * first on the next start, best first.
+ *
+ * return the number of entries.
+ */
+static uint32_t node_cache_entries(const DHT *dht, Node_Cache_Entry *entries)
+{
+    uint32_t num = 0;
+
+    for (uint32_t i = 0; i < LCLIENT_LIST; ++i) {
+        const Client_data *const client = &dht->close_clientlist[i];
+        node_cache_offer(entries, &num, client->public_key, &client->assoc4);
+        node_cache_offer(entries, &num, client->public_key, &client->assoc6);
+    }
+
+    for (uint32_t i = 0; i < dht->num_friends; ++i) {
+        for (uint32_t j = 0; j < MAX_FRIEND_CLIENTS; ++j) {
+            const Client_data *const client = &dht->friends_list[i].client_list[j];
+            node_cache_offer(entries, &num, client->public_key, &client->assoc4);
+            node_cache_offer(entries, &num, client->public_key, &client->assoc6);
+        }
+    }
+
+    return num;
+}
+
+static uint32_t node_cache_size(const Node_Cache_Entry *entries, uint32_t num)
+{
+    uint32_t size = 1;
+
+    for (uint32_t i = 0; i < num; ++i) {
+        size += packed_node_size(entries[i].node.ip_port.ip.family) + NODE_CACHE_ENTRY_EXTRA;
+    }
+
+    return size;
+}
+
 /* Get the size of the DHT (for saving). */
 uint32_t DHT_size(const DHT *dht)
 {
@@ -2793,7 +4123,12 @@ uint32_t DHT_size(const DHT *dht)
     const uint32_t size32 = sizeof(uint32_t);
     const uint32_t sizesubhead = size32 * 2;
 
-    return size32 + sizesubhead + packed_node_size(net_family_ipv4) * numv4 + packed_node_size(net_family_ipv6) * numv6;
+    Node_Cache_Entry cache[DHT_NODE_CACHE_SIZE];
+    const uint32_t num_cached = node_cache_entries(dht, cache);
+    const uint32_t cache_size = num_cached != 0 ? sizesubhead + node_cache_size(cache, num_cached) : 0;
+
+    return size32 + sizesubhead + packed_node_size(net_family_ipv4) * numv4 + packed_node_size(net_family_ipv6) * numv6
+           + cache_size;
 }
 
 static uint8_t *DHT_save_subheader(uint8_t *data, uint32_t len, uint16_t type)
@@ -2853,7 +4188,26 @@ void DHT_save(const DHT *dht, uint8_t *data)
         }
     }
 
-    DHT_save_subheader(old_data, pack_nodes(data, sizeof(Node_format) * num, clients, num), DHT_STATE_TYPE_NODES);
+    const int nodes_length = pack_nodes(data, sizeof(Node_format) * num, clients, num);
+    DHT_save_subheader(old_data, nodes_length, DHT_STATE_TYPE_NODES);
+    data += nodes_length;
+
+    Node_Cache_Entry cache[DHT_NODE_CACHE_SIZE];
+    const uint32_t num_cached = node_cache_entries(dht, cache);
+
+    if (num_cached == 0) {
+        return;
+    }
+
+    data = DHT_save_subheader(data, node_cache_size(cache, num_cached), DHT_STATE_TYPE_NODE_CACHE);
+    *data = DHT_NODE_CACHE_VERSION;
+    ++data;
+
+    for (uint32_t i = 0; i < num_cached; ++i) {
+        data += pack_nodes(data, sizeof(Node_format), &cache[i].node, 1);
+        data += net_pack_u64(data, cache[i].last_seen);
+        data += net_pack_u16(data, cache[i].rtt);
+    }
 }
 
 /* Bootstrap from this number of nodes every time DHT_connect_after_load() is called */
@@ -2887,6 +4241,107 @@ int DHT_connect_after_load(DHT *dht)
     return 0;
 }
 
+/* Mark a node that was just added to list from the cache as not heard from,
+ * so that it is pinged right away and only counts as good once it answers.
+ */
+static void mark_cached_client(Client_data *list, uint32_t length, const Node_Cache_Entry *entry)
+{
+    const uint32_t index = index_of_client_pk(list, length, entry->node.public_key);
+
+    if (index == UINT32_MAX) {
+        return;
+    }
+
+    IPPTsPng *const assoc = net_family_is_ipv4(entry->node.ip_port.ip.family)
+                            ? &list[index].assoc4
+                            : &list[index].assoc6;
+
+    if (!ipport_equal(&assoc->ip_port, &entry->node.ip_port)) {
+        return;
+    }
+
+    assoc->timestamp = unix_time() - BAD_NODE_TIMEOUT;
+    assoc->last_pinged = 0;
+    assoc->rtt = entry->rtt;
+}
+
+/* Put the cached nodes in the close list and friends' client lists as nodes we
+ * need to hear from again. Best first, so that they take the places.
+ */
+static void restore_cached_nodes(DHT *dht, const Node_Cache_Entry *entries, uint32_t num)
+{
+    if (num == 0) {
+        return;
+    }
+
+    /* They are all added before any is marked, as a node marked not heard
+     * from can be replaced by the next one. */
+    VLA(bool, added, num);
+
+    for (uint32_t i = 0; i < num; ++i) {
+        added[i] = !node_in_close_list(dht, entries[i].node.public_key, entries[i].node.ip_port);
+
+        if (added[i]) {
+            addto_lists(dht, entries[i].node.ip_port, entries[i].node.public_key);
+        }
+    }
+
+    for (uint32_t i = 0; i < num; ++i) {
+        if (!added[i]) {
+            continue;
+        }
+
+        const uint32_t first = close_bucket(dht, entries[i].node.public_key) * LCLIENT_NODES;
+        mark_cached_client(&dht->close_clientlist[first], LCLIENT_NODES, &entries[i]);
+
+        for (uint32_t j = first; j < first + LCLIENT_NODES; ++j) {
+            schedule_close_node(dht, j);
+        }
+
+        for (uint32_t j = 0; j < dht->num_friends; ++j) {
+            mark_cached_client(dht->friends_list[j].client_list, MAX_FRIEND_CLIENTS, &entries[i]);
+        }
+    }
+
+    for (uint32_t j = 0; j < dht->num_friends; ++j) {
+        friend_reindex(dht, j);
+    }
+}
+
+static void load_node_cache(DHT *dht, const uint8_t *data, uint32_t length)
+{
+    if (length == 0 || data[0] != DHT_NODE_CACHE_VERSION) {
+        LOGGER_WARNING(dht->log, "Load state (DHT): node cache of unknown version ignored");
+        return;
+    }
+
+    Node_Cache_Entry entries[DHT_NODE_CACHE_SIZE];
+    uint32_t num = 0;
+    uint32_t processed = 1;
+
+    while (processed < length && num < DHT_NODE_CACHE_SIZE) {
+        Node_Cache_Entry *const entry = &entries[num];
+        uint16_t node_length;
+
+        if (unpack_nodes(&entry->node, 1, &node_length, data + processed, length - processed, 0) != 1
+                || length - processed - node_length < NODE_CACHE_ENTRY_EXTRA) {
+            LOGGER_WARNING(dht->log, "Load state (DHT): node cache is corrupt after %u nodes", num);
+            break;
+        }
+
+        processed += node_length;
+        processed += net_unpack_u64(data + processed, &entry->last_seen);
+        processed += net_unpack_u16(data + processed, &entry->rtt);
+
+        if (entry->last_seen + DHT_NODE_CACHE_MAX_AGE >= unix_time()) {
+            ++num;
+        }
+    }
+
+    restore_cached_nodes(dht, entries, num);
+    LOGGER_DEBUG(dht->log, "Load state (DHT): restored %u nodes from the node cache", num);
+}
+
 static int dht_load_state_callback(void *outer, const uint8_t *data, uint32_t length, uint16_t type)
 {
     DHT *dht = (DHT *)outer;
@@ -2912,6 +4367,10 @@ static int dht_load_state_callback(void *outer, const uint8_t *data, uint32_t le
             break;
         }
 
+        case DHT_STATE_TYPE_NODE_CACHE:
+            load_node_cache(dht, data, length);
+            break;
+
         default:
             LOGGER_ERROR(dht->log, "Load state (DHT): contains unrecognized part (len %u, type %u)\n",
                          length, type);
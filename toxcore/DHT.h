@@ -28,6 +28,8 @@
 #include "logger.h"
 #include "network.h"
 #include "ping_array.h"
+#include "shared_key_cache.h"
+#include "timer_wheel.h"
 
 #include <stdbool.h>
 
@@ -116,6 +118,9 @@ typedef struct {
     IP_Port     ip_port;
     uint64_t    timestamp;
     uint64_t    last_pinged;
+    /* Milliseconds the node took to answer our last get nodes request, 0 if it
+     * didn't answer one yet. */
+    uint16_t    rtt;
 
     Hardening hardening;
     /* Returned by this node. Either our friend or us. */
@@ -194,23 +199,6 @@ int unpack_nodes(Node_format *nodes, uint16_t max_num_nodes, uint16_t *processed
                  uint16_t length, uint8_t tcp_enabled);
 
 
-/*----------------------------------------------------------------------------------*/
-/* struct to store some shared keys so we don't have to regenerate them for each request. */
-#define MAX_KEYS_PER_SLOT 4
-#define KEYS_TIMEOUT 600
-
-typedef struct {
-    uint8_t public_key[CRYPTO_PUBLIC_KEY_SIZE];
-    uint8_t shared_key[CRYPTO_SHARED_KEY_SIZE];
-    uint32_t times_requested;
-    uint8_t  stored; /* 0 if not, 1 if is */
-    uint64_t time_last_requested;
-} Shared_Key;
-
-typedef struct {
-    Shared_Key keys[256 * MAX_KEYS_PER_SLOT];
-} Shared_Keys;
-
 /*----------------------------------------------------------------------------------*/
 
 typedef int (*cryptopacket_handler_callback)(void *object, IP_Port ip_port, const uint8_t *source_pubkey,
@@ -231,24 +219,27 @@ void dht_set_self_secret_key(DHT *dht, const uint8_t *key);
 
 Networking_Core *dht_get_net(const DHT *dht);
 struct Ping *dht_get_ping(const DHT *dht);
+/* The timer wheel run by do_DHT(), ticking in unix_time() seconds. Modules
+ * sharing the DHT register their deadlines here rather than checking them on
+ * every iteration.
+ */
+Timer_Wheel *dht_get_timer_wheel(const DHT *dht);
 const Client_data *dht_get_close_clientlist(const DHT *dht);
 const Client_data *dht_get_close_client(const DHT *dht, uint32_t client_num);
 uint16_t dht_get_num_friends(const DHT *dht);
 
+/* Replace the close list of dht with a copy of list, which must hold LCLIENT_LIST
+ * entries as returned by dht_get_close_clientlist() for a DHT with the same self
+ * public key. Lets a DHT object which doesn't do its own lookups (e.g. one
+ * serving a second socket of the same node) answer get nodes requests.
+ */
+void dht_set_close_clientlist(DHT *dht, const Client_data *list);
+
 DHT_Friend *dht_get_friend(DHT *dht, uint32_t friend_num);
 const uint8_t *dht_get_friend_public_key(const DHT *dht, uint32_t friend_num);
 
 /*----------------------------------------------------------------------------------*/
 
-/* Shared key generations are costly, it is therefor smart to store commonly used
- * ones so that they can re used later without being computed again.
- *
- * If shared key is already in shared_keys, copy it to shared_key.
- * else generate it into shared_key and copy it to shared_keys
- */
-void get_shared_key(Shared_Keys *shared_keys, uint8_t *shared_key, const uint8_t *secret_key,
-                    const uint8_t *public_key);
-
 /* Copy shared_key to encrypt/decrypt DHT packet from public_key into shared_key
  * for packets that we receive.
  */
@@ -259,6 +250,47 @@ void DHT_get_shared_key_recv(DHT *dht, uint8_t *shared_key, const uint8_t *publi
  */
 void DHT_get_shared_key_sent(DHT *dht, uint8_t *shared_key, const uint8_t *public_key);
 
+/* Check that a packet we received from public_key can be handled without
+ * computing a shared key first.
+ *
+ * If the key isn't cached and the network has a crypto pool, the key is
+ * computed on the pool instead, and networking_poll() passes packet back to its
+ * handler once the key is cached. If the pool is full, the packet is dropped.
+ *
+ * return true if the caller must not handle the packet now.
+ */
+bool dht_defer_for_shared_key(DHT *dht, const uint8_t *public_key, IP_Port source, const uint8_t *packet,
+                              uint16_t length);
+
+/* Replace the shared key cache with an empty one for about size keys, so
+ * that a node talking to a lot of peers doesn't keep recomputing their keys.
+ *
+ * return 0 on success.
+ * return -1 on memory allocation failure, keeping the old cache.
+ */
+int dht_set_shared_key_cache_size(DHT *dht, uint32_t size);
+
+/* Copy the shared key cache's hit, miss and eviction counters into stats. */
+void dht_get_shared_key_cache_stats(const DHT *dht, Shared_Key_Cache_Stats *stats);
+
+/* Most get nodes requests a friend's lookup can have in flight at once. */
+#define DHT_MAX_LOOKUP_PARALLELISM MAX_FRIEND_CLIENTS
+
+/* Number of get nodes requests a friend's lookup has in flight by default. */
+#define DHT_DEFAULT_LOOKUP_PARALLELISM 3
+
+/* Set how many get nodes requests the lookup for a friend's neighbourhood can
+ * have in flight at once. Each answer is followed up with the closest node not
+ * asked yet, until the nodes closest to the friend have all answered.
+ *
+ * 0 turns the lookups off, leaving only the periodic get nodes requests.
+ *
+ * return 0 on success.
+ * return -1 if parallelism is more than DHT_MAX_LOOKUP_PARALLELISM.
+ */
+int dht_set_lookup_parallelism(DHT *dht, uint8_t parallelism);
+uint8_t dht_get_lookup_parallelism(const DHT *dht);
+
 void DHT_getnodes(DHT *dht, const IP_Port *from_ipp, const uint8_t *from_id, const uint8_t *which_id);
 
 /* Add a new friend to the friends list.
@@ -314,6 +346,10 @@ bool add_to_list(Node_format *nodes_list, unsigned int length, const uint8_t *pk
  */
 bool node_addable_to_close_list(DHT *dht, const uint8_t *public_key, IP_Port ip_port);
 
+/* Return 1 if node is a good node in the close list with address ip_port, 0 if it isn't.
+ */
+bool node_in_close_list(const DHT *dht, const uint8_t *public_key, IP_Port ip_port);
+
 /* Get the (maximum MAX_SENT_NODES) closest nodes to public_key we know
  * and put them in nodes_list (must be MAX_SENT_NODES big).
  *
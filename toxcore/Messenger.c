@@ -359,14 +359,14 @@ static int add_receipt(Messenger *m, int32_t friendnumber, uint32_t packet_num,
  * return -1 on failure.
  * return 0 if packet was received.
  */
-static int friend_received_packet(const Messenger *m, int32_t friendnumber, uint32_t number)
+static int friend_received_packet(const Messenger *m, int32_t friendnumber, uint8_t stream, uint32_t number)
 {
     if (friend_not_valid(m, friendnumber)) {
         return -1;
     }
 
-    return cryptpacket_received(m->net_crypto, friend_connection_crypt_connection_id(m->fr_c,
-                                m->friendlist[friendnumber].friendcon_id), number);
+    return cryptpacket_received_stream(m->net_crypto, friend_connection_crypt_connection_id(m->fr_c,
+                                       m->friendlist[friendnumber].friendcon_id), stream, number);
 }
 
 static int do_receipts(Messenger *m, int32_t friendnumber, void *userdata)
@@ -378,7 +378,7 @@ static int do_receipts(Messenger *m, int32_t friendnumber, void *userdata)
     struct Receipts *receipts = m->friendlist[friendnumber].receipts_start;
 
     while (receipts) {
-        if (friend_received_packet(m, friendnumber, receipts->packet_num) == -1) {
+        if (friend_received_packet(m, friendnumber, CRYPTO_STREAM_DEFAULT, receipts->packet_num) == -1) {
             break;
         }
 
@@ -471,6 +471,21 @@ int m_get_friend_connectionstatus(const Messenger *m, int32_t friendnumber)
     return CONNECTION_NONE;
 }
 
+int m_get_friend_transport_stats(const Messenger *m, int32_t friendnumber, Crypto_Conn_Stats *stats)
+{
+    if (friend_not_valid(m, friendnumber)) {
+        return -1;
+    }
+
+    const int crypt_conn_id = friend_connection_crypt_connection_id(m->fr_c, m->friendlist[friendnumber].friendcon_id);
+
+    if (crypto_connection_stats(m->net_crypto, crypt_conn_id, stats) == -1) {
+        memset(stats, 0, sizeof(Crypto_Conn_Stats));
+    }
+
+    return 0;
+}
+
 int m_friend_exists(const Messenger *m, int32_t friendnumber)
 {
     if (friend_not_valid(m, friendnumber)) {
@@ -1153,7 +1168,16 @@ long int new_filesender(const Messenger *m, int32_t friendnumber, uint32_t file_
     uint32_t i;
 
     for (i = 0; i < MAX_CONCURRENT_FILE_PIPES; ++i) {
-        if (m->friendlist[friendnumber].file_sending[i].status == FILESTATUS_NONE) {
+        const struct File_Transfers *ft = &m->friendlist[friendnumber].file_sending[i];
+
+        if (ft->status != FILESTATUS_NONE) {
+            continue;
+        }
+
+        /* The data of a transfer killed while it was sent on a stream of its
+         * own may still be on its way, to be taken for that of the next one. */
+        if (ft->stream == CRYPTO_STREAM_DEFAULT
+                || friend_received_packet(m, friendnumber, ft->stream, ft->last_packet_number) == 0) {
             break;
         }
     }
@@ -1180,6 +1204,8 @@ long int new_filesender(const Messenger *m, int32_t friendnumber, uint32_t file_
 
     ft->paused = FILE_PAUSE_NOT;
 
+    ft->stream = CRYPTO_STREAM_DEFAULT;
+
     memcpy(ft->id, file_id, FILE_ID_LENGTH);
 
     ++m->friendlist[friendnumber].num_sending_files;
@@ -1372,11 +1398,24 @@ int file_seek(const Messenger *m, int32_t friendnumber, uint32_t filenumber, uin
     return 0;
 }
 
+/* return the lossless stream the data of transfers to friend accepted now is sent on. */
+static uint8_t file_data_stream(const Messenger *m, int32_t friendnumber)
+{
+    const int crypt_connection_id = friend_connection_crypt_connection_id(m->fr_c,
+                                    m->friendlist[friendnumber].friendcon_id);
+
+    if (crypto_stream_available(m->net_crypto, crypt_connection_id, FILE_DATA_STREAM)) {
+        return FILE_DATA_STREAM;
+    }
+
+    return CRYPTO_STREAM_DEFAULT;
+}
+
 /* return packet number on success.
  * return -1 on failure.
  */
-static int64_t send_file_data_packet(const Messenger *m, int32_t friendnumber, uint8_t filenumber, const uint8_t *data,
-                                     uint16_t length)
+static int64_t send_file_data_packet(const Messenger *m, int32_t friendnumber, uint8_t filenumber, uint8_t stream,
+                                     const uint8_t *data, uint16_t length)
 {
     if (friend_not_valid(m, friendnumber)) {
         return -1;
@@ -1390,8 +1429,8 @@ static int64_t send_file_data_packet(const Messenger *m, int32_t friendnumber, u
         memcpy(packet + 2, data, length);
     }
 
-    return write_cryptpacket(m->net_crypto, friend_connection_crypt_connection_id(m->fr_c,
-                             m->friendlist[friendnumber].friendcon_id), packet, SIZEOF_VLA(packet), 1);
+    return write_cryptpacket_stream(m->net_crypto, friend_connection_crypt_connection_id(m->fr_c,
+                                    m->friendlist[friendnumber].friendcon_id), stream, packet, SIZEOF_VLA(packet), 1);
 }
 
 #define MAX_FILE_DATA_SIZE (MAX_CRYPTO_DATA_SIZE - 2)
@@ -1446,24 +1485,25 @@ int file_data(const Messenger *m, int32_t friendnumber, uint32_t filenumber, uin
 
     /* Prevent file sending from filling up the entire buffer preventing messages from being sent.
      * TODO(irungentoo): remove */
-    if (crypto_num_free_sendqueue_slots(m->net_crypto, friend_connection_crypt_connection_id(m->fr_c,
-                                        m->friendlist[friendnumber].friendcon_id)) < MIN_SLOTS_FREE) {
+    if (crypto_num_free_sendqueue_slots_stream(m->net_crypto, friend_connection_crypt_connection_id(m->fr_c,
+            m->friendlist[friendnumber].friendcon_id), ft->stream) < MIN_SLOTS_FREE) {
         return -6;
     }
 
-    int64_t ret = send_file_data_packet(m, friendnumber, filenumber, data, length);
+    int64_t ret = send_file_data_packet(m, friendnumber, filenumber, ft->stream, data, length);
 
     if (ret != -1) {
         // TODO(irungentoo): record packet ids to check if other received complete file.
         ft->transferred += length;
 
+        ft->last_packet_number = ret;
+
         if (ft->slots_allocated) {
             --ft->slots_allocated;
         }
 
         if (length != MAX_FILE_DATA_SIZE || ft->size == ft->transferred) {
             ft->status = FILESTATUS_FINISHED;
-            ft->last_packet_number = ret;
         }
 
         return 0;
@@ -1537,7 +1577,8 @@ static bool do_all_filetransfers(Messenger *m, int32_t friendnumber, void *userd
             --num;
 
             // If the file transfer is complete, we request a chunk of size 0.
-            if (ft->status == FILESTATUS_FINISHED && friend_received_packet(m, friendnumber, ft->last_packet_number) == 0) {
+            if (ft->status == FILESTATUS_FINISHED
+                    && friend_received_packet(m, friendnumber, ft->stream, ft->last_packet_number) == 0) {
                 if (m->file_reqchunk) {
                     m->file_reqchunk(m, friendnumber, i, ft->transferred, 0, userdata);
                 }
@@ -1604,11 +1645,12 @@ static void do_reqchunk_filecb(Messenger *m, int32_t friendnumber, void *userdat
 
     // The number of packet slots left in the sendbuffer.
     // This is a per friend count (CRYPTO_PACKET_BUFFER_SIZE).
-    uint32_t free_slots = crypto_num_free_sendqueue_slots(
+    uint32_t free_slots = crypto_num_free_sendqueue_slots_stream(
                               m->net_crypto,
                               friend_connection_crypt_connection_id(
                                   m->fr_c,
-                                  m->friendlist[friendnumber].friendcon_id));
+                                  m->friendlist[friendnumber].friendcon_id),
+                              file_data_stream(m, friendnumber));
 
     // We keep MIN_SLOTS_FREE slots free for other packets, otherwise file
     // transfers might block other traffic for a long time.
@@ -1642,6 +1684,9 @@ static void break_files(const Messenger *m, int32_t friendnumber)
             m->friendlist[friendnumber].file_sending[i].status = FILESTATUS_NONE;
         }
 
+        /* Nothing sent on the connection that went away can still arrive. */
+        m->friendlist[friendnumber].file_sending[i].stream = CRYPTO_STREAM_DEFAULT;
+
         if (m->friendlist[friendnumber].file_receiving[i].status != FILESTATUS_NONE) {
             m->friendlist[friendnumber].file_receiving[i].status = FILESTATUS_NONE;
         }
@@ -1693,6 +1738,8 @@ static int handle_filecontrol(Messenger *m, int32_t friendnumber, uint8_t receiv
         case FILECONTROL_ACCEPT: {
             if (receive_send && ft->status == FILESTATUS_NOT_ACCEPTED) {
                 ft->status = FILESTATUS_TRANSFERRING;
+                /* All the data of a transfer goes on one stream, to arrive in order. */
+                ft->stream = file_data_stream(m, friendnumber);
             } else {
                 if (ft->paused & FILE_PAUSE_OTHER) {
                     ft->paused ^= FILE_PAUSE_OTHER;
@@ -1998,7 +2045,8 @@ Messenger *new_messenger(Messenger_Options *options, unsigned int *error)
     } else {
         IP ip;
         ip_init(&ip, options->ipv6enabled);
-        m->net = new_networking_ex(m->log, ip, options->port_range[0], options->port_range[1], &net_err);
+        const Net_Backend backend = options->udp_io_uring_enabled ? NET_BACKEND_IO_URING : NET_BACKEND_SOCKETS;
+        m->net = new_networking_ex(m->log, ip, options->port_range[0], options->port_range[1], backend, &net_err);
     }
 
     if (m->net == nullptr) {
@@ -2013,6 +2061,23 @@ Messenger *new_messenger(Messenger_Options *options, unsigned int *error)
         return nullptr;
     }
 
+    if (options->udp_send_queue_enabled && !options->udp_disabled && networking_enable_send_queue(m->net) != 0) {
+        kill_networking(m->net);
+        friendreq_kill(m->fr);
+        logger_kill(m->log);
+        free(m);
+        return nullptr;
+    }
+
+    if (options->crypto_worker_threads > 0 && !options->udp_disabled
+            && networking_enable_crypto_pool(m->net, options->crypto_worker_threads) != 0) {
+        kill_networking(m->net);
+        friendreq_kill(m->fr);
+        logger_kill(m->log);
+        free(m);
+        return nullptr;
+    }
+
     m->dht = new_DHT(m->log, m->net, options->hole_punching_enabled);
 
     if (m->dht == nullptr) {
@@ -2023,6 +2088,15 @@ Messenger *new_messenger(Messenger_Options *options, unsigned int *error)
         return nullptr;
     }
 
+    if (dht_set_lookup_parallelism(m->dht, options->dht_lookup_parallelism) != 0) {
+        kill_DHT(m->dht);
+        kill_networking(m->net);
+        friendreq_kill(m->fr);
+        logger_kill(m->log);
+        free(m);
+        return nullptr;
+    }
+
     m->net_crypto = new_net_crypto(m->log, m->dht, &options->proxy_info);
 
     if (m->net_crypto == nullptr) {
@@ -2034,6 +2108,10 @@ Messenger *new_messenger(Messenger_Options *options, unsigned int *error)
         return nullptr;
     }
 
+    nc_set_congestion_control(m->net_crypto, options->congestion_control);
+    nc_set_pacing(m->net_crypto, options->packet_pacing_enabled);
+    nc_set_session_resumption(m->net_crypto, options->session_resumption_enabled);
+
     m->onion = new_onion(m->dht);
     m->onion_a = new_onion_announce(m->dht);
     m->onion_c =  new_onion_client(m->net_crypto);
@@ -2100,6 +2178,8 @@ void kill_messenger(Messenger *m)
 
     uint32_t i;
 
+    resolver_kill(m->resolver);
+
     if (m->tcp_server) {
         kill_TCP_server(m->tcp_server);
     }
@@ -2582,6 +2662,97 @@ uint32_t messenger_run_interval(const Messenger *m)
     return crypto_interval;
 }
 
+void messenger_fds(const Messenger *m, Net_Fds *fds)
+{
+    networking_fds(m->net, fds);
+    tcp_connections_fds(nc_get_tcp_c(m->net_crypto), fds);
+
+    if (m->tcp_server) {
+        tcp_server_fds(m->tcp_server, fds);
+    }
+}
+
+uint64_t messenger_run_deadline(const Messenger *m)
+{
+    const uint64_t now = current_time_monotonic();
+
+    /* The first run adds the saved relays, and queued packets only go out
+     * when we run. */
+    if (!m->has_added_relays || networking_send_queue_pending(m->net)) {
+        return now;
+    }
+
+    /* Apart from net_crypto, everything times itself with unix_time(), which
+     * only changes once a second. */
+    const uint64_t next_second = (now / 1000 + 1) * 1000;
+    const uint64_t crypto_deadline = crypto_run_deadline(m->net_crypto);
+
+    return crypto_deadline < next_second ? crypto_deadline : next_second;
+}
+
+/* Context of a name resolution: whether the node is a TCP relay, its port and
+ * its public key.
+ */
+#define RESOLVE_CONTEXT_SIZE (1 + sizeof(uint16_t) + CRYPTO_PUBLIC_KEY_SIZE)
+
+static void bootstrap_resolved(void *object, const IP_Port *ip_ports, uint32_t count, const uint8_t *context,
+                               uint16_t context_length, void *userdata)
+{
+    Messenger *m = (Messenger *)object;
+
+    if (context_length != RESOLVE_CONTEXT_SIZE) {
+        return;
+    }
+
+    const bool tcp_relay = context[0] != 0;
+    uint16_t port;
+    memcpy(&port, context + 1, sizeof(port));
+    const uint8_t *public_key = context + 1 + sizeof(port);
+
+    if (count == 0) {
+        LOGGER_WARNING(m->log, "could not resolve the address of a %s on port %u",
+                       tcp_relay ? "TCP relay" : "bootstrap node", net_ntohs(port));
+        return;
+    }
+
+    for (uint32_t i = 0; i < count; ++i) {
+        IP_Port ip_port = ip_ports[i];
+        ip_port.port = port;
+
+        if (tcp_relay) {
+            add_tcp_relay(m->net_crypto, ip_port, public_key);
+        } else {
+            onion_add_bs_path_node(m->onion_c, ip_port, public_key);
+            DHT_bootstrap(m->dht, ip_port, public_key);
+        }
+    }
+}
+
+int m_resolve_bootstrap(Messenger *m, const char *address, uint16_t port, const uint8_t *public_key, bool tcp_relay)
+{
+    if (m->resolver == nullptr) {
+        if (m->options.dns_resolver_threads == 0) {
+            return -1;
+        }
+
+        const uint32_t num_threads = m->options.dns_resolver_threads < RESOLVER_MAX_THREADS
+                                     ? m->options.dns_resolver_threads : RESOLVER_MAX_THREADS;
+        m->resolver = resolver_new(num_threads, nullptr, nullptr);
+
+        if (m->resolver == nullptr) {
+            return -1;
+        }
+    }
+
+    uint8_t context[RESOLVE_CONTEXT_SIZE];
+    context[0] = tcp_relay;
+    memcpy(context + 1, &port, sizeof(port));
+    memcpy(context + 1 + sizeof(port), public_key, CRYPTO_PUBLIC_KEY_SIZE);
+
+    return resolver_resolve(m->resolver, address, tcp_relay ? TOX_SOCK_STREAM : TOX_SOCK_DGRAM, context,
+                            sizeof(context), &bootstrap_resolved, m);
+}
+
 /* The main loop that needs to be run at least 20 times per second. */
 void do_messenger(Messenger *m, void *userdata)
 {
@@ -2608,9 +2779,16 @@ void do_messenger(Messenger *m, void *userdata)
 
     unix_time_update();
 
+    if (m->resolver != nullptr) {
+        resolver_do(m->resolver, userdata);
+    }
+
     if (!m->options.udp_disabled) {
         networking_poll(m->net, userdata);
         do_DHT(m->dht);
+    } else {
+        /* do_DHT() runs the timers otherwise. */
+        timer_wheel_run(dht_get_timer_wheel(m->dht), unix_time());
     }
 
     if (m->tcp_server) {
@@ -2623,6 +2801,9 @@ void do_messenger(Messenger *m, void *userdata)
     do_friends(m, userdata);
     connection_status_cb(m, userdata);
 
+    /* Send everything queued up during this iteration. */
+    networking_flush_send_queue(m->net);
+
     if (unix_time() > m->lastdump + DUMPING_CLIENTS_FRIENDS_EVERY_N_SECONDS) {
         m->lastdump = unix_time();
         uint32_t client, last_pinged;
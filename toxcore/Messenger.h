@@ -28,6 +28,7 @@
 #include "friend_connection.h"
 #include "friend_requests.h"
 #include "logger.h"
+#include "resolver.h"
 
 #define MAX_NAME_LENGTH 128
 /* TODO(irungentoo): this must depend on other variable. */
@@ -82,6 +83,14 @@ typedef struct {
 
     bool hole_punching_enabled;
     bool local_discovery_enabled;
+    bool udp_send_queue_enabled;
+    bool udp_io_uring_enabled;
+    uint32_t crypto_worker_threads;
+    uint8_t dht_lookup_parallelism;
+    uint32_t dns_resolver_threads;
+    Congestion_Control_Type congestion_control;
+    bool packet_pacing_enabled;
+    bool session_resumption_enabled;
 
     logger_cb *log_callback;
     void *log_user_data;
@@ -146,11 +155,16 @@ struct File_Transfers {
     uint64_t transferred;
     uint8_t status; /* 0 == no transfer, 1 = not accepted, 3 = transferring, 4 = broken, 5 = finished */
     uint8_t paused; /* 0: not paused, 1 = paused by us, 2 = paused by other, 3 = paused by both. */
+    uint8_t stream; /* lossless stream the data is sent on. */
     uint32_t last_packet_number; /* number of the last packet sent. */
     uint64_t requested; /* total data requested by the request chunk callback */
     unsigned int slots_allocated; /* number of slots allocated to this transfer. */
     uint8_t id[FILE_ID_LENGTH];
 };
+/* File data is sent on the last lossless stream where the peer supports it, so
+ * that its lost packets don't hold up messages and the other packets. */
+#define FILE_DATA_STREAM (CRYPTO_NUM_STREAMS - 1)
+
 enum {
     FILESTATUS_NONE,
     FILESTATUS_NOT_ACCEPTED,
@@ -249,6 +263,9 @@ struct Messenger {
     uint8_t has_added_relays; // If the first connection has occurred in do_messenger
     Node_format loaded_relays[NUM_SAVED_TCP_RELAYS]; // Relays loaded from config
 
+    /* NULL until the first name is resolved off the main thread. */
+    Resolver *resolver;
+
     void (*friend_message)(struct Messenger *m, uint32_t, unsigned int, const uint8_t *, size_t, void *);
     void (*friend_namechange)(struct Messenger *m, uint32_t, const uint8_t *, size_t, void *);
     void (*friend_statusmessagechange)(struct Messenger *m, uint32_t, const uint8_t *, size_t, void *);
@@ -349,6 +366,14 @@ int m_delfriend(Messenger *m, int32_t friendnumber);
  */
 int m_get_friend_connectionstatus(const Messenger *m, int32_t friendnumber);
 
+/* Copy the statistics of the connection to the friend into stats, all zero if
+ * there is none.
+ *
+ *  return 0 on success.
+ *  return -1 if friend not valid.
+ */
+int m_get_friend_transport_stats(const Messenger *m, int32_t friendnumber, Crypto_Conn_Stats *stats);
+
 /* Checks if there exists a friend with given friendnumber.
  *
  *  return 1 if friend exists.
@@ -748,6 +773,16 @@ void kill_messenger(Messenger *m);
 /* The main loop that needs to be run at least 20 times per second. */
 void do_messenger(Messenger *m, void *userdata);
 
+/* Resolve the host name address on the resolver threads and bootstrap from the
+ * node with public_key at port (in network byte order), or add it as a TCP
+ * relay if tcp_relay is true. This is done by do_messenger() once the name is
+ * resolved.
+ *
+ * return -1 if there are no resolver threads or too many names are waiting.
+ * return 0 on success.
+ */
+int m_resolve_bootstrap(Messenger *m, const char *address, uint16_t port, const uint8_t *public_key, bool tcp_relay);
+
 /* Return the time in milliseconds before do_messenger() should be called again
  * for optimal performance.
  *
@@ -755,6 +790,15 @@ void do_messenger(Messenger *m, void *userdata);
  */
 uint32_t messenger_run_interval(const Messenger *m);
 
+/* Add the descriptors do_messenger() reads from or writes to to fds. */
+void messenger_fds(const Messenger *m, Net_Fds *fds);
+
+/* return the time (as returned by current_time_monotonic()) by which
+ *   do_messenger() must run again even if none of the descriptors from
+ *   messenger_fds() becomes ready.
+ */
+uint64_t messenger_run_deadline(const Messenger *m);
+
 /* SAVING AND LOADING FUNCTIONS: */
 
 /* return size of the messenger data (for saving). */
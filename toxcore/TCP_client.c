@@ -969,6 +969,22 @@ static int do_confirmed_TCP(TCP_Client_Connection *conn, void *userdata)
     return 0;
 }
 
+void tcp_con_fds(const TCP_Client_Connection *con, Net_Fds *fds)
+{
+    if (con->status == TCP_CLIENT_NO_STATUS || con->status == TCP_CLIENT_DISCONNECTED) {
+        return;
+    }
+
+    uint8_t events = NET_FD_EVENT_READ;
+
+    /* This includes the handshakes, so we also learn when connect() is done. */
+    if (con->last_packet_length != 0 || con->priority_queue_start != nullptr) {
+        events |= NET_FD_EVENT_WRITE;
+    }
+
+    net_fds_add(fds, con->sock, events);
+}
+
 /* Run the TCP connection
  */
 void do_TCP_connection(TCP_Client_Connection *TCP_connection, void *userdata)
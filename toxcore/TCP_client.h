@@ -66,6 +66,11 @@ void tcp_con_set_custom_uint(TCP_Client_Connection *con, uint32_t uint);
 TCP_Client_Connection *new_TCP_connection(IP_Port ip_port, const uint8_t *public_key, const uint8_t *self_public_key,
         const uint8_t *self_secret_key, TCP_Proxy_Info *proxy_info);
 
+/* Add the socket of the TCP connection to fds, unless the connection is down.
+ * It waits for NET_FD_EVENT_WRITE as long as data is queued for sending.
+ */
+void tcp_con_fds(const TCP_Client_Connection *con, Net_Fds *fds);
+
 /* Run the TCP connection
  */
 void do_TCP_connection(TCP_Client_Connection *TCP_connection, void *userdata);
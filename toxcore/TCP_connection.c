@@ -1483,6 +1483,19 @@ static void kill_nonused_tcp(TCP_Connections *tcp_c)
     }
 }
 
+void tcp_connections_fds(const TCP_Connections *tcp_c, Net_Fds *fds)
+{
+    for (uint32_t i = 0; i < tcp_c->tcp_connections_length; ++i) {
+        const TCP_con *tcp_con = get_tcp_connection(tcp_c, i);
+
+        if (tcp_con == nullptr || tcp_con->status == TCP_CONN_SLEEPING) {
+            continue;
+        }
+
+        tcp_con_fds(tcp_con->connection, fds);
+    }
+}
+
 void do_tcp_connections(TCP_Connections *tcp_c, void *userdata)
 {
     do_tcp_conns(tcp_c, userdata);
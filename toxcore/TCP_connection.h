@@ -216,6 +216,9 @@ unsigned int tcp_copy_connected_relays(TCP_Connections *tcp_c, Node_format *tcp_
  */
 TCP_Connections *new_tcp_connections(const uint8_t *secret_key, TCP_Proxy_Info *proxy_info);
 
+/* Add the sockets of all TCP relay connections that aren't sleeping to fds. */
+void tcp_connections_fds(const TCP_Connections *tcp_c, Net_Fds *fds);
+
 void do_tcp_connections(TCP_Connections *tcp_c, void *userdata);
 void kill_tcp_connections(TCP_Connections *tcp_c);
 
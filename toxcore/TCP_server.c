@@ -39,6 +39,7 @@
 #include <unistd.h>
 #endif
 
+#include "hash_table.h"
 #include "util.h"
 
 typedef struct TCP_Secure_Connection {
@@ -91,7 +92,7 @@ struct TCP_Server {
 
     uint64_t counter;
 
-    BS_LIST accepted_key_list;
+    Hash_Table accepted_key_table;
 };
 
 const uint8_t *tcp_server_public_key(const TCP_Server *tcp_server)
@@ -154,7 +155,7 @@ static int realloc_connection(TCP_Server *TCP_server, uint32_t num)
  */
 static int get_TCP_connection_index(const TCP_Server *TCP_server, const uint8_t *public_key)
 {
-    return bs_list_find(&TCP_server->accepted_key_list, public_key);
+    return hash_table_find(&TCP_server->accepted_key_table, public_key);
 }
 
 
@@ -196,7 +197,7 @@ static int add_accepted(TCP_Server *TCP_server, const TCP_Secure_Connection *con
         return -1;
     }
 
-    if (!bs_list_add(&TCP_server->accepted_key_list, con->public_key, index)) {
+    if (!hash_table_add(&TCP_server->accepted_key_table, con->public_key, index)) {
         return -1;
     }
 
@@ -225,7 +226,8 @@ static int del_accepted(TCP_Server *TCP_server, int index)
         return -1;
     }
 
-    if (!bs_list_remove(&TCP_server->accepted_key_list, TCP_server->accepted_connection_array[index].public_key, index)) {
+    if (!hash_table_remove(&TCP_server->accepted_key_table, TCP_server->accepted_connection_array[index].public_key,
+                           index)) {
         return -1;
     }
 
@@ -1100,7 +1102,7 @@ TCP_Server *new_TCP_server(uint8_t ipv6_enabled, uint16_t num_sockets, const uin
     memcpy(temp->secret_key, secret_key, CRYPTO_SECRET_KEY_SIZE);
     crypto_derive_public_key(temp->public_key, temp->secret_key);
 
-    bs_list_init(&temp->accepted_key_list, CRYPTO_PUBLIC_KEY_SIZE, 8);
+    hash_table_init(&temp->accepted_key_table, CRYPTO_PUBLIC_KEY_SIZE, 8);
 
     return temp;
 }
@@ -1392,6 +1394,49 @@ static void do_TCP_epoll(TCP_Server *TCP_server)
 }
 #endif
 
+#ifndef TCP_SERVER_USE_EPOLL
+static void tcp_server_add_fd(Net_Fds *fds, const TCP_Secure_Connection *con)
+{
+    if (con->status == TCP_STATUS_NO_STATUS) {
+        return;
+    }
+
+    uint8_t events = NET_FD_EVENT_READ;
+
+    if (con->last_packet_length != 0 || con->priority_queue_start != nullptr) {
+        events |= NET_FD_EVENT_WRITE;
+    }
+
+    net_fds_add(fds, con->sock, events);
+}
+#endif
+
+void tcp_server_fds(const TCP_Server *tcp_server, Net_Fds *fds)
+{
+#ifdef TCP_SERVER_USE_EPOLL
+    /* Pending data is only retried once a second in this mode, see
+     * do_TCP_confirmed(), so the epoll instance is all we need. */
+    Socket efd;
+    efd.socket = tcp_server->efd;
+    net_fds_add(fds, efd, NET_FD_EVENT_READ);
+#else
+
+    for (uint32_t i = 0; i < tcp_server->num_listening_socks; ++i) {
+        net_fds_add(fds, tcp_server->socks_listening[i], NET_FD_EVENT_READ);
+    }
+
+    for (uint32_t i = 0; i < MAX_INCOMING_CONNECTIONS; ++i) {
+        tcp_server_add_fd(fds, &tcp_server->incoming_connection_queue[i]);
+        tcp_server_add_fd(fds, &tcp_server->unconfirmed_connection_queue[i]);
+    }
+
+    for (uint32_t i = 0; i < tcp_server->size_accepted_connections; ++i) {
+        tcp_server_add_fd(fds, &tcp_server->accepted_connection_array[i]);
+    }
+
+#endif
+}
+
 void do_TCP_server(TCP_Server *TCP_server)
 {
     unix_time_update();
@@ -1420,7 +1465,7 @@ void kill_TCP_server(TCP_Server *TCP_server)
         set_callback_handle_recv_1(TCP_server->onion, nullptr, nullptr);
     }
 
-    bs_list_free(&TCP_server->accepted_key_list);
+    hash_table_free(&TCP_server->accepted_key_table);
 
 #ifdef TCP_SERVER_USE_EPOLL
     close(TCP_server->efd);
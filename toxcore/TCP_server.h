@@ -25,7 +25,6 @@
 #define TCP_SERVER_H
 
 #include "crypto_core.h"
-#include "list.h"
 #include "onion.h"
 
 #ifdef TCP_SERVER_USE_EPOLL
@@ -95,6 +94,11 @@ size_t tcp_server_listen_count(const TCP_Server *tcp_server);
 TCP_Server *new_TCP_server(uint8_t ipv6_enabled, uint16_t num_sockets, const uint16_t *ports, const uint8_t *secret_key,
                            Onion *onion);
 
+/* Add the descriptors do_TCP_server() reads from to fds. With epoll that is the
+ * epoll instance, otherwise the listening sockets and those of all connections.
+ */
+void tcp_server_fds(const TCP_Server *tcp_server, Net_Fds *fds);
+
 /* Run the TCP_server
  */
 void do_TCP_server(TCP_Server *TCP_server);
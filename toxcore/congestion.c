@@ -0,0 +1,360 @@
+/*
+ * Congestion controllers deciding how fast a crypto connection sends its
+ * lossless packets.
+ */
+
+/*
+ * Copyright © 2016-2018 The TokTok team.
+ *
+ * This file is part of Tox, the free peer to peer instant messenger.
+ *
+ * Tox is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Tox is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Tox.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "congestion.h"
+
+#include <string.h>
+
+#include "ccompat.h"
+
+typedef struct Congestion_Ops {
+    void (*init)(Congestion_Control *cc);
+    /* Null if only the smallest round trip time of the sample is used. */
+    void (*rtt)(Congestion_Control *cc, uint64_t rtt, uint64_t now);
+    void (*update)(Congestion_Control *cc, const Congestion_Sample *sample);
+} Congestion_Ops;
+
+/* If the send queue is SEND_QUEUE_RATIO times larger than the
+ * calculated link speed the packet send speed will be reduced
+ * by a value depending on this number.
+ */
+#define SEND_QUEUE_RATIO 2.0
+
+static void queue_init(Congestion_Control *cc)
+{
+    memset(&cc->state.queue, 0, sizeof(cc->state.queue));
+}
+
+static void queue_update(Congestion_Control *cc, const Congestion_Sample *sample)
+{
+    Congestion_Queue *const q = &cc->state.queue;
+
+    unsigned int pos = q->last_sendqueue_counter % CONGESTION_QUEUE_ARRAY_SIZE;
+    q->last_sendqueue_size[pos] = sample->send_queue;
+    ++q->last_sendqueue_counter;
+
+    long signed int sum = 0;
+    sum = (long signed int)q->last_sendqueue_size[(pos) % CONGESTION_QUEUE_ARRAY_SIZE] -
+          (long signed int)q->last_sendqueue_size[(pos - (CONGESTION_QUEUE_ARRAY_SIZE - 1)) %
+                  CONGESTION_QUEUE_ARRAY_SIZE];
+
+    unsigned int n_p_pos = q->last_sendqueue_counter % CONGESTION_LAST_SENT_ARRAY_SIZE;
+    q->last_num_packets_sent[n_p_pos] = sample->packets_sent;
+    q->last_num_packets_resent[n_p_pos] = sample->packets_resent;
+
+    if (sample->hold_rates) {
+        return;
+    }
+
+    long signed int total_sent = 0, total_resent = 0;
+
+    // TODO(irungentoo): use real delay
+    unsigned int delay = (unsigned int)((sample->min_rtt / CONGESTION_SAMPLE_INTERVAL) + 0.5);
+    unsigned int packets_set_rem_array = (CONGESTION_LAST_SENT_ARRAY_SIZE - CONGESTION_QUEUE_ARRAY_SIZE);
+
+    if (delay > packets_set_rem_array) {
+        delay = packets_set_rem_array;
+    }
+
+    for (unsigned j = 0; j < CONGESTION_QUEUE_ARRAY_SIZE; ++j) {
+        unsigned int ind = (j + (packets_set_rem_array  - delay) + n_p_pos) % CONGESTION_LAST_SENT_ARRAY_SIZE;
+        total_sent += q->last_num_packets_sent[ind];
+        total_resent += q->last_num_packets_resent[ind];
+    }
+
+    if (sum > 0) {
+        total_sent -= sum;
+    } else {
+        if (total_resent > -sum) {
+            total_resent = -sum;
+        }
+    }
+
+    /* if queue is too big only allow resending packets. */
+    uint32_t npackets = sample->send_queue;
+    double min_speed = 1000.0 * (((double)(total_sent)) / ((double)(CONGESTION_QUEUE_ARRAY_SIZE) *
+                                 CONGESTION_SAMPLE_INTERVAL));
+
+    double min_speed_request = 1000.0 * (((double)(total_sent + total_resent)) / ((double)(
+            CONGESTION_QUEUE_ARRAY_SIZE) * CONGESTION_SAMPLE_INTERVAL));
+
+    if (min_speed < CONGESTION_MIN_RATE) {
+        min_speed = CONGESTION_MIN_RATE;
+    }
+
+    double send_array_ratio = (((double)npackets) / min_speed);
+
+    // TODO(irungentoo): Improve formula?
+    if (send_array_ratio > SEND_QUEUE_RATIO && CONGESTION_MIN_QUEUE_LENGTH < npackets) {
+        cc->send_rate = min_speed * (1.0 / (send_array_ratio / SEND_QUEUE_RATIO));
+    } else if (sample->last_congestion_event + CONGESTION_EVENT_TIMEOUT < sample->time) {
+        cc->send_rate = min_speed * 1.2;
+    } else {
+        cc->send_rate = min_speed * 0.9;
+    }
+
+    cc->request_rate = min_speed_request * 1.2;
+
+    if (cc->send_rate < CONGESTION_MIN_RATE) {
+        cc->send_rate = CONGESTION_MIN_RATE;
+    }
+
+    if (cc->request_rate < cc->send_rate) {
+        cc->request_rate = cc->send_rate;
+    }
+}
+
+/* Queueing delay in ms LEDBAT aims for. */
+#define LEDBAT_TARGET 100
+
+/* How fast the window moves towards the target, in packets per window of
+ * packets acknowledged with no queueing delay. */
+#define LEDBAT_GAIN 1.0
+
+/* The window a connection starts with, and the smallest one it shrinks to. */
+#define LEDBAT_INITIAL_WINDOW 16
+#define LEDBAT_MIN_WINDOW 2
+
+/* Round trip time in ms assumed until the first one is measured. */
+#define LEDBAT_INITIAL_RTT 1000
+
+#define LEDBAT_MINUTE 60000
+
+static void ledbat_init(Congestion_Control *cc)
+{
+    Congestion_Ledbat *const l = &cc->state.ledbat;
+    memset(l, 0, sizeof(Congestion_Ledbat));
+    l->window = LEDBAT_INITIAL_WINDOW;
+    l->slow_start = true;
+    cc->send_rate = l->window * 1000.0 / LEDBAT_INITIAL_RTT;
+    cc->request_rate = cc->send_rate;
+}
+
+/* return the smallest round trip time of the last minutes, 0 if there is none. */
+static uint64_t ledbat_base_delay(const Congestion_Ledbat *l)
+{
+    uint64_t base = 0;
+
+    for (uint32_t i = 0; i < CONGESTION_BASE_HISTORY; ++i) {
+        if (l->base_delay[i] != 0 && (base == 0 || l->base_delay[i] < base)) {
+            base = l->base_delay[i];
+        }
+    }
+
+    return base;
+}
+
+static void ledbat_rtt(Congestion_Control *cc, uint64_t rtt, uint64_t now)
+{
+    Congestion_Ledbat *const l = &cc->state.ledbat;
+
+    /* 0 means "none", a round trip that quick is the same as 1 ms. */
+    if (rtt == 0) {
+        rtt = 1;
+    }
+
+    const uint64_t minute = now / LEDBAT_MINUTE;
+
+    /* Forget the minutes that are too old, the ones without packets too. */
+    for (uint64_t m = l->base_minute + 1; m <= minute && m <= l->base_minute + CONGESTION_BASE_HISTORY; ++m) {
+        l->base_delay[m % CONGESTION_BASE_HISTORY] = 0;
+    }
+
+    if (minute > l->base_minute) {
+        l->base_minute = minute;
+    }
+
+    uint64_t *const base = &l->base_delay[minute % CONGESTION_BASE_HISTORY];
+
+    if (*base == 0 || rtt < *base) {
+        *base = rtt;
+    }
+
+    if (l->interval_delay == 0 || rtt < l->interval_delay) {
+        l->interval_delay = rtt;
+    }
+}
+
+static void ledbat_update(Congestion_Control *cc, const Congestion_Sample *sample)
+{
+    Congestion_Ledbat *const l = &cc->state.ledbat;
+
+    /* The smallest round trip of a sample leaves out the packets that waited
+     * for the peer to confirm them. */
+    if (l->interval_delay != 0) {
+        l->current_delay = l->interval_delay;
+        l->interval_delay = 0;
+    }
+
+    if (sample->hold_rates) {
+        return;
+    }
+
+    const uint64_t rtt = l->current_delay != 0 ? l->current_delay : LEDBAT_INITIAL_RTT;
+    const uint64_t base = ledbat_base_delay(l);
+    const double queueing_delay = base != 0 && rtt > base ? (double)(rtt - base) : 0.0;
+
+    if (sample->packets_resent > 0 && sample->time - l->last_loss > rtt) {
+        /* At most once a round trip, the losses of one window are one
+         * congestion event. */
+        l->window /= 2;
+        l->slow_start = false;
+        l->last_loss = sample->time;
+    } else if (l->slow_start && queueing_delay < LEDBAT_TARGET / 2) {
+        l->window += sample->packets_acked;
+    } else {
+        if (l->slow_start) {
+            /* The window doubled over the last round trip, the path only took
+             * the one before without a queue building up. */
+            l->window /= 2;
+            l->slow_start = false;
+        }
+
+        double off_target = (LEDBAT_TARGET - queueing_delay) / LEDBAT_TARGET;
+
+        if (off_target < -1.0) {
+            off_target = -1.0;
+        }
+
+        l->window += LEDBAT_GAIN * off_target * sample->packets_acked / l->window;
+    }
+
+    /* A connection with less to send than its window can't tell whether the
+     * path could take more, so don't grow it much past what it sends. */
+    const double max_window = 2.0 * sample->send_queue + CONGESTION_MIN_QUEUE_LENGTH;
+
+    if (l->window > max_window) {
+        l->window = max_window;
+    }
+
+    if (l->window < LEDBAT_MIN_WINDOW) {
+        l->window = LEDBAT_MIN_WINDOW;
+    }
+
+    cc->send_rate = l->window * 1000.0 / rtt;
+
+    if (cc->send_rate < CONGESTION_MIN_RATE) {
+        cc->send_rate = CONGESTION_MIN_RATE;
+    }
+
+    /* Packets sent again are part of the window like any other. */
+    cc->request_rate = cc->send_rate;
+}
+
+static const Congestion_Ops queue_ops = {
+    queue_init,
+    nullptr,
+    queue_update,
+};
+
+static const Congestion_Ops ledbat_ops = {
+    ledbat_init,
+    ledbat_rtt,
+    ledbat_update,
+};
+
+static const Congestion_Ops *congestion_ops(Congestion_Control_Type type)
+{
+    switch (type) {
+        case CONGESTION_CONTROL_LEDBAT:
+            return &ledbat_ops;
+
+        case CONGESTION_CONTROL_QUEUE:
+            break;
+    }
+
+    return &queue_ops;
+}
+
+void congestion_init(Congestion_Control *cc, Congestion_Control_Type type)
+{
+    cc->type = type;
+    cc->send_rate = CONGESTION_MIN_RATE;
+    cc->request_rate = CONGESTION_MIN_RATE;
+    congestion_ops(type)->init(cc);
+}
+
+void congestion_rtt(Congestion_Control *cc, uint64_t rtt, uint64_t now)
+{
+    const Congestion_Ops *const ops = congestion_ops(cc->type);
+
+    if (ops->rtt != nullptr) {
+        ops->rtt(cc, rtt, now);
+    }
+}
+
+void congestion_update(Congestion_Control *cc, const Congestion_Sample *sample)
+{
+    congestion_ops(cc->type)->update(cc, sample);
+}
+
+/* Most packets sent at once at rate packets a second when pacing. */
+static double pacing_burst(double rate)
+{
+    const double burst = rate * CONGESTION_PACING_INTERVAL / 1000.0;
+
+    if (burst < CONGESTION_PACING_MIN_BURST) {
+        return CONGESTION_PACING_MIN_BURST;
+    }
+
+    return burst;
+}
+
+double congestion_burst_limit(const Congestion_Control *cc, double packets, bool pacing)
+{
+    if (!pacing) {
+        return packets * 4 + CONGESTION_MIN_QUEUE_LENGTH;
+    }
+
+    return packets + pacing_burst(cc->send_rate);
+}
+
+uint32_t congestion_pace(Congestion_Pacer *pacer, double rate, uint64_t now, uint32_t wanted)
+{
+    const double burst = pacing_burst(rate);
+
+    if (pacer->last_time == 0) {
+        pacer->tokens = burst;
+    } else if (now > pacer->last_time) {
+        pacer->tokens += rate * (double)(now - pacer->last_time) / 1000.0;
+    }
+
+    if (pacer->tokens > burst) {
+        pacer->tokens = burst;
+    }
+
+    pacer->last_time = now;
+
+    uint32_t packets = (uint32_t)pacer->tokens;
+
+    if (packets > wanted) {
+        packets = wanted;
+    }
+
+    pacer->tokens -= packets;
+    return packets;
+}
@@ -0,0 +1,170 @@
+/*
+ * Congestion controllers deciding how fast a crypto connection sends its
+ * lossless packets.
+ */
+
+/*
+ * Copyright © 2016-2018 The TokTok team.
+ *
+ * This file is part of Tox, the free peer to peer instant messenger.
+ *
+ * Tox is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Tox is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Tox.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef CONGESTION_H
+#define CONGESTION_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Minimum packet rate per second. */
+#define CONGESTION_MIN_RATE 4.0
+
+/* Minimum packet queue max length. */
+#define CONGESTION_MIN_QUEUE_LENGTH 64
+
+/* Time in ms between two samples given to congestion_update(). */
+#define CONGESTION_SAMPLE_INTERVAL 50
+
+/* Timeout for increasing speed after congestion event (in ms). */
+#define CONGESTION_EVENT_TIMEOUT 1000
+
+/* Base current transfer speed on last CONGESTION_QUEUE_ARRAY_SIZE number of points taken
+   at the dT defined in net_crypto.c */
+#define CONGESTION_QUEUE_ARRAY_SIZE 12
+#define CONGESTION_LAST_SENT_ARRAY_SIZE (CONGESTION_QUEUE_ARRAY_SIZE * 2)
+
+/* Number of minutes whose smallest round trip time LEDBAT keeps, to take the
+ * smallest of them as the delay of the path without any queue.
+ */
+#define CONGESTION_BASE_HISTORY 10
+
+/* Time in ms whose worth of packets a paced connection may send at once, and
+ * the fewest packets it may send at once whatever its rate.
+ */
+#define CONGESTION_PACING_INTERVAL 2
+#define CONGESTION_PACING_MIN_BURST 2
+
+typedef enum Congestion_Control_Type {
+    /* Speeds up while the send queue stays short and slows down once it
+     * grows. */
+    CONGESTION_CONTROL_QUEUE,
+
+    /* LEDBAT (RFC 6817): keeps the delay that the connection's packets queue
+     * up on the path near a target, and halves its window on loss. */
+    CONGESTION_CONTROL_LEDBAT,
+} Congestion_Control_Type;
+
+/* What happened on the connection over the last CONGESTION_SAMPLE_INTERVAL. */
+typedef struct Congestion_Sample {
+    uint64_t time;
+
+    /* Packets sent for the first time and packets the peer asked for again. */
+    uint32_t packets_sent;
+    uint32_t packets_resent;
+
+    /* Packets the peer confirmed it received in order. */
+    uint32_t packets_acked;
+
+    /* Packets sent or waiting to be sent that the peer didn't confirm yet. */
+    uint32_t send_queue;
+
+    /* Smallest round trip time in ms seen on the connection. */
+    uint64_t min_rtt;
+
+    /* When resending packets last used up the packets the connection could
+     * send. */
+    uint64_t last_congestion_event;
+
+    /* Keep the rates as they are, the path just changed. */
+    bool hold_rates;
+} Congestion_Sample;
+
+typedef struct Congestion_Queue {
+    uint32_t last_sendqueue_size[CONGESTION_QUEUE_ARRAY_SIZE], last_sendqueue_counter;
+    long signed int last_num_packets_sent[CONGESTION_LAST_SENT_ARRAY_SIZE],
+         last_num_packets_resent[CONGESTION_LAST_SENT_ARRAY_SIZE];
+} Congestion_Queue;
+
+typedef struct Congestion_Ledbat {
+    /* Packets the connection may have on the path. */
+    double window;
+    bool slow_start;
+
+    /* Smallest round trip time of each of the last minutes. */
+    uint64_t base_delay[CONGESTION_BASE_HISTORY];
+    uint64_t base_minute;
+
+    /* Smallest round trip time since the last sample, 0 if there was none,
+     * and the latest of these. */
+    uint64_t interval_delay;
+    uint64_t current_delay;
+
+    uint64_t last_loss;
+} Congestion_Ledbat;
+
+/* The state of a connection's controller. It is kept in the connection, so
+ * that it needs no allocation.
+ */
+typedef struct Congestion_Control {
+    Congestion_Control_Type type;
+
+    /* Packets per second the connection may send, and may send including the
+     * packets the peer asked for again. */
+    double send_rate;
+    double request_rate;
+
+    union {
+        Congestion_Queue queue;
+        Congestion_Ledbat ledbat;
+    } state;
+} Congestion_Control;
+
+/* Lets packets out evenly at a rate instead of all at once, a few at a time. */
+typedef struct Congestion_Pacer {
+    double tokens;
+    uint64_t last_time;
+} Congestion_Pacer;
+
+/* Start a controller of the given type at the minimum rate. */
+void congestion_init(Congestion_Control *cc, Congestion_Control_Type type);
+
+/* Tell the controller the round trip time of a packet the peer just
+ * confirmed.
+ */
+void congestion_rtt(Congestion_Control *cc, uint64_t rtt, uint64_t now);
+
+/* Set new rates from what happened since the last sample. */
+void congestion_update(Congestion_Control *cc, const Congestion_Sample *sample);
+
+/* return the most packets a connection may have left to send after it was
+ * allowed packets more. Without pacing it may save up a few times that, to
+ * catch up after a slow iteration; with pacing only packets and what it sends
+ * in CONGESTION_PACING_INTERVAL.
+ */
+double congestion_burst_limit(const Congestion_Control *cc, double packets, bool pacing);
+
+/* return how many of wanted packets the pacer lets out at time now (in ms)
+ * when it paces them at rate packets a second, and count them as sent.
+ */
+uint32_t congestion_pace(Congestion_Pacer *pacer, double rate, uint64_t now, uint32_t wanted);
+
+#ifdef __cplusplus
+}  // extern "C"
+#endif
+
+#endif
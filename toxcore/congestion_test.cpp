@@ -0,0 +1,133 @@
+#include "congestion.h"
+
+#include "../testing/congestion_sim.h"
+
+#include <gtest/gtest.h>
+
+namespace {
+
+TEST(Congestion, PacingKeepsBurstsSmall)
+{
+    for (const Congestion_Control_Type type : {CONGESTION_CONTROL_QUEUE, CONGESTION_CONTROL_LEDBAT}) {
+        const Result bursty = simulate(type, shallow, 60, 20, {1, false, 50, 100});
+        const Result paced = simulate(type, shallow, 60, 20, {1, true, 50, 100});
+
+        EXPECT_LT(paced.max_burst, bursty.max_burst);
+        EXPECT_LT(paced.loss, bursty.loss);
+        EXPECT_GT(paced.utilisation, bursty.utilisation - 0.05);
+    }
+}
+
+TEST(Congestion, PacingSpreadsLossyFrames)
+{
+    const Result bursty = simulate_lossy(shallow, 25, 33, 60, false);
+    const Result paced = simulate_lossy(shallow, 25, 33, 60, true);
+
+    EXPECT_EQ(bursty.max_burst, 25u);
+    EXPECT_GT(bursty.loss, 0.1);
+    EXPECT_LT(paced.max_burst, bursty.max_burst);
+    EXPECT_LT(paced.loss, bursty.loss);
+    EXPECT_EQ(paced.loss, 0.0);
+
+    // Frames small enough that the pacer's rate stays below a burst per pacing
+    // interval go out no more than the smallest burst at a time.
+    const Result small = simulate_lossy(shallow, 10, 33, 60, true);
+    EXPECT_EQ(simulate_lossy(shallow, 10, 33, 60, false).max_burst, 10u);
+    EXPECT_LE(small.max_burst, uint32_t(CONGESTION_PACING_MIN_BURST));
+    EXPECT_EQ(small.loss, 0.0);
+}
+
+TEST(Congestion, PacerLetsPacketsOutAtItsRate)
+{
+    Congestion_Pacer pacer = {};
+
+    // A burst to start with, then one packet a ms at 1000 a second.
+    EXPECT_EQ(congestion_pace(&pacer, 1000.0, 100, 10), uint32_t(CONGESTION_PACING_MIN_BURST));
+    EXPECT_EQ(congestion_pace(&pacer, 1000.0, 100, 10), 0u);
+    EXPECT_EQ(congestion_pace(&pacer, 1000.0, 101, 10), 1u);
+    EXPECT_EQ(congestion_pace(&pacer, 1000.0, 104, 10), 2u);
+
+    // Time the pacer wasn't asked doesn't save up more than a burst.
+    EXPECT_EQ(congestion_pace(&pacer, 10000.0, 1000, 100), uint32_t(10000 * CONGESTION_PACING_INTERVAL / 1000));
+}
+
+TEST(Congestion, LedbatFillsTheLink)
+{
+    EXPECT_GT(simulate(CONGESTION_CONTROL_LEDBAT, broadband, 60, 20).utilisation, 0.9);
+    EXPECT_GT(simulate(CONGESTION_CONTROL_LEDBAT, long_fat, 60, 20).utilisation, 0.9);
+    EXPECT_GT(simulate(CONGESTION_CONTROL_LEDBAT, slow, 60, 20).utilisation, 0.9);
+}
+
+TEST(Congestion, LedbatKeepsTheQueueNearTheTarget)
+{
+    const Result result = simulate(CONGESTION_CONTROL_LEDBAT, broadband, 60, 20);
+    EXPECT_LT(result.mean_delay, 150.0);
+    EXPECT_LT(result.max_delay, 400.0);
+}
+
+TEST(Congestion, LedbatHalvesItsWindowOnLoss)
+{
+    Congestion_Control cc;
+    congestion_init(&cc, CONGESTION_CONTROL_LEDBAT);
+    congestion_rtt(&cc, 100, 10000);
+
+    Congestion_Sample sample = {};
+    sample.time = 10000;
+    sample.send_queue = 100;
+    sample.packets_acked = 16;
+    congestion_update(&cc, &sample);
+    const double rate = cc.send_rate;
+
+    sample.time += CONGESTION_SAMPLE_INTERVAL;
+    sample.packets_acked = 0;
+    sample.packets_resent = 1;
+    congestion_rtt(&cc, 100, sample.time);
+    congestion_update(&cc, &sample);
+    EXPECT_DOUBLE_EQ(cc.send_rate, rate / 2);
+
+    // Once a round trip at most.
+    sample.time += CONGESTION_SAMPLE_INTERVAL;
+    congestion_rtt(&cc, 100, sample.time);
+    congestion_update(&cc, &sample);
+    EXPECT_DOUBLE_EQ(cc.send_rate, rate / 2);
+}
+
+TEST(Congestion, LedbatDoesntGrowPastWhatItSends)
+{
+    Congestion_Control cc;
+    congestion_init(&cc, CONGESTION_CONTROL_LEDBAT);
+
+    Congestion_Sample sample = {};
+
+    for (uint64_t time = 1000; time < 60000; time += CONGESTION_SAMPLE_INTERVAL) {
+        congestion_rtt(&cc, 100, time);
+        sample.time = time;
+        sample.send_queue = 1;
+        sample.packets_acked = 1;
+        congestion_update(&cc, &sample);
+    }
+
+    EXPECT_LE(cc.send_rate, (2.0 + CONGESTION_MIN_QUEUE_LENGTH) * 1000.0 / 100);
+}
+
+TEST(Congestion, HoldsItsRatesWhileThePathChanges)
+{
+    for (const Congestion_Control_Type type : {CONGESTION_CONTROL_QUEUE, CONGESTION_CONTROL_LEDBAT}) {
+        Congestion_Control cc;
+        congestion_init(&cc, type);
+        const double rate = cc.send_rate;
+
+        Congestion_Sample sample = {};
+        sample.time = 10000;
+        sample.packets_sent = 1000;
+        sample.packets_acked = 1000;
+        sample.min_rtt = 100;
+        sample.hold_rates = true;
+        congestion_rtt(&cc, 100, sample.time);
+        congestion_update(&cc, &sample);
+
+        EXPECT_EQ(cc.send_rate, rate);
+    }
+}
+
+}  // namespace
@@ -0,0 +1,342 @@
+/*
+ * Worker threads computing shared keys for packets from new peers.
+ */
+
+/*
+ * Copyright © 2016-2018 The TokTok team.
+ *
+ * This file is part of Tox, the free peer to peer instant messenger.
+ *
+ * Tox is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Tox is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Tox.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "crypto_pool.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <unistd.h>
+#define CRYPTO_POOL_USE_PIPE
+#endif
+
+#include "ccompat.h"
+#include "crypto_core.h"
+
+typedef enum Crypto_Pool_Job_State {
+    CRYPTO_POOL_JOB_QUEUED,
+    CRYPTO_POOL_JOB_WORKING,
+    CRYPTO_POOL_JOB_DONE,
+} Crypto_Pool_Job_State;
+
+typedef struct Crypto_Pool_Job {
+    uint8_t public_key[CRYPTO_PUBLIC_KEY_SIZE];
+    uint8_t secret_key[CRYPTO_SECRET_KEY_SIZE];
+    uint8_t shared_key[CRYPTO_SHARED_KEY_SIZE];
+
+    IP_Port source;
+    uint8_t packet[MAX_UDP_PACKET_SIZE];
+    uint16_t length;
+
+    /* NULL once the job was cancelled. */
+    crypto_pool_done_cb *done;
+    void *object;
+
+    Crypto_Pool_Job_State state;
+} Crypto_Pool_Job;
+
+/* The jobs are a ring buffer. The counters only ever go up, and
+ * jobs[counter % CRYPTO_POOL_QUEUE_SIZE] is the job they point at:
+ *
+ *   head <= next <= tail, tail - head <= CRYPTO_POOL_QUEUE_SIZE
+ *
+ * [head, next) is being or was worked on, [next, tail) waits for a thread.
+ * crypto_pool_do() hands back the jobs from head on, so a job that finishes
+ * early waits for the ones queued before it.
+ */
+struct Crypto_Pool {
+    pthread_mutex_t mutex;
+    /* Signalled when jobs are queued and when the pool stops. */
+    pthread_cond_t work;
+
+    pthread_t threads[CRYPTO_POOL_MAX_THREADS];
+    uint32_t num_threads;
+    bool stopping;
+
+    Crypto_Pool_Job *jobs;
+    uint32_t head;
+    uint32_t next;
+    uint32_t tail;
+
+#ifdef CRYPTO_POOL_USE_PIPE
+    /* The workers write a byte to signal_fds[1] for each finished job. */
+    int signal_fds[2];
+#endif
+};
+
+static Crypto_Pool_Job *pool_job(const Crypto_Pool *pool, uint32_t counter)
+{
+    return &pool->jobs[counter % CRYPTO_POOL_QUEUE_SIZE];
+}
+
+static void *crypto_pool_thread(void *arg)
+{
+    Crypto_Pool *const pool = (Crypto_Pool *)arg;
+
+    pthread_mutex_lock(&pool->mutex);
+
+    while (true) {
+        while (!pool->stopping && pool->next == pool->tail) {
+            pthread_cond_wait(&pool->work, &pool->mutex);
+        }
+
+        if (pool->stopping) {
+            break;
+        }
+
+        Crypto_Pool_Job *const job = pool_job(pool, pool->next);
+        ++pool->next;
+        job->state = CRYPTO_POOL_JOB_WORKING;
+
+        /* The main thread leaves the keys of a job that is being worked on
+         * alone, so we can compute without the lock. */
+        pthread_mutex_unlock(&pool->mutex);
+        encrypt_precompute(job->public_key, job->secret_key, job->shared_key);
+        crypto_memzero(job->secret_key, sizeof(job->secret_key));
+        pthread_mutex_lock(&pool->mutex);
+
+        job->state = CRYPTO_POOL_JOB_DONE;
+
+#ifdef CRYPTO_POOL_USE_PIPE
+        const uint8_t signal = 0;
+
+        if (write(pool->signal_fds[1], &signal, 1) != 1) {
+            /* The pipe is full, so it is readable already. */
+        }
+
+#endif
+    }
+
+    pthread_mutex_unlock(&pool->mutex);
+    return nullptr;
+}
+
+#ifdef CRYPTO_POOL_USE_PIPE
+static int open_signal_pipe(int *fds)
+{
+    if (pipe(fds) != 0) {
+        return -1;
+    }
+
+    for (uint32_t i = 0; i < 2; ++i) {
+        const int flags = fcntl(fds[i], F_GETFL);
+
+        if (flags == -1 || fcntl(fds[i], F_SETFL, flags | O_NONBLOCK) == -1
+                || fcntl(fds[i], F_SETFD, FD_CLOEXEC) == -1) {
+            close(fds[0]);
+            close(fds[1]);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+#endif
+
+Crypto_Pool *crypto_pool_new(uint32_t num_threads)
+{
+    if (num_threads == 0 || num_threads > CRYPTO_POOL_MAX_THREADS) {
+        return nullptr;
+    }
+
+    Crypto_Pool *pool = (Crypto_Pool *)calloc(1, sizeof(Crypto_Pool));
+
+    if (pool == nullptr) {
+        return nullptr;
+    }
+
+    pool->jobs = (Crypto_Pool_Job *)calloc(CRYPTO_POOL_QUEUE_SIZE, sizeof(Crypto_Pool_Job));
+
+    if (pool->jobs == nullptr) {
+        free(pool);
+        return nullptr;
+    }
+
+    if (pthread_mutex_init(&pool->mutex, nullptr) != 0) {
+        free(pool->jobs);
+        free(pool);
+        return nullptr;
+    }
+
+    if (pthread_cond_init(&pool->work, nullptr) != 0) {
+        pthread_mutex_destroy(&pool->mutex);
+        free(pool->jobs);
+        free(pool);
+        return nullptr;
+    }
+
+#ifdef CRYPTO_POOL_USE_PIPE
+
+    if (open_signal_pipe(pool->signal_fds) != 0) {
+        pthread_cond_destroy(&pool->work);
+        pthread_mutex_destroy(&pool->mutex);
+        free(pool->jobs);
+        free(pool);
+        return nullptr;
+    }
+
+#endif
+
+    for (uint32_t i = 0; i < num_threads; ++i) {
+        if (pthread_create(&pool->threads[i], nullptr, &crypto_pool_thread, pool) != 0) {
+            crypto_pool_kill(pool);
+            return nullptr;
+        }
+
+        ++pool->num_threads;
+    }
+
+    return pool;
+}
+
+void crypto_pool_kill(Crypto_Pool *pool)
+{
+    if (pool == nullptr) {
+        return;
+    }
+
+    pthread_mutex_lock(&pool->mutex);
+    pool->stopping = true;
+    pthread_cond_broadcast(&pool->work);
+    pthread_mutex_unlock(&pool->mutex);
+
+    for (uint32_t i = 0; i < pool->num_threads; ++i) {
+        pthread_join(pool->threads[i], nullptr);
+    }
+
+    pthread_cond_destroy(&pool->work);
+    pthread_mutex_destroy(&pool->mutex);
+
+#ifdef CRYPTO_POOL_USE_PIPE
+    close(pool->signal_fds[0]);
+    close(pool->signal_fds[1]);
+#endif
+
+    crypto_memzero(pool->jobs, CRYPTO_POOL_QUEUE_SIZE * sizeof(Crypto_Pool_Job));
+    free(pool->jobs);
+    free(pool);
+}
+
+int crypto_pool_precompute(Crypto_Pool *pool, const uint8_t *public_key, const uint8_t *secret_key,
+                           IP_Port source, const uint8_t *packet, uint16_t length,
+                           crypto_pool_done_cb *done, void *object)
+{
+    if (length > MAX_UDP_PACKET_SIZE) {
+        return -1;
+    }
+
+    pthread_mutex_lock(&pool->mutex);
+
+    if (pool->tail - pool->head == CRYPTO_POOL_QUEUE_SIZE) {
+        pthread_mutex_unlock(&pool->mutex);
+        return -1;
+    }
+
+    Crypto_Pool_Job *const job = pool_job(pool, pool->tail);
+    memcpy(job->public_key, public_key, CRYPTO_PUBLIC_KEY_SIZE);
+    memcpy(job->secret_key, secret_key, CRYPTO_SECRET_KEY_SIZE);
+    job->source = source;
+    memcpy(job->packet, packet, length);
+    job->length = length;
+    job->done = done;
+    job->object = object;
+    job->state = CRYPTO_POOL_JOB_QUEUED;
+    ++pool->tail;
+
+    pthread_cond_signal(&pool->work);
+    pthread_mutex_unlock(&pool->mutex);
+    return 0;
+}
+
+void crypto_pool_cancel(Crypto_Pool *pool, const void *object)
+{
+    pthread_mutex_lock(&pool->mutex);
+
+    for (uint32_t i = pool->head; i != pool->tail; ++i) {
+        Crypto_Pool_Job *const job = pool_job(pool, i);
+
+        if (job->object == object) {
+            job->done = nullptr;
+        }
+    }
+
+    pthread_mutex_unlock(&pool->mutex);
+}
+
+uint32_t crypto_pool_do(Crypto_Pool *pool, void *userdata)
+{
+#ifdef CRYPTO_POOL_USE_PIPE
+    uint8_t signals[256];
+
+    while (read(pool->signal_fds[0], signals, sizeof(signals)) > 0) {
+        /* Empty the pipe, we look at the jobs themselves below. */
+    }
+
+#endif
+
+    uint32_t count = 0;
+
+    pthread_mutex_lock(&pool->mutex);
+
+    while (pool->head != pool->next && pool_job(pool, pool->head)->state == CRYPTO_POOL_JOB_DONE) {
+        Crypto_Pool_Job *const job = pool_job(pool, pool->head);
+        crypto_pool_done_cb *const done = job->done;
+
+        if (done == nullptr) {
+            crypto_memzero(job->shared_key, sizeof(job->shared_key));
+            ++pool->head;
+            continue;
+        }
+
+        /* Release the job before calling back: the callback can queue more. */
+        Crypto_Pool_Job finished = *job;
+        crypto_memzero(job->shared_key, sizeof(job->shared_key));
+        ++pool->head;
+        pthread_mutex_unlock(&pool->mutex);
+
+        done(finished.object, finished.public_key, finished.shared_key, finished.source, finished.packet,
+             finished.length, userdata);
+        crypto_memzero(finished.shared_key, sizeof(finished.shared_key));
+        ++count;
+
+        pthread_mutex_lock(&pool->mutex);
+    }
+
+    pthread_mutex_unlock(&pool->mutex);
+    return count;
+}
+
+int crypto_pool_fd(const Crypto_Pool *pool)
+{
+#ifdef CRYPTO_POOL_USE_PIPE
+    return pool->signal_fds[0];
+#else
+    return -1;
+#endif
+}
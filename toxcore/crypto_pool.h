@@ -0,0 +1,87 @@
+/*
+ * Worker threads computing shared keys for packets from new peers.
+ */
+
+/*
+ * Copyright © 2016-2018 The TokTok team.
+ *
+ * This file is part of Tox, the free peer to peer instant messenger.
+ *
+ * Tox is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Tox is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Tox.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef CRYPTO_POOL_H
+#define CRYPTO_POOL_H
+
+#include "network.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Most threads a pool can have. */
+#define CRYPTO_POOL_MAX_THREADS 64
+
+/* Number of packets that can wait for their key at once, a power of 2. */
+#define CRYPTO_POOL_QUEUE_SIZE 512
+
+/* Crypto_Pool is declared in network.h, which owns the pool of a socket. */
+
+/* Called from crypto_pool_do() with the key shared between public_key and the
+ * secret key given to crypto_pool_precompute(), and the packet that waited for
+ * it.
+ */
+typedef void crypto_pool_done_cb(void *object, const uint8_t *public_key, const uint8_t *shared_key,
+                                 IP_Port source, const uint8_t *packet, uint16_t length, void *userdata);
+
+/* Start num_threads threads (at most CRYPTO_POOL_MAX_THREADS).
+ *
+ * return NULL on failure.
+ */
+Crypto_Pool *crypto_pool_new(uint32_t num_threads);
+
+/* Stop the threads and drop all queued work. */
+void crypto_pool_kill(Crypto_Pool *pool);
+
+/* Queue the computation of the key shared between public_key and secret_key.
+ * packet is copied and passed to done along with the key.
+ *
+ * return -1 if the queue is full or the packet too long.
+ * return 0 on success.
+ */
+int crypto_pool_precompute(Crypto_Pool *pool, const uint8_t *public_key, const uint8_t *secret_key,
+                           IP_Port source, const uint8_t *packet, uint16_t length,
+                           crypto_pool_done_cb *done, void *object);
+
+/* Forget the queued work for object, so that done is never called for it.
+ * Call this before freeing object or changing the secret key it queues work
+ * with.
+ */
+void crypto_pool_cancel(Crypto_Pool *pool, const void *object);
+
+/* Call the done callbacks of the finished work, in the order it was queued.
+ *
+ * return the number of callbacks called.
+ */
+uint32_t crypto_pool_do(Crypto_Pool *pool, void *userdata);
+
+/* return a descriptor that becomes readable when work is finished, or -1 if
+ *   there is none on this platform. crypto_pool_do() empties it.
+ */
+int crypto_pool_fd(const Crypto_Pool *pool);
+
+#ifdef __cplusplus
+}  // extern "C"
+#endif
+
+#endif
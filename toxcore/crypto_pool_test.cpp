@@ -0,0 +1,193 @@
+#include "crypto_pool.h"
+
+#include "crypto_core.h"
+
+#include <gtest/gtest.h>
+
+#include <poll.h>
+#include <unistd.h>
+
+#include <array>
+#include <vector>
+
+namespace {
+
+using Public_Key = std::array<uint8_t, CRYPTO_PUBLIC_KEY_SIZE>;
+using Secret_Key = std::array<uint8_t, CRYPTO_SECRET_KEY_SIZE>;
+using Shared_Key = std::array<uint8_t, CRYPTO_SHARED_KEY_SIZE>;
+
+struct Finished {
+    void *object;
+    Public_Key public_key;
+    Shared_Key shared_key;
+    IP_Port source;
+    std::vector<uint8_t> packet;
+};
+
+void record(void *object, const uint8_t *public_key, const uint8_t *shared_key, IP_Port source,
+            const uint8_t *packet, uint16_t length, void *userdata)
+{
+    Finished finished;
+    finished.object = object;
+    std::copy(public_key, public_key + CRYPTO_PUBLIC_KEY_SIZE, finished.public_key.begin());
+    std::copy(shared_key, shared_key + CRYPTO_SHARED_KEY_SIZE, finished.shared_key.begin());
+    finished.source = source;
+    finished.packet.assign(packet, packet + length);
+    static_cast<std::vector<Finished> *>(userdata)->push_back(finished);
+}
+
+// Hand back finished work until there are count results or it takes too long.
+std::vector<Finished> wait_for(Crypto_Pool *pool, size_t count)
+{
+    std::vector<Finished> results;
+
+    for (int i = 0; i < 5000 && results.size() < count; ++i) {
+        if (crypto_pool_do(pool, &results) == 0) {
+            usleep(1000);
+        }
+    }
+
+    return results;
+}
+
+IP_Port port_source(uint16_t port)
+{
+    IP_Port source;
+    ip_init(&source.ip, false);
+    source.ip.ip.v4.uint32 = net_htonl(0x7f000001);
+    source.port = net_htons(port);
+    return source;
+}
+
+struct Peers {
+    Secret_Key self;
+    std::vector<Public_Key> peers;
+
+    explicit Peers(size_t count)
+        : peers(count)
+    {
+        Public_Key self_public;
+        crypto_new_keypair(self_public.data(), self.data());
+
+        for (Public_Key &peer : peers) {
+            Secret_Key peer_secret;
+            crypto_new_keypair(peer.data(), peer_secret.data());
+        }
+    }
+};
+
+TEST(CryptoPool, RefusesBadThreadCounts)
+{
+    EXPECT_EQ(crypto_pool_new(0), nullptr);
+    EXPECT_EQ(crypto_pool_new(CRYPTO_POOL_MAX_THREADS + 1), nullptr);
+}
+
+TEST(CryptoPool, HandsBackKeysAndPacketsInOrder)
+{
+    Crypto_Pool *pool = crypto_pool_new(4);
+    ASSERT_NE(pool, nullptr);
+
+    Peers peers(100);
+    int object;
+
+    for (size_t i = 0; i < peers.peers.size(); ++i) {
+        const uint8_t packet[] = {uint8_t(i), 1, 2, 3};
+        ASSERT_EQ(crypto_pool_precompute(pool, peers.peers[i].data(), peers.self.data(), port_source(uint16_t(i + 1)),
+                                         packet, sizeof(packet), &record, &object), 0);
+    }
+
+    const std::vector<Finished> results = wait_for(pool, peers.peers.size());
+    ASSERT_EQ(results.size(), peers.peers.size());
+
+    for (size_t i = 0; i < results.size(); ++i) {
+        Shared_Key expected;
+        encrypt_precompute(peers.peers[i].data(), peers.self.data(), expected.data());
+
+        EXPECT_EQ(results[i].object, &object);
+        EXPECT_EQ(results[i].public_key, peers.peers[i]);
+        EXPECT_EQ(results[i].shared_key, expected);
+        const IP_Port source = port_source(uint16_t(i + 1));
+        EXPECT_TRUE(ipport_equal(&results[i].source, &source));
+        EXPECT_EQ(results[i].packet, std::vector<uint8_t>({uint8_t(i), 1, 2, 3}));
+    }
+
+    crypto_pool_kill(pool);
+}
+
+TEST(CryptoPool, CancelledWorkIsNotHandedBack)
+{
+    Crypto_Pool *pool = crypto_pool_new(2);
+    ASSERT_NE(pool, nullptr);
+
+    Peers peers(20);
+    int kept;
+    int cancelled;
+    const uint8_t packet[] = {0};
+
+    for (size_t i = 0; i < peers.peers.size(); ++i) {
+        void *object = i % 2 == 0 ? &kept : &cancelled;
+        ASSERT_EQ(crypto_pool_precompute(pool, peers.peers[i].data(), peers.self.data(), port_source(1),
+                                         packet, sizeof(packet), &record, object), 0);
+    }
+
+    crypto_pool_cancel(pool, &cancelled);
+
+    const std::vector<Finished> results = wait_for(pool, peers.peers.size() / 2);
+    ASSERT_EQ(results.size(), peers.peers.size() / 2);
+
+    for (size_t i = 0; i < results.size(); ++i) {
+        EXPECT_EQ(results[i].object, &kept);
+        EXPECT_EQ(results[i].public_key, peers.peers[i * 2]);
+    }
+
+    crypto_pool_kill(pool);
+}
+
+TEST(CryptoPool, RefusesWorkWhenFull)
+{
+    Crypto_Pool *pool = crypto_pool_new(1);
+    ASSERT_NE(pool, nullptr);
+
+    Peers peers(1);
+    const uint8_t packet[] = {0};
+
+    // Nothing is handed back until crypto_pool_do(), so the queue fills up.
+    for (uint32_t i = 0; i < CRYPTO_POOL_QUEUE_SIZE; ++i) {
+        ASSERT_EQ(crypto_pool_precompute(pool, peers.peers[0].data(), peers.self.data(), port_source(1),
+                                         packet, sizeof(packet), &record, nullptr), 0);
+    }
+
+    EXPECT_EQ(crypto_pool_precompute(pool, peers.peers[0].data(), peers.self.data(), port_source(1),
+                                     packet, sizeof(packet), &record, nullptr), -1);
+
+    EXPECT_EQ(wait_for(pool, CRYPTO_POOL_QUEUE_SIZE).size(), size_t(CRYPTO_POOL_QUEUE_SIZE));
+    EXPECT_EQ(crypto_pool_precompute(pool, peers.peers[0].data(), peers.self.data(), port_source(1),
+                                     packet, sizeof(packet), &record, nullptr), 0);
+
+    crypto_pool_kill(pool);
+}
+
+TEST(CryptoPool, DescriptorSignalsFinishedWork)
+{
+    Crypto_Pool *pool = crypto_pool_new(1);
+    ASSERT_NE(pool, nullptr);
+    ASSERT_NE(crypto_pool_fd(pool), -1);
+
+    Peers peers(1);
+    const uint8_t packet[] = {0};
+    ASSERT_EQ(crypto_pool_precompute(pool, peers.peers[0].data(), peers.self.data(), port_source(1),
+                                     packet, sizeof(packet), &record, nullptr), 0);
+
+    pollfd fd = {crypto_pool_fd(pool), POLLIN, 0};
+    ASSERT_EQ(poll(&fd, 1, 5000), 1);
+
+    std::vector<Finished> results;
+    EXPECT_EQ(crypto_pool_do(pool, &results), 1u);
+
+    // Handing the work back empties the descriptor.
+    EXPECT_EQ(poll(&fd, 1, 0), 0);
+
+    crypto_pool_kill(pool);
+}
+
+}  // namespace
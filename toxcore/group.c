@@ -32,6 +32,12 @@
 
 #include "util.h"
 
+/* Interval in seconds to send ping messages */
+#define GROUP_PING_INTERVAL 20
+
+/* Peers we haven't heard from in this many seconds are removed. */
+#define GROUP_PEER_TIMEOUT (GROUP_PING_INTERVAL * 3)
+
 /* return 1 if the groupnumber is not valid.
  * return 0 if the groupnumber is valid.
  */
@@ -116,6 +122,7 @@ static int wipe_group_chat(Group_Chats *g_c, uint32_t groupnumber)
     }
 
     uint32_t i;
+    timer_wheel_cancel(dht_get_timer_wheel(g_c->m->dht), g_c->chats[groupnumber].timeout_timer);
     crypto_memzero(&g_c->chats[groupnumber], sizeof(Group_c));
 
     for (i = g_c->num_chats; i != 0; --i) {
@@ -403,6 +410,46 @@ static int connect_to_closest(Group_Chats *g_c, uint32_t groupnumber, void *user
     return 0;
 }
 
+static void group_timeout_timer(void *object, uint32_t groupnumber)
+{
+    Group_Chats *g_c = (Group_Chats *)object;
+    Group_c *g = get_group_c(g_c, groupnumber);
+
+    if (g) {
+        g->timeouts_due = 1;
+    }
+}
+
+/* Have do_groupchats() look for timed out peers once the peer we heard from
+ * longest ago could have timed out.
+ */
+static void schedule_group_timeout(Group_Chats *g_c, uint32_t groupnumber)
+{
+    Group_c *g = get_group_c(g_c, groupnumber);
+
+    if (!g) {
+        return;
+    }
+
+    uint64_t oldest = UINT64_MAX;
+
+    for (uint32_t i = 0; i < g->numpeers; ++i) {
+        if (g->peer_number != g->group[i].peer_number) {
+            oldest = min_u64(oldest, g->group[i].last_recv);
+        }
+    }
+
+    Timer_Wheel *wheel = dht_get_timer_wheel(g_c->m->dht);
+
+    if (oldest == UINT64_MAX) {
+        timer_wheel_cancel(wheel, g->timeout_timer);
+        g->timeout_timer = 0;
+        return;
+    }
+
+    timer_wheel_set(wheel, &g->timeout_timer, oldest + GROUP_PEER_TIMEOUT, &group_timeout_timer, g_c, groupnumber);
+}
+
 /* Add a peer to the group chat.
  *
  * do_gc_callback indicates whether we want to trigger callbacks set by the client
@@ -456,6 +503,13 @@ static int addpeer(Group_Chats *g_c, uint32_t groupnumber, const uint8_t *real_p
     g->group[g->numpeers].last_recv = unix_time();
     ++g->numpeers;
 
+    Timer_Wheel *wheel = dht_get_timer_wheel(g_c->m->dht);
+
+    if (!timer_wheel_pending(wheel, g->timeout_timer)) {
+        g->timeout_timer = timer_wheel_add(wheel, unix_time() + GROUP_PEER_TIMEOUT, &group_timeout_timer, g_c,
+                                           groupnumber);
+    }
+
     add_to_closest(g_c, groupnumber, real_pk, temp_pk);
 
     if (do_gc_callback && g_c->peer_list_changed_callback) {
@@ -2402,9 +2456,6 @@ void *group_peer_get_object(const Group_Chats *g_c, uint32_t groupnumber, int pe
     return g->group[peernumber].object;
 }
 
-/* Interval in seconds to send ping messages */
-#define GROUP_PING_INTERVAL 20
-
 static int ping_groupchat(Group_Chats *g_c, uint32_t groupnumber)
 {
     Group_c *g = get_group_c(g_c, groupnumber);
@@ -2433,7 +2484,7 @@ static int groupchat_clear_timedout(Group_Chats *g_c, uint32_t groupnumber, void
     uint32_t i;
 
     for (i = 0; i < g->numpeers; ++i) {
-        if (g->peer_number != g->group[i].peer_number && is_timeout(g->group[i].last_recv, GROUP_PING_INTERVAL * 3)) {
+        if (g->peer_number != g->group[i].peer_number && is_timeout(g->group[i].last_recv, GROUP_PEER_TIMEOUT)) {
             delpeer(g_c, groupnumber, i, userdata);
         }
 
@@ -2442,6 +2493,7 @@ static int groupchat_clear_timedout(Group_Chats *g_c, uint32_t groupnumber, void
         }
     }
 
+    schedule_group_timeout(g_c, groupnumber);
     return 0;
 }
 
@@ -2500,7 +2552,11 @@ void do_groupchats(Group_Chats *g_c, void *userdata)
         if (g->status == GROUPCHAT_STATUS_CONNECTED) {
             connect_to_closest(g_c, i, userdata);
             ping_groupchat(g_c, i);
-            groupchat_clear_timedout(g_c, i, userdata);
+
+            if (g->timeouts_due) {
+                g->timeouts_due = 0;
+                groupchat_clear_timedout(g_c, i, userdata);
+            }
         }
     }
 
@@ -99,6 +99,11 @@ typedef struct {
 
     uint64_t last_sent_ping;
 
+    /* Fires when a peer might have timed out, setting timeouts_due for
+     * do_groupchats() to remove them. */
+    Timer_Id timeout_timer;
+    uint8_t timeouts_due;
+
     int number_joined; /* friendcon_id of person that invited us to the chat. (-1 means none) */
 
     void *object;
@@ -0,0 +1,212 @@
+/*
+ * Hash table associating ids with keys of a fixed size.
+ */
+
+/*
+ * Copyright © 2016-2018 The TokTok team.
+ *
+ * This file is part of Tox, the free peer to peer instant messenger.
+ *
+ * Tox is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Tox is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Tox.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "hash_table.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "ccompat.h"
+#include "crypto_core.h"
+
+/* Keys go in the first free slot from the one they hash to (linear probing),
+ * and a removed key's slot is filled by moving the keys after it back, so
+ * that finding a key never looks past an empty slot. The table stays at most
+ * half full. Keys come from peers (addresses, public keys), so the hash is
+ * seeded per table to keep them from crowding one run of slots.
+ */
+#define HASH_TABLE_MIN_CAPACITY 8
+
+static uint32_t key_slot(const Hash_Table *table, const uint8_t *key)
+{
+    uint64_t hash = table->seed;
+    uint32_t i = 0;
+
+    for (; i + sizeof(uint64_t) <= table->key_size; i += sizeof(uint64_t)) {
+        uint64_t word;
+        memcpy(&word, key + i, sizeof(word));
+        hash = (hash ^ word) * UINT64_C(0x9E3779B97F4A7C15);
+        hash ^= hash >> 32;
+    }
+
+    if (i < table->key_size) {
+        uint64_t word = 0;
+        memcpy(&word, key + i, table->key_size - i);
+        hash = (hash ^ word) * UINT64_C(0x9E3779B97F4A7C15);
+        hash ^= hash >> 32;
+    }
+
+    return (uint32_t)hash & (table->capacity - 1);
+}
+
+static const uint8_t *slot_key(const Hash_Table *table, uint32_t slot)
+{
+    return table->keys + (size_t)slot * table->key_size;
+}
+
+/* return the slot holding key, or the empty slot where it would go. */
+static uint32_t find_slot(const Hash_Table *table, const uint8_t *key)
+{
+    uint32_t slot = key_slot(table, key);
+
+    while (table->ids[slot] != -1 && memcmp(slot_key(table, slot), key, table->key_size) != 0) {
+        slot = (slot + 1) & (table->capacity - 1);
+    }
+
+    return slot;
+}
+
+/* Move the ids to new arrays of capacity slots.
+ *
+ * return false on memory allocation failure.
+ */
+static bool resize(Hash_Table *table, uint32_t capacity)
+{
+    uint8_t *keys = (uint8_t *)malloc((size_t)capacity * table->key_size);
+    int *ids = (int *)malloc(capacity * sizeof(int));
+
+    if (keys == nullptr || ids == nullptr) {
+        free(keys);
+        free(ids);
+        return false;
+    }
+
+    for (uint32_t i = 0; i < capacity; ++i) {
+        ids[i] = -1;
+    }
+
+    uint8_t *const old_keys = table->keys;
+    int *const old_ids = table->ids;
+    const uint32_t old_capacity = table->capacity;
+
+    table->keys = keys;
+    table->ids = ids;
+    table->capacity = capacity;
+
+    for (uint32_t i = 0; i < old_capacity; ++i) {
+        if (old_ids[i] != -1) {
+            const uint8_t *const key = old_keys + (size_t)i * table->key_size;
+            const uint32_t slot = find_slot(table, key);
+            memcpy(table->keys + (size_t)slot * table->key_size, key, table->key_size);
+            table->ids[slot] = old_ids[i];
+        }
+    }
+
+    free(old_keys);
+    free(old_ids);
+    return true;
+}
+
+bool hash_table_init(Hash_Table *table, uint32_t key_size, uint32_t initial_capacity)
+{
+    table->key_size = key_size;
+    table->size = 0;
+    table->capacity = 0;
+    table->seed = random_u64();
+    table->keys = nullptr;
+    table->ids = nullptr;
+
+    uint32_t capacity = HASH_TABLE_MIN_CAPACITY;
+
+    while (capacity / 2 < initial_capacity && capacity < UINT32_MAX / 2 + 1) {
+        capacity *= 2;
+    }
+
+    return resize(table, capacity);
+}
+
+void hash_table_free(Hash_Table *table)
+{
+    free(table->keys);
+    free(table->ids);
+    table->keys = nullptr;
+    table->ids = nullptr;
+    table->size = 0;
+    table->capacity = 0;
+}
+
+int hash_table_find(const Hash_Table *table, const uint8_t *key)
+{
+    if (table->size == 0) {
+        return -1;
+    }
+
+    return table->ids[find_slot(table, key)];
+}
+
+bool hash_table_add(Hash_Table *table, const uint8_t *key, int id)
+{
+    if (id < 0 || hash_table_find(table, key) != -1) {
+        return false;
+    }
+
+    if ((table->size + 1) * 2 > table->capacity) {
+        const uint32_t capacity = table->capacity == 0 ? HASH_TABLE_MIN_CAPACITY : table->capacity * 2;
+
+        if (capacity <= table->capacity || !resize(table, capacity)) {
+            return false;
+        }
+    }
+
+    const uint32_t slot = find_slot(table, key);
+    memcpy(table->keys + (size_t)slot * table->key_size, key, table->key_size);
+    table->ids[slot] = id;
+    ++table->size;
+    return true;
+}
+
+bool hash_table_remove(Hash_Table *table, const uint8_t *key, int id)
+{
+    if (table->size == 0) {
+        return false;
+    }
+
+    uint32_t hole = find_slot(table, key);
+
+    if (table->ids[hole] == -1 || table->ids[hole] != id) {
+        return false;
+    }
+
+    const uint32_t mask = table->capacity - 1;
+
+    /* Move back each key after the hole that can't be found past it. */
+    for (uint32_t slot = (hole + 1) & mask; table->ids[slot] != -1; slot = (slot + 1) & mask) {
+        const uint32_t home = key_slot(table, slot_key(table, slot));
+
+        /* The key stays if its home is in {hole + 1, slot}, wrapping around. */
+        if (((slot - home) & mask) < ((slot - hole) & mask)) {
+            continue;
+        }
+
+        memcpy(table->keys + (size_t)hole * table->key_size, slot_key(table, slot), table->key_size);
+        table->ids[hole] = table->ids[slot];
+        hole = slot;
+    }
+
+    table->ids[hole] = -1;
+    --table->size;
+    return true;
+}
@@ -0,0 +1,76 @@
+/*
+ * Hash table associating ids with keys of a fixed size.
+ */
+
+/*
+ * Copyright © 2016-2018 The TokTok team.
+ *
+ * This file is part of Tox, the free peer to peer instant messenger.
+ *
+ * Tox is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Tox is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Tox.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef HASH_TABLE_H
+#define HASH_TABLE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct Hash_Table {
+    uint32_t key_size;
+    /* Number of ids in the table, and of slots for them, a power of 2. */
+    uint32_t size;
+    uint32_t capacity;
+    uint64_t seed;
+    /* Key of each slot, key_size bytes each. */
+    uint8_t *keys;
+    /* Id of each slot, -1 if it is empty. */
+    int *ids;
+} Hash_Table;
+
+/* Set up an empty table for keys of key_size bytes, with room for about
+ * initial_capacity of them before it grows.
+ *
+ * return false on memory allocation failure; the table is still usable and
+ *   allocates on the first hash_table_add().
+ */
+bool hash_table_init(Hash_Table *table, uint32_t key_size, uint32_t initial_capacity);
+
+void hash_table_free(Hash_Table *table);
+
+/* return the id associated with key.
+ * return -1 if there is none.
+ */
+int hash_table_find(const Hash_Table *table, const uint8_t *key);
+
+/* Associate id, which isn't negative, with key.
+ *
+ * return false if key already has an id or on memory allocation failure.
+ */
+bool hash_table_add(Hash_Table *table, const uint8_t *key, int id);
+
+/* Remove key from the table if it is associated with id.
+ *
+ * return false if it isn't.
+ */
+bool hash_table_remove(Hash_Table *table, const uint8_t *key, int id);
+
+#ifdef __cplusplus
+}  // extern "C"
+#endif
+
+#endif
@@ -0,0 +1,137 @@
+#include "hash_table.h"
+
+#include "crypto_core.h"
+
+#include <gtest/gtest.h>
+
+#include <array>
+#include <map>
+#include <random>
+#include <vector>
+
+namespace {
+
+// Not a multiple of 8, so that the end of the keys is hashed too.
+constexpr uint32_t key_size = 19;
+
+using Key = std::array<uint8_t, key_size>;
+
+Key random_key()
+{
+    Key key;
+    random_bytes(key.data(), key.size());
+    return key;
+}
+
+TEST(HashTable, FindsTheIdsAdded)
+{
+    Hash_Table table;
+    ASSERT_TRUE(hash_table_init(&table, key_size, 8));
+
+    std::vector<Key> keys;
+
+    for (int i = 0; i < 5000; ++i) {
+        keys.push_back(random_key());
+        ASSERT_TRUE(hash_table_add(&table, keys.back().data(), i));
+    }
+
+    EXPECT_EQ(table.size, 5000u);
+
+    for (int i = 0; i < 5000; ++i) {
+        EXPECT_EQ(hash_table_find(&table, keys[i].data()), i);
+    }
+
+    EXPECT_EQ(hash_table_find(&table, random_key().data()), -1);
+
+    hash_table_free(&table);
+}
+
+TEST(HashTable, KeepsOneIdPerKey)
+{
+    Hash_Table table;
+    ASSERT_TRUE(hash_table_init(&table, key_size, 0));
+
+    const Key key = random_key();
+    EXPECT_TRUE(hash_table_add(&table, key.data(), 1));
+    EXPECT_FALSE(hash_table_add(&table, key.data(), 2));
+    EXPECT_FALSE(hash_table_add(&table, random_key().data(), -1));
+    EXPECT_EQ(hash_table_find(&table, key.data()), 1);
+
+    hash_table_free(&table);
+}
+
+TEST(HashTable, RemovesOnlyTheIdGiven)
+{
+    Hash_Table table;
+    ASSERT_TRUE(hash_table_init(&table, key_size, 0));
+
+    const Key key = random_key();
+    EXPECT_FALSE(hash_table_remove(&table, key.data(), 1));
+    ASSERT_TRUE(hash_table_add(&table, key.data(), 1));
+    EXPECT_FALSE(hash_table_remove(&table, key.data(), 2));
+    EXPECT_EQ(hash_table_find(&table, key.data()), 1);
+    EXPECT_TRUE(hash_table_remove(&table, key.data(), 1));
+    EXPECT_EQ(hash_table_find(&table, key.data()), -1);
+    EXPECT_EQ(table.size, 0u);
+
+    hash_table_free(&table);
+}
+
+TEST(HashTable, AgreesWithAMapThroughAddsAndRemoves)
+{
+    Hash_Table table;
+    ASSERT_TRUE(hash_table_init(&table, key_size, 0));
+
+    // Few keys, so that the same ones come and go and the table has long runs
+    // of slots to move keys back through.
+    std::mt19937 random(42);
+    std::uniform_int_distribution<int> key_number(0, 299);
+    std::map<Key, int> ids;
+
+    for (int i = 0; i < 50000; ++i) {
+        Key key{};
+        const int number = key_number(random);
+        key[0] = uint8_t(number);
+        key[key_size - 1] = uint8_t(number >> 8);
+
+        const auto found = ids.find(key);
+
+        if (found == ids.end()) {
+            ASSERT_TRUE(hash_table_add(&table, key.data(), i));
+            ids[key] = i;
+        } else {
+            ASSERT_TRUE(hash_table_remove(&table, key.data(), found->second));
+            ids.erase(found);
+        }
+
+        ASSERT_EQ(table.size, ids.size());
+    }
+
+    for (int number = 0; number < 300; ++number) {
+        Key key{};
+        key[0] = uint8_t(number);
+        key[key_size - 1] = uint8_t(number >> 8);
+
+        const auto found = ids.find(key);
+        EXPECT_EQ(hash_table_find(&table, key.data()), found == ids.end() ? -1 : found->second);
+    }
+
+    hash_table_free(&table);
+}
+
+TEST(HashTable, CanBeUsedAfterFree)
+{
+    Hash_Table table;
+    ASSERT_TRUE(hash_table_init(&table, key_size, 8));
+    hash_table_free(&table);
+
+    const Key key = random_key();
+    EXPECT_EQ(hash_table_find(&table, key.data()), -1);
+    EXPECT_FALSE(hash_table_remove(&table, key.data(), 0));
+    EXPECT_TRUE(hash_table_add(&table, key.data(), 0));
+    EXPECT_EQ(hash_table_find(&table, key.data()), 0);
+
+    hash_table_free(&table);
+}
+
+}  // namespace
@@ -33,6 +33,8 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "crypto_pool.h"
+#include "hash_table.h"
 #include "util.h"
 
 typedef struct {
@@ -41,12 +43,49 @@ typedef struct {
     uint8_t data[MAX_CRYPTO_DATA_SIZE];
 } Packet_Data;
 
+/* Slots of a Packets_Array whose occupancy is kept in one word of its bitmap. */
+#define PACKETS_ARRAY_WORD_BITS 64
+
+#if CRYPTO_PACKET_BUFFER_SIZE % PACKETS_ARRAY_WORD_BITS != 0
+#error CRYPTO_PACKET_BUFFER_SIZE should be a multiple of PACKETS_ARRAY_WORD_BITS
+#endif
+
+#if CRYPTO_STREAM_BUFFER_SIZE % PACKETS_ARRAY_WORD_BITS != 0
+#error CRYPTO_STREAM_BUFFER_SIZE should be a multiple of PACKETS_ARRAY_WORD_BITS
+#endif
+
 typedef struct {
-    Packet_Data *buffer[CRYPTO_PACKET_BUFFER_SIZE];
+    /* Number of slots, CRYPTO_PACKET_BUFFER_SIZE or CRYPTO_STREAM_BUFFER_SIZE. */
+    uint32_t  size;
+    Packet_Data **buffer;
+    /* Bit i % 64 of used[i / 64] is set when buffer[i] holds a packet, so that
+     * the holes and the packets can be looked for a word at a time. */
+    uint64_t  *used;
     uint32_t  buffer_start;
     uint32_t  buffer_end; /* packet numbers in array: {buffer_start, buffer_end) */
 } Packets_Array;
 
+/* Most freed Packet_Data buffers kept for reuse. */
+#define PACKET_POOL_SIZE 4096
+
+/* Packet_Data buffers freed by the packet arrays, kept for the next packets
+ * so that lossless traffic doesn't malloc and free each of them. Packets are
+ * queued by write_cryptpacket() on other threads than the ones that free them,
+ * each holding only its own connection's lock, so the pool has a lock too.
+ */
+typedef struct Packet_Pool {
+    pthread_mutex_t mutex;
+    Packet_Data *free[PACKET_POOL_SIZE];
+    uint32_t num_free;
+} Packet_Pool;
+
+/* The packets of a lossless stream other than CRYPTO_STREAM_DEFAULT, whose
+ * packets are in the connection's own send_array and recv_array. */
+typedef struct Crypto_Stream {
+    Packets_Array send_array;
+    Packets_Array recv_array;
+} Crypto_Stream;
+
 typedef struct {
     uint8_t public_key[CRYPTO_PUBLIC_KEY_SIZE]; /* The real public key of the peer. */
     uint8_t recv_nonce[CRYPTO_NONCE_SIZE]; /* Nonce of received packets. */
@@ -78,6 +117,19 @@ typedef struct {
     Packets_Array send_array;
     Packets_Array recv_array;
 
+    /* The other lossless streams, allocated the first time they are used. */
+    Crypto_Stream *streams[CRYPTO_NUM_STREAMS];
+    /* Number of lossless streams the peer supports, 0 until it told us. */
+    uint8_t peer_streams;
+    /* Whether the peer told us it knows how many streams we support. */
+    bool streams_heard;
+    uint8_t streams_packets_sent;
+    /* Whether the peer told us it can resume the session once it ends. */
+    bool peer_resumption;
+    /* Whether we are resuming an ended session instead of doing a handshake,
+     * and haven't heard back from the peer yet. */
+    bool resuming;
+
     int (*connection_status_callback)(void *object, int id, uint8_t status, void *userdata);
     void *connection_status_callback_object;
     int connection_status_callback_id;
@@ -97,27 +149,39 @@ typedef struct {
     double packet_recv_rate;
     uint64_t packet_counter_set;
 
-    double packet_send_rate;
+    Congestion_Control congestion;
     uint32_t packets_left;
     uint64_t last_packets_left_set;
     double last_packets_left_rem;
 
-    double packet_send_rate_requested;
     uint32_t packets_left_requested;
     uint64_t last_packets_left_requested_set;
     double last_packets_left_requested_rem;
 
-    uint32_t last_sendqueue_size[CONGESTION_QUEUE_ARRAY_SIZE], last_sendqueue_counter;
-    long signed int last_num_packets_sent[CONGESTION_LAST_SENT_ARRAY_SIZE],
-         last_num_packets_resent[CONGESTION_LAST_SENT_ARRAY_SIZE];
-    uint32_t packets_sent, packets_resent;
+    uint32_t packets_sent, packets_resent, packets_acked;
     uint64_t last_congestion_event;
+    /* Totals of packets_resent and congestion events since the connection
+     * was made. */
+    uint64_t total_packets_resent;
+    uint64_t congestion_events;
+
+    /* Lossy packets held back by pacing, oldest first. */
+    Packet_Data *lossy_queue[CRYPTO_LOSSY_QUEUE_SIZE];
+    uint32_t lossy_queue_start;
+    uint32_t lossy_queue_length;
+    Congestion_Pacer lossy_pacer;
+    /* Lossy packets given to the connection since packet_counter_set, and
+     * how many a second it was given over the interval before. */
+    uint32_t lossy_counter;
+    double lossy_send_rate;
     uint64_t rtt_time;
 
     /* TCP_connection connection_number */
     unsigned int connection_number_tcp;
 
     uint8_t maximum_speed_reached;
+    /* Stream of the packet that couldn't be sent when maximum_speed_reached was set. */
+    uint8_t maximum_speed_stream;
 
     pthread_mutex_t mutex;
 
@@ -126,6 +190,23 @@ typedef struct {
     uint32_t dht_pk_callback_number;
 } Crypto_Connection;
 
+/* The keys of a session that has ended, with which either side can start the
+ * next one without asking the other for a cookie first.
+ */
+typedef struct Crypto_Resumption {
+    uint8_t public_key[CRYPTO_PUBLIC_KEY_SIZE]; /* The real public key of the peer. */
+    uint8_t dht_public_key[CRYPTO_PUBLIC_KEY_SIZE]; /* The dht public key of the peer. */
+    uint8_t id[CRYPTO_SHA256_SIZE]; /* Hash of shared_key, which names the session in resumption packets. */
+    uint8_t sessionpublic_key[CRYPTO_PUBLIC_KEY_SIZE]; /* Our public key for the session. */
+    uint8_t sessionsecret_key[CRYPTO_SECRET_KEY_SIZE]; /* Our private key for the session. */
+    uint8_t peersessionpublic_key[CRYPTO_PUBLIC_KEY_SIZE]; /* The public key of the peer for the session. */
+    uint8_t shared_key[CRYPTO_SHARED_KEY_SIZE]; /* The precomputed shared key of the session. */
+    uint64_t time; /* When the session ended, 0 if the entry is unused. */
+} Crypto_Resumption;
+
+/* Most ended sessions kept for resumption. */
+#define CRYPTO_RESUMPTION_CACHE_SIZE 16
+
 struct Net_Crypto {
     Logger *log;
 
@@ -144,6 +225,10 @@ struct Net_Crypto {
     uint8_t self_public_key[CRYPTO_PUBLIC_KEY_SIZE];
     uint8_t self_secret_key[CRYPTO_SECRET_KEY_SIZE];
 
+    /* Keys shared between our secret key and the real public keys of our
+     * peers, for handshakes. */
+    Shared_Key_Cache *real_keys;
+
     /* The secret key used for cookies */
     uint8_t secret_symmetric_key[CRYPTO_SYMMETRIC_KEY_SIZE];
 
@@ -152,8 +237,25 @@ struct Net_Crypto {
 
     /* The current optimal sleep time */
     uint32_t current_sleep_time;
+    /* When current_sleep_time was last computed. */
+    uint64_t last_sleep_time_update;
+
+    Hash_Table ip_port_table;
+
+    Packet_Pool packet_pool;
+
+    /* The congestion controller new connections use. */
+    Congestion_Control_Type congestion_type;
 
-    BS_LIST ip_port_list;
+    /* Whether packets are sent evenly over time rather than all at once. */
+    bool pacing;
+
+    /* Whether the lossless streams other than CRYPTO_STREAM_DEFAULT are used. */
+    bool streams;
+
+    /* Whether ended sessions can be resumed, and those that can. */
+    bool session_resumption;
+    Crypto_Resumption resumptions[CRYPTO_RESUMPTION_CACHE_SIZE];
 };
 
 const uint8_t *nc_get_self_public_key(const Net_Crypto *c)
@@ -176,6 +278,26 @@ DHT *nc_get_dht(const Net_Crypto *c)
     return c->dht;
 }
 
+void nc_set_congestion_control(Net_Crypto *c, Congestion_Control_Type type)
+{
+    c->congestion_type = type;
+}
+
+void nc_set_pacing(Net_Crypto *c, bool pacing)
+{
+    c->pacing = pacing;
+}
+
+void nc_set_streams(Net_Crypto *c, bool streams)
+{
+    c->streams = streams;
+}
+
+void nc_set_session_resumption(Net_Crypto *c, bool session_resumption)
+{
+    c->session_resumption = session_resumption;
+}
+
 static uint8_t crypt_connection_id_not_valid(const Net_Crypto *c, int crypt_connection_id)
 {
     if ((uint32_t)crypt_connection_id >= c->crypto_connections_length) {
@@ -195,6 +317,9 @@ static uint8_t crypt_connection_id_not_valid(const Net_Crypto *c, int crypt_conn
 
 /* cookie timeout in seconds */
 #define COOKIE_TIMEOUT 15
+
+/* Number of keys shared with the real public keys of peers that are cached. */
+#define REAL_KEY_CACHE_SIZE 256
 #define COOKIE_DATA_LENGTH (CRYPTO_PUBLIC_KEY_SIZE * 2)
 #define COOKIE_CONTENTS_LENGTH (sizeof(uint64_t) + COOKIE_DATA_LENGTH)
 #define COOKIE_LENGTH (CRYPTO_NONCE_SIZE + COOKIE_CONTENTS_LENGTH + CRYPTO_MAC_SIZE)
@@ -350,6 +475,11 @@ static int udp_handle_cookie_request(void *object, IP_Port source, const uint8_t
                                      void *userdata)
 {
     Net_Crypto *c = (Net_Crypto *)object;
+
+    if (length == COOKIE_REQUEST_LENGTH && dht_defer_for_shared_key(c->dht, packet + 1, source, packet, length)) {
+        return 0;
+    }
+
     uint8_t request_plain[COOKIE_REQUEST_PLAIN_LENGTH];
     uint8_t shared_key[CRYPTO_SHARED_KEY_SIZE];
     uint8_t dht_public_key[CRYPTO_PUBLIC_KEY_SIZE];
@@ -473,9 +603,12 @@ static int create_crypto_handshake(const Net_Crypto *c, uint8_t *packet, const u
         return -1;
     }
 
+    uint8_t shared_key[CRYPTO_SHARED_KEY_SIZE];
+    shared_key_cache_get(c->real_keys, shared_key, c->self_secret_key, peer_real_pk);
+
     random_nonce(packet + 1 + COOKIE_LENGTH);
-    int len = encrypt_data(peer_real_pk, c->self_secret_key, packet + 1 + COOKIE_LENGTH, plain, sizeof(plain),
-                           packet + 1 + COOKIE_LENGTH + CRYPTO_NONCE_SIZE);
+    int len = encrypt_data_symmetric(shared_key, packet + 1 + COOKIE_LENGTH, plain, sizeof(plain),
+                                     packet + 1 + COOKIE_LENGTH + CRYPTO_NONCE_SIZE);
 
     if (len != HANDSHAKE_PACKET_LENGTH - (1 + COOKIE_LENGTH + CRYPTO_NONCE_SIZE)) {
         return -1;
@@ -527,10 +660,13 @@ static int handle_crypto_handshake(const Net_Crypto *c, uint8_t *nonce, uint8_t
     uint8_t cookie_hash[CRYPTO_SHA512_SIZE];
     crypto_sha512(cookie_hash, packet + 1, COOKIE_LENGTH);
 
+    uint8_t shared_key[CRYPTO_SHARED_KEY_SIZE];
+    shared_key_cache_get(c->real_keys, shared_key, c->self_secret_key, cookie_plain);
+
     uint8_t plain[CRYPTO_NONCE_SIZE + CRYPTO_PUBLIC_KEY_SIZE + CRYPTO_SHA512_SIZE + COOKIE_LENGTH];
-    int len = decrypt_data(cookie_plain, c->self_secret_key, packet + 1 + COOKIE_LENGTH,
-                           packet + 1 + COOKIE_LENGTH + CRYPTO_NONCE_SIZE,
-                           HANDSHAKE_PACKET_LENGTH - (1 + COOKIE_LENGTH + CRYPTO_NONCE_SIZE), plain);
+    int len = decrypt_data_symmetric(shared_key, packet + 1 + COOKIE_LENGTH,
+                                     packet + 1 + COOKIE_LENGTH + CRYPTO_NONCE_SIZE,
+                                     HANDSHAKE_PACKET_LENGTH - (1 + COOKIE_LENGTH + CRYPTO_NONCE_SIZE), plain);
 
     if (len != sizeof(plain)) {
         return -1;
@@ -549,6 +685,170 @@ static int handle_crypto_handshake(const Net_Crypto *c, uint8_t *nonce, uint8_t
     return 0;
 }
 
+static bool resumption_valid(const Crypto_Resumption *res)
+{
+    return res->time != 0 && res->time + CRYPTO_RESUMPTION_TIMEOUT >= unix_time();
+}
+
+/* return the index in c->resumptions of the ended session with the peer with
+ *   real public key public_key.
+ * return -1 if there is none.
+ */
+static int find_resumption(const Net_Crypto *c, const uint8_t *public_key)
+{
+    for (int i = 0; i < CRYPTO_RESUMPTION_CACHE_SIZE; ++i) {
+        if (resumption_valid(&c->resumptions[i]) && public_key_cmp(c->resumptions[i].public_key, public_key) == 0) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+/* return the index in c->resumptions of the ended session named id.
+ * return -1 if there is none.
+ */
+static int find_resumption_id(const Net_Crypto *c, const uint8_t *id)
+{
+    for (int i = 0; i < CRYPTO_RESUMPTION_CACHE_SIZE; ++i) {
+        if (resumption_valid(&c->resumptions[i]) && crypto_memcmp(c->resumptions[i].id, id, CRYPTO_SHA256_SIZE) == 0) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+static void forget_resumption(Net_Crypto *c, int index)
+{
+    crypto_memzero(&c->resumptions[index], sizeof(Crypto_Resumption));
+}
+
+/* Forget the sessions that ended too long ago to be resumed. */
+static void clear_old_resumptions(Net_Crypto *c)
+{
+    for (int i = 0; i < CRYPTO_RESUMPTION_CACHE_SIZE; ++i) {
+        if (c->resumptions[i].time != 0 && !resumption_valid(&c->resumptions[i])) {
+            forget_resumption(c, i);
+        }
+    }
+}
+
+/* Keep the keys of the session of conn, which is ending, for resumption in
+ * place of the ended session with the same peer, an unused entry or the
+ * session that ended first.
+ */
+static void save_resumption(Net_Crypto *c, const Crypto_Connection *conn)
+{
+    int index = find_resumption(c, conn->public_key);
+
+    if (index == -1) {
+        index = 0;
+
+        for (int i = 1; i < CRYPTO_RESUMPTION_CACHE_SIZE; ++i) {
+            if (c->resumptions[i].time < c->resumptions[index].time) {
+                index = i;
+            }
+        }
+    }
+
+    Crypto_Resumption *res = &c->resumptions[index];
+    memcpy(res->public_key, conn->public_key, CRYPTO_PUBLIC_KEY_SIZE);
+    memcpy(res->dht_public_key, conn->dht_public_key, CRYPTO_PUBLIC_KEY_SIZE);
+    memcpy(res->sessionpublic_key, conn->sessionpublic_key, CRYPTO_PUBLIC_KEY_SIZE);
+    memcpy(res->sessionsecret_key, conn->sessionsecret_key, CRYPTO_SECRET_KEY_SIZE);
+    memcpy(res->peersessionpublic_key, conn->peersessionpublic_key, CRYPTO_PUBLIC_KEY_SIZE);
+    memcpy(res->shared_key, conn->shared_key, CRYPTO_SHARED_KEY_SIZE);
+    crypto_sha256(res->id, conn->shared_key, CRYPTO_SHARED_KEY_SIZE);
+    res->time = unix_time();
+}
+
+#define RESUMPTION_PACKET_LENGTH (1 + CRYPTO_SHA256_SIZE + CRYPTO_NONCE_SIZE + CRYPTO_PUBLIC_KEY_SIZE \
+                                  + CRYPTO_NONCE_SIZE * 2 + COOKIE_LENGTH + CRYPTO_MAC_SIZE)
+
+/* Create a resumption packet, which starts a new session with the keys of the
+ * ended session res, and put it in packet.
+ * nonce and session_pk are our base nonce and session public key for the new
+ * session, and peer_nonce the base nonce the peer is to use, so that we can
+ * read its packets before its handshake reaches us. The packet has a cookie
+ * for the peer to answer with a handshake.
+ * packet must be of size RESUMPTION_PACKET_LENGTH or bigger.
+ *
+ * return -1 on failure.
+ * return RESUMPTION_PACKET_LENGTH on success.
+ */
+static int create_resumption_packet(const Net_Crypto *c, uint8_t *packet, const Crypto_Resumption *res,
+                                    const uint8_t *nonce, const uint8_t *peer_nonce, const uint8_t *session_pk)
+{
+    uint8_t plain[CRYPTO_PUBLIC_KEY_SIZE + CRYPTO_NONCE_SIZE * 2 + COOKIE_LENGTH];
+    memcpy(plain, session_pk, CRYPTO_PUBLIC_KEY_SIZE);
+    memcpy(plain + CRYPTO_PUBLIC_KEY_SIZE, nonce, CRYPTO_NONCE_SIZE);
+    memcpy(plain + CRYPTO_PUBLIC_KEY_SIZE + CRYPTO_NONCE_SIZE, peer_nonce, CRYPTO_NONCE_SIZE);
+    uint8_t cookie_plain[COOKIE_DATA_LENGTH];
+    memcpy(cookie_plain, res->public_key, CRYPTO_PUBLIC_KEY_SIZE);
+    memcpy(cookie_plain + CRYPTO_PUBLIC_KEY_SIZE, res->dht_public_key, CRYPTO_PUBLIC_KEY_SIZE);
+
+    if (create_cookie(plain + CRYPTO_PUBLIC_KEY_SIZE + CRYPTO_NONCE_SIZE * 2, cookie_plain,
+                      c->secret_symmetric_key) != 0) {
+        return -1;
+    }
+
+    packet[0] = NET_PACKET_CRYPTO_RESUME;
+    memcpy(packet + 1, res->id, CRYPTO_SHA256_SIZE);
+    random_nonce(packet + 1 + CRYPTO_SHA256_SIZE);
+    int len = encrypt_data_symmetric(res->shared_key, packet + 1 + CRYPTO_SHA256_SIZE, plain, sizeof(plain),
+                                     packet + 1 + CRYPTO_SHA256_SIZE + CRYPTO_NONCE_SIZE);
+
+    if (len != RESUMPTION_PACKET_LENGTH - (1 + CRYPTO_SHA256_SIZE + CRYPTO_NONCE_SIZE)) {
+        return -1;
+    }
+
+    return RESUMPTION_PACKET_LENGTH;
+}
+
+/* Handle a resumption packet of length.
+ * put the index in c->resumptions of the ended session it resumes in index,
+ * the base nonce and session public key of the peer for the new session in
+ * nonce and session_pk, the base nonce it chose for us in our_nonce and the
+ * cookie for our handshake in cookie.
+ *
+ * nonce and our_nonce must be at least CRYPTO_NONCE_SIZE
+ * session_pk must be at least CRYPTO_PUBLIC_KEY_SIZE
+ * cookie must be at least COOKIE_LENGTH
+ *
+ * return -1 on failure.
+ * return 0 on success.
+ */
+static int handle_resumption_packet(const Net_Crypto *c, int *index, uint8_t *nonce, uint8_t *our_nonce,
+                                    uint8_t *session_pk, uint8_t *cookie, const uint8_t *packet, uint16_t length)
+{
+    if (length != RESUMPTION_PACKET_LENGTH) {
+        return -1;
+    }
+
+    const int i = find_resumption_id(c, packet + 1);
+
+    if (i == -1) {
+        return -1;
+    }
+
+    uint8_t plain[CRYPTO_PUBLIC_KEY_SIZE + CRYPTO_NONCE_SIZE * 2 + COOKIE_LENGTH];
+    int len = decrypt_data_symmetric(c->resumptions[i].shared_key, packet + 1 + CRYPTO_SHA256_SIZE,
+                                     packet + 1 + CRYPTO_SHA256_SIZE + CRYPTO_NONCE_SIZE,
+                                     RESUMPTION_PACKET_LENGTH - (1 + CRYPTO_SHA256_SIZE + CRYPTO_NONCE_SIZE), plain);
+
+    if (len != sizeof(plain)) {
+        return -1;
+    }
+
+    memcpy(session_pk, plain, CRYPTO_PUBLIC_KEY_SIZE);
+    memcpy(nonce, plain + CRYPTO_PUBLIC_KEY_SIZE, CRYPTO_NONCE_SIZE);
+    memcpy(our_nonce, plain + CRYPTO_PUBLIC_KEY_SIZE + CRYPTO_NONCE_SIZE, CRYPTO_NONCE_SIZE);
+    memcpy(cookie, plain + CRYPTO_PUBLIC_KEY_SIZE + CRYPTO_NONCE_SIZE * 2, COOKIE_LENGTH);
+    *index = i;
+    return 0;
+}
+
 
 static Crypto_Connection *get_crypto_connection(const Net_Crypto *c, int crypt_connection_id)
 {
@@ -560,6 +860,25 @@ static Crypto_Connection *get_crypto_connection(const Net_Crypto *c, int crypt_c
 }
 
 
+/* Index the connection by ip_port, which crypto_id_ip_port() looks it up by.
+ *
+ * return false if another connection has that ip_port, or on memory allocation
+ *   failure.
+ */
+static bool ip_port_table_add(Net_Crypto *c, const IP_Port *ip_port, int crypt_connection_id)
+{
+    uint8_t key[SIZE_IPPORT];
+    ipport_key(ip_port, key);
+    return hash_table_add(&c->ip_port_table, key, crypt_connection_id);
+}
+
+static void ip_port_table_remove(Net_Crypto *c, const IP_Port *ip_port, int crypt_connection_id)
+{
+    uint8_t key[SIZE_IPPORT];
+    ipport_key(ip_port, key);
+    hash_table_remove(&c->ip_port_table, key, crypt_connection_id);
+}
+
 /* Associate an ip_port to a connection.
  *
  * return -1 on failure.
@@ -575,21 +894,21 @@ static int add_ip_port_connection(Net_Crypto *c, int crypt_connection_id, IP_Por
 
     if (net_family_is_ipv4(ip_port.ip.family)) {
         if (!ipport_equal(&ip_port, &conn->ip_portv4) && ip_is_lan(conn->ip_portv4.ip) != 0) {
-            if (!bs_list_add(&c->ip_port_list, (uint8_t *)&ip_port, crypt_connection_id)) {
+            if (!ip_port_table_add(c, &ip_port, crypt_connection_id)) {
                 return -1;
             }
 
-            bs_list_remove(&c->ip_port_list, (uint8_t *)&conn->ip_portv4, crypt_connection_id);
+            ip_port_table_remove(c, &conn->ip_portv4, crypt_connection_id);
             conn->ip_portv4 = ip_port;
             return 0;
         }
     } else if (net_family_is_ipv6(ip_port.ip.family)) {
         if (!ipport_equal(&ip_port, &conn->ip_portv6)) {
-            if (!bs_list_add(&c->ip_port_list, (uint8_t *)&ip_port, crypt_connection_id)) {
+            if (!ip_port_table_add(c, &ip_port, crypt_connection_id)) {
                 return -1;
             }
 
-            bs_list_remove(&c->ip_port_list, (uint8_t *)&conn->ip_portv6, crypt_connection_id);
+            ip_port_table_remove(c, &conn->ip_portv6, crypt_connection_id);
             conn->ip_portv6 = ip_port;
             return 0;
         }
@@ -677,7 +996,8 @@ static int send_packet_to(Net_Crypto *c, int crypt_connection_id, const uint8_t
         uint64_t current_time = unix_time();
 
         if ((((UDP_DIRECT_TIMEOUT / 2) + conn->direct_send_attempt_time) > current_time && length < 96)
-                || data[0] == NET_PACKET_COOKIE_REQUEST || data[0] == NET_PACKET_CRYPTO_HS) {
+                || data[0] == NET_PACKET_COOKIE_REQUEST || data[0] == NET_PACKET_CRYPTO_HS
+                || data[0] == NET_PACKET_CRYPTO_RESUME) {
             if ((uint32_t)sendpacket(dht_get_net(c->dht), ip_port, data, length) == length) {
                 direct_send_attempt = 1;
                 conn->direct_send_attempt_time = unix_time();
@@ -708,6 +1028,201 @@ static int send_packet_to(Net_Crypto *c, int crypt_connection_id, const uint8_t
 /** START: Array Related functions **/
 
 
+/* return a Packet_Data holding data's packet, NULL on failure. */
+static Packet_Data *packet_pool_get(Packet_Pool *pool, const Packet_Data *data)
+{
+    Packet_Data *packet = nullptr;
+
+    pthread_mutex_lock(&pool->mutex);
+
+    if (pool->num_free > 0) {
+        --pool->num_free;
+        packet = pool->free[pool->num_free];
+    }
+
+    pthread_mutex_unlock(&pool->mutex);
+
+    if (packet == nullptr) {
+        packet = (Packet_Data *)malloc(sizeof(Packet_Data));
+
+        if (packet == nullptr) {
+            return nullptr;
+        }
+    }
+
+    packet->sent_time = data->sent_time;
+    packet->length = data->length;
+    memcpy(packet->data, data->data, data->length);
+    return packet;
+}
+
+static void packet_pool_put(Packet_Pool *pool, Packet_Data *packet)
+{
+    pthread_mutex_lock(&pool->mutex);
+
+    if (pool->num_free < PACKET_POOL_SIZE) {
+        pool->free[pool->num_free] = packet;
+        ++pool->num_free;
+        packet = nullptr;
+    }
+
+    pthread_mutex_unlock(&pool->mutex);
+
+    free(packet);
+}
+
+static void packet_pool_clear(Packet_Pool *pool)
+{
+    for (uint32_t i = 0; i < pool->num_free; ++i) {
+        free(pool->free[i]);
+    }
+
+    pool->num_free = 0;
+}
+
+/* return the number of trailing zero bits of word, which isn't 0. */
+static unsigned int packets_array_ctz(uint64_t word)
+{
+#if defined(__GNUC__)
+    return (unsigned int)__builtin_ctzll(word);
+#else
+    unsigned int n = 0;
+
+    while ((word & 1) == 0) {
+        word >>= 1;
+        ++n;
+    }
+
+    return n;
+#endif
+}
+
+/* Allocate the size slots of array, which must be empty.
+ *
+ * return -1 on failure.
+ * return 0 on success.
+ */
+static int init_packets_array(Packets_Array *array, uint32_t size)
+{
+    array->buffer = (Packet_Data **)calloc(size, sizeof(Packet_Data *));
+    array->used = (uint64_t *)calloc(size / PACKETS_ARRAY_WORD_BITS, sizeof(uint64_t));
+
+    if (array->buffer == nullptr || array->used == nullptr) {
+        free(array->buffer);
+        free(array->used);
+        array->buffer = nullptr;
+        array->used = nullptr;
+        return -1;
+    }
+
+    array->size = size;
+    return 0;
+}
+
+/* Free the slots of array, which must be empty. */
+static void free_packets_array(Packets_Array *array)
+{
+    free(array->buffer);
+    free(array->used);
+    array->buffer = nullptr;
+    array->used = nullptr;
+    array->size = 0;
+}
+
+/* return the slot of array for packet number. */
+static uint32_t packets_array_slot(const Packets_Array *array, uint32_t number)
+{
+    return number & (array->size - 1);
+}
+
+static void packets_array_set(Packets_Array *array, uint32_t num, Packet_Data *packet)
+{
+    array->buffer[num] = packet;
+    array->used[num / PACKETS_ARRAY_WORD_BITS] |= (uint64_t)1 << (num % PACKETS_ARRAY_WORD_BITS);
+}
+
+static void packets_array_unset(Packets_Array *array, uint32_t num)
+{
+    array->buffer[num] = nullptr;
+    array->used[num / PACKETS_ARRAY_WORD_BITS] &= ~((uint64_t)1 << (num % PACKETS_ARRAY_WORD_BITS));
+}
+
+/* return the first packet number in {from, to) whose slot holds a packet if
+ *   used is true, or is empty if it is false.
+ * return to if there is none.
+ */
+static uint32_t packets_array_find(const Packets_Array *array, uint32_t from, uint32_t to, bool used)
+{
+    uint32_t i = from;
+
+    while (i != to) {
+        const uint32_t num = packets_array_slot(array, i);
+        const uint32_t bit = num % PACKETS_ARRAY_WORD_BITS;
+        uint64_t word = array->used[num / PACKETS_ARRAY_WORD_BITS];
+
+        if (!used) {
+            word = ~word;
+        }
+
+        word >>= bit;
+
+        if (word != 0) {
+            const uint32_t offset = packets_array_ctz(word);
+            return offset < to - i ? i + offset : to;
+        }
+
+        /* Slots wrap around at a word boundary, the size of the array being
+         * a multiple of the word size. */
+        const uint32_t rest = PACKETS_ARRAY_WORD_BITS - bit;
+
+        if (rest >= to - i) {
+            return to;
+        }
+
+        i += rest;
+    }
+
+    return to;
+}
+
+/* Return packets in {from, to) to the pool, with the latest time one of them
+ * was sent put in latest_send_time if it is later.
+ */
+static void packets_array_free(Packet_Pool *pool, Packets_Array *array, uint32_t from, uint32_t to,
+                               uint64_t *latest_send_time)
+{
+    uint32_t i = from;
+
+    while (i != to) {
+        const uint32_t num = packets_array_slot(array, i);
+        const uint32_t bit = num % PACKETS_ARRAY_WORD_BITS;
+        uint32_t count = PACKETS_ARRAY_WORD_BITS - bit;
+
+        if (count > to - i) {
+            count = to - i;
+        }
+
+        const uint64_t mask = (count == PACKETS_ARRAY_WORD_BITS ? ~(uint64_t)0 : ((uint64_t)1 << count) - 1) << bit;
+        uint64_t *const word = &array->used[num / PACKETS_ARRAY_WORD_BITS];
+        uint64_t found = *word & mask;
+        *word &= ~mask;
+
+        while (found != 0) {
+            Packet_Data **const slot = &array->buffer[num - bit + packets_array_ctz(found)];
+
+            if (latest_send_time != nullptr && *latest_send_time < (*slot)->sent_time) {
+                *latest_send_time = (*slot)->sent_time;
+            }
+
+            packet_pool_put(pool, *slot);
+            *slot = nullptr;
+            found &= found - 1;
+        }
+
+        i += count;
+    }
+}
+
 /* Return number of packets in array
  * Note that holes are counted too.
  */
@@ -721,26 +1236,25 @@ static uint32_t num_packets_array(const Packets_Array *array)
  * return -1 on failure.
  * return 0 on success.
  */
-static int add_data_to_buffer(Packets_Array *array, uint32_t number, const Packet_Data *data)
+static int add_data_to_buffer(Packet_Pool *pool, Packets_Array *array, uint32_t number, const Packet_Data *data)
 {
-    if (number - array->buffer_start > CRYPTO_PACKET_BUFFER_SIZE) {
+    if (number - array->buffer_start > array->size) {
         return -1;
     }
 
-    uint32_t num = number % CRYPTO_PACKET_BUFFER_SIZE;
+    uint32_t num = packets_array_slot(array, number);
 
     if (array->buffer[num]) {
         return -1;
     }
 
-    Packet_Data *new_d = (Packet_Data *)malloc(sizeof(Packet_Data));
+    Packet_Data *new_d = packet_pool_get(pool, data);
 
     if (new_d == nullptr) {
         return -1;
     }
 
-    memcpy(new_d, data, sizeof(Packet_Data));
-    array->buffer[num] = new_d;
+    packets_array_set(array, num, new_d);
 
     if ((number - array->buffer_start) >= (array->buffer_end - array->buffer_start)) {
         array->buffer_end = number + 1;
@@ -763,7 +1277,7 @@ static int get_data_pointer(const Packets_Array *array, Packet_Data **data, uint
         return -1;
     }
 
-    uint32_t num = number % CRYPTO_PACKET_BUFFER_SIZE;
+    uint32_t num = packets_array_slot(array, number);
 
     if (!array->buffer[num]) {
         return 0;
@@ -778,21 +1292,20 @@ static int get_data_pointer(const Packets_Array *array, Packet_Data **data, uint
  * return -1 on failure.
  * return packet number on success.
  */
-static int64_t add_data_end_of_buffer(Packets_Array *array, const Packet_Data *data)
+static int64_t add_data_end_of_buffer(Packet_Pool *pool, Packets_Array *array, const Packet_Data *data)
 {
-    if (num_packets_array(array) >= CRYPTO_PACKET_BUFFER_SIZE) {
+    if (num_packets_array(array) >= array->size) {
         return -1;
     }
 
-    Packet_Data *new_d = (Packet_Data *)malloc(sizeof(Packet_Data));
+    Packet_Data *new_d = packet_pool_get(pool, data);
 
     if (new_d == nullptr) {
         return -1;
     }
 
-    memcpy(new_d, data, sizeof(Packet_Data));
     uint32_t id = array->buffer_end;
-    array->buffer[id % CRYPTO_PACKET_BUFFER_SIZE] = new_d;
+    packets_array_set(array, packets_array_slot(array, id), new_d);
     ++array->buffer_end;
     return id;
 }
@@ -802,23 +1315,26 @@ static int64_t add_data_end_of_buffer(Packets_Array *array, const Packet_Data *d
  * return -1 on failure.
  * return packet number on success.
  */
-static int64_t read_data_beg_buffer(Packets_Array *array, Packet_Data *data)
+static int64_t read_data_beg_buffer(Packet_Pool *pool, Packets_Array *array, Packet_Data *data)
 {
     if (array->buffer_end == array->buffer_start) {
         return -1;
     }
 
-    uint32_t num = array->buffer_start % CRYPTO_PACKET_BUFFER_SIZE;
+    uint32_t num = packets_array_slot(array, array->buffer_start);
 
     if (!array->buffer[num]) {
         return -1;
     }
 
-    memcpy(data, array->buffer[num], sizeof(Packet_Data));
+    const Packet_Data *const packet = array->buffer[num];
+    data->sent_time = packet->sent_time;
+    data->length = packet->length;
+    memcpy(data->data, packet->data, packet->length);
     uint32_t id = array->buffer_start;
     ++array->buffer_start;
-    free(array->buffer[num]);
-    array->buffer[num] = nullptr;
+    packet_pool_put(pool, array->buffer[num]);
+    packets_array_unset(array, num);
     return id;
 }
 
@@ -827,7 +1343,7 @@ static int64_t read_data_beg_buffer(Packets_Array *array, Packet_Data *data)
  * return -1 on failure.
  * return 0 on success
  */
-static int clear_buffer_until(Packets_Array *array, uint32_t number)
+static int clear_buffer_until(Packet_Pool *pool, Packets_Array *array, uint32_t number)
 {
     uint32_t num_spots = array->buffer_end - array->buffer_start;
 
@@ -835,35 +1351,15 @@ static int clear_buffer_until(Packets_Array *array, uint32_t number)
         return -1;
     }
 
-    uint32_t i;
-
-    for (i = array->buffer_start; i != number; ++i) {
-        uint32_t num = i % CRYPTO_PACKET_BUFFER_SIZE;
-
-        if (array->buffer[num]) {
-            free(array->buffer[num]);
-            array->buffer[num] = nullptr;
-        }
-    }
-
-    array->buffer_start = i;
+    packets_array_free(pool, array, array->buffer_start, number, nullptr);
+    array->buffer_start = number;
     return 0;
 }
 
-static int clear_buffer(Packets_Array *array)
+static int clear_buffer(Packet_Pool *pool, Packets_Array *array)
 {
-    uint32_t i;
-
-    for (i = array->buffer_start; i != array->buffer_end; ++i) {
-        uint32_t num = i % CRYPTO_PACKET_BUFFER_SIZE;
-
-        if (array->buffer[num]) {
-            free(array->buffer[num]);
-            array->buffer[num] = nullptr;
-        }
-    }
-
-    array->buffer_start = i;
+    packets_array_free(pool, array, array->buffer_start, array->buffer_end, nullptr);
+    array->buffer_start = array->buffer_end;
     return 0;
 }
 
@@ -874,11 +1370,11 @@ static int clear_buffer(Packets_Array *array)
  */
 static int set_buffer_end(Packets_Array *array, uint32_t number)
 {
-    if ((number - array->buffer_start) > CRYPTO_PACKET_BUFFER_SIZE) {
+    if ((number - array->buffer_start) > array->size) {
         return -1;
     }
 
-    if ((number - array->buffer_end) > CRYPTO_PACKET_BUFFER_SIZE) {
+    if ((number - array->buffer_end) > array->size) {
         return -1;
     }
 
@@ -910,22 +1406,19 @@ static int generate_request_packet(uint8_t *data, uint16_t length, const Packets
         return cur_len;
     }
 
-    uint32_t i, n = 1;
+    /* Each byte is the distance from the previous hole to the next one, a 0
+     * standing for 255 packets without a hole. */
+    uint32_t i = recv_array->buffer_start;
+    uint32_t n = 1;
 
-    for (i = recv_array->buffer_start; i != recv_array->buffer_end; ++i) {
-        uint32_t num = i % CRYPTO_PACKET_BUFFER_SIZE;
-
-        if (!recv_array->buffer[num]) {
-            data[cur_len] = n;
-            n = 0;
-            ++cur_len;
+    while (i != recv_array->buffer_end) {
+        const uint32_t hole = packets_array_find(recv_array, i, recv_array->buffer_end, false);
 
-            if (length <= cur_len) {
-                return cur_len;
-            }
-        } else if (n == 255) {
+        while (hole - i > 255 - n) {
+            i += 255 - n;
             data[cur_len] = 0;
-            n = 0;
+            n = 1;
+            ++i;
             ++cur_len;
 
             if (length <= cur_len) {
@@ -933,7 +1426,21 @@ static int generate_request_packet(uint8_t *data, uint16_t length, const Packets
             }
         }
 
-        ++n;
+        n += hole - i;
+        i = hole;
+
+        if (i == recv_array->buffer_end) {
+            break;
+        }
+
+        data[cur_len] = n;
+        n = 1;
+        ++i;
+        ++cur_len;
+
+        if (length <= cur_len) {
+            return cur_len;
+        }
     }
 
     return cur_len;
@@ -945,7 +1452,7 @@ static int generate_request_packet(uint8_t *data, uint16_t length, const Packets
  * return -1 on failure.
  * return number of requested packets on success.
  */
-static int handle_request_packet(Packets_Array *send_array, const uint8_t *data, uint16_t length,
+static int handle_request_packet(Packet_Pool *pool, Packets_Array *send_array, const uint8_t *data, uint16_t length,
                                  uint64_t *latest_send_time, uint64_t rtt_time)
 {
     if (length < 1) {
@@ -963,57 +1470,57 @@ static int handle_request_packet(Packets_Array *send_array, const uint8_t *data,
     ++data;
     --length;
 
-    uint32_t i, n = 1;
+    uint32_t i = send_array->buffer_start;
+    uint32_t n = 1;
     uint32_t requested = 0;
 
     uint64_t temp_time = current_time_monotonic();
     uint64_t l_sent_time = ~0;
 
-    for (i = send_array->buffer_start; i != send_array->buffer_end; ++i) {
-        if (length == 0) {
+    /* The packets up to each requested one were received, as are the 255 up
+     * to each 0 byte. */
+    while (i != send_array->buffer_end && length != 0) {
+        const bool request = data[0] >= n && data[0] != 0;
+        const uint32_t received = request ? data[0] - n : 256 - n;
+
+        if (received > send_array->buffer_end - i) {
+            packets_array_free(pool, send_array, i, send_array->buffer_end, &l_sent_time);
             break;
         }
 
-        uint32_t num = i % CRYPTO_PACKET_BUFFER_SIZE;
+        packets_array_free(pool, send_array, i, i + received, &l_sent_time);
+        i += received;
 
-        if (n == data[0]) {
-            if (send_array->buffer[num]) {
-                uint64_t sent_time = send_array->buffer[num]->sent_time;
-
-                if ((sent_time + rtt_time) < temp_time) {
-                    send_array->buffer[num]->sent_time = 0;
-                }
+        if (!request) {
+            if (data[0] != 0) {
+                return -1;
             }
 
             ++data;
             --length;
-            n = 0;
-            ++requested;
-        } else {
-            if (send_array->buffer[num]) {
-                uint64_t sent_time = send_array->buffer[num]->sent_time;
-
-                if (l_sent_time < sent_time) {
-                    l_sent_time = sent_time;
-                }
+            n = 1;
+            continue;
+        }
 
-                free(send_array->buffer[num]);
-                send_array->buffer[num] = nullptr;
-            }
+        if (i == send_array->buffer_end) {
+            break;
         }
 
-        if (n == 255) {
-            n = 1;
+        const uint32_t num = packets_array_slot(send_array, i);
 
-            if (data[0] != 0) {
-                return -1;
-            }
+        if (send_array->buffer[num]) {
+            uint64_t sent_time = send_array->buffer[num]->sent_time;
 
-            ++data;
-            --length;
-        } else {
-            ++n;
+            if ((sent_time + rtt_time) < temp_time) {
+                send_array->buffer[num]->sent_time = 0;
+            }
         }
+
+        ++data;
+        --length;
+        n = 1;
+        ++requested;
+        ++i;
     }
 
     if (*latest_send_time < l_sent_time) {
@@ -1025,14 +1532,156 @@ static int handle_request_packet(Packets_Array *send_array, const uint8_t *data,
 
 /** END: Array Related functions **/
 
+/* return the array of packets sent on stream.
+ * return nullptr if the stream wasn't used yet.
+ */
+static Packets_Array *stream_send_array(Crypto_Connection *conn, uint8_t stream)
+{
+    if (stream == CRYPTO_STREAM_DEFAULT) {
+        return &conn->send_array;
+    }
+
+    return conn->streams[stream] != nullptr ? &conn->streams[stream]->send_array : nullptr;
+}
+
+/* return the array of packets received on stream.
+ * return nullptr if the stream wasn't used yet.
+ */
+static Packets_Array *stream_recv_array(Crypto_Connection *conn, uint8_t stream)
+{
+    if (stream == CRYPTO_STREAM_DEFAULT) {
+        return &conn->recv_array;
+    }
+
+    return conn->streams[stream] != nullptr ? &conn->streams[stream]->recv_array : nullptr;
+}
+
+static void free_stream(Crypto_Stream *stream)
+{
+    free_packets_array(&stream->send_array);
+    free_packets_array(&stream->recv_array);
+    free(stream);
+}
+
+/* Allocate the arrays of stream the first time it is used.
+ *
+ * return -1 on failure.
+ * return 0 on success.
+ */
+static int open_stream(Crypto_Connection *conn, uint8_t stream)
+{
+    if (stream == CRYPTO_STREAM_DEFAULT || conn->streams[stream] != nullptr) {
+        return 0;
+    }
+
+    Crypto_Stream *new_stream = (Crypto_Stream *)calloc(1, sizeof(Crypto_Stream));
+
+    if (new_stream == nullptr) {
+        return -1;
+    }
+
+    if (init_packets_array(&new_stream->send_array, CRYPTO_STREAM_BUFFER_SIZE) != 0
+            || init_packets_array(&new_stream->recv_array, CRYPTO_STREAM_BUFFER_SIZE) != 0) {
+        free_stream(new_stream);
+        return -1;
+    }
+
+    /* Packets are written to a stream from other threads than the one that
+     * receives them. */
+    pthread_mutex_lock(&conn->mutex);
+
+    if (conn->streams[stream] == nullptr) {
+        conn->streams[stream] = new_stream;
+        new_stream = nullptr;
+    }
+
+    pthread_mutex_unlock(&conn->mutex);
+
+    if (new_stream != nullptr) {
+        free_stream(new_stream);
+    }
+
+    return 0;
+}
+
+static void close_streams(Packet_Pool *pool, Crypto_Connection *conn)
+{
+    for (uint8_t i = 0; i < CRYPTO_NUM_STREAMS; ++i) {
+        if (conn->streams[i] != nullptr) {
+            clear_buffer(pool, &conn->streams[i]->send_array);
+            clear_buffer(pool, &conn->streams[i]->recv_array);
+            free_stream(conn->streams[i]);
+            conn->streams[i] = nullptr;
+        }
+    }
+}
+
+/* Free the lossy packets held back by pacing. */
+static void clear_lossy_queue(Packet_Pool *pool, Crypto_Connection *conn)
+{
+    while (conn->lossy_queue_length > 0) {
+        packet_pool_put(pool, conn->lossy_queue[conn->lossy_queue_start]);
+        conn->lossy_queue_start = (conn->lossy_queue_start + 1) % CRYPTO_LOSSY_QUEUE_SIZE;
+        --conn->lossy_queue_length;
+    }
+}
+
+/* Return number of packets in the send arrays of all streams. */
+static uint32_t num_packets_sent_streams(Crypto_Connection *conn)
+{
+    uint32_t num = 0;
+
+    for (uint8_t i = 0; i < CRYPTO_NUM_STREAMS; ++i) {
+        const Packets_Array *send_array = stream_send_array(conn, i);
+
+        if (send_array != nullptr) {
+            num += num_packets_array(send_array);
+        }
+    }
+
+    return num;
+}
+
+/* Return number of packets in the receive arrays of all streams. */
+static uint32_t num_packets_recv_streams(Crypto_Connection *conn)
+{
+    uint32_t num = 0;
+
+    for (uint8_t i = 0; i < CRYPTO_NUM_STREAMS; ++i) {
+        const Packets_Array *recv_array = stream_recv_array(conn, i);
+
+        if (recv_array != nullptr) {
+            num += num_packets_array(recv_array);
+        }
+    }
+
+    return num;
+}
+
+uint32_t stream_packet_number(uint32_t buffer_start, uint16_t number)
+{
+    return buffer_start + (uint16_t)(number - (uint16_t)buffer_start);
+}
+
+bool stream_packet_in_window(uint32_t buffer_start, uint32_t number)
+{
+    return number - buffer_start < CRYPTO_STREAM_BUFFER_SIZE;
+}
+
 #define MAX_DATA_DATA_PACKET_SIZE (MAX_CRYPTO_PACKET_SIZE - (1 + sizeof(uint16_t) + CRYPTO_MAC_SIZE))
 
-/* Creates and sends a data packet to the peer using the fastest route.
+/* Size of the header of the data packets of streams other than CRYPTO_STREAM_DEFAULT:
+ * the stream, then the lowest 2 bytes of buffer_start and of the packet number.
+ */
+#define STREAM_DATA_HEADER_SIZE (1 + sizeof(uint16_t) + sizeof(uint16_t))
+
+/* Creates and sends a data packet of packet_type to the peer using the fastest route.
  *
  * return -1 on failure.
  * return 0 on success.
  */
-static int send_data_packet(Net_Crypto *c, int crypt_connection_id, const uint8_t *data, uint16_t length)
+static int send_data_packet(Net_Crypto *c, int crypt_connection_id, uint8_t packet_type, const uint8_t *data,
+                            uint16_t length)
 {
     if (length == 0 || length + (1 + sizeof(uint16_t) + CRYPTO_MAC_SIZE) > MAX_CRYPTO_PACKET_SIZE) {
         return -1;
@@ -1046,7 +1695,7 @@ static int send_data_packet(Net_Crypto *c, int crypt_connection_id, const uint8_
 
     pthread_mutex_lock(&conn->mutex);
     VLA(uint8_t, packet, 1 + sizeof(uint16_t) + length + CRYPTO_MAC_SIZE);
-    packet[0] = NET_PACKET_CRYPTO_DATA;
+    packet[0] = packet_type;
     memcpy(packet + 1, conn->sent_nonce + (CRYPTO_NONCE_SIZE - sizeof(uint16_t)), sizeof(uint16_t));
     int len = encrypt_data_symmetric(conn->shared_key, conn->sent_nonce, data, length, packet + 1 + sizeof(uint16_t));
 
@@ -1082,7 +1731,41 @@ static int send_data_packet_helper(Net_Crypto *c, int crypt_connection_id, uint3
     memset(packet + (sizeof(uint32_t) * 2), PACKET_ID_PADDING, padding_length);
     memcpy(packet + (sizeof(uint32_t) * 2) + padding_length, data, length);
 
-    return send_data_packet(c, crypt_connection_id, packet, SIZEOF_VLA(packet));
+    return send_data_packet(c, crypt_connection_id, NET_PACKET_CRYPTO_DATA, packet, SIZEOF_VLA(packet));
+}
+
+/* Creates and sends a data packet of stream with buffer_start and num to the peer using the fastest route.
+ *
+ * Packets of streams other than CRYPTO_STREAM_DEFAULT only carry the lowest 2
+ * bytes of the numbers: the peer tells the rest from its own arrays, which are
+ * never more than CRYPTO_STREAM_BUFFER_SIZE packets away from ours. That leaves
+ * them room for as much data as the packets of CRYPTO_STREAM_DEFAULT.
+ *
+ * return -1 on failure.
+ * return 0 on success.
+ */
+static int send_stream_data_packet_helper(Net_Crypto *c, int crypt_connection_id, uint8_t stream,
+        uint32_t buffer_start, uint32_t num, const uint8_t *data, uint16_t length)
+{
+    if (stream == CRYPTO_STREAM_DEFAULT) {
+        return send_data_packet_helper(c, crypt_connection_id, buffer_start, num, data, length);
+    }
+
+    if (length == 0 || length > MAX_CRYPTO_DATA_SIZE) {
+        return -1;
+    }
+
+    const uint16_t start = net_htons((uint16_t)buffer_start);
+    const uint16_t number = net_htons((uint16_t)num);
+    uint16_t padding_length = (MAX_CRYPTO_DATA_SIZE - length) % CRYPTO_MAX_PADDING;
+    VLA(uint8_t, packet, STREAM_DATA_HEADER_SIZE + padding_length + length);
+    packet[0] = stream;
+    memcpy(packet + 1, &start, sizeof(uint16_t));
+    memcpy(packet + 1 + sizeof(uint16_t), &number, sizeof(uint16_t));
+    memset(packet + STREAM_DATA_HEADER_SIZE, PACKET_ID_PADDING, padding_length);
+    memcpy(packet + STREAM_DATA_HEADER_SIZE + padding_length, data, length);
+
+    return send_data_packet(c, crypt_connection_id, NET_PACKET_CRYPTO_STREAM_DATA, packet, SIZEOF_VLA(packet));
 }
 
 static int reset_max_speed_reached(Net_Crypto *c, int crypt_connection_id)
@@ -1096,16 +1779,19 @@ static int reset_max_speed_reached(Net_Crypto *c, int crypt_connection_id)
     /* If last packet send failed, try to send packet again.
        If sending it fails we won't be able to send the new packet. */
     if (conn->maximum_speed_reached) {
+        const uint8_t stream = conn->maximum_speed_stream;
+        Packets_Array *send_array = stream_send_array(conn, stream);
+        const Packets_Array *recv_array = stream_recv_array(conn, stream);
         Packet_Data *dt = nullptr;
-        uint32_t packet_num = conn->send_array.buffer_end - 1;
-        int ret = get_data_pointer(&conn->send_array, &dt, packet_num);
+        uint32_t packet_num = send_array->buffer_end - 1;
+        int ret = get_data_pointer(send_array, &dt, packet_num);
 
         uint8_t send_failed = 0;
 
         if (ret == 1) {
             if (!dt->sent_time) {
-                if (send_data_packet_helper(c, crypt_connection_id, conn->recv_array.buffer_start, packet_num, dt->data,
-                                            dt->length) != 0) {
+                if (send_stream_data_packet_helper(c, crypt_connection_id, stream, recv_array->buffer_start, packet_num,
+                                                   dt->data, dt->length) != 0) {
                     send_failed = 1;
                 } else {
                     dt->sent_time = current_time_monotonic();
@@ -1123,11 +1809,11 @@ static int reset_max_speed_reached(Net_Crypto *c, int crypt_connection_id)
     return 0;
 }
 
-/*  return -1 if data could not be put in packet queue.
+/*  return -1 if data could not be put in the packet queue of stream.
  *  return positive packet number if data was put into the queue.
  */
-static int64_t send_lossless_packet(Net_Crypto *c, int crypt_connection_id, const uint8_t *data, uint16_t length,
-                                    uint8_t congestion_control)
+static int64_t send_lossless_packet(Net_Crypto *c, int crypt_connection_id, uint8_t stream, const uint8_t *data,
+                                    uint16_t length, uint8_t congestion_control)
 {
     if (length == 0 || length > MAX_CRYPTO_DATA_SIZE) {
         return -1;
@@ -1147,12 +1833,19 @@ static int64_t send_lossless_packet(Net_Crypto *c, int crypt_connection_id, cons
         return -1;
     }
 
+    Packets_Array *send_array = stream_send_array(conn, stream);
+    const Packets_Array *recv_array = stream_recv_array(conn, stream);
+
+    if (send_array == nullptr) {
+        return -1;
+    }
+
     Packet_Data dt;
     dt.sent_time = 0;
     dt.length = length;
     memcpy(dt.data, data, length);
     pthread_mutex_lock(&conn->mutex);
-    int64_t packet_num = add_data_end_of_buffer(&conn->send_array, &dt);
+    int64_t packet_num = add_data_end_of_buffer(&c->packet_pool, send_array, &dt);
     pthread_mutex_unlock(&conn->mutex);
 
     if (packet_num == -1) {
@@ -1163,14 +1856,16 @@ static int64_t send_lossless_packet(Net_Crypto *c, int crypt_connection_id, cons
         return packet_num;
     }
 
-    if (send_data_packet_helper(c, crypt_connection_id, conn->recv_array.buffer_start, packet_num, data, length) == 0) {
+    if (send_stream_data_packet_helper(c, crypt_connection_id, stream, recv_array->buffer_start, packet_num, data,
+                                       length) == 0) {
         Packet_Data *dt1 = nullptr;
 
-        if (get_data_pointer(&conn->send_array, &dt1, packet_num) == 1) {
+        if (get_data_pointer(send_array, &dt1, packet_num) == 1) {
             dt1->sent_time = current_time_monotonic();
         }
     } else {
         conn->maximum_speed_reached = 1;
+        conn->maximum_speed_stream = stream;
         LOGGER_ERROR(c->log, "send_data_packet failed\n");
     }
 
@@ -1231,12 +1926,12 @@ static int handle_data_packet(const Net_Crypto *c, int crypt_connection_id, uint
     return len;
 }
 
-/* Send a request packet.
+/* Send a request packet for stream.
  *
  * return -1 on failure.
  * return 0 on success.
  */
-static int send_request_packet(Net_Crypto *c, int crypt_connection_id)
+static int send_request_packet(Net_Crypto *c, int crypt_connection_id, uint8_t stream)
 {
     Crypto_Connection *conn = get_crypto_connection(c, crypt_connection_id);
 
@@ -1244,41 +1939,110 @@ static int send_request_packet(Net_Crypto *c, int crypt_connection_id)
         return -1;
     }
 
+    const Packets_Array *send_array = stream_send_array(conn, stream);
+    const Packets_Array *recv_array = stream_recv_array(conn, stream);
+
+    if (send_array == nullptr) {
+        return -1;
+    }
+
     uint8_t data[MAX_CRYPTO_DATA_SIZE];
-    int len = generate_request_packet(data, sizeof(data), &conn->recv_array);
+    int len = generate_request_packet(data, sizeof(data), recv_array);
 
     if (len == -1) {
         return -1;
     }
 
-    return send_data_packet_helper(c, crypt_connection_id, conn->recv_array.buffer_start, conn->send_array.buffer_end, data,
-                                   len);
+    return send_stream_data_packet_helper(c, crypt_connection_id, stream, recv_array->buffer_start,
+                                          send_array->buffer_end, data, len);
 }
 
-/* Send up to max num previously requested data packets.
+/* Number of times we tell the peer about our streams before giving up on it
+ * supporting them. */
+#define MAX_NUM_STREAMS_PACKETS 8
+
+/* Send a packet telling the peer how many lossless streams we support,
+ * whether we know how many it does, and whether we can resume the session once
+ * it ends.
+ *
+ * Peers that don't know about streams ignore it, and those that don't know
+ * about resumption its last byte.
  *
  * return -1 on failure.
- * return number of packets sent on success.
+ * return 0 on success.
  */
-static int send_requested_packets(Net_Crypto *c, int crypt_connection_id, uint32_t max_num)
+static int send_streams_packet(Net_Crypto *c, int crypt_connection_id)
 {
-    if (max_num == 0) {
+    Crypto_Connection *conn = get_crypto_connection(c, crypt_connection_id);
+
+    if (conn == nullptr) {
+        return -1;
+    }
+
+    const uint8_t packet[4] = {PACKET_ID_STREAMS, CRYPTO_NUM_STREAMS, conn->peer_streams != 0, c->session_resumption};
+    return send_data_packet_helper(c, crypt_connection_id, conn->recv_array.buffer_start, conn->send_array.buffer_end,
+                                   packet, sizeof(packet));
+}
+
+/* Send a request packet for each stream in use, and tell the peer about our
+ * streams until it knows about them.
+ *
+ * return -1 if a request packet couldn't be sent.
+ * return 0 on success.
+ */
+static int send_request_packets(Net_Crypto *c, int crypt_connection_id)
+{
+    if (send_request_packet(c, crypt_connection_id, CRYPTO_STREAM_DEFAULT) != 0) {
         return -1;
     }
 
+    Crypto_Connection *conn = get_crypto_connection(c, crypt_connection_id);
+    int ret = 0;
+
+    /* The other streams still get theirs if one can't be sent. */
+    for (uint8_t i = 0; i < CRYPTO_NUM_STREAMS; ++i) {
+        if (conn->streams[i] != nullptr && send_request_packet(c, crypt_connection_id, i) != 0) {
+            ret = -1;
+        }
+    }
+
+    if (c->streams && conn->status == CRYPTO_CONN_ESTABLISHED && !conn->streams_heard
+            && conn->streams_packets_sent < MAX_NUM_STREAMS_PACKETS) {
+        if (send_streams_packet(c, crypt_connection_id) == 0) {
+            ++conn->streams_packets_sent;
+        }
+    }
+
+    return ret;
+}
+
+/* Send up to max num previously requested data packets of stream.
+ *
+ * return -1 on failure.
+ * return number of packets sent on success.
+ */
+static int send_requested_stream_packets(Net_Crypto *c, int crypt_connection_id, uint8_t stream, uint32_t max_num)
+{
     Crypto_Connection *conn = get_crypto_connection(c, crypt_connection_id);
 
     if (conn == nullptr) {
         return -1;
     }
 
+    Packets_Array *send_array = stream_send_array(conn, stream);
+    const Packets_Array *recv_array = stream_recv_array(conn, stream);
+
+    if (send_array == nullptr) {
+        return 0;
+    }
+
     uint64_t temp_time = current_time_monotonic();
-    uint32_t i, num_sent = 0, array_size = num_packets_array(&conn->send_array);
+    uint32_t i, num_sent = 0, array_size = num_packets_array(send_array);
 
     for (i = 0; i < array_size; ++i) {
         Packet_Data *dt;
-        uint32_t packet_num = (i + conn->send_array.buffer_start);
-        int ret = get_data_pointer(&conn->send_array, &dt, packet_num);
+        uint32_t packet_num = (i + send_array->buffer_start);
+        int ret = get_data_pointer(send_array, &dt, packet_num);
 
         if (ret == -1) {
             return -1;
@@ -1292,8 +2056,8 @@ static int send_requested_packets(Net_Crypto *c, int crypt_connection_id, uint32
             continue;
         }
 
-        if (send_data_packet_helper(c, crypt_connection_id, conn->recv_array.buffer_start, packet_num, dt->data,
-                                    dt->length) == 0) {
+        if (send_stream_data_packet_helper(c, crypt_connection_id, stream, recv_array->buffer_start, packet_num,
+                                           dt->data, dt->length) == 0) {
             dt->sent_time = temp_time;
             ++num_sent;
         }
@@ -1306,6 +2070,63 @@ static int send_requested_packets(Net_Crypto *c, int crypt_connection_id, uint32
     return num_sent;
 }
 
+/* Send up to max num previously requested data packets, those of each stream
+ * before the ones of the streams after it.
+ *
+ * return -1 on failure.
+ * return number of packets sent on success.
+ */
+static int send_requested_packets(Net_Crypto *c, int crypt_connection_id, uint32_t max_num)
+{
+    if (max_num == 0) {
+        return -1;
+    }
+
+    uint32_t num_sent = 0;
+
+    for (uint8_t i = 0; i < CRYPTO_NUM_STREAMS && num_sent < max_num; ++i) {
+        const int ret = send_requested_stream_packets(c, crypt_connection_id, i, max_num - num_sent);
+
+        if (ret == -1) {
+            return -1;
+        }
+
+        num_sent += ret;
+    }
+
+    return num_sent;
+}
+
+/* Send all data packets not yet acknowledged again, as the peer couldn't read
+ * them with the keys they were sent with.
+ */
+static void resend_all_packets(Net_Crypto *c, int crypt_connection_id)
+{
+    Crypto_Connection *conn = get_crypto_connection(c, crypt_connection_id);
+
+    if (conn == nullptr) {
+        return;
+    }
+
+    for (uint8_t i = 0; i < CRYPTO_NUM_STREAMS; ++i) {
+        Packets_Array *send_array = stream_send_array(conn, i);
+
+        if (send_array == nullptr) {
+            continue;
+        }
+
+        for (uint32_t num = send_array->buffer_start; num != send_array->buffer_end; ++num) {
+            Packet_Data *dt;
+
+            if (get_data_pointer(send_array, &dt, num) == 1) {
+                dt->sent_time = 0;
+            }
+        }
+    }
+
+    send_requested_packets(c, crypt_connection_id, UINT32_MAX);
+}
+
 
 /* Add a new temp packet to send repeatedly.
  *
@@ -1423,6 +2244,92 @@ static int create_send_handshake(Net_Crypto *c, int crypt_connection_id, const u
     return 0;
 }
 
+/* Make a new cookie request the packet the connection sends until it gets a
+ * cookie.
+ *
+ * return -1 on failure.
+ * return 0 on success.
+ */
+static int new_cookie_request(Net_Crypto *c, int crypt_connection_id)
+{
+    Crypto_Connection *conn = get_crypto_connection(c, crypt_connection_id);
+
+    if (conn == nullptr) {
+        return -1;
+    }
+
+    conn->cookie_request_number = random_u64();
+    uint8_t cookie_request[COOKIE_REQUEST_LENGTH];
+
+    if (create_cookie_request(c, cookie_request, conn->dht_public_key, conn->cookie_request_number,
+                              conn->shared_key) != sizeof(cookie_request)) {
+        return -1;
+    }
+
+    return new_temp_packet(c, crypt_connection_id, cookie_request, sizeof(cookie_request));
+}
+
+/* Start the session of the connection with the keys of the ended session
+ * c->resumptions[index] rather than with a cookie request. The connection
+ * sends resumption packets instead, and data packets the peer can read as
+ * soon as it got one. We choose the base nonce of the peer too, so that its
+ * data packets can be read before its handshake comes.
+ *
+ * return -1 on failure.
+ * return 0 on success.
+ */
+static int start_resumption(Net_Crypto *c, int crypt_connection_id, int index)
+{
+    Crypto_Connection *conn = get_crypto_connection(c, crypt_connection_id);
+
+    if (conn == nullptr) {
+        return -1;
+    }
+
+    const Crypto_Resumption *res = &c->resumptions[index];
+    uint8_t packet[RESUMPTION_PACKET_LENGTH];
+    random_nonce(conn->recv_nonce);
+
+    if (create_resumption_packet(c, packet, res, conn->sent_nonce, conn->recv_nonce, conn->sessionpublic_key)
+            != sizeof(packet)
+            || new_temp_packet(c, crypt_connection_id, packet, sizeof(packet)) != 0) {
+        return -1;
+    }
+
+    memcpy(conn->peersessionpublic_key, res->peersessionpublic_key, CRYPTO_PUBLIC_KEY_SIZE);
+    encrypt_precompute(conn->peersessionpublic_key, conn->sessionsecret_key, conn->shared_key);
+    conn->resuming = 1;
+    conn->status = CRYPTO_CONN_NOT_CONFIRMED;
+    return 0;
+}
+
+/* Give up resuming the session of the connection, which the peer may not have
+ * kept, and start a new one with a cookie request.
+ *
+ * return -1 on failure.
+ * return 0 on success.
+ */
+static int fall_back_from_resumption(Net_Crypto *c, int crypt_connection_id)
+{
+    Crypto_Connection *conn = get_crypto_connection(c, crypt_connection_id);
+
+    if (conn == nullptr) {
+        return -1;
+    }
+
+    conn->resuming = 0;
+    conn->last_request_packet_sent = 0;
+    random_nonce(conn->sent_nonce);
+    crypto_new_keypair(conn->sessionpublic_key, conn->sessionsecret_key);
+
+    if (new_cookie_request(c, crypt_connection_id) != 0) {
+        return -1;
+    }
+
+    conn->status = CRYPTO_CONN_COOKIE_REQUESTING;
+    return 0;
+}
+
 /* Send a kill packet.
  *
  * return -1 on failure.
@@ -1478,32 +2385,67 @@ static int handle_data_packet_core(Net_Crypto *c, int crypt_connection_id, const
     uint8_t data[MAX_DATA_DATA_PACKET_SIZE];
     int len = handle_data_packet(c, crypt_connection_id, data, packet, length);
 
-    if (len <= (int)(sizeof(uint32_t) * 2)) {
+    if (len == -1) {
         return -1;
     }
 
+    uint8_t stream = CRYPTO_STREAM_DEFAULT;
     uint32_t buffer_start, num;
-    memcpy(&buffer_start, data, sizeof(uint32_t));
-    memcpy(&num, data + sizeof(uint32_t), sizeof(uint32_t));
-    buffer_start = net_ntohl(buffer_start);
-    num = net_ntohl(num);
+    uint16_t header_length;
+
+    if (packet[0] == NET_PACKET_CRYPTO_STREAM_DATA) {
+        if (!c->streams || len <= (int)STREAM_DATA_HEADER_SIZE) {
+            return -1;
+        }
 
+        stream = data[0];
+
+        /* Only the streams the peer told us it supports, so a peer can't make
+         * us allocate the arrays of streams it never uses. */
+        if (stream == CRYPTO_STREAM_DEFAULT || stream >= CRYPTO_NUM_STREAMS || stream >= conn->peer_streams
+                || open_stream(conn, stream) != 0) {
+            return -1;
+        }
+
+        uint16_t start16, num16;
+        memcpy(&start16, data + 1, sizeof(uint16_t));
+        memcpy(&num16, data + 1 + sizeof(uint16_t), sizeof(uint16_t));
+        buffer_start = stream_packet_number(stream_send_array(conn, stream)->buffer_start, net_ntohs(start16));
+        num = stream_packet_number(stream_recv_array(conn, stream)->buffer_start, net_ntohs(num16));
+        header_length = STREAM_DATA_HEADER_SIZE;
+    } else {
+        if (len <= (int)(sizeof(uint32_t) * 2)) {
+            return -1;
+        }
+
+        memcpy(&buffer_start, data, sizeof(uint32_t));
+        memcpy(&num, data + sizeof(uint32_t), sizeof(uint32_t));
+        buffer_start = net_ntohl(buffer_start);
+        num = net_ntohl(num);
+        header_length = sizeof(uint32_t) * 2;
+    }
+
+    Packets_Array *send_array = stream_send_array(conn, stream);
     uint64_t rtt_calc_time = 0;
 
-    if (buffer_start != conn->send_array.buffer_start) {
+    if (buffer_start != send_array->buffer_start) {
         Packet_Data *packet_time;
 
-        if (get_data_pointer(&conn->send_array, &packet_time, conn->send_array.buffer_start) == 1) {
+        if (get_data_pointer(send_array, &packet_time, send_array->buffer_start) == 1) {
             rtt_calc_time = packet_time->sent_time;
         }
 
-        if (clear_buffer_until(&conn->send_array, buffer_start) != 0) {
+        const uint32_t acked = buffer_start - send_array->buffer_start;
+
+        if (clear_buffer_until(&c->packet_pool, send_array, buffer_start) != 0) {
             return -1;
         }
+
+        conn->packets_acked += acked;
     }
 
-    uint8_t *real_data = data + (sizeof(uint32_t) * 2);
-    uint16_t real_length = len - (sizeof(uint32_t) * 2);
+    uint8_t *real_data = data + header_length;
+    uint16_t real_length = len - header_length;
 
     while (real_data[0] == PACKET_ID_PADDING) { /* Remove Padding */
         ++real_data;
@@ -1522,6 +2464,14 @@ static int handle_data_packet_core(Net_Crypto *c, int crypt_connection_id, const
     if (conn->status == CRYPTO_CONN_NOT_CONFIRMED) {
         clear_temp_packet(c, crypt_connection_id);
         conn->status = CRYPTO_CONN_ESTABLISHED;
+        conn->resuming = 0;
+
+        /* The session with the peer that ended, if any, can't be resumed any more. */
+        const int resumption = find_resumption(c, conn->public_key);
+
+        if (resumption != -1) {
+            forget_resumption(c, resumption);
+        }
 
         if (conn->connection_status_callback) {
             conn->connection_status_callback(conn->connection_status_callback_object, conn->connection_status_callback_id, 1,
@@ -1538,25 +2488,53 @@ static int handle_data_packet_core(Net_Crypto *c, int crypt_connection_id, const
             rtt_time = DEFAULT_TCP_PING_CONNECTION;
         }
 
-        int requested = handle_request_packet(&conn->send_array, real_data, real_length, &rtt_calc_time, rtt_time);
+        int requested = handle_request_packet(&c->packet_pool, send_array, real_data, real_length,
+                                              &rtt_calc_time, rtt_time);
 
         if (requested == -1) {
             return -1;
         }
 
-        set_buffer_end(&conn->recv_array, num);
+        set_buffer_end(stream_recv_array(conn, stream), num);
+    } else if (real_data[0] == PACKET_ID_STREAMS) {
+        if (real_length < 3) {
+            return -1;
+        }
+
+        conn->peer_streams = real_data[1];
+
+        if (real_data[2]) {
+            conn->streams_heard = 1;
+        }
+
+        conn->peer_resumption = real_length >= 4 && real_data[3];
+
+        set_buffer_end(stream_recv_array(conn, stream), num);
     } else if (real_data[0] >= CRYPTO_RESERVED_PACKETS && real_data[0] < PACKET_ID_LOSSY_RANGE_START) {
         Packet_Data dt;
         dt.length = real_length;
         memcpy(dt.data, real_data, real_length);
 
-        if (add_data_to_buffer(&conn->recv_array, num, &dt) != 0) {
+        Packets_Array *recv_array = stream_recv_array(conn, stream);
+
+        if (stream != CRYPTO_STREAM_DEFAULT && !stream_packet_in_window(recv_array->buffer_start, num)) {
+            return -1;
+        }
+
+        if (add_data_to_buffer(&c->packet_pool, recv_array, num, &dt) != 0) {
             return -1;
         }
 
         while (1) {
+            recv_array = stream_recv_array(conn, stream);
+
+            /* The connection might have been replaced by one not using the stream. */
+            if (recv_array == nullptr) {
+                return -1;
+            }
+
             pthread_mutex_lock(&conn->mutex);
-            int ret = read_data_beg_buffer(&conn->recv_array, &dt);
+            int ret = read_data_beg_buffer(&c->packet_pool, recv_array, &dt);
             pthread_mutex_unlock(&conn->mutex);
 
             if (ret == -1) {
@@ -1581,7 +2559,7 @@ static int handle_data_packet_core(Net_Crypto *c, int crypt_connection_id, const
     } else if (real_data[0] >= PACKET_ID_LOSSY_RANGE_START &&
                real_data[0] < (PACKET_ID_LOSSY_RANGE_START + PACKET_ID_LOSSY_RANGE_SIZE)) {
 
-        set_buffer_end(&conn->recv_array, num);
+        set_buffer_end(stream_recv_array(conn, stream), num);
 
         if (conn->connection_lossy_data_callback) {
             conn->connection_lossy_data_callback(conn->connection_lossy_data_callback_object,
@@ -1592,11 +2570,14 @@ static int handle_data_packet_core(Net_Crypto *c, int crypt_connection_id, const
     }
 
     if (rtt_calc_time != 0) {
-        uint64_t rtt_time = current_time_monotonic() - rtt_calc_time;
+        const uint64_t now = current_time_monotonic();
+        uint64_t rtt_time = now - rtt_calc_time;
 
         if (rtt_time < conn->rtt_time) {
             conn->rtt_time = rtt_time;
         }
+
+        congestion_rtt(&conn->congestion, rtt_time, now);
     }
 
     return 0;
@@ -1651,6 +2632,10 @@ static int handle_packet_connection(Net_Crypto *c, int crypt_connection_id, cons
                 uint8_t peer_real_pk[CRYPTO_PUBLIC_KEY_SIZE];
                 uint8_t dht_public_key[CRYPTO_PUBLIC_KEY_SIZE];
                 uint8_t cookie[COOKIE_LENGTH];
+                /* A peer that took our resumption packet answers with the
+                 * session public key it had in the ended session. */
+                uint8_t resumed_session_pk[CRYPTO_PUBLIC_KEY_SIZE];
+                memcpy(resumed_session_pk, conn->peersessionpublic_key, CRYPTO_PUBLIC_KEY_SIZE);
 
                 if (handle_crypto_handshake(c, conn->recv_nonce, conn->peersessionpublic_key, peer_real_pk, dht_public_key, cookie,
                                             packet, length, conn->public_key) != 0) {
@@ -1660,12 +2645,16 @@ static int handle_packet_connection(Net_Crypto *c, int crypt_connection_id, cons
                 if (public_key_cmp(dht_public_key, conn->dht_public_key) == 0) {
                     encrypt_precompute(conn->peersessionpublic_key, conn->sessionsecret_key, conn->shared_key);
 
-                    if (conn->status == CRYPTO_CONN_COOKIE_REQUESTING) {
+                    const bool resumed = conn->resuming
+                                         && public_key_cmp(conn->peersessionpublic_key, resumed_session_pk) == 0;
+
+                    if (conn->status == CRYPTO_CONN_COOKIE_REQUESTING || (conn->resuming && !resumed)) {
                         if (create_send_handshake(c, crypt_connection_id, cookie, dht_public_key) != 0) {
                             return -1;
                         }
                     }
 
+                    conn->resuming = 0;
                     conn->status = CRYPTO_CONN_NOT_CONFIRMED;
                 } else {
                     if (conn->dht_pk_callback) {
@@ -1679,7 +2668,8 @@ static int handle_packet_connection(Net_Crypto *c, int crypt_connection_id, cons
             return 0;
         }
 
-        case NET_PACKET_CRYPTO_DATA: {
+        case NET_PACKET_CRYPTO_DATA:
+        case NET_PACKET_CRYPTO_STREAM_DATA: {
             if (conn->status == CRYPTO_CONN_NOT_CONFIRMED || conn->status == CRYPTO_CONN_ESTABLISHED) {
                 return handle_data_packet_core(c, crypt_connection_id, packet, length, udp, userdata);
             }
@@ -1706,18 +2696,41 @@ static int realloc_cryptoconnection(Net_Crypto *c, uint32_t num)
         return 0;
     }
 
-    Crypto_Connection *newcrypto_connections = (Crypto_Connection *)realloc(c->crypto_connections,
-            num * sizeof(Crypto_Connection));
+    Crypto_Connection *newcrypto_connections = (Crypto_Connection *)realloc(c->crypto_connections,
+            num * sizeof(Crypto_Connection));
+
+    if (newcrypto_connections == nullptr) {
+        return -1;
+    }
+
+    c->crypto_connections = newcrypto_connections;
+    return 0;
+}
+
+
+/* Allocate the arrays of the default stream of a connection, unless they are
+ * left from one that failed to start.
+ *
+ * return -1 on failure.
+ * return connection id on success.
+ */
+static int init_crypto_connection_arrays(Net_Crypto *c, int crypt_connection_id)
+{
+    Crypto_Connection *conn = &c->crypto_connections[crypt_connection_id];
+
+    if (conn->send_array.buffer != nullptr) {
+        return crypt_connection_id;
+    }
 
-    if (newcrypto_connections == nullptr) {
+    if (init_packets_array(&conn->send_array, CRYPTO_PACKET_BUFFER_SIZE) != 0
+            || init_packets_array(&conn->recv_array, CRYPTO_PACKET_BUFFER_SIZE) != 0) {
+        free_packets_array(&conn->send_array);
         return -1;
     }
 
-    c->crypto_connections = newcrypto_connections;
-    return 0;
+    return crypt_connection_id;
 }
 
-
 /* Create a new empty crypto connection.
  *
  * return -1 on failure.
@@ -1729,7 +2742,7 @@ static int create_crypto_connection(Net_Crypto *c)
 
     for (i = 0; i < c->crypto_connections_length; ++i) {
         if (c->crypto_connections[i].status == CRYPTO_CONN_NO_CONNECTION) {
-            return i;
+            return init_crypto_connection_arrays(c, i);
         }
     }
 
@@ -1751,15 +2764,15 @@ static int create_crypto_connection(Net_Crypto *c)
         memset(&c->crypto_connections[id], 0, sizeof(Crypto_Connection));
         // Memsetting float/double to 0 is non-portable, so we explicitly set them to 0
         c->crypto_connections[id].packet_recv_rate = 0;
-        c->crypto_connections[id].packet_send_rate = 0;
         c->crypto_connections[id].last_packets_left_rem = 0;
-        c->crypto_connections[id].packet_send_rate_requested = 0;
         c->crypto_connections[id].last_packets_left_requested_rem = 0;
 
         if (pthread_mutex_init(&c->crypto_connections[id].mutex, nullptr) != 0) {
             pthread_mutex_unlock(&c->connections_mutex);
             return -1;
         }
+
+        id = init_crypto_connection_arrays(c, id);
     }
 
     pthread_mutex_unlock(&c->connections_mutex);
@@ -1779,6 +2792,9 @@ static int wipe_crypto_connection(Net_Crypto *c, int crypt_connection_id)
 
     uint32_t i;
 
+    free_packets_array(&c->crypto_connections[crypt_connection_id].send_array);
+    free_packets_array(&c->crypto_connections[crypt_connection_id].recv_array);
+
     /* Keep mutex, only destroy it when connection is realloced out. */
     pthread_mutex_t mutex = c->crypto_connections[crypt_connection_id].mutex;
     crypto_memzero(&c->crypto_connections[crypt_connection_id], sizeof(Crypto_Connection));
@@ -1786,6 +2802,8 @@ static int wipe_crypto_connection(Net_Crypto *c, int crypt_connection_id)
 
     for (i = c->crypto_connections_length; i != 0; --i) {
         if (c->crypto_connections[i - 1].status == CRYPTO_CONN_NO_CONNECTION) {
+            free_packets_array(&c->crypto_connections[i - 1].send_array);
+            free_packets_array(&c->crypto_connections[i - 1].recv_array);
             pthread_mutex_destroy(&c->crypto_connections[i - 1].mutex);
         } else {
             break;
@@ -1890,6 +2908,7 @@ static int handle_new_connection_handshake(Net_Crypto *c, IP_Port source, const
 
     n_c.source = source;
     n_c.cookie_length = COOKIE_LENGTH;
+    n_c.resumption = -1;
 
     if (handle_crypto_handshake(c, n_c.recv_nonce, n_c.peersessionpublic_key, n_c.public_key, n_c.dht_public_key,
                                 n_c.cookie, data, length, nullptr) != 0) {
@@ -1930,6 +2949,80 @@ static int handle_new_connection_handshake(Net_Crypto *c, IP_Port source, const
     return ret;
 }
 
+/* Handle a resumption packet by someone who wants to start a new session with
+ * us with the keys of an ended one. Like a handshake, it makes a new
+ * connection through the callback set by new_connection_handler(), or is
+ * taken by the connection we are making to that peer if it has no session
+ * yet. Either way the ended session is forgotten, so that the packet can't be
+ * used again.
+ *
+ * return -1 on failure.
+ * return 0 on success.
+ */
+static int handle_resumption(Net_Crypto *c, IP_Port source, const uint8_t *data, uint16_t length)
+{
+    if (!c->session_resumption) {
+        return -1;
+    }
+
+    New_Connection n_c;
+    uint8_t cookie[COOKIE_LENGTH];
+
+    if (handle_resumption_packet(c, &n_c.resumption, n_c.recv_nonce, n_c.sent_nonce, n_c.peersessionpublic_key,
+                                 cookie, data, length) != 0) {
+        return -1;
+    }
+
+    const Crypto_Resumption *res = &c->resumptions[n_c.resumption];
+    const int crypt_connection_id = getcryptconnection_id(c, res->public_key);
+
+    if (crypt_connection_id == -1) {
+        n_c.source = source;
+        memcpy(n_c.public_key, res->public_key, CRYPTO_PUBLIC_KEY_SIZE);
+        memcpy(n_c.dht_public_key, res->dht_public_key, CRYPTO_PUBLIC_KEY_SIZE);
+        n_c.cookie = cookie;
+        n_c.cookie_length = COOKIE_LENGTH;
+        return c->new_connection_callback(c->new_connection_callback_object, &n_c);
+    }
+
+    Crypto_Connection *conn = get_crypto_connection(c, crypt_connection_id);
+
+    /* When both of us are resuming the session, the packet of the one with
+     * the lower real public key wins. A packet of our own sent back to us has
+     * our session public key. */
+    const bool resuming_second = conn->resuming
+                                 && memcmp(c->self_public_key, conn->public_key, CRYPTO_PUBLIC_KEY_SIZE) > 0;
+
+    if ((conn->status != CRYPTO_CONN_COOKIE_REQUESTING && !resuming_second)
+            || public_key_cmp(n_c.peersessionpublic_key, conn->sessionpublic_key) == 0
+            || public_key_cmp(res->dht_public_key, conn->dht_public_key) != 0) {
+        return -1;
+    }
+
+    memcpy(conn->recv_nonce, n_c.recv_nonce, CRYPTO_NONCE_SIZE);
+    memcpy(conn->sent_nonce, n_c.sent_nonce, CRYPTO_NONCE_SIZE);
+    memcpy(conn->peersessionpublic_key, n_c.peersessionpublic_key, CRYPTO_PUBLIC_KEY_SIZE);
+    memcpy(conn->sessionpublic_key, res->sessionpublic_key, CRYPTO_PUBLIC_KEY_SIZE);
+    memcpy(conn->sessionsecret_key, res->sessionsecret_key, CRYPTO_SECRET_KEY_SIZE);
+    encrypt_precompute(conn->peersessionpublic_key, conn->sessionsecret_key, conn->shared_key);
+    forget_resumption(c, n_c.resumption);
+    /* The peer can't read what we sent with our own keys. */
+    conn->last_request_packet_sent = 0;
+
+    crypto_connection_add_source(c, crypt_connection_id, source);
+
+    if (create_send_handshake(c, crypt_connection_id, cookie, conn->dht_public_key) != 0) {
+        return -1;
+    }
+
+    /* Nor the data we sent while resuming. */
+    resend_all_packets(c, crypt_connection_id);
+
+    conn->resuming = 0;
+    conn->status = CRYPTO_CONN_NOT_CONFIRMED;
+    return 0;
+}
+
 /* Accept a crypto connection.
  *
  * return -1 on failure.
@@ -1949,7 +3042,8 @@ int accept_crypto_connection(Net_Crypto *c, New_Connection *n_c)
 
     Crypto_Connection *conn = &c->crypto_connections[crypt_connection_id];
 
-    if (n_c->cookie_length != COOKIE_LENGTH) {
+    if (n_c->cookie_length != COOKIE_LENGTH
+            || n_c->resumption < -1 || n_c->resumption >= CRYPTO_RESUMPTION_CACHE_SIZE) {
         return -1;
     }
 
@@ -1965,8 +3059,19 @@ int accept_crypto_connection(Net_Crypto *c, New_Connection *n_c)
     memcpy(conn->public_key, n_c->public_key, CRYPTO_PUBLIC_KEY_SIZE);
     memcpy(conn->recv_nonce, n_c->recv_nonce, CRYPTO_NONCE_SIZE);
     memcpy(conn->peersessionpublic_key, n_c->peersessionpublic_key, CRYPTO_PUBLIC_KEY_SIZE);
-    random_nonce(conn->sent_nonce);
-    crypto_new_keypair(conn->sessionpublic_key, conn->sessionsecret_key);
+
+    if (n_c->resumption == -1) {
+        random_nonce(conn->sent_nonce);
+        crypto_new_keypair(conn->sessionpublic_key, conn->sessionsecret_key);
+    } else {
+        /* Our session keys stay those of the resumed session, and it can't
+         * be resumed again. */
+        memcpy(conn->sent_nonce, n_c->sent_nonce, CRYPTO_NONCE_SIZE);
+        memcpy(conn->sessionpublic_key, c->resumptions[n_c->resumption].sessionpublic_key, CRYPTO_PUBLIC_KEY_SIZE);
+        memcpy(conn->sessionsecret_key, c->resumptions[n_c->resumption].sessionsecret_key, CRYPTO_SECRET_KEY_SIZE);
+        forget_resumption(c, n_c->resumption);
+    }
+
     encrypt_precompute(conn->peersessionpublic_key, conn->sessionsecret_key, conn->shared_key);
     conn->status = CRYPTO_CONN_NOT_CONFIRMED;
 
@@ -1979,8 +3084,7 @@ int accept_crypto_connection(Net_Crypto *c, New_Connection *n_c)
     }
 
     memcpy(conn->dht_public_key, n_c->dht_public_key, CRYPTO_PUBLIC_KEY_SIZE);
-    conn->packet_send_rate = CRYPTO_PACKET_MIN_RATE;
-    conn->packet_send_rate_requested = CRYPTO_PACKET_MIN_RATE;
+    congestion_init(&conn->congestion, c->congestion_type);
     conn->packets_left = CRYPTO_MIN_QUEUE_LENGTH;
     conn->rtt_time = DEFAULT_PING_CONNECTION;
     crypto_connection_add_source(c, crypt_connection_id, n_c->source);
@@ -2026,18 +3130,19 @@ int new_crypto_connection(Net_Crypto *c, const uint8_t *real_public_key, const u
     random_nonce(conn->sent_nonce);
     crypto_new_keypair(conn->sessionpublic_key, conn->sessionsecret_key);
     conn->status = CRYPTO_CONN_COOKIE_REQUESTING;
-    conn->packet_send_rate = CRYPTO_PACKET_MIN_RATE;
-    conn->packet_send_rate_requested = CRYPTO_PACKET_MIN_RATE;
+    congestion_init(&conn->congestion, c->congestion_type);
     conn->packets_left = CRYPTO_MIN_QUEUE_LENGTH;
     conn->rtt_time = DEFAULT_PING_CONNECTION;
     memcpy(conn->dht_public_key, dht_public_key, CRYPTO_PUBLIC_KEY_SIZE);
 
-    conn->cookie_request_number = random_u64();
-    uint8_t cookie_request[COOKIE_REQUEST_LENGTH];
+    const int resumption = c->session_resumption ? find_resumption(c, real_public_key) : -1;
 
-    if (create_cookie_request(c, cookie_request, conn->dht_public_key, conn->cookie_request_number,
-                              conn->shared_key) != sizeof(cookie_request)
-            || new_temp_packet(c, crypt_connection_id, cookie_request, sizeof(cookie_request)) != 0) {
+    if (resumption != -1 && public_key_cmp(c->resumptions[resumption].dht_public_key, dht_public_key) == 0
+            && start_resumption(c, crypt_connection_id, resumption) == 0) {
+        return crypt_connection_id;
+    }
+
+    if (new_cookie_request(c, crypt_connection_id) != 0) {
         pthread_mutex_lock(&c->tcp_mutex);
         kill_tcp_connection_to(c->tcp_c, conn->connection_number_tcp);
         pthread_mutex_unlock(&c->tcp_mutex);
@@ -2106,7 +3211,18 @@ static int tcp_data_callback(void *object, int id, const uint8_t *data, uint16_t
     // This unlocks the mutex that at this point is locked by do_tcp before
     // calling do_tcp_connections.
     pthread_mutex_unlock(&c->tcp_mutex);
-    int ret = handle_packet_connection(c, id, data, length, 0, userdata);
+    int ret;
+
+    if (data[0] == NET_PACKET_CRYPTO_RESUME) {
+        /* Only taken by the connection it came through, which needs no source. */
+        IP_Port source;
+        ip_reset(&source.ip);
+        source.port = 0;
+        ret = handle_resumption(c, source, data, length);
+    } else {
+        ret = handle_packet_connection(c, id, data, length, 0, userdata);
+    }
+
     pthread_mutex_lock(&c->tcp_mutex);
 
     if (ret != 0) {
@@ -2130,12 +3246,16 @@ static int tcp_oob_callback(void *object, const uint8_t *public_key, unsigned in
         return tcp_oob_handle_cookie_request(c, tcp_connections_number, public_key, data, length);
     }
 
-    if (data[0] == NET_PACKET_CRYPTO_HS) {
+    if (data[0] == NET_PACKET_CRYPTO_HS || data[0] == NET_PACKET_CRYPTO_RESUME) {
         IP_Port source;
         source.port = 0;
         source.ip.family = net_family_tcp_family;
         source.ip.ip.v6.uint32[0] = tcp_connections_number;
 
+        if (data[0] == NET_PACKET_CRYPTO_RESUME) {
+            return handle_resumption(c, source, data, length);
+        }
+
         if (handle_new_connection_handshake(c, source, data, length, userdata) != 0) {
             return -1;
         }
@@ -2365,16 +3485,68 @@ int nc_dht_pk_callback(Net_Crypto *c, int crypt_connection_id, void (*function)(
  */
 static int crypto_id_ip_port(const Net_Crypto *c, IP_Port ip_port)
 {
-    return bs_list_find(&c->ip_port_list, (uint8_t *)&ip_port);
+    uint8_t key[SIZE_IPPORT];
+    ipport_key(&ip_port, key);
+    return hash_table_find(&c->ip_port_table, key);
 }
 
 #define CRYPTO_MIN_PACKET_SIZE (1 + sizeof(uint16_t) + CRYPTO_MAC_SIZE)
 
+static void real_key_computed(void *object, const uint8_t *public_key, const uint8_t *shared_key, IP_Port source,
+                              const uint8_t *packet, uint16_t length, void *userdata)
+{
+    Net_Crypto *c = (Net_Crypto *)object;
+    shared_key_cache_put(c->real_keys, public_key, shared_key);
+    networking_dispatch(dht_get_net(c->dht), source, packet, length, userdata);
+}
+
+/* If the network has a crypto pool and we don't have the key shared with the
+ * real public key of the sender of a handshake yet, compute it on the pool and
+ * handle the handshake once it is ready.
+ *
+ * return true if the handshake must not be handled now.
+ */
+static bool defer_handshake(Net_Crypto *c, IP_Port source, const uint8_t *packet, uint16_t length)
+{
+    Crypto_Pool *const pool = networking_crypto_pool(dht_get_net(c->dht));
+    uint8_t cookie_plain[COOKIE_DATA_LENGTH];
+
+    if (pool == nullptr || length != HANDSHAKE_PACKET_LENGTH
+            || open_cookie(cookie_plain, packet + 1, c->secret_symmetric_key) != 0) {
+        return false;
+    }
+
+    if (shared_key_cache_contains(c->real_keys, cookie_plain)) {
+        return false;
+    }
+
+    if (crypto_pool_precompute(pool, cookie_plain, c->self_secret_key, source, packet, length,
+                               &real_key_computed, c) != 0) {
+        LOGGER_TRACE(c->log, "crypto pool full, dropping handshake");
+    }
+
+    return true;
+}
+
+/* Forget the keys shared with our old secret key, and the sessions made with it. */
+static void clear_real_keys(Net_Crypto *c)
+{
+    shared_key_cache_clear(c->real_keys);
+    crypto_memzero(c->resumptions, sizeof(c->resumptions));
+
+    Crypto_Pool *const pool = networking_crypto_pool(dht_get_net(c->dht));
+
+    if (pool != nullptr) {
+        crypto_pool_cancel(pool, c);
+    }
+}
+
 /* Handle raw UDP packets coming directly from the socket.
  *
  * Handles:
  * Cookie response packets.
  * Crypto handshake packets.
+ * Resumption packets.
  * Crypto data packets.
  *
  */
@@ -2385,6 +3557,19 @@ static int udp_handle_packet(void *object, IP_Port source, const uint8_t *packet
     }
 
     Net_Crypto *c = (Net_Crypto *)object;
+
+    if (packet[0] == NET_PACKET_CRYPTO_HS && defer_handshake(c, source, packet, length)) {
+        return 0;
+    }
+
+    if (packet[0] == NET_PACKET_CRYPTO_RESUME) {
+        if (handle_resumption(c, source, packet, length) != 0) {
+            return 1;
+        }
+
+        return 0;
+    }
+
     int crypt_connection_id = crypto_id_ip_port(c, source);
 
     if (crypt_connection_id == -1) {
@@ -2423,21 +3608,99 @@ static int udp_handle_packet(void *object, IP_Port source, const uint8_t *packet
 
 /* The dT for the average packet receiving rate calculations.
    Also used as the */
-#define PACKET_COUNTER_AVERAGE_INTERVAL 50
+#define PACKET_COUNTER_AVERAGE_INTERVAL CONGESTION_SAMPLE_INTERVAL
 
 /* Ratio of recv queue size / recv packet rate (in seconds) times
  * the number of ms between request packets to send at that ratio
  */
 #define REQUEST_PACKETS_COMPARE_CONSTANT (0.125 * 100.0)
 
-/* Timeout for increasing speed after congestion event (in ms). */
-#define CONGESTION_EVENT_TIMEOUT 1000
+/* The rate in packets a second pacing lets the lossy packets of conn out at:
+ * faster than they were given to it lately, and fast enough to empty a full
+ * queue within PACKET_COUNTER_AVERAGE_INTERVAL.
+ */
+static double lossy_pacing_rate(const Crypto_Connection *conn)
+{
+    const double rate = conn->lossy_send_rate * CRYPTO_LOSSY_PACING_GAIN;
+    const double min_rate = CRYPTO_LOSSY_QUEUE_SIZE * 1000.0 / PACKET_COUNTER_AVERAGE_INTERVAL;
+
+    return rate > min_rate ? rate : min_rate;
+}
+
+/* Hold back a lossy packet for send_lossy_queue() if pacing doesn't let it out
+ * now. conn->mutex must be held.
+ *
+ * return 0 if the packet was queued.
+ * return -1 if it should be sent now.
+ */
+static int pace_lossy_packet(Net_Crypto *c, Crypto_Connection *conn, const uint8_t *data, uint16_t length,
+                             uint64_t now)
+{
+    if (conn->lossy_queue_length == 0 && congestion_pace(&conn->lossy_pacer, lossy_pacing_rate(conn), now, 1) == 1) {
+        return -1;
+    }
+
+    /* Rather than dropping packets, send them at once when the queue is
+     * full. */
+    if (conn->lossy_queue_length == CRYPTO_LOSSY_QUEUE_SIZE) {
+        return -1;
+    }
+
+    Packet_Data dt;
+    dt.sent_time = now;
+    dt.length = length;
+    memcpy(dt.data, data, length);
+    Packet_Data *packet = packet_pool_get(&c->packet_pool, &dt);
+
+    if (packet == nullptr) {
+        return -1;
+    }
+
+    conn->lossy_queue[(conn->lossy_queue_start + conn->lossy_queue_length) % CRYPTO_LOSSY_QUEUE_SIZE] = packet;
+    ++conn->lossy_queue_length;
+    return 0;
+}
 
-/* If the send queue is SEND_QUEUE_RATIO times larger than the
- * calculated link speed the packet send speed will be reduced
- * by a value depending on this number.
+/* Send the lossy packets held back by pacing that it lets out by now.
+ *
+ * return the number of packets sent.
  */
-#define SEND_QUEUE_RATIO 2.0
+static uint32_t send_lossy_queue(Net_Crypto *c, int crypt_connection_id, uint64_t now)
+{
+    Crypto_Connection *conn = get_crypto_connection(c, crypt_connection_id);
+
+    if (conn == nullptr) {
+        return 0;
+    }
+
+    uint32_t sent = 0;
+
+    while (true) {
+        Packet_Data *packet = nullptr;
+
+        pthread_mutex_lock(&conn->mutex);
+
+        if (conn->lossy_queue_length > 0 && congestion_pace(&conn->lossy_pacer, lossy_pacing_rate(conn), now, 1) == 1) {
+            packet = conn->lossy_queue[conn->lossy_queue_start];
+            conn->lossy_queue_start = (conn->lossy_queue_start + 1) % CRYPTO_LOSSY_QUEUE_SIZE;
+            --conn->lossy_queue_length;
+        }
+
+        const uint32_t buffer_start = conn->recv_array.buffer_start;
+        const uint32_t buffer_end = conn->send_array.buffer_end;
+        pthread_mutex_unlock(&conn->mutex);
+
+        if (packet == nullptr) {
+            break;
+        }
+
+        send_data_packet_helper(c, crypt_connection_id, buffer_start, buffer_end, packet->data, packet->length);
+        packet_pool_put(&c->packet_pool, packet);
+        ++sent;
+    }
+
+    return sent;
+}
 
 static void send_crypto_packets(Net_Crypto *c)
 {
@@ -2445,6 +3708,7 @@ static void send_crypto_packets(Net_Crypto *c)
     uint64_t temp_time = current_time_monotonic();
     double total_send_rate = 0;
     uint32_t peak_request_packet_interval = ~0;
+    double peak_lossy_pacing_rate = 0;
 
     for (i = 0; i < c->crypto_connections_length; ++i) {
         Crypto_Connection *conn = get_crypto_connection(c, i);
@@ -2454,20 +3718,24 @@ static void send_crypto_packets(Net_Crypto *c)
         }
 
         if ((CRYPTO_SEND_PACKET_INTERVAL + conn->temp_packet_sent_time) < temp_time) {
+            if (conn->resuming && conn->temp_packet_num_sent >= MAX_NUM_RESUMPTION_TRIES) {
+                fall_back_from_resumption(c, i);
+            }
+
             send_temp_packet(c, i);
         }
 
         if ((conn->status == CRYPTO_CONN_NOT_CONFIRMED || conn->status == CRYPTO_CONN_ESTABLISHED)
                 && (CRYPTO_SEND_PACKET_INTERVAL + conn->last_request_packet_sent) < temp_time) {
-            if (send_request_packet(c, i) == 0) {
+            if (send_request_packets(c, i) == 0) {
                 conn->last_request_packet_sent = temp_time;
             }
         }
 
         if (conn->status == CRYPTO_CONN_ESTABLISHED) {
             if (conn->packet_recv_rate > CRYPTO_PACKET_MIN_RATE) {
-                double request_packet_interval = (REQUEST_PACKETS_COMPARE_CONSTANT / ((num_packets_array(
-                                                      &conn->recv_array) + 1.0) / (conn->packet_recv_rate + 1.0)));
+                double request_packet_interval = (REQUEST_PACKETS_COMPARE_CONSTANT / ((num_packets_recv_streams(
+                                                      conn) + 1.0) / (conn->packet_recv_rate + 1.0)));
 
                 double request_packet_interval2 = ((CRYPTO_PACKET_MIN_RATE / conn->packet_recv_rate) *
                                                    (double)CRYPTO_SEND_PACKET_INTERVAL) + (double)PACKET_COUNTER_AVERAGE_INTERVAL;
@@ -2485,7 +3753,7 @@ static void send_crypto_packets(Net_Crypto *c)
                 }
 
                 if (temp_time - conn->last_request_packet_sent > (uint64_t)request_packet_interval) {
-                    if (send_request_packet(c, i) == 0) {
+                    if (send_request_packets(c, i) == 0) {
                         conn->last_request_packet_sent = temp_time;
                     }
                 }
@@ -2503,106 +3771,54 @@ static void send_crypto_packets(Net_Crypto *c)
                 conn->packet_counter = 0;
                 conn->packet_counter_set = temp_time;
 
-                uint32_t packets_sent = conn->packets_sent;
-                conn->packets_sent = 0;
+                pthread_mutex_lock(&conn->mutex);
+                conn->lossy_send_rate = (double)conn->lossy_counter / (dt / 1000.0);
+                conn->lossy_counter = 0;
+                pthread_mutex_unlock(&conn->mutex);
 
-                uint32_t packets_resent = conn->packets_resent;
+                Congestion_Sample sample;
+                sample.time = temp_time;
+                sample.packets_sent = conn->packets_sent;
+                sample.packets_resent = conn->packets_resent;
+                sample.packets_acked = conn->packets_acked;
+                sample.send_queue = num_packets_sent_streams(conn);
+                sample.min_rtt = conn->rtt_time;
+                sample.last_congestion_event = conn->last_congestion_event;
+                conn->packets_sent = 0;
                 conn->packets_resent = 0;
-
-                /* conjestion control
-                    calculate a new value of conn->packet_send_rate based on some data
-                 */
-
-                unsigned int pos = conn->last_sendqueue_counter % CONGESTION_QUEUE_ARRAY_SIZE;
-                conn->last_sendqueue_size[pos] = num_packets_array(&conn->send_array);
-                ++conn->last_sendqueue_counter;
-
-                long signed int sum = 0;
-                sum = (long signed int)conn->last_sendqueue_size[(pos) % CONGESTION_QUEUE_ARRAY_SIZE] -
-                      (long signed int)conn->last_sendqueue_size[(pos - (CONGESTION_QUEUE_ARRAY_SIZE - 1)) % CONGESTION_QUEUE_ARRAY_SIZE];
-
-                unsigned int n_p_pos = conn->last_sendqueue_counter % CONGESTION_LAST_SENT_ARRAY_SIZE;
-                conn->last_num_packets_sent[n_p_pos] = packets_sent;
-                conn->last_num_packets_resent[n_p_pos] = packets_resent;
+                conn->packets_acked = 0;
 
                 bool direct_connected = 0;
                 crypto_connection_status(c, i, &direct_connected, nullptr);
 
-                if (direct_connected && conn->last_tcp_sent + CONGESTION_EVENT_TIMEOUT > temp_time) {
-                    /* When switching from TCP to UDP, don't change the packet send rate for CONGESTION_EVENT_TIMEOUT ms. */
-                } else {
-                    long signed int total_sent = 0, total_resent = 0;
-
-                    // TODO(irungentoo): use real delay
-                    unsigned int delay = (unsigned int)((conn->rtt_time / PACKET_COUNTER_AVERAGE_INTERVAL) + 0.5);
-                    unsigned int packets_set_rem_array = (CONGESTION_LAST_SENT_ARRAY_SIZE - CONGESTION_QUEUE_ARRAY_SIZE);
-
-                    if (delay > packets_set_rem_array) {
-                        delay = packets_set_rem_array;
-                    }
-
-                    for (unsigned j = 0; j < CONGESTION_QUEUE_ARRAY_SIZE; ++j) {
-                        unsigned int ind = (j + (packets_set_rem_array  - delay) + n_p_pos) % CONGESTION_LAST_SENT_ARRAY_SIZE;
-                        total_sent += conn->last_num_packets_sent[ind];
-                        total_resent += conn->last_num_packets_resent[ind];
-                    }
-
-                    if (sum > 0) {
-                        total_sent -= sum;
-                    } else {
-                        if (total_resent > -sum) {
-                            total_resent = -sum;
-                        }
-                    }
-
-                    /* if queue is too big only allow resending packets. */
-                    uint32_t npackets = num_packets_array(&conn->send_array);
-                    double min_speed = 1000.0 * (((double)(total_sent)) / ((double)(CONGESTION_QUEUE_ARRAY_SIZE) *
-                                                 PACKET_COUNTER_AVERAGE_INTERVAL));
-
-                    double min_speed_request = 1000.0 * (((double)(total_sent + total_resent)) / ((double)(
-                            CONGESTION_QUEUE_ARRAY_SIZE) * PACKET_COUNTER_AVERAGE_INTERVAL));
-
-                    if (min_speed < CRYPTO_PACKET_MIN_RATE) {
-                        min_speed = CRYPTO_PACKET_MIN_RATE;
-                    }
-
-                    double send_array_ratio = (((double)npackets) / min_speed);
+                /* When switching from TCP to UDP, don't change the packet send rate for CONGESTION_EVENT_TIMEOUT ms. */
+                sample.hold_rates = direct_connected && conn->last_tcp_sent + CONGESTION_EVENT_TIMEOUT > temp_time;
 
-                    // TODO(irungentoo): Improve formula?
-                    if (send_array_ratio > SEND_QUEUE_RATIO && CRYPTO_MIN_QUEUE_LENGTH < npackets) {
-                        conn->packet_send_rate = min_speed * (1.0 / (send_array_ratio / SEND_QUEUE_RATIO));
-                    } else if (conn->last_congestion_event + CONGESTION_EVENT_TIMEOUT < temp_time) {
-                        conn->packet_send_rate = min_speed * 1.2;
-                    } else {
-                        conn->packet_send_rate = min_speed * 0.9;
-                    }
-
-                    conn->packet_send_rate_requested = min_speed_request * 1.2;
-
-                    if (conn->packet_send_rate < CRYPTO_PACKET_MIN_RATE) {
-                        conn->packet_send_rate = CRYPTO_PACKET_MIN_RATE;
-                    }
-
-                    if (conn->packet_send_rate_requested < conn->packet_send_rate) {
-                        conn->packet_send_rate_requested = conn->packet_send_rate;
-                    }
-                }
+                congestion_update(&conn->congestion, &sample);
             }
 
             if (conn->last_packets_left_set == 0 || conn->last_packets_left_requested_set == 0) {
                 conn->last_packets_left_requested_set = conn->last_packets_left_set = temp_time;
                 conn->packets_left_requested = conn->packets_left = CRYPTO_MIN_QUEUE_LENGTH;
             } else {
-                if (((uint64_t)((1000.0 / conn->packet_send_rate) + 0.5) + conn->last_packets_left_set) <= temp_time) {
-                    double n_packets = conn->packet_send_rate * (((double)(temp_time - conn->last_packets_left_set)) / 1000.0);
+                const double send_rate = conn->congestion.send_rate;
+
+                if (((uint64_t)((1000.0 / send_rate) + 0.5) + conn->last_packets_left_set) <= temp_time) {
+                    double n_packets = send_rate * (((double)(temp_time - conn->last_packets_left_set)) / 1000.0);
                     n_packets += conn->last_packets_left_rem;
 
                     uint32_t num_packets = n_packets;
                     double rem = n_packets - (double)num_packets;
 
-                    if (conn->packets_left > num_packets * 4 + CRYPTO_MIN_QUEUE_LENGTH) {
-                        conn->packets_left = num_packets * 4 + CRYPTO_MIN_QUEUE_LENGTH;
+                    const uint32_t limit = (uint32_t)congestion_burst_limit(&conn->congestion, num_packets, c->pacing);
+
+                    if (c->pacing) {
+                        /* Only what the connection can send until it is run
+                         * next, and a little more. */
+                        conn->packets_left = conn->packets_left + num_packets < limit
+                                             ? conn->packets_left + num_packets : limit;
+                    } else if (conn->packets_left > limit) {
+                        conn->packets_left = limit;
                     } else {
                         conn->packets_left += num_packets;
                     }
@@ -2611,10 +3827,11 @@ static void send_crypto_packets(Net_Crypto *c)
                     conn->last_packets_left_rem = rem;
                 }
 
-                if (((uint64_t)((1000.0 / conn->packet_send_rate_requested) + 0.5) + conn->last_packets_left_requested_set) <=
-                        temp_time) {
-                    double n_packets = conn->packet_send_rate_requested * (((double)(temp_time - conn->last_packets_left_requested_set)) /
-                                       1000.0);
+                const double request_rate = conn->congestion.request_rate;
+
+                if (((uint64_t)((1000.0 / request_rate) + 0.5) + conn->last_packets_left_requested_set) <= temp_time) {
+                    double n_packets = request_rate * (((double)(temp_time - conn->last_packets_left_requested_set)) /
+                                                       1000.0);
                     n_packets += conn->last_packets_left_requested_rem;
 
                     uint32_t num_packets = n_packets;
@@ -2635,21 +3852,34 @@ static void send_crypto_packets(Net_Crypto *c)
             if (ret != -1) {
                 conn->packets_left_requested -= ret;
                 conn->packets_resent += ret;
+                conn->total_packets_resent += ret;
 
                 if ((unsigned int)ret < conn->packets_left) {
                     conn->packets_left -= ret;
                 } else {
                     conn->last_congestion_event = temp_time;
+                    ++conn->congestion_events;
                     conn->packets_left = 0;
                 }
             }
 
-            if (conn->packet_send_rate > CRYPTO_PACKET_MIN_RATE * 1.5) {
-                total_send_rate += conn->packet_send_rate;
+            if (conn->congestion.send_rate > CRYPTO_PACKET_MIN_RATE * 1.5) {
+                total_send_rate += conn->congestion.send_rate;
+            }
+
+            send_lossy_queue(c, i, temp_time);
+
+            pthread_mutex_lock(&conn->mutex);
+
+            if (conn->lossy_queue_length > 0 && lossy_pacing_rate(conn) > peak_lossy_pacing_rate) {
+                peak_lossy_pacing_rate = lossy_pacing_rate(conn);
             }
+
+            pthread_mutex_unlock(&conn->mutex);
         }
     }
 
+    c->last_sleep_time_update = temp_time;
     c->current_sleep_time = ~0;
     uint32_t sleep_time = peak_request_packet_interval;
 
@@ -2665,6 +3895,15 @@ static void send_crypto_packets(Net_Crypto *c)
         }
     }
 
+    /* Come back for the next lossy packet pacing holds back. */
+    if (peak_lossy_pacing_rate > 0) {
+        sleep_time = (1000.0 / peak_lossy_pacing_rate);
+
+        if (c->current_sleep_time > sleep_time) {
+            c->current_sleep_time = sleep_time + 1;
+        }
+    }
+
     sleep_time = CRYPTO_SEND_PACKET_INTERVAL;
 
     if (c->current_sleep_time > sleep_time) {
@@ -2684,14 +3923,27 @@ bool max_speed_reached(Net_Crypto *c, int crypt_connection_id)
  * return 0 if failure.
  */
 uint32_t crypto_num_free_sendqueue_slots(const Net_Crypto *c, int crypt_connection_id)
+{
+    return crypto_num_free_sendqueue_slots_stream(c, crypt_connection_id, CRYPTO_STREAM_DEFAULT);
+}
+
+/* returns the number of packet slots left in the sendbuffer of stream.
+ * return 0 if failure.
+ */
+uint32_t crypto_num_free_sendqueue_slots_stream(const Net_Crypto *c, int crypt_connection_id, uint8_t stream)
 {
     Crypto_Connection *conn = get_crypto_connection(c, crypt_connection_id);
 
-    if (conn == nullptr) {
+    if (conn == nullptr || stream >= CRYPTO_NUM_STREAMS) {
         return 0;
     }
 
-    uint32_t max_packets = CRYPTO_PACKET_BUFFER_SIZE - num_packets_array(&conn->send_array);
+    const Packets_Array *send_array = stream_send_array(conn, stream);
+    uint32_t max_packets = stream == CRYPTO_STREAM_DEFAULT ? CRYPTO_PACKET_BUFFER_SIZE : CRYPTO_STREAM_BUFFER_SIZE;
+
+    if (send_array != nullptr) {
+        max_packets -= num_packets_array(send_array);
+    }
 
     if (conn->packets_left < max_packets) {
         return conn->packets_left;
@@ -2709,6 +3961,32 @@ uint32_t crypto_num_free_sendqueue_slots(const Net_Crypto *c, int crypt_connecti
  */
 int64_t write_cryptpacket(Net_Crypto *c, int crypt_connection_id, const uint8_t *data, uint16_t length,
                           uint8_t congestion_control)
+{
+    return write_cryptpacket_stream(c, crypt_connection_id, CRYPTO_STREAM_DEFAULT, data, length, congestion_control);
+}
+
+/* return true if lossless packets can be written to stream of the connection.
+ * return false if the peer doesn't support it (yet).
+ */
+bool crypto_stream_available(const Net_Crypto *c, int crypt_connection_id, uint8_t stream)
+{
+    const Crypto_Connection *conn = get_crypto_connection(c, crypt_connection_id);
+
+    if (conn == nullptr || stream >= CRYPTO_NUM_STREAMS) {
+        return false;
+    }
+
+    return stream == CRYPTO_STREAM_DEFAULT || (c->streams && stream < conn->peer_streams);
+}
+
+/* Sends a lossless cryptopacket on stream, as write_cryptpacket() does on
+ * CRYPTO_STREAM_DEFAULT.
+ *
+ * return -1 if data could not be put in packet queue or the stream isn't available.
+ * return positive packet number in the stream if data was put into the queue.
+ */
+int64_t write_cryptpacket_stream(Net_Crypto *c, int crypt_connection_id, uint8_t stream, const uint8_t *data,
+                                 uint16_t length, uint8_t congestion_control)
 {
     if (length == 0) {
         return -1;
@@ -2728,15 +4006,26 @@ int64_t write_cryptpacket(Net_Crypto *c, int crypt_connection_id, const uint8_t
         return -1;
     }
 
-    if (conn->status != CRYPTO_CONN_ESTABLISHED) {
+    /* The peer reads data sent while resuming as soon as it gets a resumption
+     * packet, without waiting for a round trip. */
+    if (conn->status != CRYPTO_CONN_ESTABLISHED && !conn->resuming) {
         return -1;
     }
 
+    /* Data that reaches the peer before the resumption packet is lost. */
+    if (conn->resuming && conn->temp_packet_num_sent == 0) {
+        send_temp_packet(c, crypt_connection_id);
+    }
+
     if (congestion_control && conn->packets_left == 0) {
         return -1;
     }
 
-    int64_t ret = send_lossless_packet(c, crypt_connection_id, data, length, congestion_control);
+    if (!crypto_stream_available(c, crypt_connection_id, stream) || open_stream(conn, stream) != 0) {
+        return -1;
+    }
+
+    int64_t ret = send_lossless_packet(c, crypt_connection_id, stream, data, length, congestion_control);
 
     if (ret == -1) {
         return -1;
@@ -2766,15 +4055,31 @@ int64_t write_cryptpacket(Net_Crypto *c, int crypt_connection_id, const uint8_t
  * when `buffer_end < buffer_start`.
  */
 int cryptpacket_received(Net_Crypto *c, int crypt_connection_id, uint32_t packet_number)
+{
+    return cryptpacket_received_stream(c, crypt_connection_id, CRYPTO_STREAM_DEFAULT, packet_number);
+}
+
+/* Check if packet_number of stream was received by the other side.
+ *
+ * return -1 on failure.
+ * return 0 on success, or if nothing was ever sent on stream.
+ */
+int cryptpacket_received_stream(Net_Crypto *c, int crypt_connection_id, uint8_t stream, uint32_t packet_number)
 {
     Crypto_Connection *conn = get_crypto_connection(c, crypt_connection_id);
 
-    if (conn == nullptr) {
+    if (conn == nullptr || stream >= CRYPTO_NUM_STREAMS) {
         return -1;
     }
 
-    uint32_t num = conn->send_array.buffer_end - conn->send_array.buffer_start;
-    uint32_t num1 = packet_number - conn->send_array.buffer_start;
+    const Packets_Array *send_array = stream_send_array(conn, stream);
+
+    if (send_array == nullptr) {
+        return 0;
+    }
+
+    uint32_t num = send_array->buffer_end - send_array->buffer_start;
+    uint32_t num1 = packet_number - send_array->buffer_start;
 
     if (num < num1) {
         return 0;
@@ -2809,13 +4114,28 @@ int send_lossy_cryptpacket(Net_Crypto *c, int crypt_connection_id, const uint8_t
     Crypto_Connection *conn = get_crypto_connection(c, crypt_connection_id);
 
     int ret = -1;
+    bool queued = false;
 
     if (conn) {
         pthread_mutex_lock(&conn->mutex);
+        ++conn->lossy_counter;
+        /* Held back by pacing, do_net_crypto() sends it. */
+        queued = c->pacing && pace_lossy_packet(c, conn, data, length, current_time_monotonic()) == 0;
         uint32_t buffer_start = conn->recv_array.buffer_start;
         uint32_t buffer_end = conn->send_array.buffer_end;
         pthread_mutex_unlock(&conn->mutex);
-        ret = send_data_packet_helper(c, crypt_connection_id, buffer_start, buffer_end, data, length);
+
+        if (queued) {
+            ret = 0;
+        } else {
+            ret = send_data_packet_helper(c, crypt_connection_id, buffer_start, buffer_end, data, length);
+        }
+    }
+
+    if (ret == 0 && !queued) {
+        /* Lossy packets carry A/V and must not wait for the end of the
+         * iteration. */
+        networking_flush_send_queue(dht_get_net(c->dht));
     }
 
     pthread_mutex_lock(&c->connections_mutex);
@@ -2849,17 +4169,23 @@ int crypto_kill(Net_Crypto *c, int crypt_connection_id)
     if (conn) {
         if (conn->status == CRYPTO_CONN_ESTABLISHED) {
             send_kill_packet(c, crypt_connection_id);
+
+            if (c->session_resumption && conn->peer_resumption) {
+                save_resumption(c, conn);
+            }
         }
 
         pthread_mutex_lock(&c->tcp_mutex);
         kill_tcp_connection_to(c->tcp_c, conn->connection_number_tcp);
         pthread_mutex_unlock(&c->tcp_mutex);
 
-        bs_list_remove(&c->ip_port_list, (uint8_t *)&conn->ip_portv4, crypt_connection_id);
-        bs_list_remove(&c->ip_port_list, (uint8_t *)&conn->ip_portv6, crypt_connection_id);
+        ip_port_table_remove(c, &conn->ip_portv4, crypt_connection_id);
+        ip_port_table_remove(c, &conn->ip_portv6, crypt_connection_id);
         clear_temp_packet(c, crypt_connection_id);
-        clear_buffer(&conn->send_array);
-        clear_buffer(&conn->recv_array);
+        clear_buffer(&c->packet_pool, &conn->send_array);
+        clear_buffer(&c->packet_pool, &conn->recv_array);
+        close_streams(&c->packet_pool, conn);
+        clear_lossy_queue(&c->packet_pool, conn);
         ret = wipe_crypto_connection(c, crypt_connection_id);
     }
 
@@ -2903,9 +4229,28 @@ unsigned int crypto_connection_status(const Net_Crypto *c, int crypt_connection_
     return conn->status;
 }
 
+int crypto_connection_stats(const Net_Crypto *c, int crypt_connection_id, Crypto_Conn_Stats *stats)
+{
+    Crypto_Connection *conn = get_crypto_connection(c, crypt_connection_id);
+
+    if (conn == nullptr) {
+        return -1;
+    }
+
+    stats->rtt = conn->rtt_time;
+    stats->send_rate = conn->congestion.send_rate;
+    stats->recv_rate = conn->packet_recv_rate;
+    stats->send_queue = num_packets_sent_streams(conn);
+    stats->recv_queue = num_packets_recv_streams(conn);
+    stats->packets_resent = conn->total_packets_resent;
+    stats->congestion_events = conn->congestion_events;
+    return 0;
+}
+
 void new_keys(Net_Crypto *c)
 {
     crypto_new_keypair(c->self_public_key, c->self_secret_key);
+    clear_real_keys(c);
 }
 
 /* Save the public and private keys to the keys array.
@@ -2926,6 +4271,7 @@ void load_secret_key(Net_Crypto *c, const uint8_t *sk)
 {
     memcpy(c->self_secret_key, sk, CRYPTO_SECRET_KEY_SIZE);
     crypto_derive_public_key(c->self_public_key, c->self_secret_key);
+    clear_real_keys(c);
 }
 
 /* Run this to (re)initialize net_crypto.
@@ -2946,6 +4292,7 @@ Net_Crypto *new_net_crypto(Logger *log, DHT *dht, TCP_Proxy_Info *proxy_info)
     }
 
     temp->log = log;
+    temp->streams = true;
 
     temp->tcp_c = new_tcp_connections(dht_get_self_secret_key(dht), proxy_info);
 
@@ -2958,13 +4305,24 @@ Net_Crypto *new_net_crypto(Logger *log, DHT *dht, TCP_Proxy_Info *proxy_info)
     set_oob_packet_tcp_connection_callback(temp->tcp_c, &tcp_oob_callback, temp);
 
     if (create_recursive_mutex(&temp->tcp_mutex) != 0 ||
-            pthread_mutex_init(&temp->connections_mutex, nullptr) != 0) {
+            pthread_mutex_init(&temp->connections_mutex, nullptr) != 0 ||
+            pthread_mutex_init(&temp->packet_pool.mutex, nullptr) != 0) {
         kill_tcp_connections(temp->tcp_c);
         free(temp);
         return nullptr;
     }
 
     temp->dht = dht;
+    temp->real_keys = shared_key_cache_new(REAL_KEY_CACHE_SIZE);
+
+    if (temp->real_keys == nullptr) {
+        pthread_mutex_destroy(&temp->tcp_mutex);
+        pthread_mutex_destroy(&temp->connections_mutex);
+        pthread_mutex_destroy(&temp->packet_pool.mutex);
+        kill_tcp_connections(temp->tcp_c);
+        free(temp);
+        return nullptr;
+    }
 
     new_keys(temp);
     new_symmetric_key(temp->secret_symmetric_key);
@@ -2975,8 +4333,10 @@ Net_Crypto *new_net_crypto(Logger *log, DHT *dht, TCP_Proxy_Info *proxy_info)
     networking_registerhandler(dht_get_net(dht), NET_PACKET_COOKIE_RESPONSE, &udp_handle_packet, temp);
     networking_registerhandler(dht_get_net(dht), NET_PACKET_CRYPTO_HS, &udp_handle_packet, temp);
     networking_registerhandler(dht_get_net(dht), NET_PACKET_CRYPTO_DATA, &udp_handle_packet, temp);
+    networking_registerhandler(dht_get_net(dht), NET_PACKET_CRYPTO_STREAM_DATA, &udp_handle_packet, temp);
+    networking_registerhandler(dht_get_net(dht), NET_PACKET_CRYPTO_RESUME, &udp_handle_packet, temp);
 
-    bs_list_init(&temp->ip_port_list, sizeof(IP_Port), 8);
+    hash_table_init(&temp->ip_port_table, SIZE_IPPORT, 8);
 
     return temp;
 }
@@ -3023,11 +4383,17 @@ uint32_t crypto_run_interval(const Net_Crypto *c)
     return c->current_sleep_time;
 }
 
+uint64_t crypto_run_deadline(const Net_Crypto *c)
+{
+    return c->last_sleep_time_update + c->current_sleep_time;
+}
+
 /* Main loop. */
 void do_net_crypto(Net_Crypto *c, void *userdata)
 {
     unix_time_update();
     kill_timedout(c, userdata);
+    clear_old_resumptions(c);
     do_tcp(c, userdata);
     send_crypto_packets(c);
 }
@@ -3040,15 +4406,29 @@ void kill_net_crypto(Net_Crypto *c)
         crypto_kill(c, i);
     }
 
+    /* Connections that failed to start are left, with their arrays. */
+    for (i = 0; i < c->crypto_connections_length; ++i) {
+        free_packets_array(&c->crypto_connections[i].send_array);
+        free_packets_array(&c->crypto_connections[i].recv_array);
+        pthread_mutex_destroy(&c->crypto_connections[i].mutex);
+    }
+
+    realloc_cryptoconnection(c, 0);
     pthread_mutex_destroy(&c->tcp_mutex);
     pthread_mutex_destroy(&c->connections_mutex);
+    packet_pool_clear(&c->packet_pool);
+    pthread_mutex_destroy(&c->packet_pool.mutex);
 
     kill_tcp_connections(c->tcp_c);
-    bs_list_free(&c->ip_port_list);
+    hash_table_free(&c->ip_port_table);
     networking_registerhandler(dht_get_net(c->dht), NET_PACKET_COOKIE_REQUEST, nullptr, nullptr);
     networking_registerhandler(dht_get_net(c->dht), NET_PACKET_COOKIE_RESPONSE, nullptr, nullptr);
     networking_registerhandler(dht_get_net(c->dht), NET_PACKET_CRYPTO_HS, nullptr, nullptr);
     networking_registerhandler(dht_get_net(c->dht), NET_PACKET_CRYPTO_DATA, nullptr, nullptr);
+    networking_registerhandler(dht_get_net(c->dht), NET_PACKET_CRYPTO_STREAM_DATA, nullptr, nullptr);
+    networking_registerhandler(dht_get_net(c->dht), NET_PACKET_CRYPTO_RESUME, nullptr, nullptr);
+    clear_real_keys(c);
+    shared_key_cache_kill(c->real_keys);
     crypto_memzero(c, sizeof(Net_Crypto));
     free(c);
 }
@@ -27,10 +27,15 @@
 #include "DHT.h"
 #include "LAN_discovery.h"
 #include "TCP_connection.h"
+#include "congestion.h"
 #include "logger.h"
 
 #include <pthread.h>
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 #define CRYPTO_CONN_NO_CONNECTION 0
 #define CRYPTO_CONN_COOKIE_REQUESTING 1 //send cookie request packets
 #define CRYPTO_CONN_HANDSHAKE_SENT 2 //send handshake packets
@@ -40,11 +45,16 @@
 /* Maximum size of receiving and sending packet buffers. */
 #define CRYPTO_PACKET_BUFFER_SIZE 32768 /* Must be a power of 2 */
 
+/* Maximum size of the receiving and sending packet buffers of the lossless
+ * streams other than CRYPTO_STREAM_DEFAULT. Each stream allocates its own, so
+ * they are smaller to keep what a connection's streams cost low. */
+#define CRYPTO_STREAM_BUFFER_SIZE 4096 /* Must be a power of 2 */
+
 /* Minimum packet rate per second. */
-#define CRYPTO_PACKET_MIN_RATE 4.0
+#define CRYPTO_PACKET_MIN_RATE CONGESTION_MIN_RATE
 
 /* Minimum packet queue max length. */
-#define CRYPTO_MIN_QUEUE_LENGTH 64
+#define CRYPTO_MIN_QUEUE_LENGTH CONGESTION_MIN_QUEUE_LENGTH
 
 /* Maximum total size of packets that net_crypto sends. */
 #define MAX_CRYPTO_PACKET_SIZE 1400
@@ -61,12 +71,20 @@
    before giving up. */
 #define MAX_NUM_SENDPACKET_TRIES 8
 
+/* The number of times we send a resumption packet before we do a handshake
+   instead. */
+#define MAX_NUM_RESUMPTION_TRIES 2
+
+/* How long in seconds after a connection ended its session can be resumed. */
+#define CRYPTO_RESUMPTION_TIMEOUT 120
+
 /* The timeout of no received UDP packets before the direct UDP connection is considered dead. */
 #define UDP_DIRECT_TIMEOUT 8
 
 #define PACKET_ID_PADDING 0 /* Denotes padding */
 #define PACKET_ID_REQUEST 1 /* Used to request unreceived packets */
 #define PACKET_ID_KILL    2 /* Used to kill connection */
+#define PACKET_ID_STREAMS 3 /* Used to tell the peer how many lossless streams we support */
 
 /* Packet ids 0 to CRYPTO_RESERVED_PACKETS - 1 are reserved for use by net_crypto. */
 #define CRYPTO_RESERVED_PACKETS 16
@@ -78,17 +96,30 @@
 #define PACKET_ID_LOSSY_RANGE_START 192
 #define PACKET_ID_LOSSY_RANGE_SIZE 63
 
-#define CRYPTO_MAX_PADDING 8 /* All packets will be padded a number of bytes based on this number. */
+/* Lossless streams of a connection. Each stream numbers, acknowledges, sends
+ * again and delivers its packets in order on its own, so that a packet lost on
+ * one doesn't hold up the packets of the others. Lost packets of a stream are
+ * sent again before those of the streams after it.
+ *
+ * Stream CRYPTO_STREAM_DEFAULT is the one peers that don't know about streams
+ * use, the others can only be written to once crypto_stream_available() says
+ * the peer supports them.
+ */
+#define CRYPTO_NUM_STREAMS 4
+#define CRYPTO_STREAM_DEFAULT 0
 
-/* Base current transfer speed on last CONGESTION_QUEUE_ARRAY_SIZE number of points taken
-   at the dT defined in net_crypto.c */
-#define CONGESTION_QUEUE_ARRAY_SIZE 12
-#define CONGESTION_LAST_SENT_ARRAY_SIZE (CONGESTION_QUEUE_ARRAY_SIZE * 2)
+#define CRYPTO_MAX_PADDING 8 /* All packets will be padded a number of bytes based on this number. */
 
 /* Default connection ping in ms. */
 #define DEFAULT_PING_CONNECTION 1000
 #define DEFAULT_TCP_PING_CONNECTION 500
 
+/* With pacing, most lossy packets a connection holds back, and how much faster
+ * than they were given to it lately it lets them out.
+ */
+#define CRYPTO_LOSSY_QUEUE_SIZE 32
+#define CRYPTO_LOSSY_PACING_GAIN 2.0
+
 typedef struct Net_Crypto Net_Crypto;
 
 const uint8_t *nc_get_self_public_key(const Net_Crypto *c);
@@ -96,6 +127,33 @@ const uint8_t *nc_get_self_secret_key(const Net_Crypto *c);
 TCP_Connections *nc_get_tcp_c(const Net_Crypto *c);
 DHT *nc_get_dht(const Net_Crypto *c);
 
+/* Set the congestion controller of the connections made from now on. */
+void nc_set_congestion_control(Net_Crypto *c, Congestion_Control_Type type);
+
+/* Spread the packets of each connection evenly over time instead of sending
+ * all a connection may send each time do_net_crypto() runs. This only works as
+ * well as do_net_crypto() is run at the intervals crypto_run_interval() asks
+ * for.
+ */
+void nc_set_pacing(Net_Crypto *c, bool pacing);
+
+/* Use the lossless streams other than CRYPTO_STREAM_DEFAULT with the peers
+ * that support them (the default). Without, we act as a peer that doesn't know
+ * about streams: we don't tell the peers about ours and drop their packets.
+ */
+void nc_set_streams(Net_Crypto *c, bool streams);
+
+/* Keep the keys of each session with a peer that can do the same for a while
+ * after it ends, so that the next connection to that peer can start with them:
+ * the one that makes it sends a resumption packet instead of asking for a
+ * cookie, and can send data packets right after it. Each resumption packet
+ * can be used only once, after which the session has new keys.
+ *
+ * This trades some forward secrecy for latency, as the keys of a session stay
+ * in memory for up to CRYPTO_RESUMPTION_TIMEOUT seconds after it ends.
+ */
+void nc_set_session_resumption(Net_Crypto *c, bool session_resumption);
+
 typedef struct New_Connection {
     IP_Port source;
     uint8_t public_key[CRYPTO_PUBLIC_KEY_SIZE]; /* The real public key of the peer. */
@@ -104,6 +162,8 @@ typedef struct New_Connection {
     uint8_t peersessionpublic_key[CRYPTO_PUBLIC_KEY_SIZE]; /* The public key of the peer. */
     uint8_t *cookie;
     uint8_t cookie_length;
+    int resumption; /* The ended session the peer resumed, -1 if it did a handshake. */
+    uint8_t sent_nonce[CRYPTO_NONCE_SIZE]; /* Nonce of sent packets, chosen by the peer if it resumed. */
 } New_Connection;
 
 /* Set function to be called when someone requests a new connection to us.
@@ -195,6 +255,16 @@ int nc_dht_pk_callback(Net_Crypto *c, int crypt_connection_id, void (*function)(
  */
 uint32_t crypto_num_free_sendqueue_slots(const Net_Crypto *c, int crypt_connection_id);
 
+/* returns the number of packet slots left in the sendbuffer of stream.
+ * return 0 if failure.
+ */
+uint32_t crypto_num_free_sendqueue_slots_stream(const Net_Crypto *c, int crypt_connection_id, uint8_t stream);
+
+/* return true if lossless packets can be written to stream of the connection.
+ * return false if the peer doesn't support it (yet).
+ */
+bool crypto_stream_available(const Net_Crypto *c, int crypt_connection_id, uint8_t stream);
+
 /* Return 1 if max speed was reached for this connection (no more data can be physically through the pipe).
  * Return 0 if it wasn't reached.
  */
@@ -207,11 +277,23 @@ bool max_speed_reached(Net_Crypto *c, int crypt_connection_id);
  *
  * The first byte of data must be in the CRYPTO_RESERVED_PACKETS to PACKET_ID_LOSSY_RANGE_START range.
  *
+ * Works once the connection is established, and right after it was created
+ * if it resumes an ended session, as the peer can read the data then.
+ *
  * congestion_control: should congestion control apply to this packet?
  */
 int64_t write_cryptpacket(Net_Crypto *c, int crypt_connection_id, const uint8_t *data, uint16_t length,
                           uint8_t congestion_control);
 
+/* Sends a lossless cryptopacket on stream, as write_cryptpacket() does on
+ * CRYPTO_STREAM_DEFAULT.
+ *
+ * return -1 if data could not be put in packet queue or the stream isn't available.
+ * return positive packet number in the stream if data was put into the queue.
+ */
+int64_t write_cryptpacket_stream(Net_Crypto *c, int crypt_connection_id, uint8_t stream, const uint8_t *data,
+                                 uint16_t length, uint8_t congestion_control);
+
 /* Check if packet_number was received by the other side.
  *
  * packet_number must be a valid packet number of a packet sent on this connection.
@@ -221,6 +303,26 @@ int64_t write_cryptpacket(Net_Crypto *c, int crypt_connection_id, const uint8_t
  */
 int cryptpacket_received(Net_Crypto *c, int crypt_connection_id, uint32_t packet_number);
 
+/* Return the packet number in {buffer_start, buffer_start + 65535} whose
+ * lowest 2 bytes are number, as the packets of streams other than
+ * CRYPTO_STREAM_DEFAULT only carry those.
+ */
+uint32_t stream_packet_number(uint32_t buffer_start, uint16_t number);
+
+/* Return true if number, as rebuilt by stream_packet_number(), can be that of a
+ * packet the peer sent. An old packet can be taken for the one 65536 packets
+ * after it, which is further past buffer_start than the peer can send before
+ * buffer_start moves on.
+ */
+bool stream_packet_in_window(uint32_t buffer_start, uint32_t number);
+
+/* Check if packet_number of stream was received by the other side.
+ *
+ * return -1 on failure.
+ * return 0 on success, or if nothing was ever sent on stream.
+ */
+int cryptpacket_received_stream(Net_Crypto *c, int crypt_connection_id, uint8_t stream, uint32_t packet_number);
+
 /* return -1 on failure.
  * return 0 on success.
  *
@@ -279,6 +381,31 @@ int crypto_kill(Net_Crypto *c, int crypt_connection_id);
 unsigned int crypto_connection_status(const Net_Crypto *c, int crypt_connection_id, bool *direct_connected,
                                       unsigned int *online_tcp_relays);
 
+/* What a connection's transport is doing, to see why it is slow. */
+typedef struct Crypto_Conn_Stats {
+    /* Smallest round trip time seen on the connection, in ms. */
+    uint64_t rtt;
+    /* Packets per second the connection may send, and received lately. */
+    double send_rate;
+    double recv_rate;
+    /* Lossless packets not confirmed by the peer yet, and received ones
+     * waiting for an earlier one that is missing. */
+    uint32_t send_queue;
+    uint32_t recv_queue;
+    /* Since the connection was made: lossless packets sent again, and times
+     * sending them again used up all the connection could send. */
+    uint64_t packets_resent;
+    uint64_t congestion_events;
+} Crypto_Conn_Stats;
+
+/* Copy the statistics of the connection into stats. This takes no locks and
+ * is meant to be called from the thread running do_net_crypto().
+ *
+ * return -1 on failure.
+ * return 0 on success.
+ */
+int crypto_connection_stats(const Net_Crypto *c, int crypt_connection_id, Crypto_Conn_Stats *stats);
+
 /* Generate our public and private keys.
  *  Only call this function the first time the program starts.
  */
@@ -303,11 +430,18 @@ Net_Crypto *new_net_crypto(Logger *log, DHT *dht, TCP_Proxy_Info *proxy_info);
  */
 uint32_t crypto_run_interval(const Net_Crypto *c);
 
+/* return the time (as returned by current_time_monotonic()) at which
+ *   do_net_crypto() should run next.
+ */
+uint64_t crypto_run_deadline(const Net_Crypto *c);
+
 /* Main loop. */
 void do_net_crypto(Net_Crypto *c, void *userdata);
 
 void kill_net_crypto(Net_Crypto *c);
 
-
+#ifdef __cplusplus
+}  // extern "C"
+#endif
 
 #endif
@@ -0,0 +1,58 @@
+#include "net_crypto.h"
+
+#include <gtest/gtest.h>
+
+namespace {
+
+TEST(NetCrypto, StreamPacketNumbersFollowBufferStart)
+{
+    EXPECT_EQ(stream_packet_number(0, 0), 0u);
+    EXPECT_EQ(stream_packet_number(0, 5), 5u);
+    EXPECT_EQ(stream_packet_number(0x12340000, 0x0010), 0x12340010u);
+    EXPECT_EQ(stream_packet_number(0x1234fff0, 0xfff8), 0x1234fff8u);
+}
+
+TEST(NetCrypto, StreamPacketNumbersWrapAround16Bits)
+{
+    // Past the 16 bit boundary the number continues in the next 65536.
+    EXPECT_EQ(stream_packet_number(0xfff0, 0x0005), 0x10005u);
+    EXPECT_EQ(stream_packet_number(0x1fffe, 0xffff), 0x1ffffu);
+    EXPECT_EQ(stream_packet_number(0x1fffe, 0x0000), 0x20000u);
+
+    // And past the 32 bit one.
+    EXPECT_EQ(stream_packet_number(0xfffffff0, 0x0005), 0x00000005u);
+}
+
+TEST(NetCrypto, StreamPacketNumbersInTheWindowAreKept)
+{
+    const uint32_t starts[] = {0, 0x8000, 0xfff0, 0x1234fff0, 0xfffffff0};
+
+    for (uint32_t buffer_start : starts) {
+        const uint32_t first = stream_packet_number(buffer_start, uint16_t(buffer_start));
+        const uint32_t last = stream_packet_number(buffer_start,
+                              uint16_t(buffer_start + CRYPTO_STREAM_BUFFER_SIZE - 1));
+
+        EXPECT_EQ(first, buffer_start);
+        EXPECT_EQ(last, buffer_start + CRYPTO_STREAM_BUFFER_SIZE - 1);
+        EXPECT_TRUE(stream_packet_in_window(buffer_start, first));
+        EXPECT_TRUE(stream_packet_in_window(buffer_start, last));
+    }
+}
+
+TEST(NetCrypto, OldStreamPacketsAreOutsideTheWindow)
+{
+    const uint32_t starts[] = {0, 0x8000, 0xfff0, 0x1234fff0, 0xfffffff0};
+
+    for (uint32_t buffer_start : starts) {
+        // A packet from before buffer_start comes out almost 65536 after it.
+        const uint32_t old = stream_packet_number(buffer_start, uint16_t(buffer_start - 1));
+        EXPECT_EQ(old, buffer_start + 0xffff);
+        EXPECT_FALSE(stream_packet_in_window(buffer_start, old));
+
+        const uint32_t beyond = stream_packet_number(buffer_start,
+                                uint16_t(buffer_start + CRYPTO_STREAM_BUFFER_SIZE));
+        EXPECT_FALSE(stream_packet_in_window(buffer_start, beyond));
+    }
+}
+
+}  // namespace
@@ -33,6 +33,11 @@
 #define _XOPEN_SOURCE 600
 #endif
 
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+/* recvmmsg() and sendmmsg() are GNU extensions. */
+#define _GNU_SOURCE
+#endif
+
 #if defined(_WIN32) && _WIN32_WINNT >= _WIN32_WINNT_WINXP
 #undef _WIN32_WINNT
 #define _WIN32_WINNT  0x501
@@ -67,6 +72,9 @@
 
 #include "network.h"
 
+#include "crypto_pool.h"
+#include "rate_limiter.h"
+
 #ifdef __APPLE__
 #include <mach/clock.h>
 #include <mach/mach.h>
@@ -165,11 +173,13 @@ static int inet_pton(int family, const char *addrString, void *addrbuf)
 #endif
 
 #include <assert.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "logger.h"
+#include "network_uring.h"
 #include "util.h"
 
 // Disable MSG_NOSIGNAL on systems not supporting it, e.g. Windows, FreeBSD
@@ -183,6 +193,13 @@ static int inet_pton(int family, const char *addrString, void *addrbuf)
 #endif
 #endif
 
+/* Batched receives and sends with recvmmsg()/sendmmsg() are only available on
+ * Linux. */
+#if defined(__linux__) && defined(MSG_WAITFORONE)
+#define NET_USE_RECVMMSG
+#define NET_USE_SENDMMSG
+#endif
+
 #if TOX_INET6_ADDRSTRLEN < INET6_ADDRSTRLEN
 #error TOX_INET6_ADDRSTRLEN should be greater or equal to INET6_ADDRSTRLEN (#INET6_ADDRSTRLEN)
 #endif
@@ -398,6 +415,21 @@ int set_socket_reuseaddr(Socket sock)
     return setsockopt(sock.socket, SOL_SOCKET, SO_REUSEADDR, (const char *)&set, sizeof(set)) == 0;
 }
 
+/* Enable SO_REUSEPORT on socket.
+ *
+ * return 1 on success
+ * return 0 on failure
+ */
+int set_socket_reuseport(Socket sock)
+{
+#ifdef SO_REUSEPORT
+    int set = 1;
+    return setsockopt(sock.socket, SOL_SOCKET, SO_REUSEPORT, (const char *)&set, sizeof(set)) == 0;
+#else
+    return 0;
+#endif
+}
+
 /* Set socket to dual (IPv4 + IPv6 socket)
  *
  * return 1 on success
@@ -526,6 +558,34 @@ typedef struct {
     void *object;
 } Packet_Handler;
 
+#ifdef NET_USE_RECVMMSG
+/* Buffers reused by every recvmmsg() call on the UDP socket. */
+typedef struct Net_Recv_Batch {
+    struct mmsghdr msgs[NET_RECV_BATCH_SIZE];
+    struct iovec iovecs[NET_RECV_BATCH_SIZE];
+    struct sockaddr_storage addrs[NET_RECV_BATCH_SIZE];
+    uint8_t data[NET_RECV_BATCH_SIZE][MAX_UDP_PACKET_SIZE];
+} Net_Recv_Batch;
+#endif
+
+/* Packets deferred by sendpacket() until networking_flush_send_queue(). The
+ * mutex is needed because sendpacket() may be called from other threads, e.g.
+ * by toxav through net_crypto.
+ */
+typedef struct Net_Send_Queue {
+    pthread_mutex_t mutex;
+    uint32_t length;
+    IP_Port ip_ports[NET_SEND_QUEUE_SIZE];
+    struct sockaddr_storage addrs[NET_SEND_QUEUE_SIZE];
+    size_t addrsizes[NET_SEND_QUEUE_SIZE];
+    uint16_t data_lengths[NET_SEND_QUEUE_SIZE];
+    uint8_t data[NET_SEND_QUEUE_SIZE][MAX_UDP_PACKET_SIZE];
+#ifdef NET_USE_SENDMMSG
+    struct mmsghdr msgs[NET_SEND_QUEUE_SIZE];
+    struct iovec iovecs[NET_SEND_QUEUE_SIZE];
+#endif
+} Net_Send_Queue;
+
 struct Networking_Core {
     Logger *log;
     Packet_Handler packethandlers[256];
@@ -534,6 +594,29 @@ struct Networking_Core {
     uint16_t port;
     /* Our UDP socket. */
     Socket sock;
+
+#ifdef NET_USE_RECVMMSG
+    /* NULL if batched receives are unavailable. */
+    Net_Recv_Batch *recv_batch;
+#endif
+    Net_Recv_Stats recv_stats;
+
+    /* NULL unless the send queue was enabled. */
+    Net_Send_Queue *send_queue;
+
+    /* NULL unless the io_uring backend is in use. */
+    Net_Uring *uring;
+
+    /* NULL unless the crypto pool was enabled. */
+    Crypto_Pool *crypto_pool;
+
+    /* NULL until a rate limit is set. */
+    Rate_Limiter *rate_limiter;
+    /* current_time_monotonic() at the start of the poll, for the limiter. */
+    uint64_t poll_time;
+
+    /* Whether networking_poll() calls unix_time_update(). */
+    bool update_time;
 };
 
 Family net_family(const Networking_Core *net)
@@ -546,16 +629,24 @@ uint16_t net_port(const Networking_Core *net)
     return net->port;
 }
 
-/* Basic network functions:
- * Function to send packet(data) of length length to ip_port.
- */
-int sendpacket(Networking_Core *net, IP_Port ip_port, const uint8_t *data, uint16_t length)
+const Net_Recv_Stats *net_recv_stats(const Networking_Core *net)
 {
-    if (net_family_is_unspec(net->family)) { /* Socket not initialized */
-        LOGGER_ERROR(net->log, "attempted to send message of length %u on uninitialised socket", (unsigned)length);
-        return -1;
-    }
+    return &net->recv_stats;
+}
+
+Net_Backend net_backend(const Networking_Core *net)
+{
+    return net->uring != nullptr ? NET_BACKEND_IO_URING : NET_BACKEND_SOCKETS;
+}
 
+/* Convert ip_port into a destination address for our UDP socket.
+ *
+ * return 0 on success
+ * return -1 if we can't send to ip_port
+ */
+static int ip_port_to_sockaddr(const Networking_Core *net, IP_Port ip_port, struct sockaddr_storage *addr,
+                               size_t *addrsize)
+{
     /* socket TOX_AF_INET, but target IP NOT: can't send */
     if (net_family_is_ipv4(net->family) && !net_family_is_ipv4(ip_port.ip.family)) {
         LOGGER_ERROR(net->log, "attempted to send message with network family %d (probably IPv6) on IPv4 socket",
@@ -578,21 +669,17 @@ int sendpacket(Networking_Core *net, IP_Port ip_port, const uint8_t *data, uint1
         ip_port.ip.ip.v6 = ip6;
     }
 
-    struct sockaddr_storage addr;
-
-    size_t addrsize;
-
     if (net_family_is_ipv4(ip_port.ip.family)) {
-        struct sockaddr_in *const addr4 = (struct sockaddr_in *)&addr;
+        struct sockaddr_in *const addr4 = (struct sockaddr_in *)addr;
 
-        addrsize = sizeof(struct sockaddr_in);
+        *addrsize = sizeof(struct sockaddr_in);
         addr4->sin_family = AF_INET;
         addr4->sin_port = ip_port.port;
         fill_addr4(ip_port.ip.ip.v4, &addr4->sin_addr);
     } else if (net_family_is_ipv6(ip_port.ip.family)) {
-        struct sockaddr_in6 *const addr6 = (struct sockaddr_in6 *)&addr;
+        struct sockaddr_in6 *const addr6 = (struct sockaddr_in6 *)addr;
 
-        addrsize = sizeof(struct sockaddr_in6);
+        *addrsize = sizeof(struct sockaddr_in6);
         addr6->sin6_family = AF_INET6;
         addr6->sin6_port = ip_port.port;
         fill_addr6(ip_port.ip.ip.v6, &addr6->sin6_addr);
@@ -604,6 +691,113 @@ int sendpacket(Networking_Core *net, IP_Port ip_port, const uint8_t *data, uint1
         return -1;
     }
 
+    return 0;
+}
+
+/* Send all queued packets. The queue mutex must be held. */
+static void send_queue_flush(Networking_Core *net, Net_Send_Queue *queue)
+{
+#ifdef NET_USE_SENDMMSG
+    uint32_t sent = 0;
+
+    while (sent < queue->length) {
+        const int res = sendmmsg(net->sock.socket, &queue->msgs[sent], queue->length - sent, 0);
+
+        if (res <= 0) {
+            const int error = net_error();
+
+            if (error == TOX_EWOULDBLOCK || error == EAGAIN || error == ENOBUFS) {
+                /* The socket buffer is full, so the rest would fail the same
+                 * way. Drop them all like sendto() would. */
+                for (; sent < queue->length; ++sent) {
+                    loglogdata(net->log, "O=>", queue->data[sent], queue->data_lengths[sent], queue->ip_ports[sent], -1);
+                }
+
+                break;
+            }
+
+            /* The first packet failed, most likely because its destination is
+             * unreachable. Drop it like sendto() would and carry on. */
+            loglogdata(net->log, "O=>", queue->data[sent], queue->data_lengths[sent], queue->ip_ports[sent], -1);
+            ++sent;
+            continue;
+        }
+
+        for (int i = 0; i < res; ++i) {
+            loglogdata(net->log, "O=>", queue->data[sent + i], queue->data_lengths[sent + i], queue->ip_ports[sent + i],
+                       queue->msgs[sent + i].msg_len);
+        }
+
+        sent += res;
+    }
+
+#else
+
+    for (uint32_t i = 0; i < queue->length; ++i) {
+        const int res = sendto(net->sock.socket, (const char *)queue->data[i], queue->data_lengths[i], 0,
+                               (struct sockaddr *)&queue->addrs[i], queue->addrsizes[i]);
+        loglogdata(net->log, "O=>", queue->data[i], queue->data_lengths[i], queue->ip_ports[i], res);
+    }
+
+#endif
+    queue->length = 0;
+}
+
+static int send_queue_add(Networking_Core *net, IP_Port ip_port, const struct sockaddr_storage *addr,
+                          size_t addrsize, const uint8_t *data, uint16_t length)
+{
+    Net_Send_Queue *const queue = net->send_queue;
+
+    pthread_mutex_lock(&queue->mutex);
+
+    if (queue->length == NET_SEND_QUEUE_SIZE) {
+        send_queue_flush(net, queue);
+    }
+
+    const uint32_t i = queue->length;
+    queue->ip_ports[i] = ip_port;
+    queue->addrs[i] = *addr;
+    queue->addrsizes[i] = addrsize;
+    queue->data_lengths[i] = length;
+    memcpy(queue->data[i], data, length);
+#ifdef NET_USE_SENDMMSG
+    queue->iovecs[i].iov_len = length;
+    queue->msgs[i].msg_hdr.msg_namelen = addrsize;
+#endif
+    ++queue->length;
+
+    pthread_mutex_unlock(&queue->mutex);
+    return length;
+}
+
+/* Basic network functions:
+ * Function to send packet(data) of length length to ip_port.
+ */
+int sendpacket(Networking_Core *net, IP_Port ip_port, const uint8_t *data, uint16_t length)
+{
+    if (net_family_is_unspec(net->family)) { /* Socket not initialized */
+        LOGGER_ERROR(net->log, "attempted to send message of length %u on uninitialised socket", (unsigned)length);
+        return -1;
+    }
+
+    struct sockaddr_storage addr;
+    size_t addrsize;
+
+    if (ip_port_to_sockaddr(net, ip_port, &addr, &addrsize) == -1) {
+        return -1;
+    }
+
+    if (net->uring != nullptr && net_uring_send(net->uring, &addr, addrsize, data, length) != -1) {
+        /* Submitted by networking_flush_send_queue(), so that all the packets
+         * of an iteration go out with one syscall. */
+        loglogdata(net->log, "O=>", data, length, ip_port, length);
+        return length;
+    }
+
+    if (net->send_queue != nullptr && length <= MAX_UDP_PACKET_SIZE) {
+        return send_queue_add(net, ip_port, &addr, addrsize, data, length);
+    }
+
     const int res = sendto(net->sock.socket, (const char *) data, length, 0, (struct sockaddr *)&addr, addrsize);
 
     loglogdata(net->log, "O=>", data, length, ip_port, res);
@@ -611,39 +805,197 @@ int sendpacket(Networking_Core *net, IP_Port ip_port, const uint8_t *data, uint1
     return res;
 }
 
-/* Function to receive data
- *  ip and port of sender is put into ip_port.
- *  Packet data is put into data.
- *  Packet length is put into length.
- */
-static int receivepacket(Logger *log, Socket sock, IP_Port *ip_port, uint8_t *data, uint32_t *length)
+int networking_enable_send_queue(Networking_Core *net)
 {
-    memset(ip_port, 0, sizeof(IP_Port));
-    struct sockaddr_storage addr;
-#ifdef OS_WIN32
-    int addrlen = sizeof(addr);
-#else
-    socklen_t addrlen = sizeof(addr);
+    if (net_family_is_unspec(net->family)) {
+        return -1;
+    }
+
+    if (net->send_queue != nullptr) {
+        return 0;
+    }
+
+    Net_Send_Queue *queue = (Net_Send_Queue *)calloc(1, sizeof(Net_Send_Queue));
+
+    if (queue == nullptr) {
+        return -1;
+    }
+
+    if (pthread_mutex_init(&queue->mutex, nullptr) != 0) {
+        free(queue);
+        return -1;
+    }
+
+#ifdef NET_USE_SENDMMSG
+
+    for (uint32_t i = 0; i < NET_SEND_QUEUE_SIZE; ++i) {
+        queue->iovecs[i].iov_base = queue->data[i];
+        queue->msgs[i].msg_hdr.msg_iov = &queue->iovecs[i];
+        queue->msgs[i].msg_hdr.msg_iovlen = 1;
+        queue->msgs[i].msg_hdr.msg_name = &queue->addrs[i];
+    }
+
 #endif
-    *length = 0;
-    int fail_or_len = recvfrom(sock.socket, (char *) data, MAX_UDP_PACKET_SIZE, 0, (struct sockaddr *)&addr, &addrlen);
 
-    if (fail_or_len < 0) {
-        int error = net_error();
+    net->send_queue = queue;
+    return 0;
+}
 
-        if (fail_or_len < 0 && error != TOX_EWOULDBLOCK) {
-            const char *strerror = net_new_strerror(error);
-            LOGGER_ERROR(log, "Unexpected error reading from socket: %u, %s", error, strerror);
-            net_kill_strerror(strerror);
+void networking_flush_send_queue(Networking_Core *net)
+{
+    if (net->uring != nullptr) {
+        net_uring_submit(net->uring);
+    }
+
+    Net_Send_Queue *const queue = net->send_queue;
+
+    if (queue == nullptr) {
+        return;
+    }
+
+    pthread_mutex_lock(&queue->mutex);
+
+    if (queue->length > 0) {
+        send_queue_flush(net, queue);
+    }
+
+    pthread_mutex_unlock(&queue->mutex);
+}
+
+bool networking_send_queue_pending(Networking_Core *net)
+{
+    if (net->uring != nullptr && net_uring_send_pending(net->uring)) {
+        return true;
+    }
+
+    Net_Send_Queue *const queue = net->send_queue;
+
+    if (queue == nullptr) {
+        return false;
+    }
+
+    pthread_mutex_lock(&queue->mutex);
+    const bool pending = queue->length > 0;
+    pthread_mutex_unlock(&queue->mutex);
+
+    return pending;
+}
+
+int networking_enable_crypto_pool(Networking_Core *net, uint32_t num_threads)
+{
+    if (net_family_is_unspec(net->family)) {
+        return -1;
+    }
+
+    if (net->crypto_pool != nullptr) {
+        return 0;
+    }
+
+    net->crypto_pool = crypto_pool_new(num_threads);
+
+    if (net->crypto_pool == nullptr) {
+        return -1;
+    }
+
+    return 0;
+}
+
+Crypto_Pool *networking_crypto_pool(const Networking_Core *net)
+{
+    return net->crypto_pool;
+}
+
+int networking_set_rate_limit(Networking_Core *net, uint8_t packet_id, uint32_t rate, uint32_t burst)
+{
+    if (net->rate_limiter == nullptr) {
+        if (rate == 0) {
+            return 0;
         }
 
-        return -1; /* Nothing received. */
+        net->rate_limiter = rate_limiter_new();
+
+        if (net->rate_limiter == nullptr) {
+            return -1;
+        }
     }
 
-    *length = (uint32_t)fail_or_len;
+    return rate_limiter_set(net->rate_limiter, packet_id, rate, burst);
+}
+
+void networking_set_update_time(Networking_Core *net, bool update_time)
+{
+    net->update_time = update_time;
+}
+
+void networking_get_rate_limit(const Networking_Core *net, uint8_t packet_id, uint32_t *rate, uint32_t *burst)
+{
+    if (net->rate_limiter == nullptr) {
+        *rate = 0;
+        *burst = 0;
+        return;
+    }
+
+    rate_limiter_get(net->rate_limiter, packet_id, rate, burst);
+}
 
-    if (addr.ss_family == AF_INET) {
-        struct sockaddr_in *addr_in = (struct sockaddr_in *)&addr;
+uint64_t networking_rate_limited(const Networking_Core *net, uint8_t packet_id)
+{
+    if (net->rate_limiter == nullptr) {
+        return 0;
+    }
+
+    return rate_limiter_dropped(net->rate_limiter, packet_id);
+}
+
+void net_fds_add(Net_Fds *fds, Socket sock, uint8_t events)
+{
+    if (fds->fds != nullptr && fds->count < fds->max_fds) {
+        fds->fds[fds->count] = (int32_t)sock.socket;
+
+        if (fds->events != nullptr) {
+            fds->events[fds->count] = events;
+        }
+    }
+
+    ++fds->count;
+}
+
+void networking_fds(const Networking_Core *net, Net_Fds *fds)
+{
+    if (net_family_is_unspec(net->family)) {
+        return;
+    }
+
+    const int uring_fd = net->uring != nullptr ? net_uring_poll_fd(net->uring) : -1;
+
+    if (uring_fd != -1) {
+        Socket uring_sock;
+        uring_sock.socket = uring_fd;
+        net_fds_add(fds, uring_sock, NET_FD_EVENT_READ);
+    } else {
+        net_fds_add(fds, net->sock, NET_FD_EVENT_READ);
+    }
+
+    const int pool_fd = net->crypto_pool != nullptr ? crypto_pool_fd(net->crypto_pool) : -1;
+
+    if (pool_fd != -1) {
+        Socket pool_sock;
+        pool_sock.socket = pool_fd;
+        net_fds_add(fds, pool_sock, NET_FD_EVENT_READ);
+    }
+}
+
+/* Convert the source address of a received datagram into ip_port.
+ *
+ * return 0 on success
+ * return -1 if the address family is not supported
+ */
+static int ip_port_from_sockaddr(const struct sockaddr_storage *addr, IP_Port *ip_port)
+{
+    memset(ip_port, 0, sizeof(IP_Port));
+
+    if (addr->ss_family == AF_INET) {
+        const struct sockaddr_in *addr_in = (const struct sockaddr_in *)addr;
 
         const Family *const family = make_tox_family(addr_in->sin_family);
         assert(family != nullptr);
@@ -655,8 +1007,8 @@ static int receivepacket(Logger *log, Socket sock, IP_Port *ip_port, uint8_t *da
         ip_port->ip.family = *family;
         get_ip4(&ip_port->ip.ip.v4, &addr_in->sin_addr);
         ip_port->port = addr_in->sin_port;
-    } else if (addr.ss_family == AF_INET6) {
-        struct sockaddr_in6 *addr_in6 = (struct sockaddr_in6 *)&addr;
+    } else if (addr->ss_family == AF_INET6) {
+        const struct sockaddr_in6 *addr_in6 = (const struct sockaddr_in6 *)addr;
         const Family *const family = make_tox_family(addr_in6->sin6_family);
         assert(family != nullptr);
 
@@ -676,42 +1028,287 @@ static int receivepacket(Logger *log, Socket sock, IP_Port *ip_port, uint8_t *da
         return -1;
     }
 
+    return 0;
+}
+
+/* Function to receive data
+ *  ip and port of sender is put into ip_port.
+ *  Packet data is put into data.
+ *  Packet length is put into length.
+ */
+static int receivepacket(Logger *log, Socket sock, IP_Port *ip_port, uint8_t *data, uint32_t *length)
+{
+    memset(ip_port, 0, sizeof(IP_Port));
+    struct sockaddr_storage addr;
+#ifdef OS_WIN32
+    int addrlen = sizeof(addr);
+#else
+    socklen_t addrlen = sizeof(addr);
+#endif
+    *length = 0;
+    int fail_or_len = recvfrom(sock.socket, (char *) data, MAX_UDP_PACKET_SIZE, 0, (struct sockaddr *)&addr, &addrlen);
+
+    if (fail_or_len < 0) {
+        int error = net_error();
+
+        if (fail_or_len < 0 && error != TOX_EWOULDBLOCK) {
+            const char *strerror = net_new_strerror(error);
+            LOGGER_ERROR(log, "Unexpected error reading from socket: %u, %s", error, strerror);
+            net_kill_strerror(strerror);
+        }
+
+        return -1; /* Nothing received. */
+    }
+
+    *length = (uint32_t)fail_or_len;
+
+    if (ip_port_from_sockaddr(&addr, ip_port) == -1) {
+        return -1;
+    }
+
     loglogdata(log, "=>O", data, MAX_UDP_PACKET_SIZE, *ip_port, *length);
 
     return 0;
 }
 
+#ifdef NET_USE_RECVMMSG
+static Net_Recv_Batch *new_recv_batch(void)
+{
+    Net_Recv_Batch *batch = (Net_Recv_Batch *)calloc(1, sizeof(Net_Recv_Batch));
+
+    if (batch == nullptr) {
+        return nullptr;
+    }
+
+    for (uint32_t i = 0; i < NET_RECV_BATCH_SIZE; ++i) {
+        batch->iovecs[i].iov_base = batch->data[i];
+        batch->iovecs[i].iov_len = MAX_UDP_PACKET_SIZE;
+        batch->msgs[i].msg_hdr.msg_iov = &batch->iovecs[i];
+        batch->msgs[i].msg_hdr.msg_iovlen = 1;
+        batch->msgs[i].msg_hdr.msg_name = &batch->addrs[i];
+    }
+
+    return batch;
+}
+#endif
+
 void networking_registerhandler(Networking_Core *net, uint8_t byte, packet_handler_callback cb, void *object)
 {
     net->packethandlers[byte].function = cb;
     net->packethandlers[byte].object = object;
 }
 
-void networking_poll(Networking_Core *net, void *userdata)
+packet_handler_callback networking_get_handler(const Networking_Core *net, uint8_t byte, void **object)
 {
-    if (net_family_is_unspec(net->family)) {
-        /* Socket not initialized */
+    *object = net->packethandlers[byte].object;
+    return net->packethandlers[byte].function;
+}
+
+void networking_dispatch(Networking_Core *net, IP_Port ip_port, const uint8_t *data, uint32_t length,
+                         void *userdata)
+{
+    if (length < 1) {
         return;
     }
 
-    unix_time_update();
+    if (!(net->packethandlers[data[0]].function)) {
+        LOGGER_WARNING(net->log, "[%02u] -- Packet has no handler", data[0]);
+        return;
+    }
+
+    net->packethandlers[data[0]].function(net->packethandlers[data[0]].object, ip_port, data, length, userdata);
+}
+
+/* Dispatch a packet our socket received, unless its source is over the rate
+ * limit for its type.
+ */
+static void networking_received(Networking_Core *net, IP_Port ip_port, const uint8_t *data, uint32_t length,
+                                void *userdata)
+{
+    if (net->rate_limiter != nullptr && length > 0
+            && !rate_limiter_allow(net->rate_limiter, &ip_port.ip, data[0], net->poll_time)) {
+        return;
+    }
+
+    networking_dispatch(net, ip_port, data, length, userdata);
+}
+
+static void networking_count_recv(Networking_Core *net, uint32_t received)
+{
+    ++net->recv_stats.syscalls;
+    net->recv_stats.packets += received;
+    net->recv_stats.last_poll_packets += received;
+
+    if (received > net->recv_stats.max_batch_size) {
+        net->recv_stats.max_batch_size = received;
+    }
+}
+
+#ifdef NET_USE_RECVMMSG
+/* Drain the UDP socket NET_RECV_BATCH_SIZE datagrams per syscall.
+ *
+ * return 0 once the socket has no more data.
+ * return -1 if the kernel doesn't support recvmmsg(); batching is then turned
+ *   off and the caller must fall back to receivepacket().
+ */
+static int networking_poll_batched(Networking_Core *net, void *userdata)
+{
+    Net_Recv_Batch *const batch = net->recv_batch;
+
+    while (true) {
+        for (uint32_t i = 0; i < NET_RECV_BATCH_SIZE; ++i) {
+            batch->msgs[i].msg_hdr.msg_namelen = sizeof(batch->addrs[i]);
+            batch->msgs[i].msg_hdr.msg_flags = 0;
+        }
+
+        const int count = recvmmsg(net->sock.socket, batch->msgs, NET_RECV_BATCH_SIZE, 0, nullptr);
+
+        if (count < 0) {
+            const int error = net_error();
+            networking_count_recv(net, 0);
 
+            if (error == ENOSYS) {
+                LOGGER_WARNING(net->log, "recvmmsg() not supported, falling back to recvfrom()");
+                free(net->recv_batch);
+                net->recv_batch = nullptr;
+                return -1;
+            }
+
+            if (error != TOX_EWOULDBLOCK) {
+                const char *strerror = net_new_strerror(error);
+                LOGGER_ERROR(net->log, "Unexpected error reading from socket: %u, %s", error, strerror);
+                net_kill_strerror(strerror);
+            }
+
+            return 0;
+        }
+
+        networking_count_recv(net, (uint32_t)count);
+
+        for (int i = 0; i < count; ++i) {
+            IP_Port ip_port;
+
+            if (ip_port_from_sockaddr(&batch->addrs[i], &ip_port) == -1) {
+                continue;
+            }
+
+            const uint32_t length = batch->msgs[i].msg_len;
+            loglogdata(net->log, "=>O", batch->data[i], MAX_UDP_PACKET_SIZE, ip_port, length);
+            networking_received(net, ip_port, batch->data[i], length, userdata);
+        }
+
+        /* A short batch means the receive queue is empty, so we can skip the
+         * syscall that would only tell us EWOULDBLOCK. */
+        if (count < NET_RECV_BATCH_SIZE) {
+            return 0;
+        }
+    }
+}
+#endif
+
+typedef struct Net_Uring_Recv {
+    Networking_Core *net;
+    void *userdata;
+} Net_Uring_Recv;
+
+static void networking_uring_recv(void *object, const struct sockaddr_storage *addr, const uint8_t *data,
+                                  uint16_t length)
+{
+    const Net_Uring_Recv *const recv = (const Net_Uring_Recv *)object;
+    IP_Port ip_port;
+
+    if (ip_port_from_sockaddr(addr, &ip_port) == -1) {
+        return;
+    }
+
+    loglogdata(recv->net->log, "=>O", data, MAX_UDP_PACKET_SIZE, ip_port, length);
+    networking_received(recv->net, ip_port, data, length, recv->userdata);
+}
+
+/* Handle the datagrams io_uring received since the last poll.
+ *
+ * return 0 on success.
+ * return -1 if the kernel can't receive through io_uring; the caller must
+ *   read the socket itself.
+ */
+static int networking_poll_uring(Networking_Core *net, void *userdata)
+{
+    Net_Uring_Recv recv = {net, userdata};
+    uint64_t syscalls = 0;
+    const int received = net_uring_poll(net->uring, networking_uring_recv, &recv, &syscalls);
+
+    net->recv_stats.syscalls += syscalls;
+
+    if (received < 0) {
+        return -1;
+    }
+
+    net->recv_stats.packets += (uint32_t)received;
+    net->recv_stats.last_poll_packets += (uint32_t)received;
+
+    if ((uint32_t)received > net->recv_stats.max_batch_size) {
+        net->recv_stats.max_batch_size = (uint32_t)received;
+    }
+
+    return 0;
+}
+
+/* Drain the UDP socket one recvfrom() at a time. */
+static void networking_poll_single(Networking_Core *net, void *userdata)
+{
     IP_Port ip_port;
     uint8_t data[MAX_UDP_PACKET_SIZE];
     uint32_t length;
 
     while (receivepacket(net->log, net->sock, &ip_port, data, &length) != -1) {
-        if (length < 1) {
-            continue;
-        }
+        networking_count_recv(net, 1);
+        networking_received(net, ip_port, data, length, userdata);
+    }
 
-        if (!(net->packethandlers[data[0]].function)) {
-            LOGGER_WARNING(net->log, "[%02u] -- Packet has no handler", data[0]);
-            continue;
-        }
+    networking_count_recv(net, 0);
+}
+
+void networking_poll(Networking_Core *net, void *userdata)
+{
+    if (net_family_is_unspec(net->family)) {
+        /* Socket not initialized */
+        return;
+    }
 
-        net->packethandlers[data[0]].function(net->packethandlers[data[0]].object, ip_port, data, length, userdata);
+    if (net->update_time) {
+        unix_time_update();
     }
+
+    ++net->recv_stats.polls;
+    net->recv_stats.last_poll_packets = 0;
+
+    if (net->rate_limiter != nullptr) {
+        net->poll_time = current_time_monotonic();
+    }
+
+    /* Packets that waited for their shared key go before the new ones. */
+    if (net->crypto_pool != nullptr) {
+        crypto_pool_do(net->crypto_pool, userdata);
+    }
+
+    if (net->uring != nullptr && networking_poll_uring(net, userdata) == 0) {
+        /* Send the replies to what we just received. */
+        networking_flush_send_queue(net);
+        return;
+    }
+
+#ifdef NET_USE_RECVMMSG
+
+    if (net->recv_batch == nullptr || networking_poll_batched(net, userdata) == -1) {
+        networking_poll_single(net, userdata);
+    }
+
+#else
+    networking_poll_single(net, userdata);
+#endif
+
+    /* Send the replies to what we just received. */
+    networking_flush_send_queue(net);
 }
 
 #ifndef VANILLA_NACL
@@ -768,20 +1365,12 @@ static void at_shutdown(void)
  */
 Networking_Core *new_networking(Logger *log, IP ip, uint16_t port)
 {
-    return new_networking_ex(log, ip, port, port + (TOX_PORTRANGE_TO - TOX_PORTRANGE_FROM), nullptr);
+    return new_networking_ex(log, ip, port, port + (TOX_PORTRANGE_TO - TOX_PORTRANGE_FROM), NET_BACKEND_SOCKETS,
+                             nullptr);
 }
 
-/* Initialize networking.
- * Bind to ip and port.
- * ip must be in network order EX: 127.0.0.1 = (7F000001).
- * port is in host byte order (this means don't worry about it).
- *
- *  return Networking_Core object if no problems
- *  return NULL if there are problems.
- *
- * If error is non NULL it is set to 0 if no issues, 1 if socket related error, 2 if other.
- */
-Networking_Core *new_networking_ex(Logger *log, IP ip, uint16_t port_from, uint16_t port_to, unsigned int *error)
+static Networking_Core *new_networking_impl(Logger *log, IP ip, uint16_t port_from, uint16_t port_to, bool reuseport,
+        Net_Backend backend, unsigned int *error)
 {
     /* If both from and to are 0, use default port range
      * If one is 0 and the other is non-0, use the non-0 value as only port
@@ -823,6 +1412,7 @@ Networking_Core *new_networking_ex(Logger *log, IP ip, uint16_t port_from, uint1
     temp->log = log;
     temp->family = ip.family;
     temp->port = 0;
+    temp->update_time = true;
 
     /* Initialize our socket. */
     /* add log message what we're creating */
@@ -875,6 +1465,19 @@ Networking_Core *new_networking_ex(Logger *log, IP ip, uint16_t port_from, uint1
         return nullptr;
     }
 
+    /* Let other sockets bind to the same port, the kernel then spreads
+     * incoming packets over them by source address. */
+    if (reuseport && !set_socket_reuseport(temp->sock)) {
+        LOGGER_ERROR(log, "Failed to enable SO_REUSEPORT");
+        kill_networking(temp);
+
+        if (error) {
+            *error = 1;
+        }
+
+        return nullptr;
+    }
+
     /* Bind our socket to port PORT and the given IP address (usually 0.0.0.0 or ::) */
     uint16_t *portptr = nullptr;
     struct sockaddr_storage addr;
@@ -969,6 +1572,19 @@ Networking_Core *new_networking_ex(Logger *log, IP ip, uint16_t port_from, uint1
                 *error = 0;
             }
 
+#ifdef NET_USE_RECVMMSG
+            /* Without the batch buffers we simply fall back to recvfrom(). */
+            temp->recv_batch = new_recv_batch();
+#endif
+
+            if (backend == NET_BACKEND_IO_URING) {
+                temp->uring = net_uring_new(log, temp->sock);
+
+                if (temp->uring == nullptr) {
+                    LOGGER_WARNING(log, "io_uring not available, using plain socket calls");
+                }
+            }
+
             return temp;
         }
 
@@ -996,6 +1612,27 @@ Networking_Core *new_networking_ex(Logger *log, IP ip, uint16_t port_from, uint1
     return nullptr;
 }
 
+/* Initialize networking.
+ * Bind to ip and port.
+ * ip must be in network order EX: 127.0.0.1 = (7F000001).
+ * port is in host byte order (this means don't worry about it).
+ *
+ *  return Networking_Core object if no problems
+ *  return NULL if there are problems.
+ *
+ * If error is non NULL it is set to 0 if no issues, 1 if socket related error, 2 if other.
+ */
+Networking_Core *new_networking_ex(Logger *log, IP ip, uint16_t port_from, uint16_t port_to, Net_Backend backend,
+                                   unsigned int *error)
+{
+    return new_networking_impl(log, ip, port_from, port_to, false, backend, error);
+}
+
+Networking_Core *new_networking_reuseport(Logger *log, IP ip, uint16_t port, unsigned int *error)
+{
+    return new_networking_impl(log, ip, port, port, true, NET_BACKEND_SOCKETS, error);
+}
+
 Networking_Core *new_networking_no_udp(Logger *log)
 {
     /* this is the easiest way to completely disable UDP without changing too much code. */
@@ -1017,11 +1654,26 @@ void kill_networking(Networking_Core *net)
         return;
     }
 
+    if (net->send_queue != nullptr) {
+        networking_flush_send_queue(net);
+        pthread_mutex_destroy(&net->send_queue->mutex);
+        free(net->send_queue);
+    }
+
+    crypto_pool_kill(net->crypto_pool);
+    rate_limiter_kill(net->rate_limiter);
+
+    /* Must go before the socket, the kernel may still be using it. */
+    net_uring_kill(net->uring);
+
     if (!net_family_is_unspec(net->family)) {
         /* Socket is initialized, so we close it. */
         kill_sock(net->sock);
     }
 
+#ifdef NET_USE_RECVMMSG
+    free(net->recv_batch);
+#endif
     free(net);
 }
 
@@ -1093,6 +1745,23 @@ int ipport_equal(const IP_Port *a, const IP_Port *b)
     return ip_equal(&a->ip, &b->ip);
 }
 
+void ipport_key(const IP_Port *ip_port, uint8_t *key)
+{
+    memset(key, 0, SIZE_IPPORT);
+    key[0] = ip_port->ip.family.value;
+
+    if (net_family_is_ipv6(ip_port->ip.family) && IPV6_IPV4_IN_V6(ip_port->ip.ip.v6)) {
+        key[0] = net_family_ipv4.value;
+        memcpy(key + 1, &ip_port->ip.ip.v6.uint32[3], SIZE_IP4);
+    } else if (net_family_is_ipv4(ip_port->ip.family) || net_family_is_tcp_ipv4(ip_port->ip.family)) {
+        memcpy(key + 1, ip_port->ip.ip.v4.uint8, SIZE_IP4);
+    } else if (net_family_is_ipv6(ip_port->ip.family) || net_family_is_tcp_ipv6(ip_port->ip.family)) {
+        memcpy(key + 1, ip_port->ip.ip.v6.uint8, SIZE_IP6);
+    }
+
+    memcpy(key + SIZE_IP, &ip_port->port, SIZE_PORT);
+}
+
 /* nulls out ip */
 void ip_reset(IP *ip)
 {
@@ -107,6 +107,8 @@ typedef enum NET_PACKET_TYPE {
     NET_PACKET_COOKIE_RESPONSE      = 0x19, /* Cookie response packet */
     NET_PACKET_CRYPTO_HS            = 0x1a, /* Crypto handshake packet */
     NET_PACKET_CRYPTO_DATA          = 0x1b, /* Crypto data packet */
+    NET_PACKET_CRYPTO_STREAM_DATA   = 0x1c, /* Crypto data packet of a lossless stream */
+    NET_PACKET_CRYPTO_RESUME        = 0x1d, /* Crypto session resumption packet */
     NET_PACKET_CRYPTO               = 0x20, /* Encrypted data packet ID. */
     NET_PACKET_LAN_DISCOVERY        = 0x21, /* LAN discovery packet ID. */
 
@@ -281,6 +283,14 @@ int ip_equal(const IP *a, const IP *b);
  */
 int ipport_equal(const IP_Port *a, const IP_Port *b);
 
+/* ipport_key
+ *  writes SIZE_IPPORT bytes into key that are the same for the same address
+ *  and port: an IPv4 address in an IPv6 one is written as the IPv4 one, and
+ *  the bytes the address doesn't use are 0, so keys can be hashed and compared
+ *  with memcmp, unlike IP_Port with its padding.
+ */
+void ipport_key(const IP_Port *ip_port, uint8_t *key);
+
 /* nulls out ip */
 void ip_reset(IP *ip);
 /* nulls out ip, sets family according to flag */
@@ -339,9 +349,44 @@ typedef int (*packet_handler_callback)(void *object, IP_Port ip_port, const uint
 
 typedef struct Networking_Core Networking_Core;
 
+/* How a Networking_Core talks to its UDP socket. */
+typedef enum Net_Backend {
+    /* Plain BSD socket calls (recvmmsg/recvfrom, sendto). */
+    NET_BACKEND_SOCKETS,
+
+    /* io_uring with a multishot receive and asynchronous sends (Linux only).
+     * Sends wait for networking_flush_send_queue(), as with the send queue.
+     * Falls back to NET_BACKEND_SOCKETS where io_uring is not available.
+     */
+    NET_BACKEND_IO_URING,
+} Net_Backend;
+
 Family net_family(const Networking_Core *net);
 uint16_t net_port(const Networking_Core *net);
 
+/* Maximum number of datagrams read from the UDP socket with a single syscall
+ * on platforms supporting batched receives (recvmmsg on Linux).
+ */
+#define NET_RECV_BATCH_SIZE 32
+
+/* Receive counters of the UDP socket, updated by networking_poll().
+ * The average batch size is packets / syscalls.
+ */
+typedef struct Net_Recv_Stats {
+    uint64_t polls;              /* Number of networking_poll() calls. */
+    uint64_t syscalls;           /* Number of receive syscalls made. */
+    uint64_t packets;            /* Number of datagrams received. */
+    uint32_t last_poll_packets;  /* Datagrams received by the last networking_poll(). */
+    uint32_t max_batch_size;     /* Most datagrams returned by a single syscall. */
+} Net_Recv_Stats;
+
+const Net_Recv_Stats *net_recv_stats(const Networking_Core *net);
+
+/* return the backend actually in use, which may differ from the one requested
+ *   if it was not available.
+ */
+Net_Backend net_backend(const Networking_Core *net);
+
 /* Run this before creating sockets.
  *
  * return 0 on success
@@ -374,6 +419,13 @@ int set_socket_nosigpipe(Socket sock);
  */
 int set_socket_reuseaddr(Socket sock);
 
+/* Enable SO_REUSEPORT on socket.
+ *
+ * return 1 on success
+ * return 0 on failure
+ */
+int set_socket_reuseport(Socket sock);
+
 /* Set socket to dual (IPv4 + IPv6 socket)
  *
  * return 1 on success
@@ -386,12 +438,120 @@ uint64_t current_time_monotonic(void);
 
 /* Basic network functions: */
 
-/* Function to send packet(data) of length length to ip_port. */
+/* Function to send packet(data) of length length to ip_port.
+ *
+ * If the send queue or the io_uring backend is in use, the packet is only
+ * queued and length is returned; errors are then logged when the queue is
+ * flushed.
+ */
 int sendpacket(Networking_Core *net, IP_Port ip_port, const uint8_t *data, uint16_t length);
 
+/* Number of packets the send queue holds before it is flushed automatically. */
+#define NET_SEND_QUEUE_SIZE 64
+
+/* Defer sendpacket() calls until networking_flush_send_queue(), which sends
+ * them all with as few syscalls as possible (sendmmsg on Linux).
+ * networking_poll() flushes the queue when it is done.
+ *
+ * return 0 on success.
+ * return -1 on failure or if UDP is disabled.
+ */
+int networking_enable_send_queue(Networking_Core *net);
+
+/* Send all packets deferred by sendpacket(). Does nothing if neither the send
+ * queue nor the io_uring backend is in use.
+ */
+void networking_flush_send_queue(Networking_Core *net);
+
+/* return true if the send queue or the io_uring backend holds packets that
+ *   networking_flush_send_queue() has not sent yet.
+ */
+bool networking_send_queue_pending(Networking_Core *net);
+
+/* Threads that compute shared keys for packets from peers we have no key for
+ * yet, see crypto_pool.h.
+ */
+typedef struct Crypto_Pool Crypto_Pool;
+
+/* Start num_threads threads for computing shared keys off the main loop.
+ * networking_poll() passes the packets that waited for a key back to their
+ * handler once it is ready.
+ *
+ * return 0 on success.
+ * return -1 on failure or if UDP is disabled.
+ */
+int networking_enable_crypto_pool(Networking_Core *net, uint32_t num_threads);
+
+/* return the crypto pool of net, or NULL if it was not enabled. */
+Crypto_Pool *networking_crypto_pool(const Networking_Core *net);
+
+/* Let a single source, an IPv4 address or IPv6 /64 network, send us at most
+ * rate packets starting with packet_id per second, and up to burst at once
+ * after it has been quiet. networking_poll() drops the packets over the limit
+ * before they reach their handler, so they cost no key agreement or
+ * decryption. A rate of 0 lifts the limit. See rate_limiter.h.
+ *
+ * return 0 on success.
+ * return -1 on failure or if rate is not 0 and burst is 0.
+ */
+int networking_set_rate_limit(Networking_Core *net, uint8_t packet_id, uint32_t rate, uint32_t burst);
+
+/* Write the limit set for packets starting with packet_id into rate and burst. */
+void networking_get_rate_limit(const Networking_Core *net, uint8_t packet_id, uint32_t *rate, uint32_t *burst);
+
+/* return the number of packets starting with packet_id dropped for being over
+ *   the rate limit.
+ */
+uint64_t networking_rate_limited(const Networking_Core *net, uint8_t packet_id);
+
+/* I/O a socket is waiting for, for driving toxcore from an external event loop.
+ */
+typedef enum Net_Fd_Event {
+    NET_FD_EVENT_READ = 1,
+    NET_FD_EVENT_WRITE = 2,
+} Net_Fd_Event;
+
+/* The caller's arrays the descriptors to watch are written into, so that they
+ * can be listed without allocating.
+ */
+typedef struct Net_Fds {
+    int32_t *fds;      /* max_fds descriptors, or NULL to only count them. */
+    uint8_t *events;   /* Bitwise or of Net_Fd_Event values for each, may be NULL. */
+    uint32_t max_fds;
+    uint32_t count;    /* Descriptors to watch so far, which may be more than max_fds. */
+} Net_Fds;
+
+/* Add sock, which waits for events, to fds if there is room, and count it. */
+void net_fds_add(Net_Fds *fds, Socket sock, uint8_t events);
+
+/* Add the descriptors networking_poll() reads from to fds. That is the UDP
+ * socket, or the io_uring when it receives for us, and the crypto pool's
+ * descriptor if it has one. None if UDP is disabled.
+ */
+void networking_fds(const Networking_Core *net, Net_Fds *fds);
+
 /* Function to call when packet beginning with byte is received. */
 void networking_registerhandler(Networking_Core *net, uint8_t byte, packet_handler_callback cb, void *object);
 
+/* Return the function registered for packets beginning with byte, or NULL if
+ * there is none. Its object is stored in *object.
+ */
+packet_handler_callback networking_get_handler(const Networking_Core *net, uint8_t byte, void **object);
+
+/* Pass a packet to the handler registered for its first byte, as if it had
+ * been received by networking_poll(). Used to hand packets received on another
+ * socket over to this one's handlers.
+ */
+void networking_dispatch(Networking_Core *net, IP_Port ip_port, const uint8_t *data, uint32_t length,
+                         void *userdata);
+
+/* Whether networking_poll() updates the time unix_time() returns, which it
+ * does unless this turned it off. That time is shared by all threads and
+ * updating it isn't thread-safe, so with several threads polling only one of
+ * them may update it.
+ */
+void networking_set_update_time(Networking_Core *net, bool update_time);
+
 /* Call this several times a second. */
 void networking_poll(Networking_Core *net, void *userdata);
 
@@ -459,9 +619,21 @@ void net_kill_strerror(const char *strerror);
  * If error is non NULL it is set to 0 if no issues, 1 if socket related error, 2 if other.
  */
 Networking_Core *new_networking(Logger *log, IP ip, uint16_t port);
-Networking_Core *new_networking_ex(Logger *log, IP ip, uint16_t port_from, uint16_t port_to, unsigned int *error);
+
+/* Like new_networking(), but try all ports from port_from to port_to and talk
+ * to the socket through backend.
+ */
+Networking_Core *new_networking_ex(Logger *log, IP ip, uint16_t port_from, uint16_t port_to, Net_Backend backend,
+                                   unsigned int *error);
 Networking_Core *new_networking_no_udp(Logger *log);
 
+/* Like new_networking_ex(), but bind to exactly port with SO_REUSEPORT set, so
+ * that several Networking_Core objects (usually one per thread) can share one
+ * UDP port. The kernel hashes each packet to one of them by its source address.
+ * All sockets sharing the port must be created with this function.
+ */
+Networking_Core *new_networking_reuseport(Logger *log, IP ip, uint16_t port, unsigned int *error);
+
 /* Function to cleanup networking stuff (doesn't do much right now). */
 void kill_networking(Networking_Core *net);
 
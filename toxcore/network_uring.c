@@ -0,0 +1,683 @@
+/*
+ * io_uring backend for the UDP socket of a Networking_Core.
+ */
+
+/*
+ * Copyright © 2016-2018 The TokTok team.
+ *
+ * This file is part of Tox, the free peer to peer instant messenger.
+ *
+ * Tox is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Tox is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Tox.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+/* syscall() and MAP_ANONYMOUS are not in POSIX. */
+#define _GNU_SOURCE
+#endif
+
+#include "network_uring.h"
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#endif
+#endif
+
+/* Multishot recvmsg (Linux 6.0) is the newest feature we need; the kernel may
+ * still be older than the headers, which we find out at runtime. */
+#ifdef IORING_RECV_MULTISHOT
+#define NET_USE_IO_URING
+#endif
+
+#ifdef NET_USE_IO_URING
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+/* Size of the submission queue, which is also the most sends in flight. */
+#define NET_URING_ENTRIES 128
+
+/* Number of receive buffers handed to the kernel, must be a power of 2. */
+#define NET_URING_RECV_BUFFERS 64
+#define NET_URING_RECV_GROUP 0
+
+/* A multishot recvmsg buffer holds a header, the source address and the
+ * datagram. */
+#define NET_URING_RECV_BUFFER_SIZE \
+    (sizeof(struct io_uring_recvmsg_out) + sizeof(struct sockaddr_storage) + MAX_UDP_PACKET_SIZE)
+
+/* user_data of the requests that aren't sends, which use their slot index. */
+#define NET_URING_RECV_TAG UINT64_MAX
+#define NET_URING_CANCEL_TAG (UINT64_MAX - 1)
+
+/* How often net_uring_kill() waits for completions before giving up. */
+#define NET_URING_KILL_MAX_WAITS 100
+
+typedef struct Net_Uring_Send {
+    struct sockaddr_storage addr;
+    struct iovec iov;
+    struct msghdr msg;
+    uint8_t data[MAX_UDP_PACKET_SIZE];
+} Net_Uring_Send;
+
+struct Net_Uring {
+    Logger *log;
+    Socket sock;
+    int fd;
+
+    /* Guards the submission queue and the send slots: toxav threads send too,
+     * while completions are only reaped by the thread calling net_uring_poll().
+     */
+    pthread_mutex_t mutex;
+
+    void *sq_ptr;
+    size_t sq_size;
+    void *cq_ptr;
+    size_t cq_size;
+    struct io_uring_sqe *sqes;
+    size_t sqes_size;
+
+    uint32_t *sq_head;
+    uint32_t *sq_tail;
+    uint32_t *sq_flags;
+    uint32_t *sq_array;
+    uint32_t sq_mask;
+    uint32_t sq_entries;
+    uint32_t sq_pending;
+
+    uint32_t *cq_head;
+    uint32_t *cq_tail;
+    uint32_t cq_mask;
+    struct io_uring_cqe *cqes;
+
+    struct io_uring_buf_ring *buf_ring;
+    size_t buf_ring_size;
+    uint8_t *recv_buffers;
+    struct msghdr recv_msg;
+    bool recv_supported;
+    bool recv_armed;
+    /* The receive stopped because we were slow to return buffers, so there
+     * may be more data waiting in the socket. */
+    bool recv_starved;
+    bool cancelled;
+
+    Net_Uring_Send sends[NET_URING_ENTRIES];
+    uint16_t free_sends[NET_URING_ENTRIES];
+    uint16_t num_free_sends;
+};
+
+static int uring_setup(uint32_t entries, struct io_uring_params *params)
+{
+    return (int)syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int uring_enter(int fd, uint32_t to_submit, uint32_t min_complete, uint32_t flags)
+{
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, nullptr, 0);
+}
+
+static int uring_register(int fd, uint32_t opcode, const void *arg, uint32_t nr_args)
+{
+    return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+/* Submit everything queued so far. Must be called with the mutex held.
+ *
+ * return the number of syscalls made.
+ */
+static uint32_t uring_submit_locked(Net_Uring *uring)
+{
+    if (uring->sq_pending == 0) {
+        return 0;
+    }
+
+    const int ret = uring_enter(uring->fd, uring->sq_pending, 0, 0);
+
+    if (ret >= 0) {
+        uring->sq_pending -= (uint32_t)ret;
+    } else if (errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+        LOGGER_ERROR(uring->log, "io_uring_enter failed: %d", errno);
+    }
+
+    return 1;
+}
+
+/* Get the next free submission queue entry, submitting the queue if it is
+ * full. Must be called with the mutex held, and followed by uring_push_sqe().
+ *
+ * return NULL if the queue stays full.
+ */
+static struct io_uring_sqe *uring_get_sqe(Net_Uring *uring)
+{
+    const uint32_t tail = *uring->sq_tail;
+
+    if (tail - __atomic_load_n(uring->sq_head, __ATOMIC_ACQUIRE) == uring->sq_entries) {
+        uring_submit_locked(uring);
+
+        if (tail - __atomic_load_n(uring->sq_head, __ATOMIC_ACQUIRE) == uring->sq_entries) {
+            return nullptr;
+        }
+    }
+
+    const uint32_t index = tail & uring->sq_mask;
+    struct io_uring_sqe *sqe = &uring->sqes[index];
+    memset(sqe, 0, sizeof(struct io_uring_sqe));
+    uring->sq_array[index] = index;
+    return sqe;
+}
+
+static void uring_push_sqe(Net_Uring *uring)
+{
+    __atomic_store_n(uring->sq_tail, *uring->sq_tail + 1, __ATOMIC_RELEASE);
+    ++uring->sq_pending;
+}
+
+/* Post the multishot receive. It stays armed until the kernel runs out of
+ * buffers or fails. Must be called with the mutex held.
+ */
+static void uring_arm_recv(Net_Uring *uring)
+{
+    struct io_uring_sqe *sqe = uring_get_sqe(uring);
+
+    if (sqe == nullptr) {
+        return;
+    }
+
+    sqe->opcode = IORING_OP_RECVMSG;
+    sqe->fd = uring->sock.socket;
+    sqe->addr = (uintptr_t)&uring->recv_msg;
+    sqe->len = 1;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = NET_URING_RECV_GROUP;
+    sqe->user_data = NET_URING_RECV_TAG;
+    uring_push_sqe(uring);
+
+    uring->recv_armed = true;
+}
+
+/* Give receive buffer bid back to the kernel. Only the polling thread touches
+ * the buffer ring, so this needs no lock.
+ */
+static void uring_recycle_buffer(Net_Uring *uring, uint16_t bid)
+{
+    struct io_uring_buf_ring *ring = uring->buf_ring;
+    const uint16_t tail = ring->tail;
+    struct io_uring_buf *buf = &ring->bufs[tail & (NET_URING_RECV_BUFFERS - 1)];
+
+    buf->addr = (uintptr_t)(uring->recv_buffers + (size_t)bid * NET_URING_RECV_BUFFER_SIZE);
+    buf->len = NET_URING_RECV_BUFFER_SIZE;
+    buf->bid = bid;
+
+    __atomic_store_n(&ring->tail, (uint16_t)(tail + 1), __ATOMIC_RELEASE);
+}
+
+/* Register the receive buffers and post the first receive.
+ *
+ * return true on success.
+ * return false if the kernel doesn't support provided buffer rings.
+ */
+static bool uring_setup_recv(Net_Uring *uring)
+{
+    uring->buf_ring_size = NET_URING_RECV_BUFFERS * sizeof(struct io_uring_buf);
+    void *ring = mmap(nullptr, uring->buf_ring_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if (ring == MAP_FAILED) {
+        return false;
+    }
+
+    uring->buf_ring = (struct io_uring_buf_ring *)ring;
+    uring->recv_buffers = (uint8_t *)malloc(NET_URING_RECV_BUFFERS * NET_URING_RECV_BUFFER_SIZE);
+
+    if (uring->recv_buffers == nullptr) {
+        return false;
+    }
+
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uintptr_t)ring;
+    reg.ring_entries = NET_URING_RECV_BUFFERS;
+    reg.bgid = NET_URING_RECV_GROUP;
+
+    if (uring_register(uring->fd, IORING_REGISTER_PBUF_RING, &reg, 1) != 0) {
+        return false;
+    }
+
+    for (uint16_t i = 0; i < NET_URING_RECV_BUFFERS; ++i) {
+        uring_recycle_buffer(uring, i);
+    }
+
+    uring->recv_msg.msg_namelen = sizeof(struct sockaddr_storage);
+    uring_arm_recv(uring);
+    return true;
+}
+
+static void uring_free(Net_Uring *uring)
+{
+    if (uring->fd >= 0) {
+        close(uring->fd);
+    }
+
+    if (uring->sqes != nullptr) {
+        munmap(uring->sqes, uring->sqes_size);
+    }
+
+    if (uring->cq_ptr != nullptr && uring->cq_ptr != uring->sq_ptr) {
+        munmap(uring->cq_ptr, uring->cq_size);
+    }
+
+    if (uring->sq_ptr != nullptr) {
+        munmap(uring->sq_ptr, uring->sq_size);
+    }
+
+    if (uring->buf_ring != nullptr) {
+        munmap(uring->buf_ring, uring->buf_ring_size);
+    }
+
+    free(uring->recv_buffers);
+    pthread_mutex_destroy(&uring->mutex);
+    free(uring);
+}
+
+/* Map the rings of the io_uring set up with params.
+ *
+ * return true on success.
+ */
+static bool uring_map(Net_Uring *uring, const struct io_uring_params *params)
+{
+    uring->sq_size = params->sq_off.array + params->sq_entries * sizeof(uint32_t);
+    uring->cq_size = params->cq_off.cqes + params->cq_entries * sizeof(struct io_uring_cqe);
+
+    const bool single_mmap = (params->features & IORING_FEAT_SINGLE_MMAP) != 0;
+
+    if (single_mmap) {
+        uring->sq_size = uring->cq_size > uring->sq_size ? uring->cq_size : uring->sq_size;
+    }
+
+    void *sq_ptr = mmap(nullptr, uring->sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, uring->fd,
+                        IORING_OFF_SQ_RING);
+
+    if (sq_ptr == MAP_FAILED) {
+        return false;
+    }
+
+    uring->sq_ptr = sq_ptr;
+
+    if (single_mmap) {
+        uring->cq_ptr = sq_ptr;
+    } else {
+        void *cq_ptr = mmap(nullptr, uring->cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, uring->fd,
+                            IORING_OFF_CQ_RING);
+
+        if (cq_ptr == MAP_FAILED) {
+            return false;
+        }
+
+        uring->cq_ptr = cq_ptr;
+    }
+
+    uring->sqes_size = params->sq_entries * sizeof(struct io_uring_sqe);
+    void *sqes = mmap(nullptr, uring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, uring->fd,
+                      IORING_OFF_SQES);
+
+    if (sqes == MAP_FAILED) {
+        return false;
+    }
+
+    uring->sqes = (struct io_uring_sqe *)sqes;
+
+    uint8_t *const sq = (uint8_t *)uring->sq_ptr;
+    uring->sq_head = (uint32_t *)(sq + params->sq_off.head);
+    uring->sq_tail = (uint32_t *)(sq + params->sq_off.tail);
+    uring->sq_flags = (uint32_t *)(sq + params->sq_off.flags);
+    uring->sq_array = (uint32_t *)(sq + params->sq_off.array);
+    uring->sq_mask = *(const uint32_t *)(sq + params->sq_off.ring_mask);
+    uring->sq_entries = *(const uint32_t *)(sq + params->sq_off.ring_entries);
+
+    uint8_t *const cq = (uint8_t *)uring->cq_ptr;
+    uring->cq_head = (uint32_t *)(cq + params->cq_off.head);
+    uring->cq_tail = (uint32_t *)(cq + params->cq_off.tail);
+    uring->cq_mask = *(const uint32_t *)(cq + params->cq_off.ring_mask);
+    uring->cqes = (struct io_uring_cqe *)(cq + params->cq_off.cqes);
+
+    return true;
+}
+
+Net_Uring *net_uring_new(Logger *log, Socket sock)
+{
+    Net_Uring *uring = (Net_Uring *)calloc(1, sizeof(Net_Uring));
+
+    if (uring == nullptr) {
+        return nullptr;
+    }
+
+    if (pthread_mutex_init(&uring->mutex, nullptr) != 0) {
+        free(uring);
+        return nullptr;
+    }
+
+    uring->log = log;
+    uring->sock = sock;
+
+    /* Completions are only looked at in net_uring_poll(), so let the kernel
+     * run their task work then instead of interrupting us for it. */
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_COOP_TASKRUN | IORING_SETUP_TASKRUN_FLAG;
+    uring->fd = uring_setup(NET_URING_ENTRIES, &params);
+
+    if (uring->fd < 0 && errno == EINVAL) {
+        memset(&params, 0, sizeof(params));
+        uring->fd = uring_setup(NET_URING_ENTRIES, &params);
+    }
+
+    if (uring->fd < 0) {
+        LOGGER_DEBUG(log, "io_uring_setup failed: %d", errno);
+        uring_free(uring);
+        return nullptr;
+    }
+
+    if (!uring_map(uring, &params)) {
+        LOGGER_ERROR(log, "failed to map the io_uring: %d", errno);
+        uring_free(uring);
+        return nullptr;
+    }
+
+    for (uint16_t i = 0; i < NET_URING_ENTRIES; ++i) {
+        uring->free_sends[i] = i;
+    }
+
+    uring->num_free_sends = NET_URING_ENTRIES;
+
+    uring->recv_supported = uring_setup_recv(uring);
+
+    if (!uring->recv_supported) {
+        LOGGER_WARNING(log, "io_uring can't receive on this kernel, only using it for sends");
+    }
+
+    pthread_mutex_lock(&uring->mutex);
+    uring_submit_locked(uring);
+    pthread_mutex_unlock(&uring->mutex);
+
+    return uring;
+}
+
+int net_uring_send(Net_Uring *uring, const struct sockaddr_storage *addr, size_t addrsize, const uint8_t *data,
+                   uint16_t length)
+{
+    if (length > MAX_UDP_PACKET_SIZE || addrsize > sizeof(struct sockaddr_storage)) {
+        return -1;
+    }
+
+    pthread_mutex_lock(&uring->mutex);
+
+    struct io_uring_sqe *sqe = uring->num_free_sends > 0 ? uring_get_sqe(uring) : nullptr;
+
+    if (sqe == nullptr) {
+        pthread_mutex_unlock(&uring->mutex);
+        return -1;
+    }
+
+    const uint16_t index = uring->free_sends[--uring->num_free_sends];
+    Net_Uring_Send *const send = &uring->sends[index];
+
+    memcpy(&send->addr, addr, addrsize);
+    memcpy(send->data, data, length);
+    send->iov.iov_base = send->data;
+    send->iov.iov_len = length;
+    memset(&send->msg, 0, sizeof(send->msg));
+    send->msg.msg_name = &send->addr;
+    send->msg.msg_namelen = addrsize;
+    send->msg.msg_iov = &send->iov;
+    send->msg.msg_iovlen = 1;
+
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = uring->sock.socket;
+    sqe->addr = (uintptr_t)&send->msg;
+    sqe->len = 1;
+    sqe->user_data = index;
+    uring_push_sqe(uring);
+
+    pthread_mutex_unlock(&uring->mutex);
+    return length;
+}
+
+void net_uring_submit(Net_Uring *uring)
+{
+    pthread_mutex_lock(&uring->mutex);
+    uring_submit_locked(uring);
+    pthread_mutex_unlock(&uring->mutex);
+}
+
+bool net_uring_send_pending(Net_Uring *uring)
+{
+    pthread_mutex_lock(&uring->mutex);
+    const bool pending = uring->sq_pending > 0;
+    pthread_mutex_unlock(&uring->mutex);
+    return pending;
+}
+
+/* return 1 if a datagram was passed to cb, 0 otherwise. */
+static uint32_t uring_handle_recv(Net_Uring *uring, int32_t res, uint32_t flags, net_uring_recv_cb *cb, void *object)
+{
+    uint32_t received = 0;
+
+    if (!(flags & IORING_CQE_F_MORE)) {
+        uring->recv_armed = false;
+    }
+
+    if (res >= 0 && (flags & IORING_CQE_F_BUFFER)) {
+        const uint16_t bid = (uint16_t)(flags >> IORING_CQE_BUFFER_SHIFT);
+        const uint8_t *const buf = uring->recv_buffers + (size_t)bid * NET_URING_RECV_BUFFER_SIZE;
+
+        struct io_uring_recvmsg_out out;
+        memcpy(&out, buf, sizeof(out));
+
+        const size_t name_offset = sizeof(struct io_uring_recvmsg_out);
+        const size_t payload_offset = name_offset + uring->recv_msg.msg_namelen + uring->recv_msg.msg_controllen;
+
+        if (cb != nullptr && (size_t)res >= payload_offset && payload_offset + out.payloadlen <= (size_t)res
+                && out.namelen <= sizeof(struct sockaddr_storage) && !(out.flags & MSG_TRUNC)) {
+            struct sockaddr_storage addr;
+            memset(&addr, 0, sizeof(addr));
+            memcpy(&addr, buf + name_offset, out.namelen);
+
+            cb(object, &addr, buf + payload_offset, (uint16_t)out.payloadlen);
+            received = 1;
+        }
+
+        uring_recycle_buffer(uring, bid);
+    } else if (res == -ENOBUFS) {
+        uring->recv_starved = true;
+    } else if (res == -EINVAL || res == -EOPNOTSUPP) {
+        LOGGER_WARNING(uring->log, "multishot recvmsg not supported by the kernel, reading the socket directly");
+        uring->recv_supported = false;
+    } else if (res < 0 && res != -ECANCELED) {
+        LOGGER_ERROR(uring->log, "io_uring receive failed: %d", -res);
+    }
+
+    return received;
+}
+
+/* Handle the completions posted so far.
+ *
+ * return the number of datagrams passed to cb.
+ */
+static uint32_t uring_reap(Net_Uring *uring, net_uring_recv_cb *cb, void *object)
+{
+    uint32_t received = 0;
+    uint32_t head = *uring->cq_head;
+    const uint32_t tail = __atomic_load_n(uring->cq_tail, __ATOMIC_ACQUIRE);
+
+    while (head != tail) {
+        const struct io_uring_cqe *cqe = &uring->cqes[head & uring->cq_mask];
+        const uint64_t user_data = cqe->user_data;
+        const int32_t res = cqe->res;
+        const uint32_t flags = cqe->flags;
+
+        if (user_data == NET_URING_RECV_TAG) {
+            received += uring_handle_recv(uring, res, flags, cb, object);
+        } else if (user_data == NET_URING_CANCEL_TAG) {
+            uring->cancelled = true;
+        } else if (user_data < NET_URING_ENTRIES) {
+            if (res < 0 && res != -ECANCELED) {
+                LOGGER_TRACE(uring->log, "io_uring send failed: %d", -res);
+            }
+
+            pthread_mutex_lock(&uring->mutex);
+            uring->free_sends[uring->num_free_sends++] = (uint16_t)user_data;
+            pthread_mutex_unlock(&uring->mutex);
+        }
+
+        ++head;
+        __atomic_store_n(uring->cq_head, head, __ATOMIC_RELEASE);
+    }
+
+    return received;
+}
+
+int net_uring_poll_fd(const Net_Uring *uring)
+{
+    return uring->recv_supported ? uring->fd : -1;
+}
+
+int net_uring_poll(Net_Uring *uring, net_uring_recv_cb *cb, void *object, uint64_t *syscalls)
+{
+    uint32_t received = 0;
+    bool starved;
+
+    /* Every buffer we had may have been used before we got here. Re-arming
+     * the receive makes the kernel read the socket again during the submit,
+     * so keep going until it stops for another reason, like recvmmsg(). */
+    do {
+        /* Let the kernel post the completions it deferred (or that overflowed). */
+        const uint32_t sq_flags = __atomic_load_n(uring->sq_flags, __ATOMIC_ACQUIRE);
+
+        if (sq_flags & (IORING_SQ_TASKRUN | IORING_SQ_CQ_OVERFLOW)) {
+            uring_enter(uring->fd, 0, 0, IORING_ENTER_GETEVENTS);
+            ++*syscalls;
+        }
+
+        uring->recv_starved = false;
+        received += uring_reap(uring, cb, object);
+        starved = uring->recv_starved;
+
+        pthread_mutex_lock(&uring->mutex);
+
+        if (uring->recv_supported && !uring->recv_armed) {
+            uring_arm_recv(uring);
+        }
+
+        *syscalls += uring_submit_locked(uring);
+
+        pthread_mutex_unlock(&uring->mutex);
+    } while (starved && uring->recv_supported);
+
+    if (!uring->recv_supported) {
+        return -1;
+    }
+
+    return received;
+}
+
+void net_uring_kill(Net_Uring *uring)
+{
+    if (uring == nullptr) {
+        return;
+    }
+
+    /* The kernel may still read the send slots and write the receive buffers,
+     * so cancel everything and wait for it to finish before freeing them. */
+    pthread_mutex_lock(&uring->mutex);
+
+    struct io_uring_sqe *sqe = uring_get_sqe(uring);
+
+    if (sqe != nullptr) {
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->cancel_flags = IORING_ASYNC_CANCEL_ANY;
+        sqe->user_data = NET_URING_CANCEL_TAG;
+        uring_push_sqe(uring);
+    } else {
+        uring->cancelled = true;
+    }
+
+    pthread_mutex_unlock(&uring->mutex);
+
+    for (uint32_t i = 0; i < NET_URING_KILL_MAX_WAITS; ++i) {
+        uring_reap(uring, nullptr, nullptr);
+
+        if (uring->cancelled && !uring->recv_armed && uring->num_free_sends == NET_URING_ENTRIES) {
+            break;
+        }
+
+        const int ret = uring_enter(uring->fd, uring->sq_pending, 1, IORING_ENTER_GETEVENTS);
+
+        if (ret >= 0) {
+            uring->sq_pending -= (uint32_t)ret;
+        } else if (errno != EINTR) {
+            LOGGER_ERROR(uring->log, "io_uring_enter failed while closing: %d", errno);
+            break;
+        }
+    }
+
+    uring_free(uring);
+}
+
+#else
+
+Net_Uring *net_uring_new(Logger *log, Socket sock)
+{
+    return nullptr;
+}
+
+void net_uring_kill(Net_Uring *uring)
+{
+}
+
+int net_uring_send(Net_Uring *uring, const struct sockaddr_storage *addr, size_t addrsize, const uint8_t *data,
+                   uint16_t length)
+{
+    return -1;
+}
+
+void net_uring_submit(Net_Uring *uring)
+{
+}
+
+bool net_uring_send_pending(Net_Uring *uring)
+{
+    return false;
+}
+
+int net_uring_poll_fd(const Net_Uring *uring)
+{
+    return -1;
+}
+
+int net_uring_poll(Net_Uring *uring, net_uring_recv_cb *cb, void *object, uint64_t *syscalls)
+{
+    return -1;
+}
+
+#endif
@@ -0,0 +1,94 @@
+/*
+ * io_uring backend for the UDP socket of a Networking_Core.
+ */
+
+/*
+ * Copyright © 2016-2018 The TokTok team.
+ *
+ * This file is part of Tox, the free peer to peer instant messenger.
+ *
+ * Tox is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Tox is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Tox.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef NETWORK_URING_H
+#define NETWORK_URING_H
+
+#include "logger.h"
+#include "network.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct sockaddr_storage;
+
+typedef struct Net_Uring Net_Uring;
+
+typedef void net_uring_recv_cb(void *object, const struct sockaddr_storage *addr, const uint8_t *data,
+                               uint16_t length);
+
+/* Set up an io_uring for the bound UDP socket sock: a multishot receive is kept
+ * posted on it, and sends are queued and submitted in batches.
+ *
+ * return NULL if io_uring is not available (other platforms, old kernels,
+ *   io_uring disabled by the system), in which case the caller uses sock
+ *   directly.
+ */
+Net_Uring *net_uring_new(Logger *log, Socket sock);
+
+/* Wait for the sends in flight, cancel the receive and free the ring. The
+ * socket stays open.
+ */
+void net_uring_kill(Net_Uring *uring);
+
+/* Queue a datagram to addr. It goes out at the next net_uring_submit(), or
+ * earlier if the queue fills up. Thread safe.
+ *
+ * return length on success.
+ * return -1 if all send buffers are in flight; the caller should send it
+ *   directly instead.
+ */
+int net_uring_send(Net_Uring *uring, const struct sockaddr_storage *addr, size_t addrsize, const uint8_t *data,
+                   uint16_t length);
+
+/* Submit the queued sends. Thread safe. */
+void net_uring_submit(Net_Uring *uring);
+
+/* return true if sends are queued that net_uring_submit() has not submitted
+ *   yet. Thread safe.
+ */
+bool net_uring_send_pending(Net_Uring *uring);
+
+/* return the file descriptor that becomes readable when net_uring_poll() has
+ *   datagrams to hand out, or -1 if io_uring isn't receiving for us.
+ */
+int net_uring_poll_fd(const Net_Uring *uring);
+
+/* Reap completions, calling cb for each datagram received since the last call.
+ * Must only be called from one thread at a time. The number of io_uring_enter()
+ * calls made is added to *syscalls.
+ *
+ * return the number of datagrams received.
+ * return -1 if the kernel can't receive through io_uring (no multishot
+ *   recvmsg); the caller must read the socket itself from now on.
+ */
+int net_uring_poll(Net_Uring *uring, net_uring_recv_cb *cb, void *object, uint64_t *syscalls);
+
+#ifdef __cplusplus
+}  // extern "C"
+#endif
+
+#endif
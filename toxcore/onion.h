@@ -32,10 +32,6 @@ typedef struct {
     uint8_t secret_symmetric_key[CRYPTO_SYMMETRIC_KEY_SIZE];
     uint64_t timestamp;
 
-    Shared_Keys shared_keys_1;
-    Shared_Keys shared_keys_2;
-    Shared_Keys shared_keys_3;
-
     int (*recv_1_function)(void *, IP_Port, const uint8_t *, uint16_t);
     void *callback_object;
 } Onion;
@@ -54,10 +54,10 @@ struct Onion_Announce {
     Onion_Announce_Entry entries[ONION_ANNOUNCE_MAX_ENTRIES];
     /* This is CRYPTO_SYMMETRIC_KEY_SIZE long just so we can use new_symmetric_key() to fill it */
     uint8_t secret_bytes[CRYPTO_SYMMETRIC_KEY_SIZE];
-
-    Shared_Keys shared_keys_recv;
 };
 
+static unsigned int entries_reorder(Onion_Announce *onion_a, unsigned int index);
+
 uint8_t *onion_announce_entry_public_key(Onion_Announce *onion_a, uint32_t entry)
 {
     return onion_a->entries[entry].public_key;
@@ -66,6 +66,7 @@ uint8_t *onion_announce_entry_public_key(Onion_Announce *onion_a, uint32_t entry
 void onion_announce_entry_set_time(Onion_Announce *onion_a, uint32_t entry, uint64_t time)
 {
     onion_a->entries[entry].time = time;
+    entries_reorder(onion_a, entry);
 }
 
 /* Create an onion announce request packet in packet of max_packet_length (recommended size ONION_ANNOUNCE_REQUEST_SIZE).
@@ -245,83 +246,120 @@ static void generate_ping_id(const Onion_Announce *onion_a, uint64_t time, const
     crypto_sha256(ping_id, data, sizeof(data));
 }
 
-/* check if public key is in entries list
+/* The entries are kept ordered: the ones never used first, then the others
+ * furthest from our public key first. An entry keeps its place when it times
+ * out, so the order doesn't change with time.
  *
- * return -1 if no
- * return position in list if yes
+ * return true if entry1 goes before entry2.
  */
-static int in_entries(const Onion_Announce *onion_a, const uint8_t *public_key)
+static bool entry_goes_before(const Onion_Announce_Entry *entry1, const Onion_Announce_Entry *entry2,
+                              const uint8_t *comp_public_key)
 {
-    unsigned int i;
-
-    for (i = 0; i < ONION_ANNOUNCE_MAX_ENTRIES; ++i) {
-        if (!is_timeout(onion_a->entries[i].time, ONION_ANNOUNCE_TIMEOUT)
-                && public_key_cmp(onion_a->entries[i].public_key, public_key) == 0) {
-            return i;
-        }
+    if (entry1->time == 0 || entry2->time == 0) {
+        return entry2->time != 0;
     }
 
-    return -1;
+    return id_closest(comp_public_key, entry1->public_key, entry2->public_key) == 2;
 }
 
-typedef struct {
-    const uint8_t *base_public_key;
-    Onion_Announce_Entry entry;
-} Cmp_data;
-
-static int cmp_entry(const void *a, const void *b)
+/* return the index of the first entry that doesn't go before an entry with
+ *   public_key: the entry with public_key if there is one.
+ */
+static unsigned int entry_index(const Onion_Announce *onion_a, const uint8_t *public_key)
 {
-    Cmp_data cmp1, cmp2;
-    memcpy(&cmp1, a, sizeof(Cmp_data));
-    memcpy(&cmp2, b, sizeof(Cmp_data));
-    Onion_Announce_Entry entry1 = cmp1.entry;
-    Onion_Announce_Entry entry2 = cmp2.entry;
-    const uint8_t *cmp_public_key = cmp1.base_public_key;
+    const uint8_t *const comp_public_key = dht_get_self_public_key(onion_a->dht);
+    unsigned int low = 0;
+    unsigned int high = ONION_ANNOUNCE_MAX_ENTRIES;
 
-    int t1 = is_timeout(entry1.time, ONION_ANNOUNCE_TIMEOUT);
-    int t2 = is_timeout(entry2.time, ONION_ANNOUNCE_TIMEOUT);
+    while (low < high) {
+        const unsigned int mid = low + (high - low) / 2;
+        const Onion_Announce_Entry *const entry = &onion_a->entries[mid];
 
-    if (t1 && t2) {
-        return 0;
+        if (entry->time == 0 || id_closest(comp_public_key, entry->public_key, public_key) == 2) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
     }
 
-    if (t1) {
-        return -1;
-    }
+    return low;
+}
 
-    if (t2) {
-        return 1;
+/* return the index of the entry with public_key, timed out or not.
+ * return -1 if there is none.
+ */
+static int entry_with_public_key(const Onion_Announce *onion_a, const uint8_t *public_key)
+{
+    const unsigned int index = entry_index(onion_a, public_key);
+
+    if (index == ONION_ANNOUNCE_MAX_ENTRIES || onion_a->entries[index].time == 0
+            || public_key_cmp(onion_a->entries[index].public_key, public_key) != 0) {
+        return -1;
     }
 
-    int close = id_closest(cmp_public_key, entry1.public_key, entry2.public_key);
+    return index;
+}
 
-    if (close == 1) {
-        return 1;
-    }
+/* check if public key is in entries list
+ *
+ * return -1 if no
+ * return position in list if yes
+ */
+static int in_entries(const Onion_Announce *onion_a, const uint8_t *public_key)
+{
+    const int index = entry_with_public_key(onion_a, public_key);
 
-    if (close == 2) {
+    if (index == -1 || is_timeout(onion_a->entries[index].time, ONION_ANNOUNCE_TIMEOUT)) {
         return -1;
     }
 
-    return 0;
+    return index;
 }
 
-static void sort_onion_announce_list(Onion_Announce_Entry *list, unsigned int length, const uint8_t *comp_public_key)
+/* Move the entry at index to its place, after its public key or time
+ * changed. Only the entries between its old and new place are shifted.
+ *
+ * return its new index.
+ */
+static unsigned int entries_reorder(Onion_Announce *onion_a, unsigned int index)
 {
-    // Pass comp_public_key to qsort with each Client_data entry, so the
-    // comparison function can use it as the base of comparison.
-    VLA(Cmp_data, cmp_list, length);
-
-    for (uint32_t i = 0; i < length; i++) {
-        cmp_list[i].base_public_key = comp_public_key;
-        cmp_list[i].entry = list[i];
+    Onion_Announce_Entry *const entries = onion_a->entries;
+    const uint8_t *const comp_public_key = dht_get_self_public_key(onion_a->dht);
+    const Onion_Announce_Entry entry = entries[index];
+    unsigned int low;
+    unsigned int high;
+
+    if (index > 0 && entry_goes_before(&entry, &entries[index - 1], comp_public_key)) {
+        low = 0;
+        high = index;
+    } else if (index + 1 < ONION_ANNOUNCE_MAX_ENTRIES
+               && entry_goes_before(&entries[index + 1], &entry, comp_public_key)) {
+        low = index + 1;
+        high = ONION_ANNOUNCE_MAX_ENTRIES;
+    } else {
+        return index;
     }
 
-    qsort(cmp_list, length, sizeof(Cmp_data), cmp_entry);
+    /* The first entry in [low, high) the entry goes before, or high. */
+    while (low < high) {
+        const unsigned int mid = low + (high - low) / 2;
+
+        if (entry_goes_before(&entry, &entries[mid], comp_public_key)) {
+            high = mid;
+        } else {
+            low = mid + 1;
+        }
+    }
 
-    for (uint32_t i = 0; i < length; i++) {
-        list[i] = cmp_list[i].entry;
+    if (low < index) {
+        memmove(&entries[low + 1], &entries[low], (index - low) * sizeof(Onion_Announce_Entry));
+    } else {
+        --low;
+        memmove(&entries[index], &entries[index + 1], (low - index) * sizeof(Onion_Announce_Entry));
     }
+
+    entries[low] = entry;
+    return low;
 }
 
 /* add entry to entries list
@@ -333,12 +371,15 @@ static int add_to_entries(Onion_Announce *onion_a, IP_Port ret_ip_port, const ui
                           const uint8_t *data_public_key, const uint8_t *ret)
 {
 
-    int pos = in_entries(onion_a, public_key);
+    /* A timed out entry with the same key is reused, so that keys are never
+     * in the list twice. */
+    int pos = entry_with_public_key(onion_a, public_key);
 
     if (pos == -1) {
         for (unsigned i = 0; i < ONION_ANNOUNCE_MAX_ENTRIES; ++i) {
             if (is_timeout(onion_a->entries[i].time, ONION_ANNOUNCE_TIMEOUT)) {
                 pos = i;
+                break;
             }
         }
     }
@@ -359,8 +400,7 @@ static int add_to_entries(Onion_Announce *onion_a, IP_Port ret_ip_port, const ui
     memcpy(onion_a->entries[pos].data_public_key, data_public_key, CRYPTO_PUBLIC_KEY_SIZE);
     onion_a->entries[pos].time = unix_time();
 
-    sort_onion_announce_list(onion_a->entries, ONION_ANNOUNCE_MAX_ENTRIES, dht_get_self_public_key(onion_a->dht));
-    return in_entries(onion_a, public_key);
+    return entries_reorder(onion_a, pos);
 }
 
 static int handle_announce_request(void *object, IP_Port source, const uint8_t *packet, uint16_t length, void *userdata)
@@ -372,8 +412,13 @@ static int handle_announce_request(void *object, IP_Port source, const uint8_t *
     }
 
     const uint8_t *packet_public_key = packet + 1 + CRYPTO_NONCE_SIZE;
+
+    if (dht_defer_for_shared_key(onion_a->dht, packet_public_key, source, packet, length)) {
+        return 0;
+    }
+
     uint8_t shared_key[CRYPTO_SHARED_KEY_SIZE];
-    get_shared_key(&onion_a->shared_keys_recv, shared_key, dht_get_self_secret_key(onion_a->dht), packet_public_key);
+    DHT_get_shared_key_recv(onion_a->dht, shared_key, packet_public_key);
 
     uint8_t plain[ONION_PING_ID_SIZE + CRYPTO_PUBLIC_KEY_SIZE + CRYPTO_PUBLIC_KEY_SIZE +
                                      ONION_ANNOUNCE_SENDBACK_DATA_LENGTH];
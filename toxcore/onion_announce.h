@@ -48,7 +48,9 @@
 
 typedef struct Onion_Announce Onion_Announce;
 
-/* These two are not public; they are for tests only! */
+/* These two are not public; they are for tests only! Setting the time also
+ * moves the entry to its place in the ordered list, so write its public key
+ * first. */
 uint8_t *onion_announce_entry_public_key(Onion_Announce *onion_a, uint32_t entry);
 void onion_announce_entry_set_time(Onion_Announce *onion_a, uint32_t entry, uint64_t time);
 
@@ -39,6 +39,9 @@
 #define ANNOUNCE_ARRAY_SIZE 256
 #define ANNOUNCE_TIMEOUT 10
 
+/* Friend number, node key, node address and path number of an announce request. */
+#define ANNOUNCE_SENDBACK_DATA_SIZE (sizeof(uint32_t) + CRYPTO_PUBLIC_KEY_SIZE + sizeof(IP_Port) + sizeof(uint32_t))
+
 typedef struct {
     uint8_t     public_key[CRYPTO_PUBLIC_KEY_SIZE];
     IP_Port     ip_port;
@@ -512,7 +515,7 @@ static int send_onion_packet_tcp_udp(const Onion_Client *onion_c, const Onion_Pa
 static int new_sendback(Onion_Client *onion_c, uint32_t num, const uint8_t *public_key, IP_Port ip_port,
                         uint32_t path_num, uint64_t *sendback)
 {
-    uint8_t data[sizeof(uint32_t) + CRYPTO_PUBLIC_KEY_SIZE + sizeof(IP_Port) + sizeof(uint32_t)];
+    uint8_t data[ANNOUNCE_SENDBACK_DATA_SIZE];
     memcpy(data, &num, sizeof(uint32_t));
     memcpy(data + sizeof(uint32_t), public_key, CRYPTO_PUBLIC_KEY_SIZE);
     memcpy(data + sizeof(uint32_t) + CRYPTO_PUBLIC_KEY_SIZE, &ip_port, sizeof(IP_Port));
@@ -541,7 +544,7 @@ static uint32_t check_sendback(Onion_Client *onion_c, const uint8_t *sendback, u
 {
     uint64_t sback;
     memcpy(&sback, sendback, sizeof(uint64_t));
-    uint8_t data[sizeof(uint32_t) + CRYPTO_PUBLIC_KEY_SIZE + sizeof(IP_Port) + sizeof(uint32_t)];
+    uint8_t data[ANNOUNCE_SENDBACK_DATA_SIZE];
 
     if (ping_array_check(onion_c->announce_ping_array, data, sizeof(data), sback) != sizeof(data)) {
         return ~0;
@@ -613,15 +616,12 @@ typedef struct {
 
 static int onion_client_cmp_entry(const void *a, const void *b)
 {
-    Onion_Client_Cmp_data cmp1, cmp2;
-    memcpy(&cmp1, a, sizeof(Onion_Client_Cmp_data));
-    memcpy(&cmp2, b, sizeof(Onion_Client_Cmp_data));
-    Onion_Node entry1 = cmp1.entry;
-    Onion_Node entry2 = cmp2.entry;
-    const uint8_t *cmp_public_key = cmp1.base_public_key;
+    const Onion_Node *entry1 = &((const Onion_Client_Cmp_data *)a)->entry;
+    const Onion_Node *entry2 = &((const Onion_Client_Cmp_data *)b)->entry;
+    const uint8_t *cmp_public_key = ((const Onion_Client_Cmp_data *)a)->base_public_key;
 
-    int t1 = onion_node_timed_out(&entry1);
-    int t2 = onion_node_timed_out(&entry2);
+    int t1 = onion_node_timed_out(entry1);
+    int t2 = onion_node_timed_out(entry2);
 
     if (t1 && t2) {
         return 0;
@@ -635,7 +635,7 @@ static int onion_client_cmp_entry(const void *a, const void *b)
         return 1;
     }
 
-    int close = id_closest(cmp_public_key, entry1.public_key, entry2.public_key);
+    int close = id_closest(cmp_public_key, entry1->public_key, entry2->public_key);
 
     if (close == 1) {
         return 1;
@@ -1858,7 +1858,8 @@ Onion_Client *new_onion_client(Net_Crypto *c)
         return nullptr;
     }
 
-    onion_c->announce_ping_array = ping_array_new(ANNOUNCE_ARRAY_SIZE, ANNOUNCE_TIMEOUT);
+    onion_c->announce_ping_array = ping_array_new_slab(ANNOUNCE_ARRAY_SIZE, ANNOUNCE_TIMEOUT,
+                                                       ANNOUNCE_SENDBACK_DATA_SIZE);
 
     if (onion_c->announce_ping_array == nullptr) {
         free(onion_c);
@@ -35,6 +35,7 @@
 #include "DHT.h"
 #include "network.h"
 #include "ping_array.h"
+#include "timer_wheel.h"
 #include "util.h"
 
 #define PING_NUM_MAX 512
@@ -52,6 +53,8 @@ struct Ping {
     Ping_Array  *ping_array;
     Node_format to_ping[MAX_TO_PING];
     uint64_t    last_to_ping;
+    /* Pending while there are nodes in to_ping. */
+    Timer_Id    to_ping_timer;
 };
 
 
@@ -150,6 +153,10 @@ static int handle_ping_request(void *object, IP_Port source, const uint8_t *pack
         return 1;
     }
 
+    if (dht_defer_for_shared_key(dht, packet + 1, source, packet, length)) {
+        return 0;
+    }
+
     uint8_t shared_key[CRYPTO_SHARED_KEY_SIZE];
 
     uint8_t ping_plain[PING_PLAIN_SIZE];
@@ -237,32 +244,22 @@ static int handle_ping_response(void *object, IP_Port source, const uint8_t *pac
     return 0;
 }
 
-/* Check if public_key with ip_port is in the list.
- *
- * return 1 if it is.
- * return 0 if it isn't.
- */
-static int in_list(const Client_data *list, uint16_t length, const uint8_t *public_key, IP_Port ip_port)
+static void ping_timer(void *object, uint32_t number)
 {
-    unsigned int i;
-
-    for (i = 0; i < length; ++i) {
-        if (id_equal(list[i].public_key, public_key)) {
-            const IPPTsPng *ipptp;
+    Ping *ping = (Ping *)object;
+    ping_iterate(ping);
+}
 
-            if (net_family_is_ipv4(ip_port.ip.family)) {
-                ipptp = &list[i].assoc4;
-            } else {
-                ipptp = &list[i].assoc6;
-            }
+/* Make sure the to_ping list gets looked at once TIME_TO_PING seconds have
+ * passed since it was last.
+ */
+static void schedule_to_ping(Ping *ping)
+{
+    Timer_Wheel *wheel = dht_get_timer_wheel(ping->dht);
 
-            if (!is_timeout(ipptp->timestamp, BAD_NODE_TIMEOUT) && ipport_equal(&ipptp->ip_port, &ip_port)) {
-                return 1;
-            }
-        }
+    if (!timer_wheel_pending(wheel, ping->to_ping_timer)) {
+        ping->to_ping_timer = timer_wheel_add(wheel, ping->last_to_ping + TIME_TO_PING, &ping_timer, ping, 0);
     }
-
-    return 0;
 }
 
 /* Add nodes to the to_ping list.
@@ -285,7 +282,7 @@ int32_t ping_add(Ping *ping, const uint8_t *public_key, IP_Port ip_port)
         return -1;
     }
 
-    if (in_list(dht_get_close_clientlist(ping->dht), LCLIENT_LIST, public_key, ip_port)) {
+    if (node_in_close_list(ping->dht, public_key, ip_port)) {
         return -1;
     }
 
@@ -302,6 +299,7 @@ int32_t ping_add(Ping *ping, const uint8_t *public_key, IP_Port ip_port)
         if (!ip_isset(&ping->to_ping[i].ip_port.ip)) {
             memcpy(ping->to_ping[i].public_key, public_key, CRYPTO_PUBLIC_KEY_SIZE);
             ipport_copy(&ping->to_ping[i].ip_port, &ip_port);
+            schedule_to_ping(ping);
             return 0;
         }
 
@@ -311,6 +309,7 @@ int32_t ping_add(Ping *ping, const uint8_t *public_key, IP_Port ip_port)
     }
 
     if (add_to_list(ping->to_ping, MAX_TO_PING, public_key, ip_port, dht_get_self_public_key(ping->dht))) {
+        schedule_to_ping(ping);
         return 0;
     }
 
@@ -319,7 +318,7 @@ int32_t ping_add(Ping *ping, const uint8_t *public_key, IP_Port ip_port)
 
 
 /* Ping all the valid nodes in the to_ping list every TIME_TO_PING seconds.
- * This function must be run at least once every TIME_TO_PING seconds.
+ * This runs from the DHT timer wheel whenever nodes are waiting in the list.
  */
 void ping_iterate(Ping *ping)
 {
@@ -349,6 +348,11 @@ void ping_iterate(Ping *ping)
     if (i != 0) {
         ping->last_to_ping = unix_time();
     }
+
+    /* Nodes that couldn't be added to the close list this time stay. */
+    if (ip_isset(&ping->to_ping[0].ip_port.ip)) {
+        schedule_to_ping(ping);
+    }
 }
 
 
@@ -360,7 +364,7 @@ Ping *ping_new(DHT *dht)
         return nullptr;
     }
 
-    ping->ping_array = ping_array_new(PING_NUM_MAX, PING_TIMEOUT);
+    ping->ping_array = ping_array_new_slab(PING_NUM_MAX, PING_TIMEOUT, PING_DATA_SIZE);
 
     if (ping->ping_array == nullptr) {
         free(ping);
@@ -376,6 +380,7 @@ Ping *ping_new(DHT *dht)
 
 void ping_kill(Ping *ping)
 {
+    timer_wheel_cancel(dht_get_timer_wheel(ping->dht), ping->to_ping_timer);
     networking_registerhandler(dht_get_net(ping->dht), NET_PACKET_PING_REQUEST, nullptr, nullptr);
     networking_registerhandler(dht_get_net(ping->dht), NET_PACKET_PING_RESPONSE, nullptr, nullptr);
     ping_array_kill(ping->ping_array);
@@ -26,6 +26,10 @@
 #define PING_ARRAY_H
 
 #include "network.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
 %}
 
 class ping_Array {
@@ -42,6 +46,16 @@ struct this;
  */
 static this new(uint32_t size, uint32_t timeout);
 
+/**
+ * Initialize a Ping_Array that keeps the data of its entries in one
+ * preallocated block of size slots of slot_size bytes.
+ * add() then refuses data longer than slot_size. With a slot_size of 0, the
+ * data of each entry is allocated when it is added.
+ *
+ * return NULL on failure.
+ */
+static this new_slab(uint32_t size, uint32_t timeout, uint32_t slot_size);
+
 /**
  * Free all the allocated memory in a Ping_Array.
  */
@@ -68,5 +82,9 @@ int32_t check(uint8_t[length] data, uint64_t ping_id);
 }
 
 %{
+#ifdef __cplusplus
+}  // extern "C"
+#endif
+
 #endif
 %}
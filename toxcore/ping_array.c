@@ -44,6 +44,11 @@ typedef struct {
 struct Ping_Array {
     Ping_Array_Entry *entries;
 
+    /* For an array made with ping_array_new_slab(), the data of entry i is
+     * always at slab + i * slot_size, and nothing is allocated per entry. */
+    uint8_t *slab;
+    uint32_t slot_size;
+
     uint32_t last_deleted; /* number representing the next entry to be deleted. */
     uint32_t last_added; /* number representing the last entry to be added. */
     uint32_t total_size; /* The length of entries */
@@ -58,6 +63,18 @@ struct Ping_Array {
  * return -1 on failure.
  */
 Ping_Array *ping_array_new(uint32_t size, uint32_t timeout)
+{
+    return ping_array_new_slab(size, timeout, 0);
+}
+
+/* Initialize a Ping_Array that keeps the data of its entries in one
+ * preallocated block of size slots of slot_size bytes.
+ * ping_array_add() then refuses data longer than slot_size. With a slot_size
+ * of 0, the data of each entry is allocated when it is added.
+ *
+ * return NULL on failure.
+ */
+Ping_Array *ping_array_new_slab(uint32_t size, uint32_t timeout, uint32_t slot_size)
 {
     if (size == 0 || timeout == 0) {
         return nullptr;
@@ -76,6 +93,21 @@ Ping_Array *ping_array_new(uint32_t size, uint32_t timeout)
         return nullptr;
     }
 
+    if (slot_size != 0) {
+        empty_array->slab = (uint8_t *)calloc(size, slot_size);
+
+        if (empty_array->slab == nullptr) {
+            free(empty_array->entries);
+            free(empty_array);
+            return nullptr;
+        }
+
+        for (uint32_t i = 0; i < size; ++i) {
+            empty_array->entries[i].data = empty_array->slab + (size_t)i * slot_size;
+        }
+    }
+
+    empty_array->slot_size = slot_size;
     empty_array->last_deleted = empty_array->last_added = 0;
     empty_array->total_size = size;
     empty_array->timeout = timeout;
@@ -84,8 +116,11 @@ Ping_Array *ping_array_new(uint32_t size, uint32_t timeout)
 
 static void clear_entry(Ping_Array *array, uint32_t index)
 {
-    free(array->entries[index].data);
-    array->entries[index].data = nullptr;
+    if (array->slab == nullptr) {
+        free(array->entries[index].data);
+        array->entries[index].data = nullptr;
+    }
+
     array->entries[index].length =
         array->entries[index].time =
             array->entries[index].ping_id = 0;
@@ -101,6 +136,7 @@ void ping_array_kill(Ping_Array *array)
         ++array->last_deleted;
     }
 
+    free(array->slab);
     free(array->entries);
     free(array);
 }
@@ -128,18 +164,24 @@ static void ping_array_clear_timedout(Ping_Array *array)
  */
 uint64_t ping_array_add(Ping_Array *array, const uint8_t *data, uint32_t length)
 {
+    if (array->slab != nullptr && length > array->slot_size) {
+        return 0;
+    }
+
     ping_array_clear_timedout(array);
     uint32_t index = array->last_added % array->total_size;
 
-    if (array->entries[index].data != nullptr) {
+    if (array->entries[index].ping_id != 0) {
         array->last_deleted = array->last_added - array->total_size;
         clear_entry(array, index);
     }
 
-    array->entries[index].data = malloc(length);
+    if (array->slab == nullptr) {
+        array->entries[index].data = malloc(length);
 
-    if (array->entries[index].data == nullptr) {
-        return 0;
+        if (array->entries[index].data == nullptr) {
+            return 0;
+        }
     }
 
     memcpy(array->entries[index].data, data, length);
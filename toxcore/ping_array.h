@@ -26,6 +26,10 @@
 
 #include "network.h"
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 #ifndef PING_ARRAY_DEFINED
 #define PING_ARRAY_DEFINED
 typedef struct Ping_Array Ping_Array;
@@ -41,6 +45,16 @@ typedef struct Ping_Array Ping_Array;
  */
 struct Ping_Array *ping_array_new(uint32_t size, uint32_t timeout);
 
+/**
+ * Initialize a Ping_Array that keeps the data of its entries in one
+ * preallocated block of size slots of slot_size bytes.
+ * ping_array_add() then refuses data longer than slot_size. With a slot_size of 0, the
+ * data of each entry is allocated when it is added.
+ *
+ * return NULL on failure.
+ */
+struct Ping_Array *ping_array_new_slab(uint32_t size, uint32_t timeout, uint32_t slot_size);
+
 /**
  * Free all the allocated memory in a Ping_Array.
  */
@@ -64,4 +78,8 @@ uint64_t ping_array_add(struct Ping_Array *_array, const uint8_t *data, uint32_t
  */
 int32_t ping_array_check(struct Ping_Array *_array, uint8_t *data, size_t length, uint64_t ping_id);
 
+#ifdef __cplusplus
+}  // extern "C"
+#endif
+
 #endif
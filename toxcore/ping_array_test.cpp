@@ -0,0 +1,106 @@
+#include "ping_array.h"
+
+#include "util.h"
+
+#include <gtest/gtest.h>
+
+#include <array>
+#include <vector>
+
+namespace {
+
+using Data = std::array<uint8_t, 16>;
+
+Data data_for(uint32_t i)
+{
+    Data data;
+
+    for (size_t j = 0; j < data.size(); ++j) {
+        data[j] = uint8_t(i + j);
+    }
+
+    return data;
+}
+
+class PingArray : public ::testing::TestWithParam<uint32_t>
+{
+protected:
+    void SetUp() override
+    {
+        unix_time_update();
+        array_ = ping_array_new_slab(8, 10, GetParam());
+        ASSERT_NE(array_, nullptr);
+    }
+
+    void TearDown() override
+    {
+        ping_array_kill(array_);
+    }
+
+    Ping_Array *array_;
+};
+
+TEST_P(PingArray, ChecksEachPingOnce)
+{
+    const Data sent = data_for(1);
+    const uint64_t ping_id = ping_array_add(array_, sent.data(), sent.size());
+    ASSERT_NE(ping_id, 0u);
+
+    Data received = {};
+    EXPECT_EQ(ping_array_check(array_, received.data(), received.size(), ping_id), int32_t(sent.size()));
+    EXPECT_EQ(received, sent);
+
+    EXPECT_EQ(ping_array_check(array_, received.data(), received.size(), ping_id), -1);
+}
+
+TEST_P(PingArray, RefusesUnknownPingIds)
+{
+    const Data sent = data_for(1);
+    const uint64_t ping_id = ping_array_add(array_, sent.data(), sent.size());
+    ASSERT_NE(ping_id, 0u);
+
+    Data received;
+    EXPECT_EQ(ping_array_check(array_, received.data(), received.size(), 0), -1);
+    EXPECT_EQ(ping_array_check(array_, received.data(), received.size(), ping_id + 8), -1);
+    EXPECT_EQ(ping_array_check(array_, received.data(), received.size() - 1, ping_id), -1);
+}
+
+TEST_P(PingArray, NewPingsPushOutTheOldest)
+{
+    std::vector<uint64_t> ping_ids;
+
+    for (uint32_t i = 0; i < 12; ++i) {
+        const Data sent = data_for(i);
+        ping_ids.push_back(ping_array_add(array_, sent.data(), sent.size()));
+        ASSERT_NE(ping_ids.back(), 0u);
+    }
+
+    for (uint32_t i = 0; i < 12; ++i) {
+        Data received;
+        const int32_t length = ping_array_check(array_, received.data(), received.size(), ping_ids[i]);
+
+        if (i < 4) {
+            EXPECT_EQ(length, -1);
+        } else {
+            EXPECT_EQ(length, int32_t(received.size()));
+            EXPECT_EQ(received, data_for(i));
+        }
+    }
+}
+
+INSTANTIATE_TEST_CASE_P(SlabAndAllocated, PingArray, ::testing::Values(0u, 16u, 32u));
+
+TEST(PingArraySlab, RefusesDataLongerThanASlot)
+{
+    unix_time_update();
+    Ping_Array *array = ping_array_new_slab(8, 10, 8);
+    ASSERT_NE(array, nullptr);
+
+    const Data sent = data_for(1);
+    EXPECT_EQ(ping_array_add(array, sent.data(), sent.size()), 0u);
+    EXPECT_NE(ping_array_add(array, sent.data(), 8), 0u);
+
+    ping_array_kill(array);
+}
+
+}  // namespace
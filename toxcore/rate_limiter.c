@@ -0,0 +1,216 @@
+/*
+ * Token buckets limiting how many packets of each type a source may send us.
+ */
+
+/*
+ * Copyright © 2016-2018 The TokTok team.
+ *
+ * This file is part of Tox, the free peer to peer instant messenger.
+ *
+ * Tox is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Tox is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Tox.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "rate_limiter.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "ccompat.h"
+#include "crypto_core.h"
+
+/* Like the shared key cache, the buckets are set associative, and the hash
+ * is seeded so that sources can't pick addresses that crowd one set.
+ */
+#define RATE_LIMITER_WAYS 4
+
+/* Tokens are counted in thousandths, so that a bucket refills by rate of them
+ * every millisecond.
+ */
+#define RATE_LIMITER_TOKEN 1000
+
+typedef struct Rate_Limit {
+    uint32_t rate;
+    uint32_t burst;
+} Rate_Limit;
+
+typedef struct Rate_Bucket {
+    /* The IPv4 address or IPv6 /64 prefix, and the packet type. */
+    uint8_t source[8];
+    uint8_t ipv6;
+    uint8_t packet_id;
+
+    uint64_t tokens;
+    /* When tokens were last refilled, 0 for an unused bucket. */
+    uint64_t last_refill;
+} Rate_Bucket;
+
+struct Rate_Limiter {
+    Rate_Limit limits[256];
+    uint64_t dropped[256];
+
+    Rate_Bucket *buckets;
+    uint64_t seed;
+};
+
+Rate_Limiter *rate_limiter_new(void)
+{
+    Rate_Limiter *limiter = (Rate_Limiter *)calloc(1, sizeof(Rate_Limiter));
+
+    if (limiter == nullptr) {
+        return nullptr;
+    }
+
+    limiter->buckets = (Rate_Bucket *)calloc(RATE_LIMITER_SOURCES, sizeof(Rate_Bucket));
+
+    if (limiter->buckets == nullptr) {
+        free(limiter);
+        return nullptr;
+    }
+
+    limiter->seed = random_u64();
+    return limiter;
+}
+
+void rate_limiter_kill(Rate_Limiter *limiter)
+{
+    if (limiter == nullptr) {
+        return;
+    }
+
+    free(limiter->buckets);
+    free(limiter);
+}
+
+int rate_limiter_set(Rate_Limiter *limiter, uint8_t packet_id, uint32_t rate, uint32_t burst)
+{
+    if (rate != 0 && burst == 0) {
+        return -1;
+    }
+
+    limiter->limits[packet_id].rate = rate;
+    limiter->limits[packet_id].burst = burst;
+    return 0;
+}
+
+void rate_limiter_get(const Rate_Limiter *limiter, uint8_t packet_id, uint32_t *rate, uint32_t *burst)
+{
+    *rate = limiter->limits[packet_id].rate;
+    *burst = limiter->limits[packet_id].burst;
+}
+
+static Rate_Bucket *bucket_set(const Rate_Limiter *limiter, const Rate_Bucket *key)
+{
+    uint64_t hash;
+    memcpy(&hash, key->source, sizeof(hash));
+    hash = (hash ^ limiter->seed ^ ((uint64_t)key->packet_id << 1 | key->ipv6)) * UINT64_C(0x9E3779B97F4A7C15);
+    hash ^= hash >> 32;
+
+    const uint32_t num_sets = RATE_LIMITER_SOURCES / RATE_LIMITER_WAYS;
+    return &limiter->buckets[(hash & (num_sets - 1)) * RATE_LIMITER_WAYS];
+}
+
+static bool same_source(const Rate_Bucket *a, const Rate_Bucket *b)
+{
+    return a->packet_id == b->packet_id && a->ipv6 == b->ipv6 && memcmp(a->source, b->source, sizeof(a->source)) == 0;
+}
+
+/* Find the bucket of key's source, or take the least recently refilled one of
+ * its set for it.
+ */
+static Rate_Bucket *find_bucket(Rate_Limiter *limiter, const Rate_Bucket *key, uint64_t full)
+{
+    Rate_Bucket *const set = bucket_set(limiter, key);
+    Rate_Bucket *oldest = &set[0];
+
+    for (uint32_t i = 0; i < RATE_LIMITER_WAYS; ++i) {
+        if (set[i].last_refill != 0 && same_source(&set[i], key)) {
+            return &set[i];
+        }
+
+        if (set[i].last_refill < oldest->last_refill) {
+            oldest = &set[i];
+        }
+    }
+
+    memcpy(oldest->source, key->source, sizeof(oldest->source));
+    oldest->ipv6 = key->ipv6;
+    oldest->packet_id = key->packet_id;
+    oldest->tokens = full;
+    oldest->last_refill = 0;
+    return oldest;
+}
+
+bool rate_limiter_allow(Rate_Limiter *limiter, const IP *source, uint8_t packet_id, uint64_t now)
+{
+    const Rate_Limit *const limit = &limiter->limits[packet_id];
+
+    if (limit->rate == 0) {
+        return true;
+    }
+
+    Rate_Bucket key = {{0}};
+    key.packet_id = packet_id;
+
+    if (net_family_is_ipv4(source->family)) {
+        memcpy(key.source, source->ip.v4.uint8, sizeof(source->ip.v4.uint8));
+    } else if (net_family_is_ipv6(source->family) && IPV6_IPV4_IN_V6(source->ip.v6)) {
+        memcpy(key.source, &source->ip.v6.uint32[3], sizeof(uint32_t));
+    } else if (net_family_is_ipv6(source->family)) {
+        memcpy(key.source, source->ip.v6.uint8, sizeof(key.source));
+        key.ipv6 = 1;
+    } else {
+        return true;
+    }
+
+    const uint64_t full = (uint64_t)limit->burst * RATE_LIMITER_TOKEN;
+    Rate_Bucket *const bucket = find_bucket(limiter, &key, full);
+
+    if (bucket->last_refill != 0 && now > bucket->last_refill) {
+        const uint64_t elapsed = now - bucket->last_refill;
+
+        /* Checked first so that elapsed * rate can't overflow. */
+        if (elapsed >= full / limit->rate || bucket->tokens + elapsed * limit->rate >= full) {
+            bucket->tokens = full;
+        } else {
+            bucket->tokens += elapsed * limit->rate;
+        }
+    }
+
+    /* The limit may have been lowered since the bucket was filled. */
+    if (bucket->tokens > full) {
+        bucket->tokens = full;
+    }
+
+    if (now > bucket->last_refill) {
+        bucket->last_refill = now;
+    } else if (bucket->last_refill == 0) {
+        bucket->last_refill = 1;
+    }
+
+    if (bucket->tokens < RATE_LIMITER_TOKEN) {
+        ++limiter->dropped[packet_id];
+        return false;
+    }
+
+    bucket->tokens -= RATE_LIMITER_TOKEN;
+    return true;
+}
+
+uint64_t rate_limiter_dropped(const Rate_Limiter *limiter, uint8_t packet_id)
+{
+    return limiter->dropped[packet_id];
+}
@@ -0,0 +1,76 @@
+/*
+ * Token buckets limiting how many packets of each type a source may send us.
+ */
+
+/*
+ * Copyright © 2016-2018 The TokTok team.
+ *
+ * This file is part of Tox, the free peer to peer instant messenger.
+ *
+ * Tox is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Tox is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Tox.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef RATE_LIMITER_H
+#define RATE_LIMITER_H
+
+#include "network.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Number of sources whose buckets are kept. When more sources send limited
+ * packets, the least recently seen ones are forgotten and start over with a
+ * full bucket.
+ */
+#define RATE_LIMITER_SOURCES 4096
+
+/* A source is an IPv4 address, or the /64 network of an IPv6 address, so that
+ * a single host can't get around its limits by hopping between the addresses
+ * of its network.
+ */
+typedef struct Rate_Limiter Rate_Limiter;
+
+/* return NULL on failure. */
+Rate_Limiter *rate_limiter_new(void);
+
+void rate_limiter_kill(Rate_Limiter *limiter);
+
+/* Let each source send at most rate packets of the given type per second on
+ * average, and up to burst at once after it has been quiet. A rate of 0 lifts
+ * the limit.
+ *
+ * return -1 if rate is not 0 and burst is 0.
+ * return 0 on success.
+ */
+int rate_limiter_set(Rate_Limiter *limiter, uint8_t packet_id, uint32_t rate, uint32_t burst);
+
+/* Write the limit set for the packet type into rate and burst. */
+void rate_limiter_get(const Rate_Limiter *limiter, uint8_t packet_id, uint32_t *rate, uint32_t *burst);
+
+/* Take a token from the bucket of the source for the packet type, at time now
+ * in milliseconds (see current_time_monotonic()).
+ *
+ * return true if the packet may be handled.
+ * return false if it should be dropped; it is then counted as dropped.
+ */
+bool rate_limiter_allow(Rate_Limiter *limiter, const IP *source, uint8_t packet_id, uint64_t now);
+
+/* return the number of packets of the type rate_limiter_allow() refused. */
+uint64_t rate_limiter_dropped(const Rate_Limiter *limiter, uint8_t packet_id);
+
+#ifdef __cplusplus
+}  // extern "C"
+#endif
+
+#endif
@@ -0,0 +1,118 @@
+#include "rate_limiter.h"
+
+#include <gtest/gtest.h>
+
+namespace {
+
+IP ipv4(uint8_t last)
+{
+    IP ip;
+    ip_init(&ip, false);
+    ip.ip.v4.uint32 = net_htonl(0x0a000000 | last);
+    return ip;
+}
+
+IP ipv6(uint8_t network, uint8_t host)
+{
+    IP ip;
+    ip_init(&ip, true);
+    ip.ip.v6.uint8[0] = 0x20;
+    ip.ip.v6.uint8[1] = 0x01;
+    ip.ip.v6.uint8[7] = network;
+    ip.ip.v6.uint8[15] = host;
+    return ip;
+}
+
+uint32_t allowed(Rate_Limiter *limiter, const IP &source, uint8_t packet_id, uint64_t now, uint32_t tries)
+{
+    uint32_t count = 0;
+
+    for (uint32_t i = 0; i < tries; ++i) {
+        count += rate_limiter_allow(limiter, &source, packet_id, now);
+    }
+
+    return count;
+}
+
+class RateLimiter : public ::testing::Test
+{
+protected:
+    void SetUp() override
+    {
+        limiter_ = rate_limiter_new();
+        ASSERT_NE(limiter_, nullptr);
+    }
+
+    void TearDown() override
+    {
+        rate_limiter_kill(limiter_);
+    }
+
+    Rate_Limiter *limiter_;
+};
+
+TEST_F(RateLimiter, AllowsEverythingWithoutALimit)
+{
+    EXPECT_EQ(allowed(limiter_, ipv4(1), 2, 1000, 1000), 1000u);
+    EXPECT_EQ(rate_limiter_dropped(limiter_, 2), 0u);
+}
+
+TEST_F(RateLimiter, RefusesAZeroBurst)
+{
+    EXPECT_EQ(rate_limiter_set(limiter_, 2, 10, 0), -1);
+    EXPECT_EQ(rate_limiter_set(limiter_, 2, 0, 0), 0);
+}
+
+TEST_F(RateLimiter, AllowsABurstThenTheRate)
+{
+    ASSERT_EQ(rate_limiter_set(limiter_, 2, 10, 5), 0);
+
+    EXPECT_EQ(allowed(limiter_, ipv4(1), 2, 1000, 8), 5u);
+    EXPECT_EQ(rate_limiter_dropped(limiter_, 2), 3u);
+
+    // One packet every 100ms.
+    EXPECT_EQ(allowed(limiter_, ipv4(1), 2, 1050, 8), 0u);
+    EXPECT_EQ(allowed(limiter_, ipv4(1), 2, 1100, 8), 1u);
+    EXPECT_EQ(allowed(limiter_, ipv4(1), 2, 1400, 8), 3u);
+
+    // The bucket never holds more than the burst.
+    EXPECT_EQ(allowed(limiter_, ipv4(1), 2, 100000, 8), 5u);
+}
+
+TEST_F(RateLimiter, LimitsEachSourceAndTypeSeparately)
+{
+    ASSERT_EQ(rate_limiter_set(limiter_, 2, 1, 2), 0);
+    ASSERT_EQ(rate_limiter_set(limiter_, 3, 1, 2), 0);
+
+    EXPECT_EQ(allowed(limiter_, ipv4(1), 2, 1000, 4), 2u);
+    EXPECT_EQ(allowed(limiter_, ipv4(2), 2, 1000, 4), 2u);
+    EXPECT_EQ(allowed(limiter_, ipv4(1), 3, 1000, 4), 2u);
+    EXPECT_EQ(allowed(limiter_, ipv4(1), 4, 1000, 4), 4u);
+}
+
+TEST_F(RateLimiter, SharesTheLimitOfAnIpv6Network)
+{
+    ASSERT_EQ(rate_limiter_set(limiter_, 2, 1, 4), 0);
+
+    EXPECT_EQ(allowed(limiter_, ipv6(1, 1), 2, 1000, 2), 2u);
+    EXPECT_EQ(allowed(limiter_, ipv6(1, 2), 2, 1000, 4), 2u);
+    EXPECT_EQ(allowed(limiter_, ipv6(2, 1), 2, 1000, 4), 4u);
+}
+
+TEST_F(RateLimiter, ForgetsTheLeastRecentSources)
+{
+    ASSERT_EQ(rate_limiter_set(limiter_, 2, 1, 1), 0);
+
+    EXPECT_EQ(allowed(limiter_, ipv6(1, 1), 2, 1000, 2), 1u);
+
+    // Many more sources than buckets push the first one out, so it starts over.
+    for (uint32_t i = 0; i < RATE_LIMITER_SOURCES * 16; ++i) {
+        IP source = ipv6(2, 0);
+        source.ip.v6.uint32[1] = i;
+        rate_limiter_allow(limiter_, &source, 2, 1001);
+    }
+
+    EXPECT_EQ(allowed(limiter_, ipv6(1, 1), 2, 1002, 2), 1u);
+}
+
+}  // namespace
@@ -0,0 +1,344 @@
+/*
+ * Threads resolving host names, so that slow DNS doesn't hold up the main loop.
+ */
+
+/*
+ * Copyright © 2016-2018 The TokTok team.
+ *
+ * This file is part of Tox, the free peer to peer instant messenger.
+ *
+ * Tox is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Tox is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Tox.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "resolver.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ccompat.h"
+
+typedef enum Resolver_Job_State {
+    RESOLVER_JOB_FREE,
+    RESOLVER_JOB_QUEUED,
+    RESOLVER_JOB_WORKING,
+    RESOLVER_JOB_DONE,
+} Resolver_Job_State;
+
+typedef struct Resolver_Job {
+    char name[RESOLVER_MAX_NAME_LENGTH + 1];
+    int tox_type;
+    /* Order in which the jobs were queued, so that they are started in it. */
+    uint64_t queued;
+
+    IP_Port ip_ports[RESOLVER_MAX_ADDRESSES];
+    uint32_t count;
+
+    uint8_t context[RESOLVER_MAX_CONTEXT];
+    uint16_t context_length;
+
+    /* NULL once the job was cancelled. */
+    resolver_done_cb *done;
+    void *object;
+
+    Resolver_Job_State state;
+} Resolver_Job;
+
+/* Lookups can finish in any order, so unlike the crypto pool's jobs these
+ * don't form a ring. The finished ones are listed in finished instead, a ring
+ * of job indices:
+ *
+ *   finished_head <= finished_tail, finished_tail - finished_head <= RESOLVER_QUEUE_SIZE
+ */
+struct Resolver {
+    pthread_mutex_t mutex;
+    /* Signalled when jobs are queued and when the resolver stops. */
+    pthread_cond_t work;
+
+    pthread_t threads[RESOLVER_MAX_THREADS];
+    uint32_t num_threads;
+    /* Threads that haven't exited yet. Once stopping, the last of them or
+     * resolver_kill(), whichever comes last, frees the resolver. */
+    uint32_t num_running;
+    bool stopping;
+
+    resolver_lookup_cb *lookup;
+    void *lookup_object;
+
+    Resolver_Job jobs[RESOLVER_QUEUE_SIZE];
+    uint64_t num_queued;
+
+    uint32_t finished[RESOLVER_QUEUE_SIZE];
+    uint32_t finished_head;
+    uint32_t finished_tail;
+};
+
+static int32_t lookup_getipport(void *object, const char *name, int tox_type, IP_Port *ip_ports,
+                                uint32_t max_ip_ports)
+{
+    IP_Port *found;
+    const int32_t count = net_getipport(name, &found, tox_type);
+
+    if (count == -1) {
+        net_freeipport(found);
+        return -1;
+    }
+
+    const uint32_t copied = (uint32_t)count < max_ip_ports ? (uint32_t)count : max_ip_ports;
+
+    if (copied > 0) {
+        memcpy(ip_ports, found, copied * sizeof(IP_Port));
+    }
+
+    net_freeipport(found);
+    return (int32_t)copied;
+}
+
+/* return the index of the job queued first, or -1 if there is none. */
+static int32_t first_queued(const Resolver *resolver)
+{
+    int32_t first = -1;
+
+    for (uint32_t i = 0; i < RESOLVER_QUEUE_SIZE; ++i) {
+        const Resolver_Job *const job = &resolver->jobs[i];
+
+        if (job->state == RESOLVER_JOB_QUEUED && (first == -1 || job->queued < resolver->jobs[first].queued)) {
+            first = (int32_t)i;
+        }
+    }
+
+    return first;
+}
+
+static void resolver_free(Resolver *resolver)
+{
+    pthread_cond_destroy(&resolver->work);
+    pthread_mutex_destroy(&resolver->mutex);
+    free(resolver);
+}
+
+static void *resolver_thread(void *arg)
+{
+    Resolver *const resolver = (Resolver *)arg;
+
+    pthread_mutex_lock(&resolver->mutex);
+
+    while (true) {
+        int32_t index;
+
+        while (!resolver->stopping && (index = first_queued(resolver)) == -1) {
+            pthread_cond_wait(&resolver->work, &resolver->mutex);
+        }
+
+        if (resolver->stopping) {
+            break;
+        }
+
+        Resolver_Job *const job = &resolver->jobs[index];
+        job->state = RESOLVER_JOB_WORKING;
+
+        /* The main thread leaves the name and addresses of a job that is being
+         * worked on alone, so we can look it up without the lock. */
+        pthread_mutex_unlock(&resolver->mutex);
+        const int32_t count = resolver->lookup(resolver->lookup_object, job->name, job->tox_type, job->ip_ports,
+                                               RESOLVER_MAX_ADDRESSES);
+        pthread_mutex_lock(&resolver->mutex);
+
+        job->count = count > 0 ? (uint32_t)count : 0;
+        job->state = RESOLVER_JOB_DONE;
+        resolver->finished[resolver->finished_tail % RESOLVER_QUEUE_SIZE] = (uint32_t)index;
+        ++resolver->finished_tail;
+    }
+
+    --resolver->num_running;
+    const bool last = resolver->num_running == 0;
+    pthread_mutex_unlock(&resolver->mutex);
+
+    if (last) {
+        resolver_free(resolver);
+    }
+
+    return nullptr;
+}
+
+Resolver *resolver_new(uint32_t num_threads, resolver_lookup_cb *lookup, void *lookup_object)
+{
+    if (num_threads == 0 || num_threads > RESOLVER_MAX_THREADS) {
+        return nullptr;
+    }
+
+    Resolver *resolver = (Resolver *)calloc(1, sizeof(Resolver));
+
+    if (resolver == nullptr) {
+        return nullptr;
+    }
+
+    resolver->lookup = lookup != nullptr ? lookup : lookup_getipport;
+    resolver->lookup_object = lookup_object;
+
+    if (pthread_mutex_init(&resolver->mutex, nullptr) != 0) {
+        free(resolver);
+        return nullptr;
+    }
+
+    if (pthread_cond_init(&resolver->work, nullptr) != 0) {
+        pthread_mutex_destroy(&resolver->mutex);
+        free(resolver);
+        return nullptr;
+    }
+
+    for (uint32_t i = 0; i < num_threads; ++i) {
+        pthread_mutex_lock(&resolver->mutex);
+        ++resolver->num_running;
+        pthread_mutex_unlock(&resolver->mutex);
+
+        if (pthread_create(&resolver->threads[i], nullptr, &resolver_thread, resolver) != 0) {
+            pthread_mutex_lock(&resolver->mutex);
+            --resolver->num_running;
+            pthread_mutex_unlock(&resolver->mutex);
+            resolver_kill(resolver);
+            return nullptr;
+        }
+
+        ++resolver->num_threads;
+    }
+
+    return resolver;
+}
+
+void resolver_kill(Resolver *resolver)
+{
+    if (resolver == nullptr) {
+        return;
+    }
+
+    /* Lookups can take as long as the system's DNS timeout, so rather than
+     * waiting for them the threads are left to exit once theirs are done. */
+    pthread_mutex_lock(&resolver->mutex);
+    resolver->stopping = true;
+    pthread_cond_broadcast(&resolver->work);
+
+    for (uint32_t i = 0; i < resolver->num_threads; ++i) {
+        pthread_detach(resolver->threads[i]);
+    }
+
+    const bool last = resolver->num_running == 0;
+    pthread_mutex_unlock(&resolver->mutex);
+
+    if (last) {
+        resolver_free(resolver);
+    }
+}
+
+int resolver_resolve(Resolver *resolver, const char *name, int tox_type, const uint8_t *context,
+                     uint16_t context_length, resolver_done_cb *done, void *object)
+{
+    const size_t name_length = strlen(name);
+
+    if (name_length > RESOLVER_MAX_NAME_LENGTH || context_length > RESOLVER_MAX_CONTEXT) {
+        return -1;
+    }
+
+    pthread_mutex_lock(&resolver->mutex);
+
+    Resolver_Job *job = nullptr;
+
+    for (uint32_t i = 0; i < RESOLVER_QUEUE_SIZE; ++i) {
+        if (resolver->jobs[i].state == RESOLVER_JOB_FREE) {
+            job = &resolver->jobs[i];
+            break;
+        }
+    }
+
+    if (job == nullptr) {
+        pthread_mutex_unlock(&resolver->mutex);
+        return -1;
+    }
+
+    memcpy(job->name, name, name_length + 1);
+    job->tox_type = tox_type;
+    job->queued = resolver->num_queued;
+    ++resolver->num_queued;
+    job->count = 0;
+
+    if (context_length > 0) {
+        memcpy(job->context, context, context_length);
+    }
+
+    job->context_length = context_length;
+    job->done = done;
+    job->object = object;
+    job->state = RESOLVER_JOB_QUEUED;
+
+    pthread_cond_signal(&resolver->work);
+    pthread_mutex_unlock(&resolver->mutex);
+    return 0;
+}
+
+void resolver_cancel(Resolver *resolver, const void *object)
+{
+    pthread_mutex_lock(&resolver->mutex);
+
+    for (uint32_t i = 0; i < RESOLVER_QUEUE_SIZE; ++i) {
+        Resolver_Job *const job = &resolver->jobs[i];
+
+        if (job->state == RESOLVER_JOB_FREE || job->object != object) {
+            continue;
+        }
+
+        if (job->state == RESOLVER_JOB_QUEUED) {
+            job->state = RESOLVER_JOB_FREE;
+        } else {
+            /* Freed by resolver_do() once its lookup is done. */
+            job->done = nullptr;
+        }
+    }
+
+    pthread_mutex_unlock(&resolver->mutex);
+}
+
+uint32_t resolver_do(Resolver *resolver, void *userdata)
+{
+    uint32_t count = 0;
+
+    pthread_mutex_lock(&resolver->mutex);
+
+    while (resolver->finished_head != resolver->finished_tail) {
+        Resolver_Job *const job = &resolver->jobs[resolver->finished[resolver->finished_head % RESOLVER_QUEUE_SIZE]];
+        ++resolver->finished_head;
+
+        resolver_done_cb *const done = job->done;
+
+        if (done == nullptr) {
+            job->state = RESOLVER_JOB_FREE;
+            continue;
+        }
+
+        /* Release the job before calling back: the callback can queue more. */
+        const Resolver_Job finished = *job;
+        job->state = RESOLVER_JOB_FREE;
+        pthread_mutex_unlock(&resolver->mutex);
+
+        done(finished.object, finished.ip_ports, finished.count, finished.context, finished.context_length, userdata);
+        ++count;
+
+        pthread_mutex_lock(&resolver->mutex);
+    }
+
+    pthread_mutex_unlock(&resolver->mutex);
+    return count;
+}
@@ -0,0 +1,102 @@
+/*
+ * Threads resolving host names, so that slow DNS doesn't hold up the main loop.
+ */
+
+/*
+ * Copyright © 2016-2018 The TokTok team.
+ *
+ * This file is part of Tox, the free peer to peer instant messenger.
+ *
+ * Tox is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Tox is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Tox.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef RESOLVER_H
+#define RESOLVER_H
+
+#include "network.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Most threads a resolver can have. */
+#define RESOLVER_MAX_THREADS 16
+
+/* Number of names that can wait for their addresses at once. */
+#define RESOLVER_QUEUE_SIZE 64
+
+/* Longest name that can be resolved, as for DNS. */
+#define RESOLVER_MAX_NAME_LENGTH 253
+
+/* Most addresses handed back for one name. */
+#define RESOLVER_MAX_ADDRESSES 8
+
+/* Most bytes of context a request can carry to its callback. */
+#define RESOLVER_MAX_CONTEXT 64
+
+typedef struct Resolver Resolver;
+
+/* Look up the addresses of name, as net_getipport() does, writing at most
+ * max_ip_ports of them into ip_ports. Called from the resolver's threads.
+ *
+ * return the number of addresses written, -1 on failure.
+ */
+typedef int32_t resolver_lookup_cb(void *object, const char *name, int tox_type, IP_Port *ip_ports,
+                                   uint32_t max_ip_ports);
+
+/* Called from resolver_do() with the addresses found for a name, none if it
+ * could not be resolved, and the context given to resolver_resolve().
+ */
+typedef void resolver_done_cb(void *object, const IP_Port *ip_ports, uint32_t count, const uint8_t *context,
+                              uint16_t context_length, void *userdata);
+
+/* Start num_threads threads (at most RESOLVER_MAX_THREADS), so that as many
+ * names are resolved at once. lookup is called with lookup_object to resolve
+ * names; NULL resolves them with net_getipport(). lookup_object must outlive
+ * the lookups, which can still be running after resolver_kill().
+ *
+ * return NULL on failure.
+ */
+Resolver *resolver_new(uint32_t num_threads, resolver_lookup_cb *lookup, void *lookup_object);
+
+/* Stop the threads and drop all requests. This doesn't wait for the lookups
+ * that are running: their threads exit, and the last one frees the resolver,
+ * once they are done.
+ */
+void resolver_kill(Resolver *resolver);
+
+/* Queue the resolution of name, for sockets of tox_type (TOX_SOCK_DGRAM or
+ * TOX_SOCK_STREAM). context is copied and passed to done along with the
+ * addresses.
+ *
+ * return -1 if the queue is full, or the name or context too long.
+ * return 0 on success.
+ */
+int resolver_resolve(Resolver *resolver, const char *name, int tox_type, const uint8_t *context,
+                     uint16_t context_length, resolver_done_cb *done, void *object);
+
+/* Forget the requests for object, so that done is never called for it. */
+void resolver_cancel(Resolver *resolver, const void *object);
+
+/* Call the done callbacks of the names that were resolved, in the order they
+ * finished.
+ *
+ * return the number of callbacks called.
+ */
+uint32_t resolver_do(Resolver *resolver, void *userdata);
+
+#ifdef __cplusplus
+}  // extern "C"
+#endif
+
+#endif
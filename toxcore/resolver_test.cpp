@@ -0,0 +1,255 @@
+#include "resolver.h"
+
+#include <gtest/gtest.h>
+
+#include <unistd.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace {
+
+// A stand-in for DNS: "fail.test" doesn't resolve, names starting with "slow"
+// wait until they are let go, and any other name resolves to 10.0.0.<length>.
+struct Stub_Resolver {
+    std::mutex mutex;
+    std::condition_variable changed;
+    bool let_go = false;
+    uint32_t waiting = 0;
+    uint32_t lookups = 0;
+
+    // Wait until count lookups wait at the same time, or it takes too long.
+    bool wait_for_waiting(uint32_t count)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        return changed.wait_for(lock, std::chrono::seconds(5), [&] {
+            return waiting >= count;
+        });
+    }
+
+    void release()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        let_go = true;
+        changed.notify_all();
+    }
+};
+
+int32_t stub_lookup(void *object, const char *name, int tox_type, IP_Port *ip_ports, uint32_t max_ip_ports)
+{
+    Stub_Resolver *stub = static_cast<Stub_Resolver *>(object);
+    const std::string node(name);
+
+    {
+        std::unique_lock<std::mutex> lock(stub->mutex);
+        ++stub->lookups;
+
+        if (node.compare(0, 4, "slow") == 0) {
+            ++stub->waiting;
+            stub->changed.notify_all();
+            stub->changed.wait_for(lock, std::chrono::seconds(5), [&] {
+                return stub->let_go;
+            });
+            --stub->waiting;
+            stub->changed.notify_all();
+        }
+    }
+
+    if (node == "fail.test") {
+        return -1;
+    }
+
+    ip_init(&ip_ports[0].ip, false);
+    ip_ports[0].ip.ip.v4.uint32 = net_htonl(0x0a000000 | uint32_t(node.size()));
+    ip_ports[0].port = 0;
+    return 1;
+}
+
+struct Resolved {
+    std::string context;
+    std::vector<uint32_t> addresses;
+};
+
+void record(void *object, const IP_Port *ip_ports, uint32_t count, const uint8_t *context, uint16_t context_length,
+            void *userdata)
+{
+    Resolved resolved;
+    resolved.context.assign(reinterpret_cast<const char *>(context), context_length);
+
+    for (uint32_t i = 0; i < count; ++i) {
+        resolved.addresses.push_back(net_ntohl(ip_ports[i].ip.ip.v4.uint32));
+    }
+
+    static_cast<std::vector<Resolved> *>(userdata)->push_back(resolved);
+}
+
+int resolve(Resolver *resolver, const std::string &name, void *object = nullptr)
+{
+    return resolver_resolve(resolver, name.c_str(), TOX_SOCK_DGRAM, reinterpret_cast<const uint8_t *>(name.data()),
+                            uint16_t(name.size()), &record, object);
+}
+
+// Hand back resolved names until there are count of them or it takes too long.
+std::vector<Resolved> wait_for(Resolver *resolver, size_t count)
+{
+    std::vector<Resolved> results;
+
+    for (int i = 0; i < 5000 && results.size() < count; ++i) {
+        if (resolver_do(resolver, &results) == 0) {
+            usleep(1000);
+        }
+    }
+
+    return results;
+}
+
+TEST(Resolver, RefusesBadThreadCounts)
+{
+    EXPECT_EQ(resolver_new(0, nullptr, nullptr), nullptr);
+    EXPECT_EQ(resolver_new(RESOLVER_MAX_THREADS + 1, nullptr, nullptr), nullptr);
+}
+
+TEST(Resolver, HandsBackAddressesWithTheirContext)
+{
+    Stub_Resolver stub;
+    Resolver *resolver = resolver_new(2, &stub_lookup, &stub);
+    ASSERT_NE(resolver, nullptr);
+
+    ASSERT_EQ(resolve(resolver, "node.test"), 0);
+    ASSERT_EQ(resolve(resolver, "fail.test"), 0);
+
+    std::vector<Resolved> results = wait_for(resolver, 2);
+    ASSERT_EQ(results.size(), 2u);
+
+    if (results[0].context != "node.test") {
+        std::swap(results[0], results[1]);
+    }
+
+    EXPECT_EQ(results[0].context, "node.test");
+    EXPECT_EQ(results[0].addresses, std::vector<uint32_t>({0x0a000009}));
+    EXPECT_EQ(results[1].context, "fail.test");
+    EXPECT_TRUE(results[1].addresses.empty());
+
+    resolver_kill(resolver);
+}
+
+TEST(Resolver, SlowNamesDontHoldUpTheOthers)
+{
+    Stub_Resolver stub;
+    Resolver *resolver = resolver_new(2, &stub_lookup, &stub);
+    ASSERT_NE(resolver, nullptr);
+
+    ASSERT_EQ(resolve(resolver, "slow.test"), 0);
+    ASSERT_TRUE(stub.wait_for_waiting(1));
+    ASSERT_EQ(resolve(resolver, "fast.test"), 0);
+
+    const std::vector<Resolved> fast = wait_for(resolver, 1);
+    ASSERT_EQ(fast.size(), 1u);
+    EXPECT_EQ(fast[0].context, "fast.test");
+
+    stub.release();
+    const std::vector<Resolved> slow = wait_for(resolver, 1);
+    ASSERT_EQ(slow.size(), 1u);
+    EXPECT_EQ(slow[0].context, "slow.test");
+
+    resolver_kill(resolver);
+}
+
+TEST(Resolver, ResolvesNamesInParallel)
+{
+    Stub_Resolver stub;
+    Resolver *resolver = resolver_new(8, &stub_lookup, &stub);
+    ASSERT_NE(resolver, nullptr);
+
+    for (int i = 0; i < 8; ++i) {
+        ASSERT_EQ(resolve(resolver, "slow" + std::to_string(i) + ".test"), 0);
+    }
+
+    EXPECT_TRUE(stub.wait_for_waiting(8));
+    stub.release();
+
+    EXPECT_EQ(wait_for(resolver, 8).size(), 8u);
+
+    resolver_kill(resolver);
+}
+
+TEST(Resolver, CancelledNamesAreNotHandedBack)
+{
+    Stub_Resolver stub;
+    Resolver *resolver = resolver_new(1, &stub_lookup, &stub);
+    ASSERT_NE(resolver, nullptr);
+
+    int kept;
+    int cancelled;
+
+    // The slow name keeps the only thread busy while the others are queued.
+    ASSERT_EQ(resolve(resolver, "slow.test", &cancelled), 0);
+    ASSERT_TRUE(stub.wait_for_waiting(1));
+    ASSERT_EQ(resolve(resolver, "queued.test", &cancelled), 0);
+    ASSERT_EQ(resolve(resolver, "kept.test", &kept), 0);
+
+    resolver_cancel(resolver, &cancelled);
+    stub.release();
+
+    const std::vector<Resolved> results = wait_for(resolver, 1);
+    ASSERT_EQ(results.size(), 1u);
+    EXPECT_EQ(results[0].context, "kept.test");
+
+    // The queued name was never looked up.
+    {
+        std::lock_guard<std::mutex> lock(stub.mutex);
+        EXPECT_EQ(stub.lookups, 2u);
+    }
+
+    resolver_kill(resolver);
+}
+
+TEST(Resolver, KillDoesntWaitForLookups)
+{
+    // The lookup outlives the resolver, so its object has to as well.
+    static Stub_Resolver stub;
+    Resolver *resolver = resolver_new(1, &stub_lookup, &stub);
+    ASSERT_NE(resolver, nullptr);
+
+    ASSERT_EQ(resolve(resolver, "slow.test"), 0);
+    ASSERT_TRUE(stub.wait_for_waiting(1));
+
+    const auto start = std::chrono::steady_clock::now();
+    resolver_kill(resolver);
+    EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::seconds(1));
+
+    // Let the lookup finish, so that its thread frees the resolver.
+    stub.release();
+    std::unique_lock<std::mutex> lock(stub.mutex);
+    EXPECT_TRUE(stub.changed.wait_for(lock, std::chrono::seconds(5), [&] {
+        return stub.waiting == 0;
+    }));
+}
+
+TEST(Resolver, RefusesWorkItCantTake)
+{
+    Stub_Resolver stub;
+    Resolver *resolver = resolver_new(1, &stub_lookup, &stub);
+    ASSERT_NE(resolver, nullptr);
+
+    EXPECT_EQ(resolve(resolver, std::string(RESOLVER_MAX_NAME_LENGTH + 1, 'a')), -1);
+    EXPECT_EQ(resolver_resolve(resolver, "node.test", TOX_SOCK_DGRAM, nullptr, RESOLVER_MAX_CONTEXT + 1, &record,
+                               nullptr), -1);
+
+    // Nothing is handed back until resolver_do(), so the queue fills up.
+    for (uint32_t i = 0; i < RESOLVER_QUEUE_SIZE; ++i) {
+        ASSERT_EQ(resolve(resolver, "node.test"), 0);
+    }
+
+    EXPECT_EQ(resolve(resolver, "node.test"), -1);
+
+    EXPECT_EQ(wait_for(resolver, RESOLVER_QUEUE_SIZE).size(), size_t(RESOLVER_QUEUE_SIZE));
+    EXPECT_EQ(resolve(resolver, "node.test"), 0);
+
+    resolver_kill(resolver);
+}
+
+}  // namespace
@@ -0,0 +1,175 @@
+/*
+ * Cache of the shared keys computed for the peers we exchange packets with.
+ */
+
+/*
+ * Copyright © 2016-2018 The TokTok team.
+ *
+ * This file is part of Tox, the free peer to peer instant messenger.
+ *
+ * Tox is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Tox is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Tox.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "shared_key_cache.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "ccompat.h"
+#include "crypto_core.h"
+
+/* The cache is set associative: a key can only go in one of the
+ * SHARED_KEY_CACHE_WAYS entries of the set its public key hashes to, and
+ * pushes out the least recently used one there. Peers pick their own public
+ * keys, so the hash is seeded per cache to keep them from crowding one set.
+ */
+#define SHARED_KEY_CACHE_WAYS 8
+
+typedef struct Shared_Key_Entry {
+    uint8_t public_key[CRYPTO_PUBLIC_KEY_SIZE];
+    uint8_t shared_key[CRYPTO_SHARED_KEY_SIZE];
+    /* Value of the cache's clock when last looked up, 0 for an empty entry. */
+    uint64_t last_used;
+} Shared_Key_Entry;
+
+struct Shared_Key_Cache {
+    Shared_Key_Entry *entries;
+    uint32_t num_sets;
+    uint64_t seed;
+    uint64_t clock;
+
+    Shared_Key_Cache_Stats stats;
+};
+
+Shared_Key_Cache *shared_key_cache_new(uint32_t capacity)
+{
+    Shared_Key_Cache *cache = (Shared_Key_Cache *)calloc(1, sizeof(Shared_Key_Cache));
+
+    if (cache == nullptr) {
+        return nullptr;
+    }
+
+    const uint32_t max_sets = (UINT32_MAX / 2 + 1) / SHARED_KEY_CACHE_WAYS;
+    cache->num_sets = 1;
+
+    while (cache->num_sets * SHARED_KEY_CACHE_WAYS < capacity && cache->num_sets < max_sets) {
+        cache->num_sets *= 2;
+    }
+
+    cache->entries = (Shared_Key_Entry *)calloc(cache->num_sets * SHARED_KEY_CACHE_WAYS, sizeof(Shared_Key_Entry));
+
+    if (cache->entries == nullptr) {
+        free(cache);
+        return nullptr;
+    }
+
+    cache->seed = random_u64();
+    cache->stats.capacity = cache->num_sets * SHARED_KEY_CACHE_WAYS;
+    return cache;
+}
+
+void shared_key_cache_kill(Shared_Key_Cache *cache)
+{
+    if (cache == nullptr) {
+        return;
+    }
+
+    crypto_memzero(cache->entries, cache->stats.capacity * sizeof(Shared_Key_Entry));
+    free(cache->entries);
+    free(cache);
+}
+
+static Shared_Key_Entry *key_set(const Shared_Key_Cache *cache, const uint8_t *public_key)
+{
+    uint64_t hash;
+    memcpy(&hash, public_key, sizeof(hash));
+    hash = (hash ^ cache->seed) * UINT64_C(0x9E3779B97F4A7C15);
+    hash ^= hash >> 32;
+
+    return &cache->entries[(hash & (cache->num_sets - 1)) * SHARED_KEY_CACHE_WAYS];
+}
+
+static Shared_Key_Entry *find_key(Shared_Key_Entry *set, const uint8_t *public_key)
+{
+    for (uint32_t i = 0; i < SHARED_KEY_CACHE_WAYS; ++i) {
+        if (set[i].last_used != 0 && public_key_cmp(set[i].public_key, public_key) == 0) {
+            return &set[i];
+        }
+    }
+
+    return nullptr;
+}
+
+void shared_key_cache_get(Shared_Key_Cache *cache, uint8_t *shared_key, const uint8_t *secret_key,
+                          const uint8_t *public_key)
+{
+    Shared_Key_Entry *const entry = find_key(key_set(cache, public_key), public_key);
+
+    if (entry != nullptr) {
+        memcpy(shared_key, entry->shared_key, CRYPTO_SHARED_KEY_SIZE);
+        entry->last_used = ++cache->clock;
+        ++cache->stats.hits;
+        return;
+    }
+
+    encrypt_precompute(public_key, secret_key, shared_key);
+    shared_key_cache_put(cache, public_key, shared_key);
+}
+
+bool shared_key_cache_contains(const Shared_Key_Cache *cache, const uint8_t *public_key)
+{
+    return find_key(key_set(cache, public_key), public_key) != nullptr;
+}
+
+void shared_key_cache_put(Shared_Key_Cache *cache, const uint8_t *public_key, const uint8_t *shared_key)
+{
+    Shared_Key_Entry *const set = key_set(cache, public_key);
+    Shared_Key_Entry *entry = find_key(set, public_key);
+
+    ++cache->stats.misses;
+
+    if (entry == nullptr) {
+        entry = &set[0];
+
+        for (uint32_t i = 1; i < SHARED_KEY_CACHE_WAYS; ++i) {
+            if (set[i].last_used < entry->last_used) {
+                entry = &set[i];
+            }
+        }
+
+        if (entry->last_used != 0) {
+            ++cache->stats.evictions;
+        } else {
+            ++cache->stats.size;
+        }
+    }
+
+    memcpy(entry->public_key, public_key, CRYPTO_PUBLIC_KEY_SIZE);
+    memcpy(entry->shared_key, shared_key, CRYPTO_SHARED_KEY_SIZE);
+    entry->last_used = ++cache->clock;
+}
+
+void shared_key_cache_clear(Shared_Key_Cache *cache)
+{
+    crypto_memzero(cache->entries, cache->stats.capacity * sizeof(Shared_Key_Entry));
+    cache->stats.size = 0;
+}
+
+void shared_key_cache_get_stats(const Shared_Key_Cache *cache, Shared_Key_Cache_Stats *stats)
+{
+    *stats = cache->stats;
+}
@@ -0,0 +1,86 @@
+/*
+ * Cache of the shared keys computed for the peers we exchange packets with.
+ */
+
+/*
+ * Copyright © 2016-2018 The TokTok team.
+ *
+ * This file is part of Tox, the free peer to peer instant messenger.
+ *
+ * Tox is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Tox is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Tox.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef SHARED_KEY_CACHE_H
+#define SHARED_KEY_CACHE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Number of keys cached if not told otherwise. */
+#define SHARED_KEY_CACHE_DEFAULT_CAPACITY 4096
+
+typedef struct Shared_Key_Cache Shared_Key_Cache;
+
+typedef struct Shared_Key_Cache_Stats {
+    /* Lookups answered from the cache. */
+    uint64_t hits;
+    /* Lookups that had to compute the key. */
+    uint64_t misses;
+    /* Misses that pushed another key out of the cache. */
+    uint64_t evictions;
+    /* Number of keys cached now, and at most. */
+    uint32_t size;
+    uint32_t capacity;
+} Shared_Key_Cache_Stats;
+
+/* Create a cache for about capacity keys. The capacity is rounded up to a
+ * power of 2.
+ *
+ * return NULL on memory allocation failure.
+ */
+Shared_Key_Cache *shared_key_cache_new(uint32_t capacity);
+
+void shared_key_cache_kill(Shared_Key_Cache *cache);
+
+/* Copy the key shared between secret_key and public_key into shared_key,
+ * computing it if it isn't cached yet.
+ *
+ * All lookups on a cache must use the same secret_key; call
+ * shared_key_cache_clear() when it changes.
+ */
+void shared_key_cache_get(Shared_Key_Cache *cache, uint8_t *shared_key, const uint8_t *secret_key,
+                          const uint8_t *public_key);
+
+/* return true if the key shared with public_key is cached. This doesn't count
+ *   as a lookup.
+ */
+bool shared_key_cache_contains(const Shared_Key_Cache *cache, const uint8_t *public_key);
+
+/* Cache a key computed elsewhere, e.g. on another thread. It counts as a miss.
+ */
+void shared_key_cache_put(Shared_Key_Cache *cache, const uint8_t *public_key, const uint8_t *shared_key);
+
+/* Forget all cached keys. The counters are kept. */
+void shared_key_cache_clear(Shared_Key_Cache *cache);
+
+void shared_key_cache_get_stats(const Shared_Key_Cache *cache, Shared_Key_Cache_Stats *stats);
+
+#ifdef __cplusplus
+}  // extern "C"
+#endif
+
+#endif
@@ -0,0 +1,124 @@
+#include "shared_key_cache.h"
+
+#include "crypto_core.h"
+
+#include <gtest/gtest.h>
+
+#include <array>
+#include <vector>
+
+namespace {
+
+using Public_Key = std::array<uint8_t, CRYPTO_PUBLIC_KEY_SIZE>;
+using Shared_Key = std::array<uint8_t, CRYPTO_SHARED_KEY_SIZE>;
+
+struct Key_Pair {
+    Public_Key pk;
+    std::array<uint8_t, CRYPTO_SECRET_KEY_SIZE> sk;
+
+    Key_Pair()
+    {
+        crypto_new_keypair(pk.data(), sk.data());
+    }
+};
+
+Shared_Key computed_key(const Key_Pair &self, const Public_Key &public_key)
+{
+    Shared_Key shared_key;
+    encrypt_precompute(public_key.data(), self.sk.data(), shared_key.data());
+    return shared_key;
+}
+
+Shared_Key cached_key(Shared_Key_Cache *cache, const Key_Pair &self, const Public_Key &public_key)
+{
+    Shared_Key shared_key;
+    shared_key_cache_get(cache, shared_key.data(), self.sk.data(), public_key.data());
+    return shared_key;
+}
+
+Shared_Key_Cache_Stats stats_of(const Shared_Key_Cache *cache)
+{
+    Shared_Key_Cache_Stats stats;
+    shared_key_cache_get_stats(cache, &stats);
+    return stats;
+}
+
+TEST(SharedKeyCache, ReturnsTheComputedKey)
+{
+    Key_Pair self;
+    Key_Pair peer;
+    Shared_Key_Cache *cache = shared_key_cache_new(16);
+
+    EXPECT_EQ(cached_key(cache, self, peer.pk), computed_key(self, peer.pk));
+    EXPECT_EQ(cached_key(cache, self, peer.pk), computed_key(self, peer.pk));
+
+    const Shared_Key_Cache_Stats stats = stats_of(cache);
+    EXPECT_EQ(stats.misses, 1u);
+    EXPECT_EQ(stats.hits, 1u);
+    EXPECT_EQ(stats.evictions, 0u);
+    EXPECT_EQ(stats.size, 1u);
+
+    shared_key_cache_kill(cache);
+}
+
+TEST(SharedKeyCache, CapacityIsRoundedUpToAPowerOfTwo)
+{
+    Shared_Key_Cache *cache = shared_key_cache_new(1000);
+    EXPECT_EQ(stats_of(cache).capacity, 1024u);
+    shared_key_cache_kill(cache);
+
+    cache = shared_key_cache_new(0);
+    EXPECT_GT(stats_of(cache).capacity, 0u);
+    shared_key_cache_kill(cache);
+}
+
+TEST(SharedKeyCache, HotKeysSurviveAStreamOfNewPeers)
+{
+    Key_Pair self;
+    Shared_Key_Cache *cache = shared_key_cache_new(256);
+    std::vector<Key_Pair> hot(32);
+    std::vector<Key_Pair> passing(2000);
+
+    for (const Key_Pair &peer : hot) {
+        cached_key(cache, self, peer.pk);
+    }
+
+    // Every few new peers, all the hot ones are looked up again.
+    for (size_t i = 0; i < passing.size(); ++i) {
+        EXPECT_EQ(cached_key(cache, self, passing[i].pk), computed_key(self, passing[i].pk));
+
+        if (i % 4 == 3) {
+            for (const Key_Pair &peer : hot) {
+                EXPECT_EQ(cached_key(cache, self, peer.pk), computed_key(self, peer.pk));
+            }
+        }
+    }
+
+    const Shared_Key_Cache_Stats stats = stats_of(cache);
+    EXPECT_EQ(stats.misses, hot.size() + passing.size());
+    EXPECT_EQ(stats.hits, hot.size() * (passing.size() / 4));
+    EXPECT_EQ(stats.size, stats.capacity);
+    EXPECT_EQ(stats.evictions, stats.misses - stats.size);
+
+    shared_key_cache_kill(cache);
+}
+
+TEST(SharedKeyCache, ClearForgetsAllKeys)
+{
+    Key_Pair self;
+    Key_Pair other_self;
+    Key_Pair peer;
+    Shared_Key_Cache *cache = shared_key_cache_new(16);
+
+    cached_key(cache, self, peer.pk);
+    shared_key_cache_clear(cache);
+    EXPECT_EQ(stats_of(cache).size, 0u);
+
+    // After a clear, the cache can be used with a new secret key.
+    EXPECT_EQ(cached_key(cache, other_self, peer.pk), computed_key(other_self, peer.pk));
+    EXPECT_EQ(stats_of(cache).misses, 2u);
+
+    shared_key_cache_kill(cache);
+}
+
+}  // namespace
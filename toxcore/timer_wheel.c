@@ -0,0 +1,361 @@
+/*
+ * Hierarchical timer wheel: lets modules register deadlines instead of
+ * scanning all their objects with is_timeout() on every iteration.
+ */
+
+/*
+ * Copyright © 2016-2018 The TokTok team.
+ *
+ * This file is part of Tox, the free peer to peer instant messenger.
+ *
+ * Tox is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Tox is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Tox.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "timer_wheel.h"
+
+#include <stdlib.h>
+
+#include "ccompat.h"
+
+/* Each level has 64 slots, each slot of level n covering 64^n ticks. A timer
+ * sits in the lowest level whose slots still distinguish its deadline from the
+ * current tick, and moves down a level every time the wheel below wraps
+ * around. With 4 levels that covers 2^24 ticks (194 days of seconds); timers
+ * further out than that wait in an overflow list.
+ *
+ * Timers live in one array and are linked by index rather than pointer, so
+ * that growing the array doesn't invalidate anything.
+ */
+#define TIMER_WHEEL_BITS 6
+#define TIMER_WHEEL_SLOTS (1 << TIMER_WHEEL_BITS)
+#define TIMER_WHEEL_MASK (TIMER_WHEEL_SLOTS - 1)
+#define TIMER_WHEEL_LEVELS 4
+
+#define TIMER_SLOT_OVERFLOW (TIMER_WHEEL_LEVELS * TIMER_WHEEL_SLOTS)
+/* Timers that are due and about to be fired by timer_wheel_run(). */
+#define TIMER_SLOT_FIRING (TIMER_SLOT_OVERFLOW + 1)
+#define TIMER_NUM_SLOTS (TIMER_SLOT_FIRING + 1)
+#define TIMER_SLOT_FREE TIMER_NUM_SLOTS
+
+#define TIMER_NONE UINT32_MAX
+
+#define TIMER_WHEEL_INITIAL_SIZE 16
+
+typedef struct Timer {
+    uint64_t deadline;
+    timer_cb *cb;
+    void *object;
+    uint32_t number;
+
+    /* Bumped every time the timer is freed, so that stale ids don't match. */
+    uint32_t generation;
+    uint32_t prev;
+    uint32_t next;
+    uint16_t slot;
+} Timer;
+
+struct Timer_Wheel {
+    Timer *timers;
+    uint32_t size;
+    uint32_t free_list;
+    uint32_t count;
+    uint32_t level_count[TIMER_WHEEL_LEVELS];
+
+    /* The next tick timer_wheel_run() has to look at. */
+    uint64_t current;
+
+    uint32_t heads[TIMER_NUM_SLOTS];
+};
+
+static Timer_Id timer_id(const Timer_Wheel *wheel, uint32_t index)
+{
+    return ((uint64_t)wheel->timers[index].generation << 32) | (index + 1);
+}
+
+/* return the index of the pending timer id, or TIMER_NONE. */
+static uint32_t timer_index(const Timer_Wheel *wheel, Timer_Id id)
+{
+    const uint32_t index = (uint32_t)(id & UINT32_MAX) - 1;
+
+    if (id == 0 || index >= wheel->size) {
+        return TIMER_NONE;
+    }
+
+    const Timer *timer = &wheel->timers[index];
+
+    if (timer->slot == TIMER_SLOT_FREE || timer->generation != (uint32_t)(id >> 32)) {
+        return TIMER_NONE;
+    }
+
+    return index;
+}
+
+static void link_timer(Timer_Wheel *wheel, uint32_t index, uint16_t slot)
+{
+    Timer *timer = &wheel->timers[index];
+    timer->slot = slot;
+    timer->prev = TIMER_NONE;
+    timer->next = wheel->heads[slot];
+
+    if (timer->next != TIMER_NONE) {
+        wheel->timers[timer->next].prev = index;
+    }
+
+    wheel->heads[slot] = index;
+
+    if (slot < TIMER_SLOT_OVERFLOW) {
+        ++wheel->level_count[slot / TIMER_WHEEL_SLOTS];
+    }
+}
+
+static void unlink_timer(Timer_Wheel *wheel, uint32_t index)
+{
+    Timer *timer = &wheel->timers[index];
+
+    if (timer->prev != TIMER_NONE) {
+        wheel->timers[timer->prev].next = timer->next;
+    } else {
+        wheel->heads[timer->slot] = timer->next;
+    }
+
+    if (timer->next != TIMER_NONE) {
+        wheel->timers[timer->next].prev = timer->prev;
+    }
+
+    if (timer->slot < TIMER_SLOT_OVERFLOW) {
+        --wheel->level_count[timer->slot / TIMER_WHEEL_SLOTS];
+    }
+}
+
+/* Put a timer in the slot its deadline falls in, as seen from the current tick. */
+static void place_timer(Timer_Wheel *wheel, uint32_t index)
+{
+    uint64_t deadline = wheel->timers[index].deadline;
+
+    if (deadline < wheel->current) {
+        deadline = wheel->current;
+    }
+
+    for (uint32_t level = 0; level < TIMER_WHEEL_LEVELS; ++level) {
+        const uint32_t shift = TIMER_WHEEL_BITS * level;
+
+        if ((deadline >> (shift + TIMER_WHEEL_BITS)) == (wheel->current >> (shift + TIMER_WHEEL_BITS))) {
+            link_timer(wheel, index, level * TIMER_WHEEL_SLOTS + ((deadline >> shift) & TIMER_WHEEL_MASK));
+            return;
+        }
+    }
+
+    link_timer(wheel, index, TIMER_SLOT_OVERFLOW);
+}
+
+static void free_timer(Timer_Wheel *wheel, uint32_t index)
+{
+    Timer *timer = &wheel->timers[index];
+    timer->slot = TIMER_SLOT_FREE;
+    ++timer->generation;
+    timer->next = wheel->free_list;
+    wheel->free_list = index;
+    --wheel->count;
+}
+
+static bool grow_timers(Timer_Wheel *wheel)
+{
+    const uint32_t new_size = wheel->size == 0 ? TIMER_WHEEL_INITIAL_SIZE : wheel->size * 2;
+
+    if (new_size <= wheel->size) {
+        return false;
+    }
+
+    Timer *temp = (Timer *)realloc(wheel->timers, new_size * sizeof(Timer));
+
+    if (temp == nullptr) {
+        return false;
+    }
+
+    wheel->timers = temp;
+
+    for (uint32_t i = new_size; i > wheel->size; --i) {
+        Timer *timer = &wheel->timers[i - 1];
+        timer->generation = 0;
+        timer->slot = TIMER_SLOT_FREE;
+        timer->next = wheel->free_list;
+        wheel->free_list = i - 1;
+    }
+
+    wheel->size = new_size;
+    return true;
+}
+
+Timer_Wheel *timer_wheel_new(uint64_t now)
+{
+    Timer_Wheel *wheel = (Timer_Wheel *)calloc(1, sizeof(Timer_Wheel));
+
+    if (wheel == nullptr) {
+        return nullptr;
+    }
+
+    wheel->free_list = TIMER_NONE;
+    wheel->current = now;
+
+    for (uint32_t i = 0; i < TIMER_NUM_SLOTS; ++i) {
+        wheel->heads[i] = TIMER_NONE;
+    }
+
+    return wheel;
+}
+
+void timer_wheel_kill(Timer_Wheel *wheel)
+{
+    if (wheel == nullptr) {
+        return;
+    }
+
+    free(wheel->timers);
+    free(wheel);
+}
+
+Timer_Id timer_wheel_add(Timer_Wheel *wheel, uint64_t deadline, timer_cb *cb, void *object, uint32_t number)
+{
+    if (wheel->free_list == TIMER_NONE && !grow_timers(wheel)) {
+        return 0;
+    }
+
+    const uint32_t index = wheel->free_list;
+    Timer *timer = &wheel->timers[index];
+    wheel->free_list = timer->next;
+    ++wheel->count;
+
+    timer->deadline = deadline;
+    timer->cb = cb;
+    timer->object = object;
+    timer->number = number;
+    place_timer(wheel, index);
+
+    return timer_id(wheel, index);
+}
+
+bool timer_wheel_cancel(Timer_Wheel *wheel, Timer_Id id)
+{
+    const uint32_t index = timer_index(wheel, id);
+
+    if (index == TIMER_NONE) {
+        return false;
+    }
+
+    unlink_timer(wheel, index);
+    free_timer(wheel, index);
+    return true;
+}
+
+void timer_wheel_set(Timer_Wheel *wheel, Timer_Id *id, uint64_t deadline, timer_cb *cb, void *object,
+                     uint32_t number)
+{
+    timer_wheel_cancel(wheel, *id);
+    *id = timer_wheel_add(wheel, deadline, cb, object, number);
+}
+
+bool timer_wheel_pending(const Timer_Wheel *wheel, Timer_Id id)
+{
+    return timer_index(wheel, id) != TIMER_NONE;
+}
+
+uint32_t timer_wheel_count(const Timer_Wheel *wheel)
+{
+    return wheel->count;
+}
+
+/* Move all timers of a slot to wherever they belong now. */
+static void replace_slot(Timer_Wheel *wheel, uint32_t slot)
+{
+    uint32_t index = wheel->heads[slot];
+
+    while (index != TIMER_NONE) {
+        const uint32_t next = wheel->timers[index].next;
+        unlink_timer(wheel, index);
+        place_timer(wheel, index);
+        index = next;
+    }
+}
+
+/* Bring down the timers of the upper level slots that start at tick t. */
+static void cascade(Timer_Wheel *wheel, uint64_t t)
+{
+    if ((t & ((UINT64_C(1) << (TIMER_WHEEL_BITS * TIMER_WHEEL_LEVELS)) - 1)) == 0) {
+        replace_slot(wheel, TIMER_SLOT_OVERFLOW);
+    }
+
+    for (uint32_t level = TIMER_WHEEL_LEVELS - 1; level > 0; --level) {
+        const uint32_t shift = TIMER_WHEEL_BITS * level;
+
+        if ((t & ((UINT64_C(1) << shift) - 1)) == 0) {
+            replace_slot(wheel, level * TIMER_WHEEL_SLOTS + ((t >> shift) & TIMER_WHEEL_MASK));
+        }
+    }
+}
+
+uint32_t timer_wheel_run(Timer_Wheel *wheel, uint64_t now)
+{
+    uint32_t fired = 0;
+
+    while (wheel->current <= now) {
+        const uint64_t t = wheel->current;
+        cascade(wheel, t);
+
+        if (wheel->count == 0) {
+            wheel->current = now + 1;
+            break;
+        }
+
+        if (wheel->level_count[0] == 0) {
+            /* Nothing can be due before the next cascade. */
+            const uint64_t next = (t | TIMER_WHEEL_MASK) + 1;
+            wheel->current = next <= now ? next : now + 1;
+            continue;
+        }
+
+        /* Take the due timers out of the wheel before firing any, so that
+         * callbacks adding timers for "now" get them in the next tick rather
+         * than in the list we are walking.
+         */
+        const uint32_t slot = t & TIMER_WHEEL_MASK;
+        uint32_t index = wheel->heads[slot];
+
+        while (index != TIMER_NONE) {
+            const uint32_t next = wheel->timers[index].next;
+            unlink_timer(wheel, index);
+            link_timer(wheel, index, TIMER_SLOT_FIRING);
+            index = next;
+        }
+
+        wheel->current = t + 1;
+
+        while (wheel->heads[TIMER_SLOT_FIRING] != TIMER_NONE) {
+            index = wheel->heads[TIMER_SLOT_FIRING];
+            const Timer *timer = &wheel->timers[index];
+            timer_cb *const cb = timer->cb;
+            void *const object = timer->object;
+            const uint32_t number = timer->number;
+
+            unlink_timer(wheel, index);
+            free_timer(wheel, index);
+            cb(object, number);
+            ++fired;
+        }
+    }
+
+    return fired;
+}
@@ -0,0 +1,92 @@
+/*
+ * Hierarchical timer wheel: lets modules register deadlines instead of
+ * scanning all their objects with is_timeout() on every iteration.
+ */
+
+/*
+ * Copyright © 2016-2018 The TokTok team.
+ *
+ * This file is part of Tox, the free peer to peer instant messenger.
+ *
+ * Tox is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Tox is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Tox.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Time is counted in ticks of the caller's choosing; the DHT wheel ticks in
+ * unix_time() seconds.
+ */
+typedef struct Timer_Wheel Timer_Wheel;
+
+/* Identifies a pending timer. 0 is never a valid timer, so it can be used for
+ * "no timer". Ids of timers that have fired or been cancelled are not reused.
+ */
+typedef uint64_t Timer_Id;
+
+/* Called once when the timer's deadline has been reached. The timer is gone
+ * by then; the callback may add new timers, including to reschedule itself.
+ */
+typedef void timer_cb(void *object, uint32_t number);
+
+Timer_Wheel *timer_wheel_new(uint64_t now);
+
+void timer_wheel_kill(Timer_Wheel *wheel);
+
+/* Call cb(object, number) at the first timer_wheel_run() with now >= deadline.
+ * Deadlines at or before the last run's now fire at the next run.
+ *
+ * return the timer id.
+ * return 0 on memory allocation failure.
+ */
+Timer_Id timer_wheel_add(Timer_Wheel *wheel, uint64_t deadline, timer_cb *cb, void *object, uint32_t number);
+
+/* Cancel a pending timer.
+ *
+ * return true if the timer was pending.
+ * return false if it has already fired or been cancelled, or id is 0.
+ */
+bool timer_wheel_cancel(Timer_Wheel *wheel, Timer_Id id);
+
+/* Cancel the timer *id if it is still pending and replace it with a new one.
+ * *id is set to 0 if adding the new timer fails.
+ */
+void timer_wheel_set(Timer_Wheel *wheel, Timer_Id *id, uint64_t deadline, timer_cb *cb, void *object,
+                     uint32_t number);
+
+/* return true if the timer id is pending. */
+bool timer_wheel_pending(const Timer_Wheel *wheel, Timer_Id id);
+
+/* return the number of pending timers. */
+uint32_t timer_wheel_count(const Timer_Wheel *wheel);
+
+/* Fire all timers with a deadline up to and including now. The cost is the
+ * number of timers fired plus the number of wheel slots advanced over, not the
+ * number of timers pending. Calling it again with the same now does nothing.
+ *
+ * return the number of timers fired.
+ */
+uint32_t timer_wheel_run(Timer_Wheel *wheel, uint64_t now);
+
+#ifdef __cplusplus
+}  // extern "C"
+#endif
+
+#endif
@@ -0,0 +1,164 @@
+#include "timer_wheel.h"
+
+#include <gtest/gtest.h>
+
+#include <vector>
+
+namespace {
+
+struct Fired {
+    Timer_Wheel *wheel;
+    std::vector<uint32_t> numbers;
+    uint64_t reschedule_at;
+};
+
+void record(void *object, uint32_t number)
+{
+    static_cast<Fired *>(object)->numbers.push_back(number);
+}
+
+void reschedule(void *object, uint32_t number)
+{
+    Fired *fired = static_cast<Fired *>(object);
+    fired->numbers.push_back(number);
+    timer_wheel_add(fired->wheel, fired->reschedule_at, reschedule, object, number + 1);
+}
+
+TEST(TimerWheel, FiresAtDeadline)
+{
+    Timer_Wheel *wheel = timer_wheel_new(1000);
+    Fired fired = {wheel, {}, 0};
+
+    timer_wheel_add(wheel, 1005, record, &fired, 5);
+    timer_wheel_add(wheel, 1001, record, &fired, 1);
+
+    EXPECT_EQ(timer_wheel_run(wheel, 1000), 0u);
+    EXPECT_EQ(timer_wheel_run(wheel, 1001), 1u);
+    EXPECT_EQ(fired.numbers, std::vector<uint32_t>({1}));
+    EXPECT_EQ(timer_wheel_run(wheel, 1004), 0u);
+    EXPECT_EQ(timer_wheel_run(wheel, 1010), 1u);
+    EXPECT_EQ(fired.numbers, std::vector<uint32_t>({1, 5}));
+    EXPECT_EQ(timer_wheel_count(wheel), 0u);
+
+    timer_wheel_kill(wheel);
+}
+
+TEST(TimerWheel, RunningTwiceForTheSameTimeDoesNothing)
+{
+    Timer_Wheel *wheel = timer_wheel_new(0);
+    Fired fired = {wheel, {}, 0};
+
+    timer_wheel_add(wheel, 3, record, &fired, 3);
+    EXPECT_EQ(timer_wheel_run(wheel, 3), 1u);
+    EXPECT_EQ(timer_wheel_run(wheel, 3), 0u);
+
+    // Deadlines in the past fire at the next run.
+    timer_wheel_add(wheel, 1, record, &fired, 1);
+    EXPECT_EQ(timer_wheel_run(wheel, 3), 0u);
+    EXPECT_EQ(timer_wheel_run(wheel, 4), 1u);
+    EXPECT_EQ(fired.numbers, std::vector<uint32_t>({3, 1}));
+
+    timer_wheel_kill(wheel);
+}
+
+TEST(TimerWheel, FarDeadlinesCascadeDownToTheRightTick)
+{
+    const uint64_t start = 1234567;
+    const uint64_t delays[] = {63, 64, 65, 4095, 4096, 4097, 300000, 20000000};
+
+    for (const uint64_t delay : delays) {
+        Timer_Wheel *wheel = timer_wheel_new(start);
+        Fired fired = {wheel, {}, 0};
+
+        timer_wheel_add(wheel, start + delay, record, &fired, 0);
+        EXPECT_EQ(timer_wheel_run(wheel, start + delay - 1), 0u) << "delay " << delay;
+        EXPECT_EQ(timer_wheel_run(wheel, start + delay), 1u) << "delay " << delay;
+
+        timer_wheel_kill(wheel);
+    }
+}
+
+TEST(TimerWheel, CancelledTimersDontFire)
+{
+    Timer_Wheel *wheel = timer_wheel_new(0);
+    Fired fired = {wheel, {}, 0};
+
+    const Timer_Id id = timer_wheel_add(wheel, 10, record, &fired, 1);
+    ASSERT_NE(id, 0u);
+    EXPECT_TRUE(timer_wheel_pending(wheel, id));
+    EXPECT_TRUE(timer_wheel_cancel(wheel, id));
+    EXPECT_FALSE(timer_wheel_pending(wheel, id));
+    EXPECT_FALSE(timer_wheel_cancel(wheel, id));
+
+    // The freed timer is reused, but the old id doesn't match it.
+    const Timer_Id other = timer_wheel_add(wheel, 10, record, &fired, 2);
+    EXPECT_NE(other, id);
+    EXPECT_FALSE(timer_wheel_cancel(wheel, id));
+
+    EXPECT_EQ(timer_wheel_run(wheel, 100), 1u);
+    EXPECT_EQ(fired.numbers, std::vector<uint32_t>({2}));
+    EXPECT_FALSE(timer_wheel_pending(wheel, other));
+
+    timer_wheel_kill(wheel);
+}
+
+TEST(TimerWheel, SetReplacesThePendingTimer)
+{
+    Timer_Wheel *wheel = timer_wheel_new(0);
+    Fired fired = {wheel, {}, 0};
+    Timer_Id id = 0;
+
+    timer_wheel_set(wheel, &id, 50, record, &fired, 1);
+    timer_wheel_set(wheel, &id, 20, record, &fired, 2);
+    EXPECT_EQ(timer_wheel_count(wheel), 1u);
+    EXPECT_EQ(timer_wheel_run(wheel, 100), 1u);
+    EXPECT_EQ(fired.numbers, std::vector<uint32_t>({2}));
+
+    timer_wheel_kill(wheel);
+}
+
+TEST(TimerWheel, CallbacksCanRescheduleThemselves)
+{
+    Timer_Wheel *wheel = timer_wheel_new(0);
+    Fired fired = {wheel, {}, 0};
+
+    // A callback asking for "now" again must not loop within one run.
+    timer_wheel_add(wheel, 5, reschedule, &fired, 0);
+    fired.reschedule_at = 5;
+    EXPECT_EQ(timer_wheel_run(wheel, 5), 1u);
+    EXPECT_EQ(timer_wheel_run(wheel, 6), 1u);
+    EXPECT_EQ(fired.numbers, std::vector<uint32_t>({0, 1}));
+
+    timer_wheel_kill(wheel);
+}
+
+TEST(TimerWheel, ManyTimersAllFireInOrder)
+{
+    Timer_Wheel *wheel = timer_wheel_new(0);
+    Fired fired = {wheel, {}, 0};
+    const uint32_t num_timers = 10000;
+
+    for (uint32_t i = 0; i < num_timers; ++i) {
+        ASSERT_NE(timer_wheel_add(wheel, (i * 7919) % 100000, record, &fired, (i * 7919) % 100000), 0u);
+    }
+
+    EXPECT_EQ(timer_wheel_count(wheel), num_timers);
+
+    uint32_t total = 0;
+
+    for (uint64_t now = 0; now < 100000; now += 37) {
+        total += timer_wheel_run(wheel, now);
+    }
+
+    total += timer_wheel_run(wheel, 100000);
+    EXPECT_EQ(total, num_timers);
+    EXPECT_EQ(timer_wheel_count(wheel), 0u);
+
+    for (size_t i = 1; i < fired.numbers.size(); ++i) {
+        EXPECT_LE(fired.numbers[i - 1], fired.numbers[i]);
+    }
+
+    timer_wheel_kill(wheel);
+}
+
+}  // namespace
@@ -397,6 +397,24 @@ enum class SAVEDATA_TYPE {
 }
 
 
+/**
+ * How connections to friends decide how fast to send lossless packets, such
+ * as messages and file data.
+ */
+enum class CONGESTION_CONTROL {
+  /**
+   * Speed up while the packets waiting to be sent stay few, slow down once
+   * they pile up.
+   */
+  DEFAULT,
+  /**
+   * LEDBAT (RFC 6817): keep the delay the connection adds to the path near
+   * 100ms, so that a file transfer yields to the user's other traffic.
+   */
+  LEDBAT,
+}
+
+
 /**
  * Severity level of log messages.
  */
@@ -581,6 +599,81 @@ static class options {
        */
       any user_data;
     }
+
+    /**
+     * Queue outgoing UDP packets and send them in batches at the end of each
+     * ${tox.iterate} call, rather than with one system call per packet.
+     *
+     * Lossy packets (e.g. audio and video) flush the queue immediately, so
+     * they are not delayed. Lossless packets sent outside ${tox.iterate} wait for
+     * the next ${tox.iterate} call. (Default: disabled).
+     */
+    bool udp_send_queue_enabled;
+
+    /**
+     * Receive and send UDP packets through io_uring instead of one system call
+     * per packet. As with the send queue, packets are sent together at the end
+     * of each ${tox.iterate} call, and lossless packets sent outside it wait for the
+     * next one. Only available on Linux; elsewhere, or if the kernel doesn't
+     * support it, the normal socket calls are used. (Default: disabled).
+     */
+    bool udp_io_uring_enabled;
+
+    /**
+     * Number of threads that compute the keys shared with peers we have no key
+     * for yet, so that requests and handshakes from new peers don't hold up
+     * ${tox.iterate}. Their packets are handled in a later ${tox.iterate} call,
+     * once the key is ready. 0 computes the keys in ${tox.iterate}, at most 64
+     * threads can be used. (Default: 0).
+     */
+    uint32_t crypto_worker_threads;
+
+    /**
+     * Number of get nodes requests the search for a friend's DHT neighbourhood
+     * keeps in flight at once. Each answer is followed up right away with the
+     * closest node not asked yet, so friends are found in seconds rather than
+     * minutes. 0 turns the searches off, at most 8 requests can be in flight.
+     * (Default: 3).
+     */
+    uint8_t dht_lookup_parallelism;
+
+    /**
+     * Number of threads that resolve the host names given to ${bootstrap} and
+     * ${add_tcp_relay}, so that slow DNS doesn't hold up the caller. Both then
+     * return right away, and the node is used once its name is resolved in a
+     * later ${tox.iterate} call; names that can't be resolved are logged and
+     * dropped. Addresses that are IP literals are used right away either way.
+     * 0 resolves names in the calling thread, at most 16 threads are used.
+     * (Default: 0).
+     */
+    uint32_t dns_resolver_threads;
+
+    /**
+     * The congestion controller of the connections to friends. It applies to
+     * the connections made after the Tox instance was created, on this side
+     * only: each side controls what it sends. (Default: ${CONGESTION_CONTROL.DEFAULT}).
+     */
+    CONGESTION_CONTROL congestion_control;
+
+    /**
+     * Send the packets of each connection to a friend evenly over time rather
+     * than as many as it may send at once each time ${tox.iterate} runs, so
+     * that they don't arrive in bursts that overflow small router buffers.
+     * Lossy packets (e.g. audio and video) are held back briefly for this too.
+     * This only works as well as ${tox.iterate} is called at the intervals
+     * ${iteration_interval} asks for. (Default: disabled).
+     */
+    bool packet_pacing_enabled;
+
+    /**
+     * Keep the keys of each session with a friend for two minutes after the
+     * connection ends, so that when it comes back, the friend is connected
+     * after one round trip instead of the two a handshake takes. Each
+     * session can be resumed only once. Only works with friends that enabled
+     * it too. This weakens forward secrecy, as the keys of a session are kept
+     * in memory after it ended. (Default: disabled).
+     */
+    bool session_resumption_enabled;
   }
 
 
@@ -854,6 +947,72 @@ const uint32_t iteration_interval();
 void iterate(any user_data);
 
 
+/**
+ * I/O events a file descriptor returned by $get_fds is waiting for.
+ */
+bitmask FD_EVENT {
+  /**
+   * Call $iterate when the descriptor becomes readable.
+   */
+  READ,
+  /**
+   * Call $iterate when the descriptor becomes writable.
+   */
+  WRITE,
+}
+
+
+error for get_fds {
+  NULL,
+}
+
+
+int32_t[size] fds {
+  /**
+   * Instead of calling $iterate every $iteration_interval() milliseconds, an
+   * application with its own event loop (e.g. epoll across many Tox instances)
+   * can wait for the file descriptors returned by $get and call $iterate when
+   * one of them is ready, or when $iteration_deadline() has passed.
+   *
+   * The descriptors and the deadline change as $iterate runs and as other
+   * functions taking a non-const Tox are called, so get them again after each
+   * such call. The descriptors are owned by the Tox instance; only wait on
+   * them.
+   *
+   * Return the number of file descriptors the Tox instance currently wants to
+   * be polled on.
+   */
+  size();
+
+  /**
+   * Copy the file descriptors and the events each of them waits for into two
+   * arrays of $size elements. This doesn't allocate, so it can be called on
+   * every turn of the event loop.
+   *
+   * @param fds The file descriptors.
+   * @param events The $FD_EVENT bitmask for each descriptor. May be NULL.
+   *
+   * @return true on success.
+   */
+  get(uint8_t[size] events) with error for get_fds;
+}
+
+
+/**
+ * Return the time, as returned by $time_monotonic(), by which $iterate must be
+ * called again even if none of the file descriptors from $get_fds becomes
+ * ready. It is never more than a second away, and may be in the past.
+ */
+const uint64_t iteration_deadline();
+
+
+/**
+ * Return the milliseconds elapsed on toxcore's monotonic clock, which is the
+ * clock $iteration_deadline() uses.
+ */
+static uint64_t time_monotonic();
+
+
 /*******************************************************************************
  *
  * :: Internal client information (Tox address/id)
@@ -1460,6 +1619,78 @@ namespace friend {
 
 }
 
+%{
+/**
+ * What the connection to a friend is doing, to see why transfers with them are
+ * slow. Filled in by ${friend.transport_stats.get}.
+ */
+typedef struct Tox_Friend_Transport_Stats {
+
+    /**
+     * Smallest round trip time seen on the connection, in milliseconds.
+     */
+    uint64_t rtt;
+
+    /**
+     * Packets per second the connection may send, as its congestion
+     * controller decided.
+     */
+    double send_rate;
+
+    /**
+     * Packets per second the connection received lately.
+     */
+    double recv_rate;
+
+    /**
+     * Lossless packets sent that the friend didn't confirm yet.
+     */
+    uint32_t send_queue;
+
+    /**
+     * Lossless packets received that wait for an earlier one that is missing.
+     */
+    uint32_t recv_queue;
+
+    /**
+     * Lossless packets sent again since the connection was made.
+     */
+    uint64_t packets_resent;
+
+    /**
+     * Times sending lost packets again used up all the connection could send,
+     * since the connection was made.
+     */
+    uint64_t congestion_events;
+
+    /**
+     * Whether the connection is direct (${CONNECTION.UDP}) or goes through a
+     * TCP relay (${CONNECTION.TCP}).
+     */
+    TOX_CONNECTION connection;
+
+} Tox_Friend_Transport_Stats;
+%}
+
+namespace friend {
+
+  /**
+   * Copy what the connection to a friend is doing into stats. All values are 0
+   * and the connection is ${CONNECTION.NONE} while the friend is offline.
+   *
+   * This is cheap and does no allocation, so it can be called every second for
+   * each friend.
+   *
+   * @param friend_number The friend number for which to query the statistics.
+   * @param stats The statistics are written here.
+   *
+   * @return true on success.
+   */
+  bool get_transport_stats(uint32_t friend_number, Tox_Friend_Transport_Stats *stats)
+      with error for query;
+
+}
+
 
 /*******************************************************************************
  *
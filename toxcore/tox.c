@@ -31,6 +31,7 @@
 typedef struct Messenger Tox;
 #include "tox.h"
 
+#include <stdlib.h>
 #include <string.h>
 
 #include "Messenger.h"
@@ -88,6 +89,7 @@ Tox *tox_new(const struct Tox_Options *options, TOX_ERR_NEW *error)
 
     if (options == nullptr) {
         m_options.ipv6enabled = TOX_ENABLE_IPV6_DEFAULT;
+        m_options.dht_lookup_parallelism = DHT_DEFAULT_LOOKUP_PARALLELISM;
     } else {
         if (tox_options_get_savedata_type(options) != TOX_SAVEDATA_TYPE_NONE) {
             if (tox_options_get_savedata_data(options) == nullptr || tox_options_get_savedata_length(options) == 0) {
@@ -124,6 +126,15 @@ Tox *tox_new(const struct Tox_Options *options, TOX_ERR_NEW *error)
         m_options.tcp_server_port = tox_options_get_tcp_port(options);
         m_options.hole_punching_enabled = tox_options_get_hole_punching_enabled(options);
         m_options.local_discovery_enabled = tox_options_get_local_discovery_enabled(options);
+        m_options.udp_send_queue_enabled = tox_options_get_udp_send_queue_enabled(options);
+        m_options.udp_io_uring_enabled = tox_options_get_udp_io_uring_enabled(options);
+        m_options.crypto_worker_threads = tox_options_get_crypto_worker_threads(options);
+        m_options.dht_lookup_parallelism = tox_options_get_dht_lookup_parallelism(options);
+        m_options.dns_resolver_threads = tox_options_get_dns_resolver_threads(options);
+        m_options.congestion_control = tox_options_get_congestion_control(options) == TOX_CONGESTION_CONTROL_LEDBAT
+                                       ? CONGESTION_CONTROL_LEDBAT : CONGESTION_CONTROL_QUEUE;
+        m_options.packet_pacing_enabled = tox_options_get_packet_pacing_enabled(options);
+        m_options.session_resumption_enabled = tox_options_get_session_resumption_enabled(options);
 
         m_options.log_callback = (logger_cb *)tox_options_get_log_callback(options);
         m_options.log_user_data = tox_options_get_log_user_data(options);
@@ -235,6 +246,16 @@ bool tox_bootstrap(Tox *tox, const char *address, uint16_t port, const uint8_t *
         return 0;
     }
 
+    Messenger *m = tox;
+    IP ip;
+
+    /* Names are resolved off the main thread if there are resolver threads,
+     * falling back to resolving here if too many names are waiting. */
+    if (!addr_parse_ip(address, &ip) && m_resolve_bootstrap(m, address, net_htons(port), public_key, false) == 0) {
+        SET_ERROR_PARAMETER(error, TOX_ERR_BOOTSTRAP_OK);
+        return 1;
+    }
+
     IP_Port *root;
 
     int32_t count = net_getipport(address, &root, TOX_SOCK_DGRAM);
@@ -250,7 +271,6 @@ bool tox_bootstrap(Tox *tox, const char *address, uint16_t port, const uint8_t *
     for (i = 0; i < count; i++) {
         root[i].port = net_htons(port);
 
-        Messenger *m = tox;
         onion_add_bs_path_node(m->onion_c, root[i], public_key);
         DHT_bootstrap(m->dht, root[i], public_key);
     }
@@ -279,6 +299,16 @@ bool tox_add_tcp_relay(Tox *tox, const char *address, uint16_t port, const uint8
         return 0;
     }
 
+    Messenger *m = tox;
+    IP ip;
+
+    /* Names are resolved off the main thread if there are resolver threads,
+     * falling back to resolving here if too many names are waiting. */
+    if (!addr_parse_ip(address, &ip) && m_resolve_bootstrap(m, address, net_htons(port), public_key, true) == 0) {
+        SET_ERROR_PARAMETER(error, TOX_ERR_BOOTSTRAP_OK);
+        return 1;
+    }
+
     IP_Port *root;
 
     int32_t count = net_getipport(address, &root, TOX_SOCK_STREAM);
@@ -294,7 +324,6 @@ bool tox_add_tcp_relay(Tox *tox, const char *address, uint16_t port, const uint8
     for (i = 0; i < count; i++) {
         root[i].port = net_htons(port);
 
-        Messenger *m = tox;
         add_tcp_relay(m->net_crypto, root[i], public_key);
     }
 
@@ -344,6 +373,49 @@ void tox_iterate(Tox *tox, void *user_data)
     Messenger *m = tox;
     do_messenger(m, user_data);
     do_groupchats((Group_Chats *)m->conferences_object, user_data);
+    networking_flush_send_queue(m->net);
+}
+
+size_t tox_get_fds_size(const Tox *tox)
+{
+    const Messenger *m = tox;
+    Net_Fds net_fds = {nullptr, nullptr, 0, 0};
+    messenger_fds(m, &net_fds);
+    return net_fds.count;
+}
+
+bool tox_get_fds(const Tox *tox, int32_t *fds, uint8_t *events, TOX_ERR_GET_FDS *error)
+{
+    if (fds == nullptr) {
+        SET_ERROR_PARAMETER(error, TOX_ERR_GET_FDS_NULL);
+        return 0;
+    }
+
+    /* Never write more than tox_get_fds_size() said there would be. */
+    const Messenger *m = tox;
+    Net_Fds net_fds = {fds, events, (uint32_t)tox_get_fds_size(tox), 0};
+    messenger_fds(m, &net_fds);
+
+    if (events != nullptr) {
+        for (uint32_t i = 0; i < net_fds.count && i < net_fds.max_fds; ++i) {
+            events[i] = (events[i] & NET_FD_EVENT_READ ? TOX_FD_EVENT_READ : 0)
+                        | (events[i] & NET_FD_EVENT_WRITE ? TOX_FD_EVENT_WRITE : 0);
+        }
+    }
+
+    SET_ERROR_PARAMETER(error, TOX_ERR_GET_FDS_OK);
+    return 1;
+}
+
+uint64_t tox_iteration_deadline(const Tox *tox)
+{
+    const Messenger *m = tox;
+    return messenger_run_deadline(m);
+}
+
+uint64_t tox_time_monotonic(void)
+{
+    return current_time_monotonic();
 }
 
 void tox_self_get_address(const Tox *tox, uint8_t *address)
@@ -744,6 +816,38 @@ void tox_callback_friend_connection_status(Tox *tox, tox_friend_connection_statu
     m_callback_connectionstatus(m, (void (*)(Messenger *, uint32_t, unsigned int, void *))callback);
 }
 
+bool tox_friend_get_transport_stats(const Tox *tox, uint32_t friend_number, Tox_Friend_Transport_Stats *stats,
+                                    TOX_ERR_FRIEND_QUERY *error)
+{
+    if (!stats) {
+        SET_ERROR_PARAMETER(error, TOX_ERR_FRIEND_QUERY_NULL);
+        return 0;
+    }
+
+    const Messenger *m = tox;
+    Crypto_Conn_Stats conn_stats;
+
+    if (m_get_friend_transport_stats(m, friend_number, &conn_stats) == -1) {
+        SET_ERROR_PARAMETER(error, TOX_ERR_FRIEND_QUERY_FRIEND_NOT_FOUND);
+        return 0;
+    }
+
+    const int connection = m_get_friend_connectionstatus(m, friend_number);
+
+    stats->rtt = conn_stats.rtt;
+    stats->send_rate = conn_stats.send_rate;
+    stats->recv_rate = conn_stats.recv_rate;
+    stats->send_queue = conn_stats.send_queue;
+    stats->recv_queue = conn_stats.recv_queue;
+    stats->packets_resent = conn_stats.packets_resent;
+    stats->congestion_events = conn_stats.congestion_events;
+    stats->connection = connection == CONNECTION_UDP || connection == CONNECTION_TCP
+                        ? (TOX_CONNECTION)connection : TOX_CONNECTION_NONE;
+
+    SET_ERROR_PARAMETER(error, TOX_ERR_FRIEND_QUERY_OK);
+    return 1;
+}
+
 bool tox_friend_get_typing(const Tox *tox, uint32_t friend_number, TOX_ERR_FRIEND_QUERY *error)
 {
     const Messenger *m = tox;
@@ -441,6 +441,27 @@ typedef enum TOX_SAVEDATA_TYPE {
 } TOX_SAVEDATA_TYPE;
 
 
+/**
+ * How connections to friends decide how fast to send lossless packets, such
+ * as messages and file data.
+ */
+typedef enum TOX_CONGESTION_CONTROL {
+
+    /**
+     * Speed up while the packets waiting to be sent stay few, slow down once
+     * they pile up.
+     */
+    TOX_CONGESTION_CONTROL_DEFAULT,
+
+    /**
+     * LEDBAT (RFC 6817): keep the delay the connection adds to the path near
+     * 100ms, so that a file transfer yields to the user's other traffic.
+     */
+    TOX_CONGESTION_CONTROL_LEDBAT,
+
+} TOX_CONGESTION_CONTROL;
+
+
 /**
  * Severity level of log messages.
  */
@@ -642,6 +663,89 @@ struct Tox_Options {
      */
     void *log_user_data;
 
+
+    /**
+     * Queue outgoing UDP packets and send them in batches at the end of each
+     * tox_iterate call, rather than with one system call per packet.
+     *
+     * Lossy packets (e.g. audio and video) flush the queue immediately, so
+     * they are not delayed. Lossless packets sent outside tox_iterate wait for
+     * the next tox_iterate call. (Default: disabled).
+     */
+    bool udp_send_queue_enabled;
+
+
+    /**
+     * Receive and send UDP packets through io_uring instead of one system call
+     * per packet. As with the send queue, packets are sent together at the end
+     * of each tox_iterate call, and lossless packets sent outside it wait for the
+     * next one. Only available on Linux; elsewhere, or if the kernel doesn't
+     * support it, the normal socket calls are used. (Default: disabled).
+     */
+    bool udp_io_uring_enabled;
+
+
+    /**
+     * Number of threads that compute the keys shared with peers we have no key
+     * for yet, so that requests and handshakes from new peers don't hold up
+     * tox_iterate. Their packets are handled in a later tox_iterate call,
+     * once the key is ready. 0 computes the keys in tox_iterate, at most 64
+     * threads can be used. (Default: 0).
+     */
+    uint32_t crypto_worker_threads;
+
+
+    /**
+     * Number of get nodes requests the search for a friend's DHT neighbourhood
+     * keeps in flight at once. Each answer is followed up right away with the
+     * closest node not asked yet, so friends are found in seconds rather than
+     * minutes. 0 turns the searches off, at most 8 requests can be in flight.
+     * (Default: 3).
+     */
+    uint8_t dht_lookup_parallelism;
+
+
+    /**
+     * Number of threads that resolve the host names given to tox_bootstrap and
+     * tox_add_tcp_relay, so that slow DNS doesn't hold up the caller. Both then
+     * return right away, and the node is used once its name is resolved in a
+     * later tox_iterate call; names that can't be resolved are logged and
+     * dropped. Addresses that are IP literals are used right away either way.
+     * 0 resolves names in the calling thread, at most 16 threads are used.
+     * (Default: 0).
+     */
+    uint32_t dns_resolver_threads;
+
+
+    /**
+     * The congestion controller of the connections to friends. It applies to
+     * the connections made after the Tox instance was created, on this side
+     * only: each side controls what it sends. (Default: TOX_CONGESTION_CONTROL_DEFAULT).
+     */
+    TOX_CONGESTION_CONTROL congestion_control;
+
+
+    /**
+     * Send the packets of each connection to a friend evenly over time rather
+     * than as many as it may send at once each time tox_iterate runs, so
+     * that they don't arrive in bursts that overflow small router buffers.
+     * Lossy packets (e.g. audio and video) are held back briefly for this too.
+     * This only works as well as tox_iterate is called at the intervals
+     * tox_iteration_interval asks for. (Default: disabled).
+     */
+    bool packet_pacing_enabled;
+
+
+    /**
+     * Keep the keys of each session with a friend for two minutes after the
+     * connection ends, so that when it comes back, the friend is connected
+     * after one round trip instead of the two a handshake takes. Each
+     * session can be resumed only once. Only works with friends that enabled
+     * it too. This weakens forward secrecy, as the keys of a session are kept
+     * in memory after it ended. (Default: disabled).
+     */
+    bool session_resumption_enabled;
+
 };
 
 
@@ -705,6 +809,38 @@ void *tox_options_get_log_user_data(const struct Tox_Options *options);
 
 void tox_options_set_log_user_data(struct Tox_Options *options, void *user_data);
 
+bool tox_options_get_udp_send_queue_enabled(const struct Tox_Options *options);
+
+void tox_options_set_udp_send_queue_enabled(struct Tox_Options *options, bool udp_send_queue_enabled);
+
+bool tox_options_get_udp_io_uring_enabled(const struct Tox_Options *options);
+
+void tox_options_set_udp_io_uring_enabled(struct Tox_Options *options, bool udp_io_uring_enabled);
+
+uint32_t tox_options_get_crypto_worker_threads(const struct Tox_Options *options);
+
+void tox_options_set_crypto_worker_threads(struct Tox_Options *options, uint32_t crypto_worker_threads);
+
+uint8_t tox_options_get_dht_lookup_parallelism(const struct Tox_Options *options);
+
+void tox_options_set_dht_lookup_parallelism(struct Tox_Options *options, uint8_t dht_lookup_parallelism);
+
+uint32_t tox_options_get_dns_resolver_threads(const struct Tox_Options *options);
+
+void tox_options_set_dns_resolver_threads(struct Tox_Options *options, uint32_t dns_resolver_threads);
+
+TOX_CONGESTION_CONTROL tox_options_get_congestion_control(const struct Tox_Options *options);
+
+void tox_options_set_congestion_control(struct Tox_Options *options, TOX_CONGESTION_CONTROL congestion_control);
+
+bool tox_options_get_packet_pacing_enabled(const struct Tox_Options *options);
+
+void tox_options_set_packet_pacing_enabled(struct Tox_Options *options, bool packet_pacing_enabled);
+
+bool tox_options_get_session_resumption_enabled(const struct Tox_Options *options);
+
+void tox_options_set_session_resumption_enabled(struct Tox_Options *options, bool session_resumption_enabled);
+
 /**
  * Initialises a Tox_Options object with the default options.
  *
@@ -1005,6 +1141,84 @@ uint32_t tox_iteration_interval(const Tox *tox);
  */
 void tox_iterate(Tox *tox, void *user_data);
 
+/**
+ * I/O events a file descriptor returned by tox_get_fds is waiting for.
+ */
+enum TOX_FD_EVENT {
+
+    /**
+     * The empty bit mask. None of the bits specified below are set.
+     */
+    TOX_FD_EVENT_NONE = 0,
+
+    /**
+     * Call tox_iterate when the descriptor becomes readable.
+     */
+    TOX_FD_EVENT_READ = 1,
+
+    /**
+     * Call tox_iterate when the descriptor becomes writable.
+     */
+    TOX_FD_EVENT_WRITE = 2,
+
+};
+
+
+typedef enum TOX_ERR_GET_FDS {
+
+    /**
+     * The function returned successfully.
+     */
+    TOX_ERR_GET_FDS_OK,
+
+    /**
+     * One of the arguments to the function was NULL when it was not expected.
+     */
+    TOX_ERR_GET_FDS_NULL,
+
+} TOX_ERR_GET_FDS;
+
+
+/**
+ * Instead of calling tox_iterate every tox_iteration_interval() milliseconds, an
+ * application with its own event loop (e.g. epoll across many Tox instances)
+ * can wait for the file descriptors returned by tox_get_fds and call tox_iterate
+ * when one of them is ready, or when tox_iteration_deadline() has passed.
+ *
+ * The descriptors and the deadline change as tox_iterate runs and as other
+ * functions taking a non-const Tox are called, so get them again after each
+ * such call. The descriptors are owned by the Tox instance; only wait on them.
+ *
+ * Return the number of file descriptors the Tox instance currently wants to
+ * be polled on.
+ */
+size_t tox_get_fds_size(const Tox *tox);
+
+/**
+ * Copy the file descriptors and the events each of them waits for into two
+ * arrays of tox_get_fds_size elements. This doesn't allocate, so it can be called on
+ * every turn of the event loop.
+ *
+ * @param fds The file descriptors.
+ * @param events The TOX_FD_EVENT bitmask for each descriptor. May be NULL.
+ *
+ * @return true on success.
+ */
+bool tox_get_fds(const Tox *tox, int32_t *fds, uint8_t *events, TOX_ERR_GET_FDS *error);
+
+/**
+ * Return the time, as returned by tox_time_monotonic(), by which tox_iterate must be
+ * called again even if none of the file descriptors from tox_get_fds becomes
+ * ready. It is never more than a second away, and may be in the past.
+ */
+uint64_t tox_iteration_deadline(const Tox *tox);
+
+/**
+ * Return the milliseconds elapsed on toxcore's monotonic clock, which is the
+ * clock tox_iteration_deadline() uses.
+ */
+uint64_t tox_time_monotonic(void);
+
 
 /*******************************************************************************
  *
@@ -1630,6 +1844,74 @@ typedef void tox_friend_typing_cb(Tox *tox, uint32_t friend_number, bool is_typi
 void tox_callback_friend_typing(Tox *tox, tox_friend_typing_cb *callback);
 
 
+/**
+ * What the connection to a friend is doing, to see why transfers with them are
+ * slow. Filled in by tox_friend_get_transport_stats.
+ */
+typedef struct Tox_Friend_Transport_Stats {
+
+    /**
+     * Smallest round trip time seen on the connection, in milliseconds.
+     */
+    uint64_t rtt;
+
+    /**
+     * Packets per second the connection may send, as its congestion
+     * controller decided.
+     */
+    double send_rate;
+
+    /**
+     * Packets per second the connection received lately.
+     */
+    double recv_rate;
+
+    /**
+     * Lossless packets sent that the friend didn't confirm yet.
+     */
+    uint32_t send_queue;
+
+    /**
+     * Lossless packets received that wait for an earlier one that is missing.
+     */
+    uint32_t recv_queue;
+
+    /**
+     * Lossless packets sent again since the connection was made.
+     */
+    uint64_t packets_resent;
+
+    /**
+     * Times sending lost packets again used up all the connection could send,
+     * since the connection was made.
+     */
+    uint64_t congestion_events;
+
+    /**
+     * Whether the connection is direct (TOX_CONNECTION_UDP) or goes through a
+     * TCP relay (TOX_CONNECTION_TCP).
+     */
+    TOX_CONNECTION connection;
+
+} Tox_Friend_Transport_Stats;
+
+
+/**
+ * Copy what the connection to a friend is doing into stats. All values are 0
+ * and the connection is TOX_CONNECTION_NONE while the friend is offline.
+ *
+ * This is cheap and does no allocation, so it can be called every second for
+ * each friend.
+ *
+ * @param friend_number The friend number for which to query the statistics.
+ * @param stats The statistics are written here.
+ *
+ * @return true on success.
+ */
+bool tox_friend_get_transport_stats(const Tox *tox, uint32_t friend_number, Tox_Friend_Transport_Stats *stats,
+                                    TOX_ERR_FRIEND_QUERY *error);
+
+
 /*******************************************************************************
  *
  * :: Sending private messages
@@ -1,5 +1,6 @@
 #include "tox.h"
 
+#include "DHT.h"
 #include "ccompat.h"
 
 #include <stdlib.h>
@@ -55,6 +56,14 @@ ACCESSORS(size_t, savedata_, length)
 ACCESSORS(tox_log_cb *, log_, callback)
 ACCESSORS(void *, log_, user_data)
 ACCESSORS(bool,, local_discovery_enabled)
+ACCESSORS(bool,, udp_send_queue_enabled)
+ACCESSORS(bool,, udp_io_uring_enabled)
+ACCESSORS(uint32_t,, crypto_worker_threads)
+ACCESSORS(uint8_t,, dht_lookup_parallelism)
+ACCESSORS(uint32_t,, dns_resolver_threads)
+ACCESSORS(TOX_CONGESTION_CONTROL,, congestion_control)
+ACCESSORS(bool,, packet_pacing_enabled)
+ACCESSORS(bool,, session_resumption_enabled)
 
 const uint8_t *tox_options_get_savedata_data(const struct Tox_Options *options)
 {
@@ -77,6 +86,7 @@ void tox_options_default(struct Tox_Options *options)
         tox_options_set_proxy_type(options, TOX_PROXY_TYPE_NONE);
         tox_options_set_hole_punching_enabled(options, true);
         tox_options_set_local_discovery_enabled(options, true);
+        tox_options_set_dht_lookup_parallelism(options, DHT_DEFAULT_LOOKUP_PARALLELISM);
     }
 }
 